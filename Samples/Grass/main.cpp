@@ -49,29 +49,20 @@ int main()
 		auto swapchain = vctx->makeSwapchain(window.getSurface());
 		finalRenderer->targetSwapcahin(swapchain, false);
 
-		auto sceneRenderer = vctx->makeRenderer();
+		auto sceneSize = windowSize * UPSAMPLE_FACTOR;
 
-		VulkanImage2DRef colorTarget, emissiveTarget;
+		//The scene targets only live between the scene and blit passes, the graph owns their memory
+		auto graph = vctx->makeRenderGraph();
 
-		auto sceneSize = windowSize * UPSAMPLE_FACTOR;
+		auto colorId = graph->createImage("color", vk::Format::eR8G8B8A8Unorm, sceneSize);
+		auto emissiveId = graph->createImage("emissive", vk::Format::eR8G8B8A8Unorm, sceneSize);
 
-		colorTarget = vctx->makeImage2D(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Unorm, sceneSize);
+		VulkanImage2DRef colorTarget = graph->getImage(colorId);
 		colorTarget->setSampler(vctx->getLinearSampler());
 
-		emissiveTarget = vctx->makeImage2D(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Unorm, sceneSize);
+		VulkanImage2DRef emissiveTarget = graph->getImage(emissiveId);
 		emissiveTarget->setSampler(vctx->getLinearSampler());
 
-		sceneRenderer->targetImages({
-			colorTarget,
-			emissiveTarget
-			}, true);
-
-		sceneRenderer->setClearColors({
-			{0.0f, 0.0f, 0.0f, 0.0f},
-			//{0.1f, 0.3f, 0.05f, 1.0f},
-			{ 0.0f, 0.0f, 0.0f, 0.0f}
-		});
-
 		auto sceneUBO = vctx->makeUBO<uSceneGlobals>(1);
 		{
 			auto &usb = sceneUBO->at(0);
@@ -158,13 +149,6 @@ int main()
 
 
 
-		auto grassPipeline = vctx->makePipeline(
-			grassShader,
-			sceneRenderer,
-			{ vk::PrimitiveTopology::eTriangleStrip, 3, vk::CullModeFlagBits::eNone }
-		);
-
-
 		VertexUV vuvs[4] = {
 			{ { -1.0, -1.0 },{ 0.0, 0.0 } },
 			{ { -1.0, 1.0 }, { 0.0, 1.0 } },
@@ -190,9 +174,6 @@ int main()
 
 		auto blitUniformSet = vctx->makeSet(blitUniformLayout);
 
-		blitUniformSet->bindImage(0, colorTarget);
-		blitUniformSet->bindImage(1, emissiveTarget);
-
 		auto blitShader = vctx->makeShader(
 			"shaders/final_pass_vert.spv",
 			"shaders/final_pass_frag.spv",
@@ -204,41 +185,70 @@ int main()
 			}
 			);
 
-		auto blitPipeline = vctx->makePipeline(
-			blitShader,
-			finalRenderer
-		);
-	
-		auto sceneTask = vctx->makeTask();
-		auto finalTask = vctx->makeTask();
+		VulkanRenderPipelineRef grassPipeline, blitPipeline;
 
-		auto recordTasks = [&]() {
-			sceneTask->record([&](vk::CommandBuffer * cmd) {
+		auto & scenePass = graph->addPass("scene", [&](vk::CommandBuffer * cmd) {
 
-				cmd->setViewport(0, 1, &sceneRenderer->getFullViewport());
+			grassPipeline->bind(cmd);
 
-				cmd->setScissor(0, 1, &sceneRenderer->getFullRect());
+			grassVBO->bind(cmd);
 
-				sceneRenderer->record(cmd, [&]() {
+			grassPipeline->bindSets(cmd, {
+				uSceneSet
+			});
 
-					grassPipeline->bind(cmd);
+			cmd->draw(verticesPerBlade, 160000, 0, 0);
+		})
+			.colorAttachment(colorId)
+			.colorAttachment(emissiveId)
+			.useDepth()
+			.setClearColors({
+				{0.0f, 0.0f, 0.0f, 0.0f},
+				{0.0f, 0.0f, 0.0f, 0.0f}
+			});
 
-					grassVBO->bind(cmd);
+		graph->addPass("blit", [&](vk::CommandBuffer * cmd) {
 
-					grassPipeline->bindSets(cmd, {
-						uSceneSet
-					});
+			blitPipeline->bind(cmd);
 
-					cmd->draw(verticesPerBlade, 160000, 0, 0);
+			blitVBO->bind(cmd);
 
-				});
+			blitIBO->bind(cmd);
+
+			blitPipeline->bindSets(cmd, {
+				blitUniformSet
 			});
-		};
 
-		recordTasks();
+			cmd->drawIndexed(blitIBO->getCount(), 1, 0, 0, 0);
+		})
+			.sample(colorId)
+			.sample(emissiveId)
+			.target(finalRenderer);
 
-		vk::Semaphore sceneSemaphore = vctx->getDevice().createSemaphore(vk::SemaphoreCreateInfo());
+		graph->compile();
+		graph->printStats(std::cout);
 
+		//Pipelines need the scene pass' renderer, which compile creates
+		grassPipeline = vctx->makePipeline(
+			grassShader,
+			scenePass.getRenderer(),
+			{ vk::PrimitiveTopology::eTriangleStrip, 3, vk::CullModeFlagBits::eNone }
+		);
+
+		blitPipeline = vctx->makePipeline(
+			blitShader,
+			finalRenderer
+		);
+
+		blitUniformSet->bindImage(0, colorTarget);
+		blitUniformSet->bindImage(1, emissiveTarget);
+
+		auto frameTask = vctx->makeTask();
+
+		auto profiler = vctx->makeProfiler();
+		graph->setProfiler(profiler);
+
+		uint32_t frameCount = 0;
 
 		auto resize = [&]() {
 			if (!swapchain->resize()) {
@@ -251,17 +261,14 @@ int main()
 			windowSize.y = rect.extent.height;
 			sceneSize = windowSize * UPSAMPLE_FACTOR;
 
-			colorTarget->resize(sceneSize);
-			emissiveTarget->resize(sceneSize);
+			graph->resizeImage(colorId, sceneSize);
+			graph->resizeImage(emissiveId, sceneSize);
 
-			sceneRenderer->resize();
 			finalRenderer->resize();
+			graph->compile();
 
 			blitUniformSet->bindImage(0, colorTarget);
 			blitUniformSet->bindImage(1, emissiveTarget);
-
-
-			recordTasks();
 		};
 
 		//Main Loop
@@ -275,35 +282,19 @@ int main()
 
 			rotateCam();
 
-			auto tStart = std::chrono::system_clock::now();
-
-			sceneTask->execute(false, {}, { sceneSemaphore });
-
-			//Record to command buffer
-			finalTask->record([&](vk::CommandBuffer * cmd) {
-
-				cmd->setViewport(0, 1, &finalRenderer->getFullViewport());
-				cmd->setScissor(0, 1, &finalRenderer->getFullRect());
-
-				finalRenderer->record(cmd, [&]() {
-
-					blitPipeline->bind(cmd);
+			//Both passes in one command buffer, the graph puts the barrier between them
+			frameTask->record([&](vk::CommandBuffer * cmd) {
 
-					blitVBO->bind(cmd);
+				profiler->beginFrame(cmd);
 
-					blitIBO->bind(cmd);
+				graph->execute(cmd);
 
-					blitPipeline->bindSets(cmd, {
-						blitUniformSet
-						});
-
-					cmd->drawIndexed(blitIBO->getCount(), 1, 0, 0, 0);
-
-				});
+				profiler->endFrame(cmd);
 			});
 
-			//Submit command buffer
-			finalTask->execute(true, { swapchain->getSemaphore(), sceneSemaphore });
+			frameTask->waitFor(swapchain->getSemaphore(), vk::PipelineStageFlagBits::eColorAttachmentOutput);
+
+			frameTask->execute(true);
 			
 			//Present current frame to screen
 			if (!swapchain->present()) {
@@ -311,15 +302,14 @@ int main()
 				return;
 			}
 
-			auto tStop = std::chrono::system_clock::now();
-			std::chrono::duration<double> dt = tStop - tStart;
-			std::cout << "FPS: " << 1.0 / dt.count() << std::endl;
+			//GPU times resolve a few frames late, print them now and then
+			if (++frameCount % 60 == 0) {
+				profiler->print(std::cout);
+			}
 
 
 			SDL_Delay(10);
 		});
-
-		vctx->getDevice().destroySemaphore(sceneSemaphore);
 	}
 
 	int i;
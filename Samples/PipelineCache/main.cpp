@@ -0,0 +1,167 @@
+#include "Vulcro.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+/*
+* Startup cost of pipeline creation with and without a warm pipeline cache.
+* Run it twice: the second run loads the cache the first one saved to VulkanPipelineCache::DEFAULT_PATH.
+* Drivers keep shader caches of their own, so a "cold" run can still be faster than a truly first launch.
+*/
+int main()
+{
+	{
+		VulkanWindow window(0, 0, 64, 64, SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN);
+
+		vector<const char *> extensions = { "VK_KHR_swapchain", "VK_KHR_get_memory_requirements2" };
+		auto vdm = std::make_unique<vke::VulkanDeviceManager>(window.getInstance());
+		auto devices = vdm->findPhysicalDevicesWithCapabilities(extensions, vk::QueueFlagBits::eGraphics);
+		auto vctx = window.createContext(vdm->getPhysicalDevice(devices[0]), extensions);
+
+		//Loaded from disk when the context was created
+		auto diskCache = vctx->getPipelineCache();
+
+		auto target = vctx->makeImage2D(VulkanImage::SAMPLED_COLOR_ATTACHMENT, vk::Format::eR8G8B8A8Unorm, glm::uvec2(64, 64));
+
+		auto renderer = vctx->makeRenderer();
+		renderer->targetImages({ target });
+
+		auto vertexLayout = vctx->makeVertexLayout({
+			vk::Format::eR32G32B32A32Sfloat,
+			vk::Format::eR32G32B32A32Sfloat
+		});
+
+		auto setLayout = vctx->makeSetLayout({
+			SLB(1, vk::DescriptorType::eUniformBuffer)
+		});
+
+		auto shader = vctx->makeShader(
+			"../Triangle/shaders/pos_color_vert.spv",
+			"../Triangle/shaders/pos_color_frag.spv",
+			{ vertexLayout },
+			{ setLayout }
+		);
+
+		//Every combination below is its own pipeline
+		vector<vk::PrimitiveTopology> topologies = {
+			vk::PrimitiveTopology::eTriangleList,
+			vk::PrimitiveTopology::eTriangleStrip,
+			vk::PrimitiveTopology::eLineList,
+			vk::PrimitiveTopology::eLineStrip
+		};
+
+		vector<vk::CullModeFlags> cullModes = {
+			vk::CullModeFlagBits::eNone,
+			vk::CullModeFlagBits::eBack,
+			vk::CullModeFlagBits::eFront
+		};
+
+		vector<vk::FrontFace> frontFaces = {
+			vk::FrontFace::eClockwise,
+			vk::FrontFace::eCounterClockwise
+		};
+
+		vector<VulkanColorBlend> blends = {
+			VULCRO_BLEND_OPAQUE,
+			VULCRO_BLEND_ALPHA
+		};
+
+		//Unless reuse is set the variant cache is emptied first, so every pipeline reaches the driver
+		auto createAll = [&](const char * name, bool reuse) {
+
+			if (!reuse) vctx->getPipelineVariantCache()->clear();
+
+			vector<VulkanRenderPipelineRef> pipelines;
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			for (auto topology : topologies)
+			for (auto cullMode : cullModes)
+			for (auto frontFace : frontFaces)
+			for (auto blend : blends) {
+
+				PipelineConfig config;
+				config.topology = topology;
+				config.cullFlags = cullMode;
+				config.frontFace = frontFace;
+
+				ColorBlendConfig blendConfig;
+				blendConfig.blend = blend;
+
+				pipelines.push_back(vctx->makePipeline(shader, renderer, config, { blendConfig }));
+			}
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+			printf("%-28s %3zu pipelines in %8.2f ms (%.3f ms each)\n", name, pipelines.size(), ms, ms / pipelines.size());
+		};
+
+		//Same pipelines compiled on the worker pool, waiting for all of them
+		auto createAllAsync = [&](const char * name) {
+
+			vctx->getPipelineVariantCache()->clear();
+
+			vector<VulkanRenderPipelineFuture> futures;
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			for (auto topology : topologies)
+			for (auto cullMode : cullModes)
+			for (auto frontFace : frontFaces)
+			for (auto blend : blends) {
+
+				PipelineConfig config;
+				config.topology = topology;
+				config.cullFlags = cullMode;
+				config.frontFace = frontFace;
+
+				ColorBlendConfig blendConfig;
+				blendConfig.blend = blend;
+
+				futures.push_back(vctx->makePipelineAsync(shader, renderer, config, { blendConfig }));
+			}
+
+			for (auto & future : futures) {
+				future.wait();
+			}
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+			printf("%-28s %3zu pipelines in %8.2f ms (%u workers)\n", name, futures.size(), ms, vctx->getWorkerPool()->getThreadCount());
+		};
+
+		printf("Pipeline cache %s: %s\n\n", diskCache->getPath().c_str(), diskCache->wasLoaded() ? "loaded" : "missing or stale");
+
+		//Empty in memory cache, then the same cache again now that it holds every pipeline
+		vctx->setPipelineCache(vctx->makePipelineCache());
+
+		createAll("cold (empty cache)", false);
+		createAll("warm (same process)", false);
+
+		vctx->setPipelineCache(vctx->makePipelineCache());
+
+		createAllAsync("cold, async (empty cache)");
+
+		//As an application starting up would
+		vctx->setPipelineCache(diskCache);
+
+		createAll(diskCache->wasLoaded() ? "warm (loaded from disk)" : "cold (nothing on disk)", false);
+
+		//Identical requests again, as a material system asking per object would
+		createAll("variant cache", true);
+
+		auto variants = vctx->getPipelineVariantCache();
+		printf("Variant cache: %u hits, %u misses, %u evicted by trim\n", variants->getHitCount(), variants->getMissCount(), variants->trim());
+
+		if (diskCache->save()) {
+			printf("\nSaved %zu bytes, run again for a warm start\n", diskCache->getData().size());
+		}
+	}
+
+	return 0;
+}
@@ -346,6 +346,7 @@ int main()
 		colorTarget->resize(sceneSize);
 		rtSet->bindStorageImage(2, colorTarget);
 		finalSet->bindImage(0, colorTarget);
+		VulkanSet::update({ rtSet, finalSet });
 		renderer->resize();
 		vctx->resetTasks(RENDER_POOL);
 		recordTasks();
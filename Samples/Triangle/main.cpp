@@ -113,11 +113,39 @@ int main()
 
 		randomizeTriangle();
 
-		auto taskGroup = vctx->makeTaskGroup(swapchain->numImages());
+		//Two frames in flight, the CPU records the next frame while the GPU renders the last one
+		auto frames = vctx->makeFrameContext(swapchain, 2);
 
-		auto recordTasks = [&]() {
-			taskGroup->record([&](vk::CommandBuffer * cmd, glm::uint32 taskNumber) {
+		auto resize = [&]() {
+			frames->waitIdle();
+
+			if (!swapchain->resize()) {
+				SDL_Delay(100);
+				return;
+			}
+			renderer->resize();
+		};
+
+		//Main Loop
+		window.run([&]() {
+
+			//Randomize Triangle Buffers
+
+			//Wait for this frame slot to be free and for the next swapchain image
+			if (!frames->beginFrame()) {
+				resize();
+				return;
+			}
+
+			//Buffers are shared between frames, only touch them once the previous frame is done
+            if (rand() % 10 == 1) {
+				frames->waitIdle();
+			    randomizeTriangle();
+			}
+
+			frames->getTask()->record([&](vk::CommandBuffer * cmd) {
 
+				//Renders into the framebuffer of the image acquired by beginFrame
 				renderer->record(cmd, [&]() {
 
 					cmd->setViewport(0, 1, &renderer->getFullViewport());
@@ -134,44 +162,15 @@ int main()
 
 					cmd->drawIndexed(vbuf->getCount(), 1, 0, 0, 0);
 
-				}, taskNumber);
+				});
 
 			});
-		};
-
-		recordTasks();
-
-		auto resize = [&]() {
-			if (!swapchain->resize()) {
-				SDL_Delay(100);
-				return;
-			}
-			renderer->resize();
-			//vctx->resetTasks();
-			recordTasks();
-		};
-
-		//Main Loop
-		window.run([&]() {
-
-			//Randomize Triangle Buffers
-
-            if (rand() % 10 == 1)
-			    randomizeTriangle();
-
-			//Wait for next available frame
-			if (!swapchain->nextFrame()) {
-				resize();
-				return;
-			}
 
-			taskGroup->at(swapchain->getRenderingIndex())->execute(
-				true, // Block on CPU until completed
-				{ swapchain->getSemaphore() } //Wait for swapchain to be ready before rendering
-			);
+			//Waits for the acquired image, does not block the CPU
+			frames->submit({ frames->getTask() });
 
 			//Present current frame to screen
-			if (!swapchain->present()) {
+			if (!frames->endFrame()) {
 				resize();
 				return;
 			}
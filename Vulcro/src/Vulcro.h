@@ -5,6 +5,26 @@
 #include "vulkan-core/VulkanTaskGroup.h"
 #include "vulkan-core/VulkanTaskPool.h"
 #include "vulkan-core/VulkanSwapchain.h"
+#include "vulkan-core/VulkanRingBuffer.h"
+#include "vulkan-core/VulkanQueue.h"
+#include "vulkan-core/VulkanWorkerPool.h"
+#include "vulkan-core/VulkanFencePool.h"
+#include "vulkan-core/VulkanBarrierBatch.h"
+#include "vulkan-core/VulkanTimeline.h"
+#include "vulkan-core/VulkanDescriptorAllocator.h"
+#include "vulkan-core/VulkanBindlessHeap.h"
+#include "vulkan-core/VulkanLayoutCache.h"
+#include "vulkan-core/VulkanPipelineCache.h"
+#include "vulkan-core/VulkanPipelineFuture.h"
+#include "vulkan-core/VulkanPipelineVariantCache.h"
+#include "vulkan-core/VulkanStateRecorder.h"
+#include "vulkan-core/VulkanShaderCache.h"
+#include "vulkan-core/VulkanShaderReflection.h"
+#include "vulkan-core/VulkanSpecialization.h"
+#include "vulkan-core/VulkanFrameContext.h"
+#include "vulkan-core/VulkanProfiler.h"
+#include "vulkan-core/VulkanTracer.h"
+#include "vulkan-core/VulkanRenderGraph.h"
 #include "vulkan-rtx/RTAccelerationStructure.h"
 #include "vulkan-rtx/RTScene.h"
 #include "vulkan-rtx/RTPipeline.h"
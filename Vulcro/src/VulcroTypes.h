@@ -23,6 +23,26 @@ class VulkanImage1D;
 class VulkanImage2D;
 class VulkanImage3D;
 class VulkanImageCube;
+class VulkanMemoryAllocator;
+class VulkanDescriptorAllocator;
+class VulkanDescriptorArena;
+class VulkanLayoutCache;
+class VulkanRingBuffer;
+class VulkanUploader;
+class VulkanQueue;
+class VulkanWorkerPool;
+class VulkanFencePool;
+class VulkanCompletion;
+class VulkanTimeline;
+class VulkanFrameContext;
+class VulkanProfiler;
+class VulkanRenderGraph;
+class VulkanBindlessHeap;
+class VulkanPipelineCache;
+class VulkanPipelineVariantCache;
+class VulkanStateRecorder;
+class VulkanShaderCache;
+class VulkanShaderModule;
 
 class RTGeometry;
 class RTBlasRepo;
@@ -77,11 +97,37 @@ typedef shared_ptr<VulkanImageCube> VulkanImageCubeRef;
 typedef shared_ptr<VulkanTaskGroup> VulkanTaskGroupRef;
 typedef shared_ptr<VulkanComputePipeline> VulkanComputePipelineRef;
 typedef shared_ptr<VulkanTaskPool> VulkanTaskPoolRef;
+typedef shared_ptr<VulkanRingBuffer> VulkanRingBufferRef;
+typedef shared_ptr<VulkanTimeline> VulkanTimelineRef;
+typedef shared_ptr<VulkanFrameContext> VulkanFrameContextRef;
+typedef shared_ptr<VulkanProfiler> VulkanProfilerRef;
+typedef shared_ptr<VulkanRenderGraph> VulkanRenderGraphRef;
+typedef shared_ptr<VulkanBindlessHeap> VulkanBindlessHeapRef;
+typedef shared_ptr<VulkanPipelineCache> VulkanPipelineCacheRef;
+typedef shared_ptr<VulkanShaderModule> VulkanShaderModuleRef;
+typedef shared_ptr<VulkanStateRecorder> VulkanStateRecorderRef;
+
+enum class VulkanQueueType
+{
+    GRAPHICS,
+    COMPUTE,  // Async compute, aliases GRAPHICS when the device has no dedicated compute family
+    TRANSFER  // DMA, aliases COMPUTE or GRAPHICS when the device has no dedicated transfer family
+};
+
+//Identifies the VulkanUploader batch a copy was recorded into, 0 means already complete
+typedef uint64_t VulkanUploadToken;
 
 typedef shared_ptr<RTGeometry> RTGeometryRef;
 typedef shared_ptr<RTBlasRepo> RTBlasRepoRef;
 typedef shared_ptr<RTShaderBuilder> RTShaderBuilderRef;
 typedef shared_ptr<RTPipeline> RTPipelineRef;
+
+template <class T>
+class VulkanPipelineFuture;
+
+typedef VulkanPipelineFuture<VulkanRenderPipeline> VulkanRenderPipelineFuture;
+typedef VulkanPipelineFuture<VulkanComputePipeline> VulkanComputePipelineFuture;
+typedef VulkanPipelineFuture<RTPipeline> RTPipelineFuture;
 typedef shared_ptr<RTAccelerationStructure> RTAccelStructRef;
 typedef shared_ptr<RTTopStructure> RTTopStructureRef;
 typedef shared_ptr<RTTopStructureManager> RTTopStructureManagerRef;
@@ -0,0 +1,188 @@
+#include "VulkanBarrierBatch.h"
+
+#include "VulkanImage.h"
+#include "VulkanBuffer.h"
+
+const vk::AccessFlags VulkanResourceState::WRITE_ACCESS =
+    vk::AccessFlagBits::eShaderWrite |
+    vk::AccessFlagBits::eColorAttachmentWrite |
+    vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+    vk::AccessFlagBits::eTransferWrite |
+    vk::AccessFlagBits::eHostWrite |
+    vk::AccessFlagBits::eMemoryWrite |
+    vk::AccessFlagBits::eAccelerationStructureWriteNV;
+
+VulkanResourceUse VulkanResourceUse::forLayout(vk::ImageLayout layout)
+{
+    switch (layout)
+    {
+    case vk::ImageLayout::eTransferDstOptimal:
+        return { vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer };
+
+    case vk::ImageLayout::eTransferSrcOptimal:
+        return { vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer };
+
+    case vk::ImageLayout::eShaderReadOnlyOptimal:
+        return { vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eAllCommands };
+
+    case vk::ImageLayout::eColorAttachmentOptimal:
+        return { vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::PipelineStageFlagBits::eColorAttachmentOutput };
+
+    case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+        return { vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests };
+
+    case vk::ImageLayout::ePresentSrcKHR:
+        return { vk::AccessFlags(), vk::PipelineStageFlagBits::eBottomOfPipe };
+
+    default:
+        // eGeneral is used for sampling and storage alike
+        return { vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eAllCommands };
+    }
+}
+
+void VulkanBarrierBatch::transition(VulkanImage * image, vk::ImageLayout layout, vk::AccessFlags access, vk::PipelineStageFlags stage, bool discard)
+{
+    auto & state = image->getState();
+
+    if (state.layout == layout && !discard)
+    {
+        this->access(state, access, stage);
+        return;
+    }
+
+    // The layout transition waits for every earlier use, without one there is nothing to wait for
+    auto srcStage = state.writeStage | state.readStage;
+
+    mImageBarriers.push_back(vk::ImageMemoryBarrier(
+        state.writeAccess,
+        access,
+        discard ? vk::ImageLayout::eUndefined : state.layout,
+        layout,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image->getImage(),
+        vk::ImageSubresourceRange(getAspect(image->getFormat()), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS)
+    ));
+
+    dependOn(srcStage ? srcStage : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe), stage);
+
+    // The transition itself counts as a write that is already visible to this use
+    state.layout = layout;
+    state.writeAccess = access & VulkanResourceState::WRITE_ACCESS;
+    state.writeStage = stage;
+    state.readAccess = access;
+    state.readStage = stage;
+}
+
+void VulkanBarrierBatch::transition(VulkanImage * image, vk::ImageLayout layout, bool discard)
+{
+    auto use = VulkanResourceUse::forLayout(layout);
+
+    transition(image, layout, use.access, use.stage, discard);
+}
+
+void VulkanBarrierBatch::access(VulkanResourceState & state, vk::AccessFlags access, vk::PipelineStageFlags stage)
+{
+    if (access & VulkanResourceState::WRITE_ACCESS)
+    {
+        // Waits for the last write and every read since, the reads only need an execution dependency
+        auto srcStage = state.writeStage | state.readStage;
+
+        if (srcStage)
+        {
+            memory(srcStage, state.writeAccess, stage, access);
+        }
+
+        state.writeAccess = access & VulkanResourceState::WRITE_ACCESS;
+        state.writeStage = stage;
+        state.readAccess = vk::AccessFlags();
+        state.readStage = vk::PipelineStageFlags();
+        return;
+    }
+
+    // Reads after reads are free once the last write is visible to them
+    bool visible = (stage & state.readStage) == stage && (access & state.readAccess) == access;
+
+    if (state.writeStage && !visible)
+    {
+        memory(state.writeStage, state.writeAccess, stage, access);
+    }
+
+    state.readAccess |= access;
+    state.readStage |= stage;
+}
+
+void VulkanBarrierBatch::access(VulkanBuffer * buffer, vk::AccessFlags access, vk::PipelineStageFlags stage)
+{
+    this->access(buffer->getState(), access, stage);
+}
+
+void VulkanBarrierBatch::memory(vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+{
+    mSrcAccess |= srcAccess;
+    mDstAccess |= dstAccess;
+
+    dependOn(srcStage, dstStage);
+}
+
+void VulkanBarrierBatch::image(vk::ImageMemoryBarrier const & barrier, vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage)
+{
+    mImageBarriers.push_back(barrier);
+
+    dependOn(srcStage, dstStage);
+}
+
+void VulkanBarrierBatch::dependOn(vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage)
+{
+    mSrcStage |= srcStage;
+    mDstStage |= dstStage;
+}
+
+void VulkanBarrierBatch::flush(vk::CommandBuffer * cmd)
+{
+    if (empty()) return;
+
+    vk::MemoryBarrier memoryBarrier(mSrcAccess, mDstAccess);
+    bool hasMemoryBarrier = mSrcAccess || mDstAccess;
+
+    cmd->pipelineBarrier(
+        mSrcStage ? mSrcStage : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe),
+        mDstStage ? mDstStage : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eBottomOfPipe),
+        vk::DependencyFlags(),
+        hasMemoryBarrier ? 1 : 0,
+        hasMemoryBarrier ? &memoryBarrier : nullptr,
+        0,
+        nullptr,
+        static_cast<uint32_t>(mImageBarriers.size()),
+        mImageBarriers.size() > 0 ? mImageBarriers.data() : nullptr
+    );
+
+    mSrcStage = vk::PipelineStageFlags();
+    mDstStage = vk::PipelineStageFlags();
+    mSrcAccess = vk::AccessFlags();
+    mDstAccess = vk::AccessFlags();
+    mImageBarriers.clear();
+}
+
+vk::ImageAspectFlags VulkanBarrierBatch::getAspect(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eD16Unorm:
+    case vk::Format::eX8D24UnormPack32:
+    case vk::Format::eD32Sfloat:
+        return vk::ImageAspectFlagBits::eDepth;
+
+    case vk::Format::eD16UnormS8Uint:
+    case vk::Format::eD24UnormS8Uint:
+    case vk::Format::eD32SfloatS8Uint:
+        return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+
+    case vk::Format::eS8Uint:
+        return vk::ImageAspectFlagBits::eStencil;
+
+    default:
+        return vk::ImageAspectFlagBits::eColor;
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "../VulcroTypes.h"
+
+//How a command accesses a resource
+struct VulkanResourceUse
+{
+    vk::AccessFlags access;
+    vk::PipelineStageFlags stage;
+
+    //Typical access and stages of an image in layout
+    static VulkanResourceUse forLayout(vk::ImageLayout layout);
+};
+
+/*
+* Last write to an image, buffer or acceleration structure and the reads it has been made visible to since,
+* in command recording order. Resources used from several command buffers are only tracked correctly
+* if those are submitted in recording order.
+*/
+struct VulkanResourceState
+{
+    static const vk::AccessFlags WRITE_ACCESS;
+
+    VulkanResourceState()
+    {}
+
+    //State after a use outside a VulkanBarrierBatch, e.g. a render pass writing its attachments
+    VulkanResourceState(vk::ImageLayout _layout, vk::AccessFlags access, vk::PipelineStageFlags stage) :
+        layout(_layout)
+    {
+        if (access & WRITE_ACCESS)
+        {
+            writeAccess = access & WRITE_ACCESS;
+            writeStage = stage;
+        }
+        else
+        {
+            readAccess = access;
+            readStage = stage;
+        }
+    }
+
+    //Unused for buffers
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+
+    vk::AccessFlags writeAccess;
+    vk::PipelineStageFlags writeStage;
+
+    vk::AccessFlags readAccess;
+    vk::PipelineStageFlags readStage;
+};
+
+/*
+* Collects the barriers needed to move resources to their next use and records them as one vkCmdPipelineBarrier.
+* Reads after reads need nothing, writes after reads only an execution dependency, and all memory dependencies
+* are merged into a single global memory barrier. Image barriers are only used where the layout changes.
+*
+*   VulkanBarrierBatch barriers;
+*   barriers.transition(colorTarget.get(), vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eComputeShader);
+*   barriers.access(particleBuffer->getState(), vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eComputeShader);
+*   barriers.flush(cmd);
+*/
+class VulkanBarrierBatch
+{
+public:
+
+    //Move image to layout for the given use. discard drops its contents, saving the transition from the current layout
+    void transition(VulkanImage * image, vk::ImageLayout layout, vk::AccessFlags access, vk::PipelineStageFlags stage, bool discard = false);
+
+    //transition with the access and stages VulkanResourceUse::forLayout gives
+    void transition(VulkanImage * image, vk::ImageLayout layout, bool discard = false);
+
+    //Memory dependency for a buffer, acceleration structure or image that stays in its layout
+    void access(VulkanResourceState & state, vk::AccessFlags access, vk::PipelineStageFlags stage);
+
+    void access(VulkanBuffer * buffer, vk::AccessFlags access, vk::PipelineStageFlags stage);
+
+    //Untracked barriers, e.g. for a sub range of an image
+    void memory(vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+    void image(vk::ImageMemoryBarrier const & barrier, vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage);
+
+    //Record everything collected so far, no-op if nothing is needed
+    void flush(vk::CommandBuffer * cmd);
+
+    bool empty()
+    {
+        return !mSrcStage && !mDstStage;
+    }
+
+    static vk::ImageAspectFlags getAspect(vk::Format format);
+
+private:
+
+    void dependOn(vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage);
+
+    vk::PipelineStageFlags mSrcStage;
+    vk::PipelineStageFlags mDstStage;
+
+    vk::AccessFlags mSrcAccess;
+    vk::AccessFlags mDstAccess;
+
+    vector<vk::ImageMemoryBarrier> mImageBarriers;
+};
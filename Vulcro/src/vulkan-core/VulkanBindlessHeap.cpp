@@ -0,0 +1,206 @@
+#include "VulkanBindlessHeap.h"
+
+#include "VulkanSetLayout.h"
+#include "VulkanSet.h"
+#include "VulkanTracer.h"
+
+const VulkanBindlessHeap::Handle VulkanBindlessHeap::INVALID_HANDLE = ~0u;
+
+const uint32_t VulkanBindlessHeap::SAMPLED_IMAGE_BINDING = 0;
+const uint32_t VulkanBindlessHeap::STORAGE_IMAGE_BINDING = 1;
+const uint32_t VulkanBindlessHeap::STORAGE_BUFFER_BINDING = 2;
+
+const uint32_t VulkanBindlessHeap::DEFAULT_MAX_SAMPLED_IMAGES = 4096;
+const uint32_t VulkanBindlessHeap::DEFAULT_MAX_STORAGE_IMAGES = 256;
+const uint32_t VulkanBindlessHeap::DEFAULT_MAX_STORAGE_BUFFERS = 4096;
+
+VulkanBindlessHeap::VulkanBindlessHeap(VulkanContextPtr ctx, uint32_t maxSampledImages, uint32_t maxStorageImages, uint32_t maxStorageBuffers) :
+    mCtx(ctx)
+{
+    auto & limits = mCtx->getPhysicalDeviceProperties().limits;
+
+    mSampledImages.capacity = glm::max(glm::min(maxSampledImages, limits.maxPerStageDescriptorSampledImages), 1u);
+    mStorageImages.capacity = glm::max(glm::min(maxStorageImages, limits.maxPerStageDescriptorStorageImages), 1u);
+    mStorageBuffers.capacity = glm::max(glm::min(maxStorageBuffers, limits.maxPerStageDescriptorStorageBuffers), 1u);
+
+    mSampledImages.name = "sampled image";
+    mStorageImages.name = "storage image";
+    mStorageBuffers.name = "storage buffer";
+
+    mSampledImages.images.resize(mSampledImages.capacity);
+    mStorageImages.images.resize(mStorageImages.capacity);
+    mStorageBuffers.buffers.resize(mStorageBuffers.capacity);
+
+    // Arrays are partially bound, slots never registered are never written
+    mLayout = mCtx->makeSetLayout({
+        SLB(mSampledImages.capacity, vk::DescriptorType::eCombinedImageSampler),
+        SLB(mStorageImages.capacity, vk::DescriptorType::eStorageImage),
+        SLB(mStorageBuffers.capacity, vk::DescriptorType::eStorageBuffer)
+    }, 1, true);
+
+    mSet = mCtx->makeSet(mLayout);
+}
+
+VulkanBindlessHeap::Handle VulkanBindlessHeap::allocate(Table & table)
+{
+    if (!table.freeHandles.empty())
+    {
+        auto handle = table.freeHandles.back();
+        table.freeHandles.pop_back();
+        table.count++;
+        return handle;
+    }
+
+    // Without released handles every handle below count is in use
+    if (table.count == table.capacity)
+    {
+        std::cerr << "(VulkanBindlessHeap - allocate) out of " << table.name << " slots" << std::endl;
+        return INVALID_HANDLE;
+    }
+
+    return table.count++;
+}
+
+void VulkanBindlessHeap::release(Table & table, Handle handle)
+{
+    if (!isValid(table, handle)) return;
+
+    // Image tables only hold images and buffer tables only buffers, an empty slot was already released
+    if (table.images.size() > 0)
+    {
+        if (!table.images[handle]) return;
+        table.images[handle] = nullptr;
+    }
+    else
+    {
+        if (!table.buffers[handle]) return;
+        table.buffers[handle] = nullptr;
+    }
+
+    table.freeHandles.push_back(handle);
+    table.count--;
+}
+
+bool VulkanBindlessHeap::isValid(Table & table, Handle handle)
+{
+    if (handle >= table.capacity)
+    {
+        std::cerr << "(VulkanBindlessHeap - isValid) invalid " << table.name << " handle " << handle << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanBindlessHeap::isRegistered(Table & table, Handle handle)
+{
+    if (!isValid(table, handle)) return false;
+
+    bool empty = table.images.size() > 0 ? !table.images[handle] : !table.buffers[handle];
+
+    if (empty)
+    {
+        std::cerr << "(VulkanBindlessHeap - isRegistered) " << table.name << " handle " << handle << " was released" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+VulkanBindlessHeap::Handle VulkanBindlessHeap::registerImage(VulkanImageRef image)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    if (!image) return INVALID_HANDLE;
+
+    auto handle = allocate(mSampledImages);
+
+    if (handle != INVALID_HANDLE)
+    {
+        mSampledImages.images[handle] = image;
+        updateImage(handle, image);
+    }
+
+    return handle;
+}
+
+VulkanBindlessHeap::Handle VulkanBindlessHeap::registerStorageImage(VulkanImageRef image, uint16_t mipLevel)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    if (!image) return INVALID_HANDLE;
+
+    auto handle = allocate(mStorageImages);
+
+    if (handle != INVALID_HANDLE)
+    {
+        mStorageImages.images[handle] = image;
+        updateStorageImage(handle, image, mipLevel);
+    }
+
+    return handle;
+}
+
+VulkanBindlessHeap::Handle VulkanBindlessHeap::registerBuffer(VulkanBufferRef buffer)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    if (!buffer) return INVALID_HANDLE;
+
+    auto handle = allocate(mStorageBuffers);
+
+    if (handle != INVALID_HANDLE)
+    {
+        mStorageBuffers.buffers[handle] = buffer;
+        updateBuffer(handle, buffer);
+    }
+
+    return handle;
+}
+
+void VulkanBindlessHeap::updateImage(Handle handle, VulkanImageRef image)
+{
+    if (!image || !isRegistered(mSampledImages, handle)) return;
+
+    mSampledImages.images[handle] = image;
+
+    mSet->bindImageAt(SAMPLED_IMAGE_BINDING, handle, image, vk::DescriptorType::eCombinedImageSampler);
+}
+
+void VulkanBindlessHeap::updateStorageImage(Handle handle, VulkanImageRef image, uint16_t mipLevel)
+{
+    if (!image || !isRegistered(mStorageImages, handle)) return;
+
+    mStorageImages.images[handle] = image;
+
+    mSet->bindImageAt(STORAGE_IMAGE_BINDING, handle, image, vk::DescriptorType::eStorageImage, mipLevel);
+}
+
+void VulkanBindlessHeap::updateBuffer(Handle handle, VulkanBufferRef buffer)
+{
+    if (!buffer || !isRegistered(mStorageBuffers, handle)) return;
+
+    mStorageBuffers.buffers[handle] = buffer;
+
+    mSet->bindBufferAt(STORAGE_BUFFER_BINDING, handle, buffer->getDBI(), vk::DescriptorType::eStorageBuffer);
+}
+
+void VulkanBindlessHeap::releaseImage(Handle handle)
+{
+    release(mSampledImages, handle);
+}
+
+void VulkanBindlessHeap::releaseStorageImage(Handle handle)
+{
+    release(mStorageImages, handle);
+}
+
+void VulkanBindlessHeap::releaseBuffer(Handle handle)
+{
+    release(mStorageBuffers, handle);
+}
+
+void VulkanBindlessHeap::flush()
+{
+    mSet->update();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+/*
+* One descriptor set holding every registered image and buffer, which shaders index by handle:
+*
+*   layout(set = 0, binding = 0) uniform sampler2D textures[];
+*   layout(set = 0, binding = 1, rgba8) uniform image2D storageImages[];
+*   layout(set = 0, binding = 2) buffer Buffers { ... } buffers[];
+*
+*   auto albedo = heap->registerImage(texture);     //pass albedo to the shader, e.g. in a ubo
+*
+* Registrations are queued on the heap's set and written when the next task records (see
+* VulkanContext::flushDescriptorWrites), or by flush.
+* With VulkanContext::supportsUpdateAfterBind that is fine while earlier frames using the set are in flight,
+* otherwise the set must not be in use when written. Released handles are handed out again, so release one
+* only once the GPU is done with it, e.g. through VulkanFrameContext::defer.
+*/
+class VulkanBindlessHeap
+{
+public:
+
+    typedef uint32_t Handle;
+
+    static const Handle INVALID_HANDLE;
+
+    static const uint32_t SAMPLED_IMAGE_BINDING;
+    static const uint32_t STORAGE_IMAGE_BINDING;
+    static const uint32_t STORAGE_BUFFER_BINDING;
+
+    static const uint32_t DEFAULT_MAX_SAMPLED_IMAGES;
+    static const uint32_t DEFAULT_MAX_STORAGE_IMAGES;
+    static const uint32_t DEFAULT_MAX_STORAGE_BUFFERS;
+
+    //Counts are clamped to the device's per stage limits
+    VulkanBindlessHeap(VulkanContextPtr ctx,
+        uint32_t maxSampledImages = DEFAULT_MAX_SAMPLED_IMAGES,
+        uint32_t maxStorageImages = DEFAULT_MAX_STORAGE_IMAGES,
+        uint32_t maxStorageBuffers = DEFAULT_MAX_STORAGE_BUFFERS);
+
+    VULCRO_DONT_COPY(VulkanBindlessHeap)
+
+    //The heap keeps registered resources alive until their handle is released. Returns INVALID_HANDLE when full
+    Handle registerImage(VulkanImageRef image);
+    Handle registerStorageImage(VulkanImageRef image, uint16_t mipLevel = 0);
+    Handle registerBuffer(VulkanBufferRef buffer);
+
+    //Point a registered handle at another resource, or rewrite it after its resource was resized
+    void updateImage(Handle handle, VulkanImageRef image);
+    void updateStorageImage(Handle handle, VulkanImageRef image, uint16_t mipLevel = 0);
+    void updateBuffer(Handle handle, VulkanBufferRef buffer);
+
+    void releaseImage(Handle handle);
+    void releaseStorageImage(Handle handle);
+    void releaseBuffer(Handle handle);
+
+    //Write queued registrations now instead of when the next task records
+    void flush();
+
+    VulkanSetLayoutRef getLayout()
+    {
+        return mLayout;
+    }
+
+    VulkanSetRef getSet()
+    {
+        return mSet;
+    }
+
+    uint32_t getImageCount()
+    {
+        return mSampledImages.count;
+    }
+
+    uint32_t getStorageImageCount()
+    {
+        return mStorageImages.count;
+    }
+
+    uint32_t getBufferCount()
+    {
+        return mStorageBuffers.count;
+    }
+
+private:
+
+    //Slots of one binding, handles are indices into its array
+    struct Table
+    {
+        uint32_t capacity = 0;
+        uint32_t count = 0;
+
+        vector<VulkanImageRef> images;
+        vector<VulkanBufferRef> buffers;
+
+        //Released handles, reused before slots that were never handed out
+        vector<Handle> freeHandles;
+
+        const char * name;
+    };
+
+    Handle allocate(Table & table);
+
+    void release(Table & table, Handle handle);
+
+    bool isValid(Table & table, Handle handle);
+
+    //Valid and not released, updates to a released handle would revive a slot on the free list
+    bool isRegistered(Table & table, Handle handle);
+
+    VulkanContextPtr mCtx;
+
+    VulkanSetLayoutRef mLayout;
+    VulkanSetRef mSet;
+
+    Table mSampledImages;
+    Table mStorageImages;
+    Table mStorageBuffers;
+};
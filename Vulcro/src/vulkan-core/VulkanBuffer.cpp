@@ -34,40 +34,35 @@ VulkanBuffer::VulkanBuffer(VulkanContextPtr ctx, vk::BufferUsageFlags usage, uin
     // Ask the buffer what memory flags it requires
 	auto memReqs =_ctx->getDevice().getBufferMemoryRequirements(mBuffer);
 
-    auto memTypeRes = _ctx->getBestMemoryIndex(memReqs, memFlags);
+    // Sub-allocate from the context's memory blocks
+    mAllocation = _ctx->getAllocator()->allocate(memReqs, memFlags, true /* linear */, false, vk::MemoryDedicatedAllocateInfo(nullptr, mBuffer));
 
-    assert(memTypeRes.isValid);
+    // Bind the backed buffer with the allocated memoery
+	_ctx->getDevice().bindBufferMemory(mBuffer, mAllocation.memory, mAllocation.offset);
 
-    // Given our requirments, allocate memory
-	mMemory = _ctx->getDevice().allocateMemory(
-		vk::MemoryAllocateInfo(
-			memReqs.size,
-			memTypeRes.value
-		)
-	);
+    // Host visible buffers stay mapped for their whole lifetime
+    if (mMemoryFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+    {
+        _mappedData = _ctx->getAllocator()->map(mAllocation);
+    }
 
-#ifdef VULCRO_PRINT_ALLOCATIONS
-    printf("VulkanBuffer: Allocating memory %lli \n", memReqs.size);
-#endif
     // If a handle to data was passed, upload it
     if (data != nullptr)
     {
         upload(size, data);
     }
-
-    // Bind the backed buffer with the allocated memoery
-	_ctx->getDevice().bindBufferMemory(mBuffer, mMemory, 0);
 }
 
 VulkanBuffer::~VulkanBuffer()
 {
     if (_mappedData)
     {
-        unmap();
+        _ctx->getAllocator()->unmap(mAllocation);
+        _mappedData = nullptr;
     }
 
 	_ctx->getDevice().destroyBuffer(mBuffer);
-	_ctx->getDevice().freeMemory(mMemory);
+	_ctx->getAllocator()->free(mAllocation);
 
 	if (_view) {
 		_ctx->getDevice().destroyBufferView(_view);
@@ -97,25 +92,18 @@ void VulkanBuffer::bindIndex(vk::CommandBuffer * cmd, vk::IndexType type)
 void VulkanBuffer::upload(uint64_t size, void * data, uint64_t offset)
 {
 
-	auto * pData = getMapped(offset, size);
-
-	memcpy(pData, data, size);
+	memcpy(getMapped(offset, size), data, size);
 
     flush(offset, size);
-
-	unmap();
 }
 
 #include "VulkanTask.h"
+#include "VulkanUploader.h"
 
-void VulkanBuffer::copyBuffer(VulkanBufferRef srcBuffer, uint64_t size, uint64_t srcOffset, uint64_t dstOffset)
+VulkanUploadToken VulkanBuffer::copyBuffer(VulkanBufferRef srcBuffer, uint64_t size, uint64_t srcOffset, uint64_t dstOffset)
 {
-
-    // Create a new task and record our copy command
-    auto pool = _ctx->makeTaskPool(vk::CommandPoolCreateFlagBits::eTransient);
-    auto task = _ctx->makeTask(pool);
-
-    copyBuffer(task, srcBuffer, size, srcOffset, dstOffset);
+    // Batched with other uploads, srcBuffer and this buffer are kept alive until the copy completes
+    return _ctx->getUploader()->copyBuffer(srcBuffer, this, size, srcOffset, dstOffset, shared_from_this());
 }
 
 
@@ -170,36 +158,17 @@ static uint64_t roundUp(uint64_t number, uint64_t multiplier)
     return number + multiplier - remainder;
 }
 
-void * VulkanBuffer::getMapped(uint64_t offset, uint64_t size){
-
-    assert(mMemoryFlags & vk::MemoryPropertyFlagBits::eHostVisible);
-    
-    if ((_mappedData != nullptr) && offset == 0) {
-        return _mappedData;
-    }
-
-    if (size == _size || size == VK_WHOLE_SIZE)
-    {
-        size = VK_WHOLE_SIZE;
-    }
-    else
-    {
-        auto multiplier = _ctx->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
-        size = roundUp(size, multiplier);
-    }
+static uint64_t roundDown(uint64_t number, uint64_t multiplier)
+{
+    return number - (number % multiplier);
+}
 
-	void * pData = _ctx->getDevice().mapMemory(
-		mMemory,
-		offset,
-		size,
-		vk::MemoryMapFlags()
-	);
+void * VulkanBuffer::getMapped(uint64_t offset, uint64_t /* size */){
 
-    if (offset == 0) {
-        _mappedData = pData;
-    }
+    assert(mMemoryFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+    assert(_mappedData != nullptr);
 
-	return pData;
+	return (char*)_mappedData + offset;
 }
 
 
@@ -217,34 +186,27 @@ void VulkanBuffer::flush(uint64_t offset, uint64_t size)
     }
 
 
-    if (size == _size || size == VK_WHOLE_SIZE)
-    {
-        size = VK_WHOLE_SIZE;
-    }
-    else
+    // Flush ranges are in memory space, so the atom rounding is applied to the allocation offset too.
+    // The allocator pads non-coherent allocations out to whole atoms, so the rounded range never leaves it.
+    uint64_t begin = mAllocation.offset;
+    uint64_t end = mAllocation.offset + mAllocation.size;
+
+    if (!(offset == 0 && (size == _size || size == VK_WHOLE_SIZE)))
     {
-        auto multiplier = _ctx->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
-        size = roundUp(size, multiplier);
+        auto atom = _ctx->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
+
+        begin = glm::max(begin, roundDown(mAllocation.offset + offset, atom));
+        end = glm::min(end, roundUp(mAllocation.offset + offset + size, atom));
     }
-    
 
     _ctx->getDevice().flushMappedMemoryRanges(vk::MappedMemoryRange{
-        mMemory, offset, size
+        mAllocation.memory, begin, end - begin
     });
 }
 
 void VulkanBuffer::unmap()
 {
-    if (!(mMemoryFlags & vk::MemoryPropertyFlagBits::eHostVisible))
-    {
-        return;
-    }
-
-	_ctx->getDevice().unmapMemory(
-		mMemory
-	);
-
-    _mappedData = nullptr;
+    // Host visible buffers are persistently mapped and released in the destructor
 }
 
 void VulkanBuffer::createView(vk::Format format)
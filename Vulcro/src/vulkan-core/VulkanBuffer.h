@@ -2,10 +2,12 @@
 
 #include "VulkanContext.h"
 #include "VulkanVertexLayout.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanBarrierBatch.h"
 //Catch all class for non-image buffers
 
 
-class VulkanBuffer
+class VulkanBuffer : public std::enable_shared_from_this<VulkanBuffer>
 {
 public:
 
@@ -47,7 +49,8 @@ public:
 
 	void upload(uint64_t size, void* data, uint64_t offset = 0);
 
-    void copyBuffer(VulkanBufferRef srcBuffer, uint64_t size, uint64_t srcOffset, uint64_t dstOffset);
+    //Batched on the context's uploader, returns without waiting
+    VulkanUploadToken copyBuffer(VulkanBufferRef srcBuffer, uint64_t size, uint64_t srcOffset, uint64_t dstOffset);
     void copyBuffer(VulkanTaskRef task, VulkanBufferRef srcBuffer, uint64_t size, uint64_t srcOffset, uint64_t dstOffset);
     
 
@@ -77,10 +80,12 @@ public:
 		return mBuffer;
 	}
 
+	//Host visible buffers are mapped once at creation, this just offsets the persistent pointer
 	void * getMapped(uint64_t offset = 0, uint64_t size = VK_WHOLE_SIZE);
 
     void flush(uint64_t offset = 0, uint64_t size = VK_WHOLE_SIZE);
 
+	//No-op, kept for existing callers of the map / unmap pattern
 	void unmap();
 
 	void createView(vk::Format format);
@@ -93,17 +98,28 @@ public:
 		return _size;
 	}
 
+	const VulkanAllocation & getAllocation() {
+		return mAllocation;
+	}
+
+	//Last access as recorded through VulkanBarrierBatch
+	VulkanResourceState & getState() {
+		return mState;
+	}
+
 private:
 	vk::DeviceSize _size;
 
 	VulkanContextPtr _ctx;
 	vk::BufferUsageFlags _usage;
     vk::MemoryPropertyFlags mMemoryFlags;
-	vk::DeviceMemory mMemory;
+	VulkanAllocation mAllocation;
 	vk::Buffer mBuffer;
 	vk::BufferView _view = nullptr;
 
     void * _mappedData = nullptr;
+
+	VulkanResourceState mState;
 };
 
 
@@ -176,7 +192,7 @@ public:
 	};
 
 	void sync(uint32_t index, uint32_t count) {
-		_vbr->upload(count * sizeof(T), values[index], index * sizeof(T));
+		_vbr->upload(count * sizeof(T), &values[index], index * sizeof(T));
 	}
 
 	SLB getLayout() {
@@ -451,11 +467,11 @@ class dynamic_ssbo : public issbo, public VulkanCoherentArray<T> {
 public:
 
     dynamic_ssbo(VulkanContextPtr ctx, uint32_t arrayCount) :
-        VulkanCoherentArray(ctx, arrayCount, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc)
+        VulkanCoherentArray<T>(ctx, arrayCount, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc)
     {}
 
     VulkanBufferRef getBuffer() {
-        return _vbr;
+        return this->_vbr;
     }
 
 };
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+/*
+* Declarations for extensions newer than the bundled Vulkan headers. Each block is skipped when the
+* headers already provide the extension, so this keeps working after Lib/vulkan is updated.
+* Only the C API is declared, vulkan.hpp has no wrappers for these so call through the loaded function pointers.
+*/
+
+//////////////////////////////////////
+// VK_KHR_timeline_semaphore
+//////////////////////////////////////
+
+#ifndef VK_KHR_timeline_semaphore
+#define VK_KHR_timeline_semaphore 1
+
+#define VK_KHR_TIMELINE_SEMAPHORE_SPEC_VERSION 2
+#define VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME "VK_KHR_timeline_semaphore"
+
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR ((VkStructureType)1000207000)
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_PROPERTIES_KHR ((VkStructureType)1000207001)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR ((VkStructureType)1000207002)
+#define VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR ((VkStructureType)1000207003)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR ((VkStructureType)1000207004)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR ((VkStructureType)1000207005)
+
+typedef enum VkSemaphoreTypeKHR {
+    VK_SEMAPHORE_TYPE_BINARY_KHR = 0,
+    VK_SEMAPHORE_TYPE_TIMELINE_KHR = 1,
+    VK_SEMAPHORE_TYPE_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreTypeKHR;
+
+typedef enum VkSemaphoreWaitFlagBitsKHR {
+    VK_SEMAPHORE_WAIT_ANY_BIT_KHR = 0x00000001,
+    VK_SEMAPHORE_WAIT_FLAG_BITS_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreWaitFlagBitsKHR;
+typedef VkFlags VkSemaphoreWaitFlagsKHR;
+
+typedef struct VkPhysicalDeviceTimelineSemaphoreFeaturesKHR {
+    VkStructureType sType;
+    void* pNext;
+    VkBool32 timelineSemaphore;
+} VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+
+typedef struct VkPhysicalDeviceTimelineSemaphorePropertiesKHR {
+    VkStructureType sType;
+    void* pNext;
+    uint64_t maxTimelineSemaphoreValueDifference;
+} VkPhysicalDeviceTimelineSemaphorePropertiesKHR;
+
+typedef struct VkSemaphoreTypeCreateInfoKHR {
+    VkStructureType sType;
+    const void* pNext;
+    VkSemaphoreTypeKHR semaphoreType;
+    uint64_t initialValue;
+} VkSemaphoreTypeCreateInfoKHR;
+
+typedef struct VkTimelineSemaphoreSubmitInfoKHR {
+    VkStructureType sType;
+    const void* pNext;
+    uint32_t waitSemaphoreValueCount;
+    const uint64_t* pWaitSemaphoreValues;
+    uint32_t signalSemaphoreValueCount;
+    const uint64_t* pSignalSemaphoreValues;
+} VkTimelineSemaphoreSubmitInfoKHR;
+
+typedef struct VkSemaphoreWaitInfoKHR {
+    VkStructureType sType;
+    const void* pNext;
+    VkSemaphoreWaitFlagsKHR flags;
+    uint32_t semaphoreCount;
+    const VkSemaphore* pSemaphores;
+    const uint64_t* pValues;
+} VkSemaphoreWaitInfoKHR;
+
+typedef struct VkSemaphoreSignalInfoKHR {
+    VkStructureType sType;
+    const void* pNext;
+    VkSemaphore semaphore;
+    uint64_t value;
+} VkSemaphoreSignalInfoKHR;
+
+typedef VkResult (VKAPI_PTR *PFN_vkGetSemaphoreCounterValueKHR)(VkDevice device, VkSemaphore semaphore, uint64_t* pValue);
+typedef VkResult (VKAPI_PTR *PFN_vkWaitSemaphoresKHR)(VkDevice device, const VkSemaphoreWaitInfoKHR* pWaitInfo, uint64_t timeout);
+typedef VkResult (VKAPI_PTR *PFN_vkSignalSemaphoreKHR)(VkDevice device, const VkSemaphoreSignalInfoKHR* pSignalInfo);
+
+#endif
+
+//Device level entry points, all null when the extension isn't enabled
+struct VulkanTimelineDispatch
+{
+    PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR = nullptr;
+    PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR = nullptr;
+    PFN_vkSignalSemaphoreKHR vkSignalSemaphoreKHR = nullptr;
+
+    bool isSupported() const
+    {
+        return vkGetSemaphoreCounterValueKHR && vkWaitSemaphoresKHR && vkSignalSemaphoreKHR;
+    }
+};
+
+//////////////////////////////////////
+// VK_EXT_extended_dynamic_state
+//////////////////////////////////////
+
+#ifndef VK_EXT_extended_dynamic_state
+#define VK_EXT_extended_dynamic_state 1
+
+#define VK_EXT_EXTENDED_DYNAMIC_STATE_SPEC_VERSION 1
+#define VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME "VK_EXT_extended_dynamic_state"
+
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT ((VkStructureType)1000267000)
+
+#define VK_DYNAMIC_STATE_CULL_MODE_EXT ((VkDynamicState)1000267000)
+#define VK_DYNAMIC_STATE_FRONT_FACE_EXT ((VkDynamicState)1000267001)
+#define VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT ((VkDynamicState)1000267002)
+#define VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT_EXT ((VkDynamicState)1000267003)
+#define VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT_EXT ((VkDynamicState)1000267004)
+#define VK_DYNAMIC_STATE_VERTEX_INPUT_BINDING_STRIDE_EXT ((VkDynamicState)1000267005)
+#define VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT ((VkDynamicState)1000267006)
+#define VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT ((VkDynamicState)1000267007)
+#define VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT ((VkDynamicState)1000267008)
+#define VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE_EXT ((VkDynamicState)1000267009)
+#define VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE_EXT ((VkDynamicState)1000267010)
+#define VK_DYNAMIC_STATE_STENCIL_OP_EXT ((VkDynamicState)1000267011)
+
+typedef struct VkPhysicalDeviceExtendedDynamicStateFeaturesEXT {
+    VkStructureType sType;
+    void* pNext;
+    VkBool32 extendedDynamicState;
+} VkPhysicalDeviceExtendedDynamicStateFeaturesEXT;
+
+typedef void (VKAPI_PTR *PFN_vkCmdSetCullModeEXT)(VkCommandBuffer commandBuffer, VkCullModeFlags cullMode);
+typedef void (VKAPI_PTR *PFN_vkCmdSetFrontFaceEXT)(VkCommandBuffer commandBuffer, VkFrontFace frontFace);
+typedef void (VKAPI_PTR *PFN_vkCmdSetPrimitiveTopologyEXT)(VkCommandBuffer commandBuffer, VkPrimitiveTopology primitiveTopology);
+typedef void (VKAPI_PTR *PFN_vkCmdSetDepthTestEnableEXT)(VkCommandBuffer commandBuffer, VkBool32 depthTestEnable);
+typedef void (VKAPI_PTR *PFN_vkCmdSetDepthWriteEnableEXT)(VkCommandBuffer commandBuffer, VkBool32 depthWriteEnable);
+typedef void (VKAPI_PTR *PFN_vkCmdSetDepthCompareOpEXT)(VkCommandBuffer commandBuffer, VkCompareOp depthCompareOp);
+
+#endif
+
+//Device level entry points, all null when the extension isn't enabled
+struct VulkanExtendedDynamicStateDispatch
+{
+    PFN_vkCmdSetCullModeEXT vkCmdSetCullModeEXT = nullptr;
+    PFN_vkCmdSetFrontFaceEXT vkCmdSetFrontFaceEXT = nullptr;
+    PFN_vkCmdSetPrimitiveTopologyEXT vkCmdSetPrimitiveTopologyEXT = nullptr;
+    PFN_vkCmdSetDepthTestEnableEXT vkCmdSetDepthTestEnableEXT = nullptr;
+    PFN_vkCmdSetDepthWriteEnableEXT vkCmdSetDepthWriteEnableEXT = nullptr;
+
+    bool isSupported() const
+    {
+        return vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT && vkCmdSetPrimitiveTopologyEXT &&
+            vkCmdSetDepthTestEnableEXT && vkCmdSetDepthWriteEnableEXT;
+    }
+};
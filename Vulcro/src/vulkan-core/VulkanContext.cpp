@@ -11,10 +11,31 @@
 #include "VulkanSwapchain.h"
 #include "VulkanBuffer.h"
 #include "VulkanShader.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanLayoutCache.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanPipelineFuture.h"
+#include "VulkanShaderCache.h"
+#include "VulkanPipelineVariantCache.h"
+#include "VulkanRingBuffer.h"
+#include "VulkanUploader.h"
+#include "VulkanQueue.h"
+#include "VulkanWorkerPool.h"
+#include "VulkanFencePool.h"
+#include "VulkanTimeline.h"
+#include "VulkanFrameContext.h"
+#include "VulkanProfiler.h"
+#include "VulkanTracer.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanBindlessHeap.h"
+#include "VulkanStateRecorder.h"
 #include "../vulkan-rtx/RTPipeline.h"
 #include "../vulkan-rtx/RTAccelerationStructure.h"
 #include "../vulkan-rtx/RTScene.h"
 
+#include <algorithm>
+
 VulkanContext::VulkanContext(vk::Instance instance, vk::PhysicalDevice& pDevice, const std::vector<const char *> & deviceExtensions)
 	:_instance(instance),
     _physicalDevice(pDevice)
@@ -23,18 +44,29 @@ VulkanContext::VulkanContext(vk::Instance instance, vk::PhysicalDevice& pDevice,
 	auto qfps = pDevice.getQueueFamilyProperties();
 
 	int familyIndex = -1;
+    int computeFamilyIndex = -1;
+    int transferFamilyIndex = -1;
 
+    // Prefer families that do nothing but the job we want them for, those run alongside graphics
     for (uint32_t i = 0; i < qfps.size(); ++i)
     {
-		if (qfps[i].queueFlags & vk::QueueFlagBits::eGraphics)
-        {
+        auto flags = qfps[i].queueFlags;
 
+		if ((flags & vk::QueueFlagBits::eGraphics) && familyIndex == -1)
+        {
 			familyIndex = i;
-			break;
 		}
+        else if ((flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics) && computeFamilyIndex == -1)
+        {
+            computeFamilyIndex = i;
+        }
+        else if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) && transferFamilyIndex == -1)
+        {
+            transferFamilyIndex = i;
+        }
 	}
 
-    _queueCount = qfps[familyIndex].queueCount;
+    _queueCount = glm::min(qfps[familyIndex].queueCount, MAX_QUEUES_PER_FAMILY);
 
 	_familyIndex = familyIndex;
 
@@ -66,6 +98,65 @@ VulkanContext::VulkanContext(vk::Instance instance, vk::PhysicalDevice& pDevice,
 		addExtensionSafe(ext);
 	}
 
+    // Timeline semaphores are optional, tasks fall back to host waits without them
+    auto timelineFeatures = VkPhysicalDeviceTimelineSemaphoreFeaturesKHR();
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timelineFeatures.timelineSemaphore = VK_FALSE;
+
+    // Update after bind is optional too, VulkanBindlessHeap needs it to register resources while its set is in use
+    auto supportedIndexing = VkPhysicalDeviceDescriptorIndexingFeaturesEXT();
+    supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+    // Extended dynamic state is optional as well, without it VulkanStateRecorder picks a pipeline per state
+    auto dynamicStateFeatures = VkPhysicalDeviceExtendedDynamicStateFeaturesEXT();
+    dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+    dynamicStateFeatures.extendedDynamicState = VK_FALSE;
+
+    auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2>(instance.getProcAddr("vkGetPhysicalDeviceFeatures2"));
+
+    if (getFeatures2)
+    {
+        VkPhysicalDeviceFeatures2 supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported.pNext = &supportedIndexing;
+
+        if (extensionLookup[VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME])
+        {
+            supportedIndexing.pNext = &timelineFeatures;
+        }
+
+        if (extensionLookup[VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME])
+        {
+            dynamicStateFeatures.pNext = supportedIndexing.pNext;
+            supportedIndexing.pNext = &dynamicStateFeatures;
+        }
+
+        getFeatures2(pDevice, &supported);
+
+        timelineFeatures.pNext = nullptr;
+        dynamicStateFeatures.pNext = nullptr;
+    }
+
+    bool enableTimelines = timelineFeatures.timelineSemaphore == VK_TRUE;
+
+    bool enableDynamicState = dynamicStateFeatures.extendedDynamicState == VK_TRUE;
+
+    mUpdateAfterBind =
+        supportedIndexing.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+        supportedIndexing.descriptorBindingStorageImageUpdateAfterBind == VK_TRUE &&
+        supportedIndexing.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+        supportedIndexing.descriptorBindingUpdateUnusedWhilePending == VK_TRUE;
+
+    if (enableTimelines && std::find_if(extensions.begin(), extensions.end(), [](const char * ext) { return std::string(ext) == VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME; }) == extensions.end())
+    {
+        extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+
+    if (enableDynamicState && std::find_if(extensions.begin(), extensions.end(), [](const char * ext) { return std::string(ext) == VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME; }) == extensions.end())
+    {
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+    }
+
     auto features = vk::PhysicalDeviceFeatures();
 
 	features.setTessellationShader(true);
@@ -84,22 +175,51 @@ VulkanContext::VulkanContext(vk::Instance instance, vk::PhysicalDevice& pDevice,
     indexingFeatures.setDescriptorBindingVariableDescriptorCount(true);
     indexingFeatures.setShaderStorageTexelBufferArrayDynamicIndexing(true);
 
-    indexingFeatures.setPNext(nullptr);
+    if (mUpdateAfterBind)
+    {
+        indexingFeatures.setDescriptorBindingSampledImageUpdateAfterBind(true);
+        indexingFeatures.setDescriptorBindingStorageImageUpdateAfterBind(true);
+        indexingFeatures.setDescriptorBindingStorageBufferUpdateAfterBind(true);
+        indexingFeatures.setDescriptorBindingUpdateUnusedWhilePending(true);
+    }
+
+    indexingFeatures.setPNext(enableTimelines ? &timelineFeatures : nullptr);
+
+    if (enableDynamicState)
+    {
+        dynamicStateFeatures.pNext = indexingFeatures.pNext;
+        indexingFeatures.setPNext(&dynamicStateFeatures);
+    }
 
 
     features2.setPNext(&indexingFeatures);
 
 
-	float qpriors[1] = { 0.0f };
+	float qpriors[MAX_QUEUES_PER_FAMILY] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    std::vector<vk::DeviceQueueCreateInfo> devQs;
+
+    devQs.push_back(vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), familyIndex, _queueCount, qpriors));
+
+    uint32_t computeQueueCount = 0;
+
+    if (computeFamilyIndex != -1)
+    {
+        computeQueueCount = glm::min(qfps[computeFamilyIndex].queueCount, MAX_QUEUES_PER_FAMILY);
+        devQs.push_back(vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), computeFamilyIndex, computeQueueCount, qpriors));
+    }
 
-	auto devQ = vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), familyIndex, 1, qpriors);
+    if (transferFamilyIndex != -1)
+    {
+        devQs.push_back(vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), transferFamilyIndex, 1, qpriors));
+    }
 
     vk::DeviceCreateInfo devCreateInfo;
     devCreateInfo.flags = vk::DeviceCreateFlags();
     devCreateInfo.pNext = &features2;
     devCreateInfo.enabledLayerCount = 0;
-    devCreateInfo.queueCreateInfoCount = 1;
-    devCreateInfo.pQueueCreateInfos = &devQ;
+    devCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(devQs.size());
+    devCreateInfo.pQueueCreateInfos = devQs.data();
     devCreateInfo.ppEnabledLayerNames = nullptr;
     devCreateInfo.enabledExtensionCount = extensions.size();
     devCreateInfo.ppEnabledExtensionNames = &extensions[0];
@@ -111,6 +231,20 @@ VulkanContext::VulkanContext(vk::Instance instance, vk::PhysicalDevice& pDevice,
     
     mPhysicalDeviceProperties = pDevice.getProperties();
 
+    mAllocator.reset(new VulkanMemoryAllocator(this));
+
+    mDescriptorAllocator.reset(new VulkanDescriptorAllocator(this));
+
+    mLayoutCache.reset(new VulkanLayoutCache(this));
+
+    mPipelineCache = makePipelineCache(VulkanPipelineCache::DEFAULT_PATH);
+
+    mShaderCache.reset(new VulkanShaderCache(this));
+
+    mPipelineVariantCache.reset(new VulkanPipelineVariantCache(this));
+
+    mFencePool.reset(new VulkanFencePool(this));
+
     /*
     vk::DynamicLoader         dl;
     PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr =
@@ -123,14 +257,46 @@ VulkanContext::VulkanContext(vk::Instance instance, vk::PhysicalDevice& pDevice,
 
     _dynamicDispatch = new vk::DispatchLoaderDynamic(_instance, _device);
 
-    //_queue = _device.getQueue(familyIndex, 0);
-    _queues.resize(_queueCount);
+    if (enableTimelines)
+    {
+        mTimelineDispatch.vkGetSemaphoreCounterValueKHR = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(_device.getProcAddr("vkGetSemaphoreCounterValueKHR"));
+        mTimelineDispatch.vkWaitSemaphoresKHR = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(_device.getProcAddr("vkWaitSemaphoresKHR"));
+        mTimelineDispatch.vkSignalSemaphoreKHR = reinterpret_cast<PFN_vkSignalSemaphoreKHR>(_device.getProcAddr("vkSignalSemaphoreKHR"));
+    }
+
+    if (enableDynamicState)
+    {
+        mExtendedDynamicStateDispatch.vkCmdSetCullModeEXT = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(_device.getProcAddr("vkCmdSetCullModeEXT"));
+        mExtendedDynamicStateDispatch.vkCmdSetFrontFaceEXT = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(_device.getProcAddr("vkCmdSetFrontFaceEXT"));
+        mExtendedDynamicStateDispatch.vkCmdSetPrimitiveTopologyEXT = reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(_device.getProcAddr("vkCmdSetPrimitiveTopologyEXT"));
+        mExtendedDynamicStateDispatch.vkCmdSetDepthTestEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(_device.getProcAddr("vkCmdSetDepthTestEnableEXT"));
+        mExtendedDynamicStateDispatch.vkCmdSetDepthWriteEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(_device.getProcAddr("vkCmdSetDepthWriteEnableEXT"));
+    }
+
+    auto & graphicsQueues = mQueues[static_cast<int>(VulkanQueueType::GRAPHICS)];
+    auto & computeQueues = mQueues[static_cast<int>(VulkanQueueType::COMPUTE)];
+    auto & transferQueues = mQueues[static_cast<int>(VulkanQueueType::TRANSFER)];
+
+    for (uint32_t i = 0; i < _queueCount; i++)
+    {
+        graphicsQueues.emplace_back(new VulkanQueue(this, VulkanQueueType::GRAPHICS, familyIndex, i));
+    }
+
+    // Queue types without a family of their own share the queues (and locks) of a more capable type
+    for (uint32_t i = 0; i < computeQueueCount; i++)
+    {
+        computeQueues.emplace_back(new VulkanQueue(this, VulkanQueueType::COMPUTE, computeFamilyIndex, i));
+    }
 
-    for (int i = 0; i < _queueCount; i++)
+    if (transferFamilyIndex != -1)
     {
-        _queues[i] = _device.getQueue(familyIndex, 0);
+        transferQueues.emplace_back(new VulkanQueue(this, VulkanQueueType::TRANSFER, transferFamilyIndex, 0));
     }
 
+#ifdef VULCRO_PRINT_ALLOCATIONS
+    printf("Queue families: graphics %d (%u queues), compute %d, transfer %d\n", familyIndex, _queueCount, computeFamilyIndex, transferFamilyIndex);
+#endif
+
     getLinearSampler();
     getShadowSampler();
     getNearestSampler();
@@ -140,7 +306,7 @@ vk::Sampler const & VulkanContext::getShadowSampler() {
 
     if (!_shadowSampler) {
 
-        _shadowSampler = getDevice().createSampler(
+        _shadowSampler = mLayoutCache->getSampler(
             vk::SamplerCreateInfo(
                 vk::SamplerCreateFlags(),
                 vk::Filter::eLinear, //Mag Filter
@@ -191,21 +357,51 @@ vk::Sampler const & VulkanContext::getNearestSampler()
 
 VulkanContext::~VulkanContext()
 {
-	if (_linearSampler) getDevice().destroySampler(_linearSampler);
-	if (_nearestSampler) getDevice().destroySampler(_nearestSampler);
-	if (_shadowSampler) getDevice().destroySampler(_shadowSampler);
+    mWorkerPool = nullptr;
+
+    // After the workers, nothing is left compiling into it
+    mPipelineVariantCache = nullptr;
+
+    mUploader = nullptr;
 
     mOneTimePool = nullptr;
 
+    mTransientRing = nullptr;
+
+    // Saves the cache to disk
+    mPipelineCache = nullptr;
+
+    mShaderCache = nullptr;
+
+    // Cached set layouts go before the allocator owning their descriptor layouts, samplers and pipeline layouts with them
+    mLayoutCache = nullptr;
+
+    mDescriptorAllocator = nullptr;
+
+    // Freed descriptor sets are tagged with its submission serials, so it outlives the descriptor allocator
+    mFencePool = nullptr;
+
+    mAllocator = nullptr;
+
+    for (auto & queues : mQueues)
+    {
+        queues.clear();
+    }
+
 	_device.destroy();
 	
 	delete _dynamicDispatch;
 
 }
 
+vk::Sampler VulkanContext::getSampler(vk::SamplerCreateInfo const & info)
+{
+    return mLayoutCache->getSampler(info);
+}
+
 vk::Sampler VulkanContext::createSampler2D(vk::Filter filter)
 {
-    return getDevice().createSampler(
+    return mLayoutCache->getSampler(
         vk::SamplerCreateInfo(
             vk::SamplerCreateFlags(),
             filter, //Mag Filter
@@ -234,79 +430,176 @@ vk::Sampler VulkanContext::createSampler2D(vk::Filter filter)
 
 
 
-VulkanSetLayoutRef VulkanContext::makeSetLayout(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t maxSets)
+VulkanSetLayoutRef VulkanContext::makeSetLayout(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t maxSets, bool updateAfterBind)
 {
-	return make_shared<VulkanSetLayout>(this, bindings, maxSets);
+    VULCRO_TRACE_FUNCTION();
+
+	return mLayoutCache->getSetLayout(bindings, maxSets, updateAfterBind);
 }
 
 shared_ptr<VulkanVertexLayout> VulkanContext::makeVertexLayout(vk::ArrayProxy<const vk::Format> fields)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanVertexLayout>(fields);
 }
 
 shared_ptr<VulkanRenderer> VulkanContext::makeRenderer()
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanRenderer>(this);
 }
 
 shared_ptr<VulkanRenderPipeline> VulkanContext::makePipeline(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
 	vector<ColorBlendConfig> colorBlendConfigs, uint32_t pushConstantSize)
 {
-	return make_shared<VulkanRenderPipeline>(this, shader, renderer, config, colorBlendConfigs, pushConstantSize);
+    VULCRO_TRACE_FUNCTION();
+
+	return mPipelineVariantCache->getPipeline(shader, renderer, config, colorBlendConfigs, pushConstantSize);
 }
 
-VulkanComputePipelineRef VulkanContext::makeComputePipeline(VulkanShaderRef shader, uint32_t pushConstantSize)
+VulkanComputePipelineRef VulkanContext::makeComputePipeline(VulkanShaderRef shader, uint32_t pushConstantSize, VulkanSpecialization const & specialization)
 {
-	return make_shared<VulkanComputePipeline>(this, shader, pushConstantSize);
+    VULCRO_TRACE_FUNCTION();
+
+	return mPipelineVariantCache->getComputePipeline(specialization.empty() ? shader : shader->specialize(specialization), pushConstantSize);
 }
 
-VulkanComputePipelineRef VulkanContext::makeComputePipeline(const char * computePath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, uint32_t pushConstantSize)
+VulkanComputePipelineRef VulkanContext::makeComputePipeline(const char * computePath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, uint32_t pushConstantSize, VulkanSpecialization const & specialization)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return makeComputePipeline(
-		makeComputeShader(computePath, setLayouts), pushConstantSize
+		makeComputeShader(computePath, setLayouts, specialization), pushConstantSize
 	);
 }
 
+VulkanRenderPipelineFuture VulkanContext::makePipelineAsync(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config, vector<ColorBlendConfig> colorBlendConfigs, uint32_t pushConstantSize)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return mPipelineVariantCache->getPipelineAsync(shader, renderer, config, colorBlendConfigs, pushConstantSize);
+}
+
+VulkanComputePipelineFuture VulkanContext::makeComputePipelineAsync(VulkanShaderRef shader, uint32_t pushConstantSize, VulkanSpecialization const & specialization)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    // Variants are looked up here, the shader isn't touched from the worker
+    if (!specialization.empty()) shader = shader->specialize(specialization);
+
+    return mPipelineVariantCache->getComputePipelineAsync(shader, pushConstantSize);
+}
+
 
 VulkanSwapchainRef VulkanContext::makeSwapchain(vk::SurfaceKHR surface)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanSwapchain>(this, surface);
 }
 
-VulkanShaderRef VulkanContext::makeShader(const char * vertPath, const char * fragPath, vk::ArrayProxy<const VulkanVertexLayoutRef>vertexLayouts, vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts)
+VulkanFrameContextRef VulkanContext::makeFrameContext(VulkanSwapchainRef swapchain, uint32_t framesInFlight)
 {
-	return make_shared<VulkanShader>(this, vertPath, fragPath, vertexLayouts, uniformLayouts);
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanFrameContext>(this, swapchain, framesInFlight);
 }
 
-VulkanShaderRef VulkanContext::makeTessShader(const char * vertPath, const char * tessControlPath, const char * tessEvalPath, const char * tessGeomPath, const char * fragPath, vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts, vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts)
+VulkanProfilerRef VulkanContext::makeProfiler(uint32_t framesInFlight, uint32_t maxRegionsPerFrame)
 {
-	return make_shared<VulkanShader>(this, vertPath, tessControlPath, tessEvalPath, tessGeomPath, fragPath, vertexLayouts, uniformLayouts);
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanProfiler>(this, framesInFlight, maxRegionsPerFrame);
 }
 
-VulkanShaderRef VulkanContext::makeComputeShader(const char * computePath, vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts)
+VulkanRenderGraphRef VulkanContext::makeRenderGraph()
 {
-	return make_shared<VulkanShader>(this, computePath, uniformLayouts);
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanRenderGraph>(this);
+}
+
+VulkanPipelineCacheRef VulkanContext::makePipelineCache(std::string path)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanPipelineCache>(this, path);
+}
+
+VulkanBindlessHeapRef VulkanContext::makeBindlessHeap()
+{
+    return makeBindlessHeap(
+        VulkanBindlessHeap::DEFAULT_MAX_SAMPLED_IMAGES,
+        VulkanBindlessHeap::DEFAULT_MAX_STORAGE_IMAGES,
+        VulkanBindlessHeap::DEFAULT_MAX_STORAGE_BUFFERS
+    );
+}
+
+VulkanBindlessHeapRef VulkanContext::makeBindlessHeap(uint32_t maxSampledImages, uint32_t maxStorageImages, uint32_t maxStorageBuffers)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanBindlessHeap>(this, maxSampledImages, maxStorageImages, maxStorageBuffers);
+}
+
+VulkanStateRecorderRef VulkanContext::makeStateRecorder(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
+    vector<ColorBlendConfig> colorBlendConfigs, uint32_t pushConstantSize)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanStateRecorder>(this, shader, renderer, config, colorBlendConfigs, pushConstantSize);
+}
+
+VulkanShaderRef VulkanContext::makeShader(const char * vertPath, const char * fragPath, vk::ArrayProxy<const VulkanVertexLayoutRef>vertexLayouts, vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts, VulkanSpecialization const & specialization)
+{
+    VULCRO_TRACE_FUNCTION();
+
+	return make_shared<VulkanShader>(this, vertPath, fragPath, vertexLayouts, uniformLayouts, specialization);
+}
+
+VulkanShaderRef VulkanContext::makeTessShader(const char * vertPath, const char * tessControlPath, const char * tessEvalPath, const char * tessGeomPath, const char * fragPath, vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts, vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts, VulkanSpecialization const & specialization)
+{
+    VULCRO_TRACE_FUNCTION();
+
+	return make_shared<VulkanShader>(this, vertPath, tessControlPath, tessEvalPath, tessGeomPath, fragPath, vertexLayouts, uniformLayouts, specialization);
+}
+
+VulkanShaderRef VulkanContext::makeComputeShader(const char * computePath, vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts, VulkanSpecialization const & specialization)
+{
+    VULCRO_TRACE_FUNCTION();
+
+	return make_shared<VulkanShader>(this, computePath, uniformLayouts, specialization);
 }
 
 
 shared_ptr<ibo> VulkanContext::makeIBO(vk::ArrayProxy<const VulkanBuffer::IndexType> indices)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<ibo>(this, indices);
 
 }
 
 shared_ptr<ibo> VulkanContext::makeIBO(shared_ptr<ibo> sourceIbo, uint32_t indexOffset, uint32_t numIndices)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<ibo>(sourceIbo, indexOffset, numIndices);
 }
 
 VulkanBufferRef VulkanContext::makeBuffer(vk::BufferUsageFlags usage, uint64_t size, vk::MemoryPropertyFlags flags, void * data)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanBuffer>(this, usage, size, flags, data);
 }
 
 VulkanBufferRef VulkanContext::makeDeviceBuffer(vk::BufferUsageFlags usage, uint64_t size, void * data)
 {
+    VULCRO_TRACE_FUNCTION();
+
     // If no data needs to be staged then just create the buffer
 	if (data == nullptr)
     {
@@ -317,23 +610,9 @@ VulkanBufferRef VulkanContext::makeDeviceBuffer(vk::BufferUsageFlags usage, uint
     // so that we can target this buffer as the destination when copying from the staging buffer.
     auto buffer = makeBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, size, VulkanBuffer::CPU_NEVER);
 
-    // Create a staging buffer that's cpu accessible, we'll use this buffer to copy our initial data into the
-    // gpu only buffer
-    auto staging = makeBuffer(vk::BufferUsageFlagBits::eTransferSrc, size, VulkanBuffer::CPU_ALOT, data);
-
-    // A config describing the copy command, we'll be copying thfrom the start of data into the start
-    // of the new buffer
-    auto BufferCopy = vk::BufferCopy(0, 0, size);
-
-    // Create a new task and record our copy command
-    auto task = makeTask();
-    task->record([&](vk::CommandBuffer* cmd)
-    {
-        cmd->copyBuffer(staging->getBuffer(), buffer->getBuffer(), { BufferCopy });
-    });
-
-    // Execute the copy task
-    task->execute(true);
+    // Stage the data through the uploader, the copy is batched with other uploads and
+    // submitted before the next task executes, so the buffer can be returned right away
+    getUploader()->uploadBuffer(buffer.get(), data, size, 0, buffer);
 
     return buffer;
 }
@@ -341,35 +620,147 @@ VulkanBufferRef VulkanContext::makeDeviceBuffer(vk::BufferUsageFlags usage, uint
 
 VulkanBufferRef VulkanContext::makeStagingBuffer(vk::BufferUsageFlags usage, uint64_t sizeBytes, void* data)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return makeBuffer(usage | vk::BufferUsageFlagBits::eTransferSrc, sizeBytes, VulkanBuffer::CPU_ALOT, data);
 }
 
 
 VulkanBufferRef VulkanContext::makeStagingStorageBuffer(uint64_t sizeBytes, void * data)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return makeBuffer(VulkanBuffer::TRANSFER_SRC_STORAGE_BUFFER, sizeBytes, VulkanBuffer::CPU_ALOT);
 }
 
 VulkanBufferRef VulkanContext::makeDeviceStorageBuffer(uint64_t size, void * data)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return makeDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, size, data);
 }
 
+vk::Queue & VulkanContext::getQueue(uint32_t queueIndex)
+{
+    return getQueue(VulkanQueueType::GRAPHICS, queueIndex)->getQueue();
+}
+
+VulkanQueue * VulkanContext::getQueue(VulkanQueueType type, uint32_t queueIndex)
+{
+    // Fall back to the next more capable queue type when this one has no family of its own
+    while (mQueues[static_cast<int>(type)].empty())
+    {
+        type = type == VulkanQueueType::TRANSFER ? VulkanQueueType::COMPUTE : VulkanQueueType::GRAPHICS;
+    }
+
+    auto & queues = mQueues[static_cast<int>(type)];
+
+    return queues[queueIndex % queues.size()].get();
+}
+
+uint32_t VulkanContext::getQueueCount(VulkanQueueType type)
+{
+    auto & queues = mQueues[static_cast<int>(type)];
+
+    return queues.empty() ? getQueueCount(type == VulkanQueueType::TRANSFER ? VulkanQueueType::COMPUTE : VulkanQueueType::GRAPHICS) : static_cast<uint32_t>(queues.size());
+}
+
+VulkanUploader * VulkanContext::getUploader()
+{
+    if (mUploader == nullptr)
+    {
+        mUploader.reset(new VulkanUploader(this));
+    }
+
+    return mUploader.get();
+}
+
+VulkanWorkerPool * VulkanContext::getWorkerPool()
+{
+    if (mWorkerPool == nullptr)
+    {
+        mWorkerPool.reset(new VulkanWorkerPool());
+    }
+
+    return mWorkerPool.get();
+}
+
+void VulkanContext::flushUploads()
+{
+    if (mUploader != nullptr)
+    {
+        mUploader->flush();
+    }
+}
+
+void VulkanContext::flushDescriptorWrites()
+{
+    std::lock_guard<std::mutex> lock(mPendingSetsMutex);
+
+    if (mPendingSets.empty()) return;
+
+    VulkanSet::update(mPendingSets);
+
+    for (auto * set : mPendingSets)
+    {
+        set->_queued = false;
+    }
+
+    mPendingSets.clear();
+}
+
+void VulkanContext::queueDescriptorWrites(VulkanSet * set)
+{
+    std::lock_guard<std::mutex> lock(mPendingSetsMutex);
+
+    mPendingSets.push_back(set);
+}
+
+void VulkanContext::cancelDescriptorWrites(VulkanSet * set)
+{
+    std::lock_guard<std::mutex> lock(mPendingSetsMutex);
+
+    mPendingSets.erase(std::remove(mPendingSets.begin(), mPendingSets.end(), set), mPendingSets.end());
+}
+
+VulkanRingBufferRef VulkanContext::makeRingBuffer(uint64_t frameSize, uint32_t framesInFlight)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanRingBuffer>(this, frameSize, framesInFlight);
+}
+
+VulkanRingBufferRef VulkanContext::getTransientRing()
+{
+    if (mTransientRing == nullptr)
+    {
+        mTransientRing = makeRingBuffer(VulkanRingBuffer::DEFAULT_FRAME_SIZE, VulkanRingBuffer::DEFAULT_FRAMES_IN_FLIGHT);
+    }
+
+    return mTransientRing;
+}
+
 
 
 VulkanSetRef VulkanContext::makeSet(VulkanSetLayoutRef layout)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanSet>(this, layout);
 }
 
 VulkanSetRef VulkanContext::makeSet(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanSet>(this, VulkanContext::makeSetLayout(bindings));
 
 }
 
 VulkanTaskRef VulkanContext::makeTask()
 {
+    VULCRO_TRACE_FUNCTION();
+
 
     if (mOneTimePool == nullptr)
     {
@@ -381,6 +772,8 @@ VulkanTaskRef VulkanContext::makeTask()
 
 VulkanTaskGroupRef VulkanContext::makeTaskGroup(uint32_t numTasks)
 {
+    VULCRO_TRACE_FUNCTION();
+
     if (mOneTimePool == nullptr)
     {
         mOneTimePool = makeTaskPool(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
@@ -391,22 +784,98 @@ VulkanTaskGroupRef VulkanContext::makeTaskGroup(uint32_t numTasks)
 
 VulkanTaskGroupRef VulkanContext::makeTaskGroup(uint32_t numTasks, VulkanTaskPoolRef pool)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return VulkanTaskGroupRef(new VulkanTaskGroup(this, numTasks, pool));
 }
 
-VulkanTaskPoolRef VulkanContext::makeTaskPool(vk::CommandPoolCreateFlags createFlags)
+VulkanTimelineRef VulkanContext::makeTimeline(uint64_t initialValue)
 {
-    return VulkanTaskPoolRef(new VulkanTaskPool(this, createFlags));
+    VULCRO_TRACE_FUNCTION();
+
+    return make_shared<VulkanTimeline>(this, initialValue);
+}
+
+VulkanCompletion VulkanContext::submit(vk::ArrayProxy<const VulkanTaskRef> tasks, bool blockUntilFinished)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    flushUploads();
+
+    mFencePool->collect();
+
+    VulkanCompletion last;
+    vector<VulkanCompletion> completions;
+
+    // Emulated timelines wait on the host, which only works once the signaling task is already submitted
+    size_t maxBatch = supportsTimelineSemaphores() ? tasks.size() : 1;
+
+    auto * it = tasks.begin();
+
+    while (it != tasks.end())
+    {
+        auto * queue = (*it)->getQueue();
+
+        auto * batchEnd = it;
+        while (batchEnd != tasks.end() && (*batchEnd)->getQueue() == queue && static_cast<size_t>(batchEnd - it) < maxBatch)
+        {
+            batchEnd++;
+        }
+
+        // SubmitInfos point into their submission, which must not move until the queue submit
+        vector<VulkanSubmission> submissions(batchEnd - it);
+        vector<vk::SubmitInfo> infos;
+        infos.reserve(submissions.size());
+
+        for (size_t i = 0; i < submissions.size(); i++)
+        {
+            it[i]->prepareSubmission(submissions[i]);
+            infos.push_back(submissions[i].build(&it[i]->getCommandBuffer()));
+        }
+
+        auto fence = mFencePool->acquire();
+
+        queue->submit(infos, fence);
+
+        last = mFencePool->track(fence);
+        completions.push_back(last);
+
+        for (; it != batchEnd; it++)
+        {
+            (*it)->onSubmitted(last);
+        }
+    }
+
+    if (blockUntilFinished)
+    {
+        for (auto & completion : completions)
+        {
+            completion.wait();
+        }
+    }
+
+    return last;
+}
+
+VulkanTaskPoolRef VulkanContext::makeTaskPool(vk::CommandPoolCreateFlags createFlags, VulkanQueueType queueType)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return VulkanTaskPoolRef(new VulkanTaskPool(this, createFlags, queueType));
 }
 
 VulkanTaskRef VulkanContext::makeTask(VulkanTaskPoolRef taskPool)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return VulkanTaskRef(new VulkanTask(this, taskPool));
 }
 
 
 VulkanImage1DRef VulkanContext::makeImage1D(vk::ImageUsageFlags usage, vk::Format format, float size)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	auto r = make_shared<VulkanImage1D>(this, usage, format, size);
 	r->setSampler(getNearestSampler());
 	return r;
@@ -414,11 +883,15 @@ VulkanImage1DRef VulkanContext::makeImage1D(vk::ImageUsageFlags usage, vk::Forma
 
 VulkanImage1DRef VulkanContext::makeImage1D(vk::Image image, vk::Format format, float size)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanImage1D>(this, image, format, size);
 }
 
 VulkanImage2DRef VulkanContext::makeImage2D(vk::ImageUsageFlags usage, vk::Format format, glm::uvec2 size, vk::MemoryPropertyFlags memFlags)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	auto r = make_shared<VulkanImage2D>(this, usage, format, size, memFlags);
 	r->setSampler(getNearestSampler());
 	return r;
@@ -426,6 +899,8 @@ VulkanImage2DRef VulkanContext::makeImage2D(vk::ImageUsageFlags usage, vk::Forma
 
 VulkanImage2DRef VulkanContext::makeImage2D(vk::ImageUsageFlags usage, vk::Format format, glm::uvec2 size, uint16_t mipLevels, vk::MemoryPropertyFlags memFlags)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	auto r = make_shared<VulkanImage2D>(this, usage, format, size, mipLevels, memFlags);
 	r->setSampler(getNearestSampler());
 	return r;
@@ -433,16 +908,20 @@ VulkanImage2DRef VulkanContext::makeImage2D(vk::ImageUsageFlags usage, vk::Forma
 
 VulkanImage2DRef VulkanContext::makeImage2D(vk::Image image, vk::Format format, glm::uvec2 size, uint16_t mipLevels)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanImage2D>(this, image, format, size);
 }
 
 VulkanImage2DRef VulkanContext::makeTexture2D_RGBA(glm::uvec2 size, uint16_t mipLevels, void * pixelData)
 {
+    VULCRO_TRACE_FUNCTION();
+
     auto res = makeImage2D(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, vk::Format::eR8G8B8A8Unorm, size, mipLevels);
 
     if (pixelData)
     {
-        res->loadFromMemory(pixelData, size.x * size.y * sizeof(uint8_t) * 4);
+        getUploader()->uploadImage(res.get(), pixelData, size.x * size.y * sizeof(uint8_t) * 4, res);
     }
 
     return res;
@@ -450,6 +929,8 @@ VulkanImage2DRef VulkanContext::makeTexture2D_RGBA(glm::uvec2 size, uint16_t mip
 
 VulkanImage3DRef VulkanContext::makeImage3D(vk::ImageUsageFlags usage, vk::Format format, glm::uvec3 size)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	auto r = make_shared<VulkanImage3D>(this, usage, format, size);
 	r->setSampler(getNearestSampler());
 	return r;
@@ -457,55 +938,86 @@ VulkanImage3DRef VulkanContext::makeImage3D(vk::ImageUsageFlags usage, vk::Forma
 
 VulkanImage3DRef VulkanContext::makeImage3D(vk::Image image, vk::Format format, glm::uvec3 size)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanImage3D>(this, image, format, size);
 }
 
 VulkanImageCubeRef VulkanContext::makeImageCube(vk::ImageUsageFlags usage, glm::uvec2 size, vk::Format format)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<VulkanImageCube>(this, usage, size, format);
 }
 
 RTBlasRepoRef VulkanContext::makeRayTracingBlasRepo()
 {
+    VULCRO_TRACE_FUNCTION();
+
     return RTBlasRepoRef(new RTBlasRepo(this));
 }
 
 RTGeometryRef VulkanContext::makeRayTracingGeometry(iboRef indexBuffer, vboRef vertexBuffer)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<RTGeometry>(indexBuffer, vertexBuffer);
 }
 
 RTGeometryRef VulkanContext::makeRayTracingGeometry(uint64_t aabbCount, uint64_t aabbOffset, VulkanBufferRef aabbBuffer)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return make_shared<RTGeometry>(aabbCount, aabbOffset, aabbBuffer);
 }
 
 RTGeometryRef VulkanContext::makeRayTracingGeometry(VulkanBufferRef vertexBuffer, uint64_t vertexCount, uint32_t vertexStride, uint32_t positionOffset, vk::Format positionFormat)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return make_shared<RTGeometry>(vertexBuffer, vertexCount, vertexStride, positionOffset, positionFormat);
 }
 
-shared_ptr<RTShaderBuilder> VulkanContext::makeRayTracingShaderBuilder(const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts)
+shared_ptr<RTShaderBuilder> VulkanContext::makeRayTracingShaderBuilder(const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, VulkanSpecialization const & specialization)
 {
-	return make_shared<RTShaderBuilder>(this, raygenPath, setLayouts);
+    VULCRO_TRACE_FUNCTION();
+
+	return make_shared<RTShaderBuilder>(this, raygenPath, setLayouts, specialization);
 }
 
 shared_ptr<RTPipeline> VulkanContext::makeRayTracingPipeline(RTShaderBuilderRef shader)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<RTPipeline>(this, shader);
 }
 
+RTPipelineFuture VulkanContext::makeRayTracingPipelineAsync(RTShaderBuilderRef shader)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    return RTPipelineFuture::compile(this, [=]() {
+        return make_shared<RTPipeline>(this, shader);
+    });
+}
+
 shared_ptr<RTScene> VulkanContext::makeRayTracingScene()
 {
+    VULCRO_TRACE_FUNCTION();
+
 	return make_shared<RTScene>(this);
 }
 
 shared_ptr<RTScene> VulkanContext::makeRayTracingScene(RTBlasRepoRef geoRepoRef)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return shared_ptr<RTScene>(new RTScene(this, geoRepoRef));
 }
 
 RTTopStructureManagerRef VulkanContext::makeRayTracingTopStructureManager(uint32_t numInstances)
 {
+    VULCRO_TRACE_FUNCTION();
+
     return RTTopStructureManagerRef(new RTTopStructureManager(this, numInstances));
 }
\ No newline at end of file
@@ -2,8 +2,11 @@
 
 #include "General.h"
 #include <unordered_map>
+#include <mutex>
 #include <vulkan/vulkan.hpp>
 #include "../VulcroTypes.h"
+#include "VulkanCompat.h"
+#include "VulkanSpecialization.h"
 
 struct VulkanSetLayoutBinding {
 
@@ -61,6 +64,14 @@ struct PipelineConfig {
     uint32_t patchCount = 3;
     vk::CullModeFlags cullFlags = vk::CullModeFlagBits::eBack;
     vk::FrontFace frontFace = vk::FrontFace::eCounterClockwise;
+
+    //Ignored without a depth buffer
+    bool depthTest = true;
+    bool depthWrite = true;
+
+    //Where supported, cull mode, front face, depth test / write and topology within its class are set on the command buffer
+    //instead of baked, see VulkanStateRecorder. Such pipelines draw nothing sensible until that state is recorded
+    bool dynamicState = false;
 };
 
 enum VulkanColorBlend {
@@ -148,25 +159,55 @@ public:
 	const vk::Device &getDevice() { return _device; }
 	const vk::PhysicalDevice &getPhysicalDevice() { return _physicalDevice; }
 
-	vk::Queue &getQueue(uint32_t queueIndex = 0) {
-		
-        return _queues[0];
-        //return getDevice().getQueue(_familyIndex, queueIndex);
+	//Raw graphics queue, prefer getQueue(VulkanQueueType) which locks around submits
+	vk::Queue &getQueue(uint32_t queueIndex = 0);
 
-	}
+    VulkanQueue * getQueue(VulkanQueueType type, uint32_t queueIndex = 0);
+
+    uint32_t getQueueCount(VulkanQueueType type);
 
 	VulkanVertexLayoutRef makeVertexLayout(vk::ArrayProxy<const vk::Format> fields);
 	VulkanRendererRef makeRenderer();
 
+	//Pipelines come from the variant cache, identical state returns the same pipeline.
+	//The cache holds the shader and renderer until VulkanPipelineVariantCache::trim evicts the pipeline, see getPipelineVariantCache
 	VulkanRenderPipelineRef makePipeline(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config = PipelineConfig(), 
 		vector<ColorBlendConfig> colorBlendConfigs = {}, uint32_t pushConstantSize = 0
 	);
 
-	VulkanComputePipelineRef makeComputePipeline(VulkanShaderRef shader, uint32_t pushConstantSize = 0);
-	VulkanComputePipelineRef makeComputePipeline(const char * shaderPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, uint32_t pushConstantSize = 0);
+	//A specialization compiles the shader's variant with those constants, see VulkanShader::specialize
+	VulkanComputePipelineRef makeComputePipeline(VulkanShaderRef shader, uint32_t pushConstantSize = 0, VulkanSpecialization const & specialization = VulkanSpecialization());
+	VulkanComputePipelineRef makeComputePipeline(const char * shaderPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, uint32_t pushConstantSize = 0, VulkanSpecialization const & specialization = VulkanSpecialization());
+
+	//Compile on the worker pool, see VulkanPipelineFuture. Shaders are loaded by the caller, only the driver compile runs in the background
+	VulkanRenderPipelineFuture makePipelineAsync(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config = PipelineConfig(),
+		vector<ColorBlendConfig> colorBlendConfigs = {}, uint32_t pushConstantSize = 0
+	);
+
+	VulkanComputePipelineFuture makeComputePipelineAsync(VulkanShaderRef shader, uint32_t pushConstantSize = 0, VulkanSpecialization const & specialization = VulkanSpecialization());
 
 	VulkanSwapchainRef makeSwapchain(vk::SurfaceKHR surface);
 
+	//Per frame command buffers, semaphores and transient memory so consecutive frames overlap
+	VulkanFrameContextRef makeFrameContext(VulkanSwapchainRef swapchain, uint32_t framesInFlight = 2);
+
+	//GPU timestamps for regions of command buffers, results trail by framesInFlight frames
+	VulkanProfilerRef makeProfiler(uint32_t framesInFlight = 3, uint32_t maxRegionsPerFrame = 256);
+
+	//Passes with declared reads / writes, aliased transient images and automatic barriers
+	VulkanRenderGraphRef makeRenderGraph();
+
+	//Pipeline cache stored at path, see VulkanPipelineCache. An empty path keeps it in memory
+	VulkanPipelineCacheRef makePipelineCache(std::string path = "");
+
+	//Set of every registered image and buffer, indexed by handle in shaders. Without counts it takes VulkanBindlessHeap's defaults
+	VulkanBindlessHeapRef makeBindlessHeap();
+	VulkanBindlessHeapRef makeBindlessHeap(uint32_t maxSampledImages, uint32_t maxStorageImages, uint32_t maxStorageBuffers);
+
+	//Cull, front face, topology and depth state set between draws, on one pipeline where extended dynamic state is supported
+	VulkanStateRecorderRef makeStateRecorder(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config = PipelineConfig(),
+		vector<ColorBlendConfig> colorBlendConfigs = {}, uint32_t pushConstantSize = 0);
+
     
     res<uint32_t, VulcroError> getBestMemoryIndex(vk::MemoryRequirements memReqs, vk::MemoryPropertyFlags memFlags)
     {
@@ -191,10 +232,12 @@ public:
         Shaders
     ****************************/
 
+	//Layouts left empty are reflected from the SPIR-V
 	VulkanShaderRef makeShader(const char * vertPath,
 		const char * fragPath,
-		vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts,
-		vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts = {});
+		vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts = {},
+		vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts = {},
+		VulkanSpecialization const & specialization = VulkanSpecialization());
 
 	VulkanShaderRef makeTessShader(
 		const char * vertPath,
@@ -203,19 +246,22 @@ public:
 		const char * tessGeomPath,
 		const char * fragPath,
 		vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts = {},
-		vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts = {}
+		vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts = {},
+		VulkanSpecialization const & specialization = VulkanSpecialization()
 	);
 
 	VulkanShaderRef makeComputeShader(
 		const char * computePath,
-		vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts = {}
+		vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts = {},
+		VulkanSpecialization const & specialization = VulkanSpecialization()
 	);
 
     /****************************
         Sets / Set Layouts
     ****************************/
 
-	VulkanSetLayoutRef makeSetLayout(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t maxSets = 1);
+	//Equal bindings return the same layout. updateAfterBind is ignored unless supportsUpdateAfterBind
+	VulkanSetLayoutRef makeSetLayout(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t maxSets = 1, bool updateAfterBind = false);
 
 	VulkanSetRef makeSet(VulkanSetLayoutRef layout);
 
@@ -225,7 +271,8 @@ public:
         Tasks / Command Buffers
     **********************/
 
-    VulkanTaskPoolRef makeTaskPool(vk::CommandPoolCreateFlags createFlags = vk::CommandPoolCreateFlags());
+    //Command buffers from the pool are submitted to a queue of queueType
+    VulkanTaskPoolRef makeTaskPool(vk::CommandPoolCreateFlags createFlags = vk::CommandPoolCreateFlags(), VulkanQueueType queueType = VulkanQueueType::GRAPHICS);
 
     VulkanTaskRef makeTask(VulkanTaskPoolRef taskPool);
 
@@ -233,6 +280,43 @@ public:
 	
     VulkanTaskGroupRef makeTaskGroup(uint32_t numTasks);
     VulkanTaskGroupRef makeTaskGroup(uint32_t numTasks, VulkanTaskPoolRef taskPool);
+
+    VulkanTimelineRef makeTimeline(uint64_t initialValue = 0);
+
+    /*
+    * Submit tasks with the dependencies declared through VulkanTask::waitFor / signal.
+    * Runs of tasks on the same queue go out in a single vkQueueSubmit, in order.
+    * The returned completion is that of the last submit.
+    */
+    VulkanCompletion submit(vk::ArrayProxy<const VulkanTaskRef> tasks, bool blockUntilFinished = false);
+
+    //VK_KHR_timeline_semaphore is enabled, otherwise VulkanTimeline falls back to host waits
+    bool supportsTimelineSemaphores()
+    {
+        return mTimelineDispatch.isSupported();
+    }
+
+    //Sampled image, storage image and storage buffer descriptors can be written while their set is in use
+    bool supportsUpdateAfterBind()
+    {
+        return mUpdateAfterBind;
+    }
+
+    VulkanTimelineDispatch const & getTimelineDispatch()
+    {
+        return mTimelineDispatch;
+    }
+
+    //VK_EXT_extended_dynamic_state is enabled, PipelineConfig::dynamicState pipelines take cull mode, front face, topology and depth test / write from the command buffer
+    bool supportsExtendedDynamicState()
+    {
+        return mExtendedDynamicStateDispatch.isSupported();
+    }
+
+    VulkanExtendedDynamicStateDispatch const & getExtendedDynamicStateDispatch()
+    {
+        return mExtendedDynamicStateDispatch;
+    }
    
 
     /****************************
@@ -243,6 +327,9 @@ public:
     vk::Sampler const& getNearestSampler();
     vk::Sampler const& getShadowSampler();
 
+    //Equal create infos share one sampler, owned by the context
+    vk::Sampler getSampler(vk::SamplerCreateInfo const & info);
+
     /****************************
         Images
     ****************************/
@@ -322,6 +409,12 @@ public:
         return VulkanCoherentArrayRef<T>(new VulkanCoherentArray<T>(this, arrayCount, usageFlags));
     }
 
+    //Per-frame linear allocator for transient uniform, vertex and index data
+    VulkanRingBufferRef makeRingBuffer(uint64_t frameSize, uint32_t framesInFlight);
+
+    //Shared ring, created on first use with the default frame size and frames in flight
+    VulkanRingBufferRef getTransientRing();
+
     /****************************
         RTX
     ****************************/
@@ -332,8 +425,9 @@ public:
     RTBlasRepoRef makeRayTracingBlasRepo();
     RTTopStructureManagerRef makeRayTracingTopStructureManager(uint32_t numInstances);
 
-	RTShaderBuilderRef makeRayTracingShaderBuilder(const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts);
+	RTShaderBuilderRef makeRayTracingShaderBuilder(const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, VulkanSpecialization const & specialization = VulkanSpecialization());
 	RTPipelineRef makeRayTracingPipeline(RTShaderBuilderRef shader);
+	RTPipelineFuture makeRayTracingPipelineAsync(RTShaderBuilderRef shader);
 	RTSceneRef makeRayTracingScene();
 	RTSceneRef makeRayTracingScene(RTBlasRepoRef repo);
 		
@@ -346,6 +440,71 @@ public:
         return _queueCount;
     }
 
+    VulkanMemoryAllocator * getAllocator()
+    {
+        return mAllocator.get();
+    }
+
+    //Used by every pipeline the context makes, loaded from VulkanPipelineCache::DEFAULT_PATH on creation
+    VulkanPipelineCacheRef getPipelineCache()
+    {
+        return mPipelineCache;
+    }
+
+    //Pipelines made from now on use cache, the previous one is saved once nothing else holds it. Not while async pipelines compile
+    void setPipelineCache(VulkanPipelineCacheRef cache)
+    {
+        mPipelineCache = cache;
+    }
+
+    //Pipelines by shader, renderer and fixed function state, see makePipeline
+    VulkanPipelineVariantCache * getPipelineVariantCache()
+    {
+        return mPipelineVariantCache.get();
+    }
+
+    //SPIR-V modules shared by every shader loading the same file
+    VulkanShaderCache * getShaderCache()
+    {
+        return mShaderCache.get();
+    }
+
+    //Shared set layouts, samplers and pipeline layouts
+    VulkanLayoutCache * getLayoutCache()
+    {
+        return mLayoutCache.get();
+    }
+
+    //Backs every VulkanSetLayout, see VulkanDescriptorAllocator
+    VulkanDescriptorAllocator * getDescriptorAllocator()
+    {
+        return mDescriptorAllocator.get();
+    }
+
+    //Created on first use
+    VulkanUploader * getUploader();
+
+    VulkanFencePool * getFencePool()
+    {
+        return mFencePool.get();
+    }
+
+    //Threads for parallel recording and building, created on first use
+    VulkanWorkerPool * getWorkerPool();
+
+    //Submit any batched uploads so work submitted next sees them, no-op if the uploader was never used
+    void flushUploads();
+
+    /*
+    * Write the queued binds of every VulkanSet in one vkUpdateDescriptorSets. VulkanTask::record and VulkanTaskGroup call it
+    * before recording starts, call it yourself before begin() when recording by hand. Sets must not be bound in between.
+    */
+    void flushDescriptorWrites();
+
+    //For VulkanSet, a set with queued binds is written by the next flushDescriptorWrites
+    void queueDescriptorWrites(VulkanSet * set);
+    void cancelDescriptorWrites(VulkanSet * set);
+
     const vk::PhysicalDeviceProperties &getPhysicalDeviceProperties()
     {
         return mPhysicalDeviceProperties;
@@ -364,10 +523,44 @@ private:
 	
     VulkanTaskPoolRef mOneTimePool = nullptr;
 
+    std::unique_ptr<VulkanMemoryAllocator> mAllocator;
+
+    std::unique_ptr<VulkanDescriptorAllocator> mDescriptorAllocator;
+
+    std::unique_ptr<VulkanLayoutCache> mLayoutCache;
+
+    VulkanPipelineCacheRef mPipelineCache;
+
+    std::unique_ptr<VulkanShaderCache> mShaderCache;
+
+    std::unique_ptr<VulkanPipelineVariantCache> mPipelineVariantCache;
+
+    std::unique_ptr<VulkanUploader> mUploader;
+
+    std::unique_ptr<VulkanWorkerPool> mWorkerPool;
+
+    std::unique_ptr<VulkanFencePool> mFencePool;
+
+    //Sets with binds queued since the last flushDescriptorWrites
+    vector<VulkanSet *> mPendingSets;
+    std::mutex mPendingSetsMutex;
+
+    VulkanRingBufferRef mTransientRing = nullptr;
+
+    VulkanTimelineDispatch mTimelineDispatch;
+
+    VulkanExtendedDynamicStateDispatch mExtendedDynamicStateDispatch;
+
+    bool mUpdateAfterBind = false;
+
     uint32_t _queueCount = 0;
 
 	vk::CommandBuffer _cmd;
-	vector<vk::Queue> _queues;
+
+    static const uint32_t MAX_QUEUES_PER_FAMILY = 4;
+
+    //Indexed by VulkanQueueType
+    std::vector<std::unique_ptr<VulkanQueue>> mQueues[3];
 	vk::Sampler _linearSampler = nullptr, _nearestSampler = nullptr, _shadowSampler = nullptr;
 
 
@@ -0,0 +1,333 @@
+#include "VulkanDescriptorAllocator.h"
+
+#include "VulkanSetLayout.h"
+#include "VulkanFencePool.h"
+#include "VulkanTracer.h"
+
+const uint32_t VulkanDescriptorAllocator::DEFAULT_SETS_PER_POOL = 16;
+const uint32_t VulkanDescriptorAllocator::MAX_SETS_PER_POOL = 1024;
+
+const uint32_t VulkanDescriptorArena::DEFAULT_SETS_PER_POOL = 256;
+
+/**************************************************
+ * Allocator
+ * ************************************************/
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+
+}
+
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator()
+{
+    for (auto & entry : mSignatures)
+    {
+        for (auto pool : entry.second->pools)
+        {
+            mCtx->getDevice().destroyDescriptorPool(pool, nullptr, mCtx->getDynamicDispatch());
+        }
+
+        mCtx->getDevice().destroyDescriptorSetLayout(entry.second->layout, nullptr, mCtx->getDynamicDispatch());
+    }
+}
+
+VulkanDescriptorSignature * VulkanDescriptorAllocator::getSignature(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t minSets, bool updateAfterBind)
+{
+    // Everything that makes two layouts incompatible, immutable samplers included
+    vector<uint64_t> key;
+
+    for (auto & binding : bindings)
+    {
+        key.push_back(static_cast<uint64_t>(binding.type));
+        key.push_back(binding.arrayCount);
+        key.push_back(static_cast<uint32_t>(binding.stageFlags));
+
+        for (uint32_t i = 0; binding.samplers && i < binding.arrayCount; i++)
+        {
+            key.push_back(reinterpret_cast<uint64_t>(static_cast<VkSampler>(binding.samplers[i])));
+        }
+
+        key.push_back(~0ull);
+    }
+
+    key.push_back(updateAfterBind ? 1 : 0);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto & signature = mSignatures[key];
+
+    if (!signature)
+    {
+        signature.reset(new VulkanDescriptorSignature());
+        signature->nextPoolSets = DEFAULT_SETS_PER_POOL;
+        signature->updateAfterBind = updateAfterBind;
+
+        createLayout(*signature, bindings);
+    }
+
+    signature->nextPoolSets = glm::max(signature->nextPoolSets, glm::min(minSets, MAX_SETS_PER_POOL));
+
+    return signature.get();
+}
+
+void VulkanDescriptorAllocator::createLayout(VulkanDescriptorSignature & signature, vk::ArrayProxy<const VulkanSetLayoutBinding> bindings)
+{
+    vector<vk::DescriptorSetLayoutBinding> vkbindings;
+    vector<vk::DescriptorBindingFlagsEXT> bindingFlags;
+
+    // Every binding of an update after bind layout is one, so all of its slots can be written while the set is in use
+    vk::DescriptorBindingFlagsEXT updateFlags;
+
+    if (signature.updateAfterBind)
+    {
+        updateFlags = vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind | vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+    }
+
+    for (auto & binding : bindings)
+    {
+        if (binding.arrayCount > 1) bindingFlags.push_back(vk::DescriptorBindingFlagBitsEXT::ePartiallyBound | updateFlags);
+        else bindingFlags.push_back(updateFlags);
+
+        vkbindings.push_back(vk::DescriptorSetLayoutBinding(
+            static_cast<uint32_t>(vkbindings.size()),
+            binding.type,
+            binding.arrayCount,
+            binding.stageFlags,
+            binding.samplers
+        ));
+
+        // Empty bindings only reserve their number, pools can't hold zero descriptors of a type
+        if (binding.arrayCount > 0) signature.poolSizes.push_back(vk::DescriptorPoolSize(binding.type, binding.arrayCount));
+    }
+
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingsExt;
+    bindingsExt.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingsExt.setPBindingFlags(bindingFlags.data());
+    bindingsExt.setPNext(nullptr);
+
+    vk::DescriptorSetLayoutCreateInfo layoutCreateInfo(
+        signature.updateAfterBind ? vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT : vk::DescriptorSetLayoutCreateFlags(),
+        static_cast<uint32_t>(vkbindings.size()),
+        vkbindings.data()
+    );
+
+    layoutCreateInfo.pNext = &bindingsExt;
+
+    signature.layout = mCtx->getDevice().createDescriptorSetLayout(
+        layoutCreateInfo, nullptr,
+        mCtx->getDynamicDispatch()
+    );
+}
+
+void VulkanDescriptorAllocator::growPool(VulkanDescriptorSignature & signature)
+{
+    uint32_t sets = signature.nextPoolSets;
+
+    vector<vk::DescriptorPoolSize> poolSizes = signature.poolSizes;
+
+    for (auto & size : poolSizes)
+    {
+        size.descriptorCount *= sets;
+    }
+
+    signature.pools.push_back(mCtx->getDevice().createDescriptorPool(
+        vk::DescriptorPoolCreateInfo(
+            signature.updateAfterBind ? vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT : vk::DescriptorPoolCreateFlags(),
+            sets,
+            static_cast<uint32_t>(poolSizes.size()),
+            poolSizes.data()
+        ), nullptr,
+        mCtx->getDynamicDispatch()
+    ));
+
+    signature.remainingInPool = sets;
+    signature.nextPoolSets = glm::min(sets * 2, MAX_SETS_PER_POOL);
+}
+
+vk::DescriptorSet VulkanDescriptorAllocator::allocate(VulkanDescriptorSignature * signature)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    auto completedSerial = mCtx->getFencePool()->getCompletedSerial();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    signature->allocatedSets++;
+
+    auto & retired = signature->retiredSets;
+
+    while (!retired.empty() && retired.front().second <= completedSerial)
+    {
+        signature->freeSets.push_back(retired.front().first);
+        retired.pop_front();
+    }
+
+    if (!signature->freeSets.empty())
+    {
+        auto set = signature->freeSets.back();
+        signature->freeSets.pop_back();
+        return set;
+    }
+
+    // Pools are sized for exactly this layout and never free, so they can't fragment
+    if (signature->remainingInPool == 0)
+    {
+        growPool(*signature);
+    }
+
+    signature->remainingInPool--;
+
+    return mCtx->getDevice().allocateDescriptorSets(
+        vk::DescriptorSetAllocateInfo(
+            signature->pools.back(),
+            1,
+            &signature->layout
+        ),
+        mCtx->getDynamicDispatch()
+    )[0];
+}
+
+void VulkanDescriptorAllocator::free(VulkanDescriptorSignature * signature, vk::DescriptorSet set)
+{
+    // Command buffers already submitted may still read the set, it waits until they are done
+    auto submittedSerial = mCtx->getFencePool()->getSubmittedSerial();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    signature->allocatedSets--;
+    signature->retiredSets.push_back(std::make_pair(set, submittedSerial));
+}
+
+uint32_t VulkanDescriptorAllocator::getSignatureCount()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return static_cast<uint32_t>(mSignatures.size());
+}
+
+uint32_t VulkanDescriptorAllocator::getPoolCount()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t count = 0;
+
+    for (auto & entry : mSignatures)
+    {
+        count += static_cast<uint32_t>(entry.second->pools.size());
+    }
+
+    return count;
+}
+
+/**************************************************
+ * Arena
+ * ************************************************/
+
+VulkanDescriptorArena::VulkanDescriptorArena(VulkanContextPtr ctx, uint32_t setsPerPool) :
+    mCtx(ctx),
+    mSetsPerPool(glm::max(setsPerPool, 1u))
+{
+
+}
+
+VulkanDescriptorArena::~VulkanDescriptorArena()
+{
+    for (auto pool : mPools)
+    {
+        mCtx->getDevice().destroyDescriptorPool(pool, nullptr, mCtx->getDynamicDispatch());
+    }
+}
+
+void VulkanDescriptorArena::addPool(VulkanDescriptorSignature const & signature)
+{
+    for (auto & size : signature.poolSizes)
+    {
+        auto & count = mTypeCounts[size.type];
+        count = glm::max(count, size.descriptorCount);
+    }
+
+    vector<vk::DescriptorPoolSize> poolSizes;
+
+    for (auto & entry : mTypeCounts)
+    {
+        poolSizes.push_back(vk::DescriptorPoolSize(entry.first, entry.second * mSetsPerPool));
+    }
+
+    mPools.push_back(mCtx->getDevice().createDescriptorPool(
+        vk::DescriptorPoolCreateInfo(
+            vk::DescriptorPoolCreateFlags(),
+            mSetsPerPool,
+            static_cast<uint32_t>(poolSizes.size()),
+            poolSizes.data()
+        ), nullptr,
+        mCtx->getDynamicDispatch()
+    ));
+}
+
+vk::DescriptorSet VulkanDescriptorArena::allocate(VulkanSetLayoutRef const & layout)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    auto * signature = layout->getSignature();
+
+    if (signature->updateAfterBind)
+    {
+        std::cerr << "(VulkanDescriptorArena - allocate) update after bind layouts need their own pools" << std::endl;
+        return nullptr;
+    }
+
+    // Pools made before this layout's descriptor types were seen can't hold it, chain a new one
+    bool covered = true;
+
+    for (auto & size : signature->poolSizes)
+    {
+        auto it = mTypeCounts.find(size.type);
+        if (it == mTypeCounts.end() || it->second < size.descriptorCount) covered = false;
+    }
+
+    if (!covered)
+    {
+        addPool(*signature);
+        mCurrentPool = static_cast<uint32_t>(mPools.size() - 1);
+    }
+
+    vk::DescriptorSetAllocateInfo info(nullptr, 1, &signature->layout);
+    vk::DescriptorSet set;
+
+    // Move on to the next pool when the current one runs out, adding one when the chain ends
+    while (true)
+    {
+        if (mCurrentPool == mPools.size())
+        {
+            addPool(*signature);
+        }
+
+        info.descriptorPool = mPools[mCurrentPool];
+
+        auto result = mCtx->getDevice().allocateDescriptorSets(&info, &set, mCtx->getDynamicDispatch());
+
+        if (result == vk::Result::eSuccess)
+        {
+            return set;
+        }
+
+        if (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)
+        {
+            std::cerr << "(VulkanDescriptorArena - allocate) " << vk::to_string(result) << std::endl;
+            return nullptr;
+        }
+
+        mCurrentPool++;
+    }
+}
+
+void VulkanDescriptorArena::reset()
+{
+    for (uint32_t i = 0; i < mPools.size() && i <= mCurrentPool; i++)
+    {
+        mCtx->getDevice().resetDescriptorPool(mPools[i], vk::DescriptorPoolResetFlags(), mCtx->getDynamicDispatch());
+    }
+
+    mCurrentPool = 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+
+/*
+* Descriptor set layouts that are defined identically share one entry, with one vk::DescriptorSetLayout
+* and a chain of pools sized for exactly that layout. Sets handed back with free are kept for reuse
+* instead of going back to the driver, so no pool needs eFreeDescriptorSet. They are only reused once
+* every submission made before they were freed has completed.
+*/
+struct VulkanDescriptorSignature
+{
+    vk::DescriptorSetLayout layout;
+
+    //Descriptors of each type one set takes
+    vector<vk::DescriptorPoolSize> poolSizes;
+
+    vector<vk::DescriptorPool> pools;
+    uint32_t remainingInPool = 0;
+    uint32_t nextPoolSets;
+
+    bool updateAfterBind = false;
+
+    vector<vk::DescriptorSet> freeSets;
+
+    //Freed sets with the fence pool serial of the last submission that may still use them, oldest first
+    std::deque<std::pair<vk::DescriptorSet, uint64_t>> retiredSets;
+
+    uint32_t allocatedSets = 0;
+};
+
+/*
+* Context owned allocator for descriptor sets that live until they are freed, see VulkanSetLayout.
+* Pools grow geometrically per layout signature, so any number of sets can be made from one layout.
+*/
+class VulkanDescriptorAllocator
+{
+public:
+
+    //Sets in the first pool of a signature, later pools double up to MAX_SETS_PER_POOL
+    static const uint32_t DEFAULT_SETS_PER_POOL;
+    static const uint32_t MAX_SETS_PER_POOL;
+
+    VulkanDescriptorAllocator(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanDescriptorAllocator)
+
+    ~VulkanDescriptorAllocator();
+
+    //Entry shared by every layout with the same bindings, valid for the lifetime of the allocator. minSets sizes the first pool
+    VulkanDescriptorSignature * getSignature(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t minSets = 1, bool updateAfterBind = false);
+
+    vk::DescriptorSet allocate(VulkanDescriptorSignature * signature);
+
+    //The set may still be in use by submitted work, allocate hands it out again once that work completes
+    void free(VulkanDescriptorSignature * signature, vk::DescriptorSet set);
+
+    uint32_t getSignatureCount();
+
+    uint32_t getPoolCount();
+
+private:
+
+    void createLayout(VulkanDescriptorSignature & signature, vk::ArrayProxy<const VulkanSetLayoutBinding> bindings);
+
+    void growPool(VulkanDescriptorSignature & signature);
+
+    VulkanContextPtr mCtx;
+
+    std::map<vector<uint64_t>, std::unique_ptr<VulkanDescriptorSignature>> mSignatures;
+
+    std::mutex mMutex;
+};
+
+/*
+* Sets for a single frame. Pools chain as needed and are all reset at once, so sets are never freed one by one.
+* VulkanFrameContext keeps one per frame in flight, see VulkanFrameContext::makeSet.
+*/
+class VulkanDescriptorArena
+{
+public:
+
+    static const uint32_t DEFAULT_SETS_PER_POOL;
+
+    VulkanDescriptorArena(VulkanContextPtr ctx, uint32_t setsPerPool = DEFAULT_SETS_PER_POOL);
+
+    VULCRO_DONT_COPY(VulkanDescriptorArena)
+
+    ~VulkanDescriptorArena();
+
+    vk::DescriptorSet allocate(VulkanSetLayoutRef const & layout);
+
+    //Frees every set allocated since the last reset, none may still be in use by the GPU
+    void reset();
+
+private:
+
+    void addPool(VulkanDescriptorSignature const & signature);
+
+    VulkanContextPtr mCtx;
+
+    uint32_t mSetsPerPool;
+
+    vector<vk::DescriptorPool> mPools;
+    uint32_t mCurrentPool = 0;
+
+    //Largest per set count of each descriptor type seen so far, new pools fit setsPerPool of the worst case
+    std::map<vk::DescriptorType, uint32_t> mTypeCounts;
+};
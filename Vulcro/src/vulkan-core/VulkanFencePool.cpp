@@ -0,0 +1,207 @@
+#include "VulkanFencePool.h"
+
+#include <algorithm>
+
+static void runCallbacks(vector<function<void()>> & callbacks)
+{
+    for (auto & callback : callbacks)
+    {
+        callback();
+    }
+}
+
+bool VulkanCompletion::poll()
+{
+    if (!mState) return true;
+
+    vector<function<void()>> callbacks;
+
+    {
+        std::lock_guard<std::mutex> lock(mState->mutex);
+
+        if (mState->done) return true;
+
+        if (mState->pool->mCtx->getDevice().getFenceStatus(mState->fence) != vk::Result::eSuccess)
+        {
+            return false;
+        }
+
+        callbacks = mState->pool->complete(*mState);
+    }
+
+    runCallbacks(callbacks);
+
+    return true;
+}
+
+bool VulkanCompletion::wait(uint64_t timeoutNs)
+{
+    if (!mState) return true;
+
+    vector<function<void()>> callbacks;
+
+    {
+        std::lock_guard<std::mutex> lock(mState->mutex);
+
+        if (mState->done) return true;
+
+        auto res = mState->pool->mCtx->getDevice().waitForFences(1, &mState->fence, VK_TRUE, timeoutNs);
+
+        if (res == vk::Result::eTimeout)
+        {
+            return false;
+        }
+        else if (res != vk::Result::eSuccess)
+        {
+            std::cerr << "(VulkanCompletion - wait) waiting on fence failed" << std::endl;
+        }
+
+        callbacks = mState->pool->complete(*mState);
+    }
+
+    runCallbacks(callbacks);
+
+    return true;
+}
+
+void VulkanCompletion::then(function<void()> callback)
+{
+    if (mState)
+    {
+        std::lock_guard<std::mutex> lock(mState->mutex);
+
+        if (!mState->done)
+        {
+            mState->callbacks.push_back(callback);
+            return;
+        }
+    }
+
+    callback();
+}
+
+VulkanFencePool::VulkanFencePool(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+}
+
+VulkanFencePool::~VulkanFencePool()
+{
+    auto device = mCtx->getDevice();
+
+    // Tracked fences may still be in use
+    for (auto & state : mPending)
+    {
+        device.waitForFences(1, &state->fence, VK_TRUE, UINT64_MAX);
+        device.destroyFence(state->fence);
+        state->fence = nullptr;
+        state->done = true;
+    }
+
+    for (auto & fence : mFreeFences)
+    {
+        device.destroyFence(fence);
+    }
+}
+
+vk::Fence VulkanFencePool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFreeFences.empty())
+    {
+        return mCtx->getDevice().createFence(vk::FenceCreateInfo());
+    }
+
+    auto fence = mFreeFences.back();
+    mFreeFences.pop_back();
+
+    return fence;
+}
+
+void VulkanFencePool::release(vk::Fence fence)
+{
+    mCtx->getDevice().resetFences(1, &fence);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFreeFences.push_back(fence);
+}
+
+VulkanCompletion VulkanFencePool::track(vk::Fence fence)
+{
+    auto state = make_shared<VulkanCompletion::State>();
+    state->pool = this;
+    state->fence = fence;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    state->serial = ++mSubmittedSerial;
+    mPending.push_back(state);
+
+    return VulkanCompletion(state);
+}
+
+void VulkanFencePool::collect()
+{
+    vector<shared_ptr<VulkanCompletion::State>> pending;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pending = mPending;
+    }
+
+    for (auto & state : pending)
+    {
+        VulkanCompletion(state).poll();
+    }
+}
+
+uint32_t VulkanFencePool::getPendingCount()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return static_cast<uint32_t>(mPending.size());
+}
+
+uint64_t VulkanFencePool::getSubmittedSerial()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return mSubmittedSerial;
+}
+
+uint64_t VulkanFencePool::getCompletedSerial()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Submissions can complete out of order, everything before the oldest one still pending is done
+    uint64_t completed = mSubmittedSerial;
+
+    for (auto & state : mPending)
+    {
+        completed = glm::min(completed, state->serial - 1);
+    }
+
+    return completed;
+}
+
+vector<function<void()>> VulkanFencePool::complete(VulkanCompletion::State & state)
+{
+    state.done = true;
+
+    release(state.fence);
+    state.fence = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        mPending.erase(std::remove_if(mPending.begin(), mPending.end(), [&state](shared_ptr<VulkanCompletion::State> const & pending)
+        {
+            return pending.get() == &state;
+        }), mPending.end());
+    }
+
+    vector<function<void()>> callbacks;
+    callbacks.swap(state.callbacks);
+
+    return callbacks;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <mutex>
+
+class VulkanFencePool;
+
+/*
+* Handle to a GPU submission, cheap to copy. A default constructed handle counts as already complete.
+* then() callbacks run on whichever thread first observes completion: poll(), wait(),
+* or VulkanFencePool::collect(), which the context calls on every task submit.
+*/
+class VulkanCompletion
+{
+public:
+
+    VulkanCompletion() {}
+
+    bool poll();
+
+    //Returns false if timeoutNs elapsed first
+    bool wait(uint64_t timeoutNs = UINT64_MAX);
+
+    void then(function<void()> callback);
+
+    bool isPending()
+    {
+        return mState != nullptr && !poll();
+    }
+
+private:
+
+    friend class VulkanFencePool;
+
+    struct State
+    {
+        VulkanFencePool * pool = nullptr;
+        vk::Fence fence = nullptr;
+        uint64_t serial = 0;
+        bool done = false;
+        vector<function<void()>> callbacks;
+        std::mutex mutex;
+    };
+
+    VulkanCompletion(shared_ptr<State> state) :
+        mState(state)
+    {}
+
+    shared_ptr<State> mState = nullptr;
+};
+
+/*
+* Context owned pool of reset fences. Fences handed out through track() come back on their own
+* once the submission they guard is seen to complete.
+*/
+class VulkanFencePool
+{
+public:
+
+    VulkanFencePool(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanFencePool)
+
+    ~VulkanFencePool();
+
+    //An unsignaled fence, give it back with release() or hand it to track()
+    vk::Fence acquire();
+
+    void release(vk::Fence fence);
+
+    //Wrap a fence that has just been submitted
+    VulkanCompletion track(vk::Fence fence);
+
+    //Retire every tracked submission the GPU has finished, firing their callbacks
+    void collect();
+
+    uint32_t getPendingCount();
+
+    //Counts tracked submissions, the serial of the latest one
+    uint64_t getSubmittedSerial();
+
+    //Every submission up to this serial is known to be complete
+    uint64_t getCompletedSerial();
+
+private:
+
+    friend class VulkanCompletion;
+
+    //Called with state.mutex held, returns the callbacks to run once it is released
+    vector<function<void()>> complete(VulkanCompletion::State & state);
+
+    VulkanContextPtr mCtx;
+
+    vector<vk::Fence> mFreeFences;
+
+    vector<shared_ptr<VulkanCompletion::State>> mPending;
+
+    uint64_t mSubmittedSerial = 0;
+
+    std::mutex mMutex;
+};
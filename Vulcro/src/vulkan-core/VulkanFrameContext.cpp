@@ -0,0 +1,166 @@
+#include "VulkanFrameContext.h"
+
+#include "VulkanQueue.h"
+#include "VulkanSwapchain.h"
+#include "VulkanTask.h"
+#include "VulkanTaskPool.h"
+#include "VulkanRingBuffer.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanSet.h"
+
+const uint32_t VulkanFrameContext::DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+VulkanFrameContext::VulkanFrameContext(VulkanContextPtr ctx, VulkanSwapchainRef swapchain, uint32_t framesInFlight) :
+    mCtx(ctx),
+    mSwapchain(swapchain)
+{
+    framesInFlight = glm::max(framesInFlight, 1u);
+
+    mRing = mCtx->makeRingBuffer(VulkanRingBuffer::DEFAULT_FRAME_SIZE, framesInFlight);
+
+    mFrames.resize(framesInFlight);
+
+    auto device = mCtx->getDevice();
+
+    for (auto & frame : mFrames)
+    {
+        // Buffers are only ever reset all at once with the pool
+        frame.pool = mCtx->makeTaskPool(vk::CommandPoolCreateFlagBits::eTransient);
+        frame.task = mCtx->makeTask(frame.pool);
+
+        frame.descriptors.reset(new VulkanDescriptorArena(mCtx));
+
+        frame.imageAcquired = device.createSemaphore(vk::SemaphoreCreateInfo());
+        frame.renderFinished = device.createSemaphore(vk::SemaphoreCreateInfo());
+    }
+}
+
+VulkanFrameContext::~VulkanFrameContext()
+{
+    waitIdle();
+
+    auto device = mCtx->getDevice();
+
+    for (auto & frame : mFrames)
+    {
+        device.destroySemaphore(frame.imageAcquired);
+        device.destroySemaphore(frame.renderFinished);
+
+        // Tasks go before the pool they were allocated from
+        frame.task = nullptr;
+        frame.pool = nullptr;
+
+        frame.descriptors = nullptr;
+    }
+}
+
+bool VulkanFrameContext::beginFrame()
+{
+    auto & frame = mFrames[mFrameIndex];
+
+    retire(frame);
+
+    frame.pool->reset();
+
+    frame.descriptors->reset();
+
+    mRing->beginFrame(mFrameIndex);
+
+    mSubmitted = false;
+
+    if (!mSwapchain->nextFrame(frame.imageAcquired))
+    {
+        return false;
+    }
+
+    mFrameNumber++;
+
+    return true;
+}
+
+VulkanCompletion VulkanFrameContext::submit(vk::ArrayProxy<const VulkanTaskRef> tasks)
+{
+    auto & frame = mFrames[mFrameIndex];
+
+    if (tasks.size() == 0) return VulkanCompletion();
+
+    // The acquire semaphore is only consumed by the frame's first submit
+    if (!mSubmitted)
+    {
+        tasks.front()->waitFor(frame.imageAcquired, vk::PipelineStageFlagBits::eColorAttachmentOutput);
+    }
+
+    tasks.back()->signal(frame.renderFinished);
+
+    frame.completion = mCtx->submit(tasks);
+
+    mSubmitted = true;
+
+    return frame.completion;
+}
+
+bool VulkanFrameContext::endFrame()
+{
+    auto & frame = mFrames[mFrameIndex];
+
+    mFrameIndex = (mFrameIndex + 1) % mFrames.size();
+
+    if (!mSubmitted)
+    {
+        std::cerr << "(VulkanFrameContext - endFrame) nothing was submitted this frame" << std::endl;
+
+        // An empty batch still has to consume the acquire semaphore, or the next acquire using it is invalid
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+
+        auto * fences = mCtx->getFencePool();
+        auto fence = fences->acquire();
+
+        mCtx->getQueue(VulkanQueueType::GRAPHICS)->submit(
+            vk::SubmitInfo(1, &frame.imageAcquired, &waitStage, 0, nullptr, 1, &frame.renderFinished),
+            fence
+        );
+
+        frame.completion = fences->track(fence);
+    }
+
+    return mSwapchain->present({ frame.renderFinished });
+}
+
+VulkanSetRef VulkanFrameContext::makeSet(VulkanSetLayoutRef layout)
+{
+    auto set = mFrames[mFrameIndex].descriptors->allocate(layout);
+
+    if (!set) return nullptr;
+
+    return make_shared<VulkanSet>(mCtx, layout, set);
+}
+
+void VulkanFrameContext::defer(function<void()> deletion)
+{
+    mFrames[mFrameIndex].deletions.push_back(deletion);
+}
+
+void VulkanFrameContext::waitIdle()
+{
+    for (auto & frame : mFrames)
+    {
+        retire(frame);
+    }
+}
+
+void VulkanFrameContext::retire(Frame & frame)
+{
+    if (!frame.completion.wait(1000ull * 1000 * 1000 * 10))
+    {
+        std::cerr << "(VulkanFrameContext - retire) frame timed out" << std::endl;
+    }
+
+    frame.completion = VulkanCompletion();
+
+    for (auto & deletion : frame.deletions)
+    {
+        deletion();
+    }
+
+    frame.deletions.clear();
+}
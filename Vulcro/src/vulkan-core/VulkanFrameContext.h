@@ -0,0 +1,124 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+#include "VulkanFencePool.h"
+
+/*
+* Frames in flight for a swapchain render loop. Each frame slot owns its command pool and task,
+* acquire / render finished semaphores, a partition of the ring buffer, a descriptor arena and a deferred deletion list,
+* so the CPU records frame N+1 while the GPU still renders frame N.
+*
+*   if (!frames->beginFrame()) resize();
+*   frames->getTask()->record(...);
+*   frames->submit({ frames->getTask() });
+*   if (!frames->endFrame()) resize();
+*/
+class VulkanFrameContext
+{
+public:
+
+    static const uint32_t DEFAULT_FRAMES_IN_FLIGHT;
+
+    VulkanFrameContext(VulkanContextPtr ctx, VulkanSwapchainRef swapchain, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
+
+    VULCRO_DONT_COPY(VulkanFrameContext)
+
+    ~VulkanFrameContext();
+
+    /*
+    * Waits until the GPU is done with the slot's previous frame, recycles its resources and acquires the next swapchain image.
+    * Returns false when the swapchain needs to be resized.
+    */
+    bool beginFrame();
+
+    /*
+    * Submit the frame's tasks through VulkanContext::submit. The first waits for the acquired image at
+    * color attachment output, the last signals the semaphore endFrame presents on. Tasks should share a queue.
+    */
+    VulkanCompletion submit(vk::ArrayProxy<const VulkanTaskRef> tasks);
+
+    //Present and move on to the next slot, returns false when the swapchain needs to be resized
+    bool endFrame();
+
+    //Run deletion once the GPU is done with the current frame
+    void defer(function<void()> deletion);
+
+    //Keep resource alive until the GPU is done with the current frame
+    template<typename T>
+    void keepAlive(shared_ptr<T> resource)
+    {
+        defer([resource]() {});
+    }
+
+    //Block until every frame in flight is done, e.g. before resizing the swapchain
+    void waitIdle();
+
+    //Primary task of the current frame, its pool is reset in beginFrame
+    VulkanTaskRef getTask()
+    {
+        return mFrames[mFrameIndex].task;
+    }
+
+    //For extra tasks of the current frame
+    VulkanTaskPoolRef getTaskPool()
+    {
+        return mFrames[mFrameIndex].pool;
+    }
+
+    //Descriptor set that is only valid for the current frame, reclaimed with the rest of the slot's sets in beginFrame
+    VulkanSetRef makeSet(VulkanSetLayoutRef layout);
+
+    //Partitioned per frame, beginFrame starts the current slot's partition
+    VulkanRingBufferRef getRing()
+    {
+        return mRing;
+    }
+
+    uint32_t getFrameIndex()
+    {
+        return mFrameIndex;
+    }
+
+    uint32_t getFramesInFlight()
+    {
+        return static_cast<uint32_t>(mFrames.size());
+    }
+
+    //Counts every frame begun
+    uint64_t getFrameNumber()
+    {
+        return mFrameNumber;
+    }
+
+private:
+
+    struct Frame
+    {
+        VulkanTaskPoolRef pool;
+        VulkanTaskRef task;
+
+        vk::Semaphore imageAcquired;
+        vk::Semaphore renderFinished;
+
+        std::unique_ptr<VulkanDescriptorArena> descriptors;
+
+        VulkanCompletion completion;
+
+        vector<function<void()>> deletions;
+    };
+
+    void retire(Frame & frame);
+
+    VulkanContextPtr mCtx;
+    VulkanSwapchainRef mSwapchain;
+    VulkanRingBufferRef mRing;
+
+    vector<Frame> mFrames;
+
+    uint32_t mFrameIndex = 0;
+    uint64_t mFrameNumber = 0;
+
+    bool mSubmitted = false;
+};
@@ -1,9 +1,12 @@
 #include "VulkanImage.h"
+#include "VulkanFrameContext.h"
 
 
 vk::ImageUsageFlags VulkanImage::SAMPLED_STORAGE = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
 vk::ImageUsageFlags VulkanImage::SAMPLED_COLOR_ATTACHMENT = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
 
+const vk::DeviceSize VulkanImage::DEDICATED_RENDER_TARGET_SIZE = 16ull * 1024 * 1024;
+
 VulkanImage::VulkanImage(VulkanContextPtr ctx, vk::ImageUsageFlags usage, vk::Format format, glm::uvec3 size, vk::ImageType imageType)
 	:mContext(ctx),
 	mFormat(format),
@@ -49,69 +52,67 @@ void VulkanImage::createImage()
 
 void VulkanImage::allocateDeviceMemory(vk::MemoryPropertyFlags memFlags)
 {
-	auto memProps = mContext->getPhysicalDevice().getMemoryProperties();
-
-	auto req = mContext->getDevice().getImageMemoryRequirements(mImage);
+	auto reqs = mContext->getDevice().getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+		vk::ImageMemoryRequirementsInfo2(mImage)
+	);
 
+	auto req = reqs.get<vk::MemoryRequirements2>().memoryRequirements;
+	auto dedicatedReq = reqs.get<vk::MemoryDedicatedRequirements>();
 
-    auto memTypeRes = mContext->getBestMemoryIndex(req, memFlags);
+	// Large render targets get resized and aliased as a whole, keep them out of the shared blocks
+	bool isRenderTarget = (bool)(mUsage & (vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment));
 
-    assert(memTypeRes.isValid);
+	bool dedicated = dedicatedReq.prefersDedicatedAllocation || dedicatedReq.requiresDedicatedAllocation ||
+		(isRenderTarget && req.size >= DEDICATED_RENDER_TARGET_SIZE);
 
-	
+	mMemoryFlags = memFlags;
 	mMemorySize = req.size;
 
-	mMemory = mContext->getDevice().allocateMemory(
-		vk::MemoryAllocateInfo(req.size, memTypeRes.value)
-	);
-
-#ifdef VULCRO_PRINT_ALLOCATIONS
-    printf("VulkanImage: Allocating memory %lli \n", req.size);
-#endif
+	mAllocation = mContext->getAllocator()->allocate(req, memFlags, false /* linear */, dedicated, vk::MemoryDedicatedAllocateInfo(mImage));
 
-	mContext->getDevice().bindImageMemory(mImage, mMemory, 0);
+	mContext->getDevice().bindImageMemory(mImage, mAllocation.memory, mAllocation.offset);
 
 	mMemoryAllocated = true;
 
 	// If the memory is host visible then map the memory, keeping the memory mapped does not come at a performance cost
 	if ((memFlags & vk::MemoryPropertyFlagBits::eHostVisible) == vk::MemoryPropertyFlagBits::eHostVisible)
 	{
-		mMemoryMapping = mContext->getDevice().mapMemory(
-			mMemory,
-			0,
-			mMemorySize,
-			vk::MemoryMapFlags()
-		);
+		mMemoryMapping = mContext->getAllocator()->map(mAllocation);
+	}
+}
+
+void VulkanImage::freeDeviceMemory()
+{
+	if (isMemoryMapped())
+	{
+		mContext->getAllocator()->unmap(mAllocation);
+		mMemoryMapping = nullptr;
 	}
+
+	mContext->getAllocator()->free(mAllocation);
 }
 
 void VulkanImage::transitionLayout(vk::CommandBuffer * cmd, vk::ImageLayout layout)
 {
-	vk::ImageMemoryBarrier imgbarr(
-		vk::AccessFlags(),
-		vk::AccessFlags(),
-		vk::ImageLayout::eUndefined,
-		layout,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		getImage(),
-		vk::ImageSubresourceRange(
-			vk::ImageAspectFlagBits::eColor,
-			0,
-			mMipLevels,
-			0,
-			1
-		)
-	);
+	VulkanBarrierBatch barriers;
+	barriers.transition(this, layout);
+	barriers.flush(cmd);
+}
 
-	cmd->pipelineBarrier(
-		vk::PipelineStageFlagBits::eTopOfPipe,
-		vk::PipelineStageFlagBits::eTopOfPipe,
-		vk::DependencyFlags(0),
-		{},
-		{},
-		{ imgbarr }
-	);
+vk::MemoryRequirements VulkanImage::getMemoryRequirements()
+{
+	return mContext->getDevice().getImageMemoryRequirements(mImage);
+}
+
+void VulkanImage::bindMemory(vk::DeviceMemory memory, vk::DeviceSize offset)
+{
+	assert(mBindMemoryLater && !mMemoryBound);
+
+	mContext->getDevice().bindImageMemory(mImage, memory, offset);
+	mMemoryBound = true;
+
+	// Views can't be created before the image has memory
+	createImageView(mUsage & vk::ImageUsageFlagBits::eDepthStencilAttachment ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor);
 }
 
 void VulkanImage::upload(uint64_t size, void* data)
@@ -173,11 +174,6 @@ vk::DescriptorType VulkanImage::getDescriptorType()
 
 VulkanImage::~VulkanImage()
 {
-	if (isMemoryMapped())
-    {
-		mContext->getDevice().unmapMemory(mMemory);
-	}
-
     if (mViewCreated)
     {
         mContext->getDevice().destroyImageView(mImageView);
@@ -190,7 +186,7 @@ VulkanImage::~VulkanImage()
 
 	if (mMemoryAllocated)
     {
-		mContext->getDevice().freeMemory(mMemory);
+		freeDeviceMemory();
 	}
 }
 
@@ -243,12 +239,13 @@ void VulkanImage1D::resize(uint64_t size)
 {
 	if (mViewCreated) mContext->getDevice().destroyImageView(mImageView);
 	if (mImageCreated) mContext->getDevice().destroyImage(mImage);
-	if (mMemoryAllocated) mContext->getDevice().freeMemory(mMemory);
+	if (mMemoryAllocated) freeDeviceMemory();
 
 	mSize.x = size;
+	mState = VulkanResourceState();
 
 	if (mImageCreated) createImage();
-	if (mMemoryAllocated) allocateDeviceMemory();
+	if (mMemoryAllocated) allocateDeviceMemory(mMemoryFlags);
 	if (mViewCreated) createImageView();
 }
 
@@ -295,6 +292,27 @@ VulkanImage2D::VulkanImage2D(VulkanContextPtr ctx, vk::Image image, vk::Format f
 
 }
 
+VulkanImage2D::VulkanImage2D(VulkanContextPtr ctx, vk::ImageUsageFlags usage, vk::Format format, glm::uvec2 size, VulkanImageMemory memory) :
+	VulkanImage(ctx, usage, format, glm::uvec3(size.x, size.y, 1), vk::ImageType::e2D)
+{
+	createImage();
+
+	if (memory == VulkanImageMemory::BIND_LATER)
+	{
+		mBindMemoryLater = true;
+		return;
+	}
+
+	allocateDeviceMemory();
+
+	if (usage & vk::ImageUsageFlagBits::eDepthStencilAttachment) {
+		createImageView(vk::ImageAspectFlagBits::eDepth);
+	}
+	else {
+		createImageView(vk::ImageAspectFlagBits::eColor);
+	}
+}
+
 void VulkanImage2D::createImageView(vk::ImageAspectFlags aspectFlags) {
 	vk::ComponentMapping cmap;
 	cmap.r = vk::ComponentSwizzle::eR;
@@ -346,24 +364,29 @@ void VulkanImage2D::createImageView(vk::ImageAspectFlags aspectFlags) {
 
 #include "VulkanTask.h"
 #include "VulkanBuffer.h"
+#include "VulkanUploader.h"
 
 void VulkanImage2D::loadFromBuffer(VulkanBufferRef stagingBuffer, vk::CommandBuffer * cmd)
 {
-    VulkanTaskRef task = nullptr;
-
     if (!cmd)
     {
-        auto pool = mContext->makeTaskPool(vk::CommandPoolCreateFlagBits::eTransient);
-        task = mContext->makeTask(pool);
-        task->begin();
-        cmd = &task->getCommandBuffer();
+        mContext->getUploader()->copyBufferToImage(stagingBuffer, this, shared_from_this());
+        return;
     }
 
-    transitionLayout(cmd, vk::ImageLayout::eTransferDstOptimal);
+    recordCopyFromBuffer(cmd, stagingBuffer->getBuffer());
+}
+
+void VulkanImage2D::recordCopyFromBuffer(vk::CommandBuffer * cmd, vk::Buffer srcBuffer, vk::DeviceSize srcOffset, bool transitionToGeneral)
+{
+    // The copy overwrites all of mip 0 and leaves the other mips stale, so the old contents can be discarded
+    VulkanBarrierBatch barriers;
+    barriers.transition(this, vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer, true /* discard */);
+    barriers.flush(cmd);
 
     vk::BufferImageCopy bic;
     bic.bufferRowLength = 0;
-    bic.bufferOffset = 0;
+    bic.bufferOffset = srcOffset;
     bic.bufferImageHeight = 0;
 
     bic.imageExtent = vk::Extent3D{ (uint32_t)mSize.x, (uint32_t)mSize.y, 1 };
@@ -375,7 +398,7 @@ void VulkanImage2D::loadFromBuffer(VulkanBufferRef stagingBuffer, vk::CommandBuf
     bic.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
 
     cmd->copyBufferToImage(
-        stagingBuffer->getBuffer(),
+        srcBuffer,
         getImage(),
         vk::ImageLayout::eTransferDstOptimal,
         {
@@ -383,19 +406,22 @@ void VulkanImage2D::loadFromBuffer(VulkanBufferRef stagingBuffer, vk::CommandBuf
         }
     );
 
-    transitionLayout(cmd);
-
-
-    if (task)
+    if (transitionToGeneral)
     {
-        task->end();
-        task->execute(true);
+        transitionLayout(cmd);
     }
 }
 
 void VulkanImage2D::loadFromMemory(void * pixelData, uint64_t sizeBytes, VulkanBufferRef stagingBuffer, vk::CommandBuffer * cmd)
 {
 
+    if (!stagingBuffer && !cmd)
+    {
+        // The batch records into this image later, hold it until the batch completes
+        mContext->getUploader()->uploadImage(this, pixelData, sizeBytes, shared_from_this());
+        return;
+    }
+
     if (!stagingBuffer) 
     {
         stagingBuffer = mContext->makeBuffer(vk::BufferUsageFlagBits::eTransferSrc, sizeBytes, VulkanBuffer::CPU_ALOT, (void*)pixelData);
@@ -424,6 +450,11 @@ void VulkanImage2D::generateMipmaps(vk::CommandBuffer * cmd)
         cmd = &task->getCommandBuffer();
     }
 
+    // Order the blits after whatever last wrote mip 0, the mips stay in eGeneral throughout
+    VulkanBarrierBatch barriers;
+    barriers.transition(this, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer);
+    barriers.flush(cmd);
+
 	vk::ImageMemoryBarrier barrier = {};
 	barrier.image = mImage;
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
@@ -436,23 +467,21 @@ void VulkanImage2D::generateMipmaps(vk::CommandBuffer * cmd)
 	barrier.oldLayout = vk::ImageLayout::eGeneral;
 	barrier.newLayout = vk::ImageLayout::eGeneral;
 
+	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
 	int32_t mipWidth = mSize.x;
 	int32_t mipHeight = mSize.y;
 
 	for (uint16_t mipLevel = 1; mipLevel < mMipLevels; mipLevel++) 
 	{
-		barrier.subresourceRange.baseMipLevel = mipLevel - 1;
-		//barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-		//barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-
-		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-		barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-
-		cmd->pipelineBarrier(
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::DependencyFlags{}, nullptr, nullptr, { barrier }
-		);
+		// Mip 0 is covered by the barrier above, later sources were written by the previous blit
+		if (mipLevel > 1)
+		{
+			barrier.subresourceRange.baseMipLevel = mipLevel - 1;
+			barriers.image(barrier, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer);
+			barriers.flush(cmd);
+		}
 
 		vk::ImageBlit blit = {};
 		blit.srcOffsets[0] = vk::Offset3D{ 0, 0, 0 };
@@ -469,24 +498,11 @@ void VulkanImage2D::generateMipmaps(vk::CommandBuffer * cmd)
 		blit.dstSubresource.layerCount = 1;
 
 		cmd->blitImage(
-			//mImage, vk::ImageLayout::eTransferSrcOptimal,
-			//mImage, vk::ImageLayout::eTransferSrcOptimal,
 			mImage, vk::ImageLayout::eGeneral,
 			mImage, vk::ImageLayout::eGeneral,
 			{ blit }, vk::Filter::eLinear
 		);
 
-		//barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
-		//barrier.newLayout = vk::ImageLayout::eGeneral;
-		barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-		cmd->pipelineBarrier(
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			vk::DependencyFlags{}, nullptr, nullptr, { barrier }
-		);
-
         if (mipWidth > 1) 
         {
             mipWidth /= 2;
@@ -497,17 +513,9 @@ void VulkanImage2D::generateMipmaps(vk::CommandBuffer * cmd)
         }
 	}
 
-	barrier.subresourceRange.baseMipLevel = mMipLevels - 1;
-	//barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-	//barrier.newLayout = vk::ImageLayout::eGeneral;
-	barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-	cmd->pipelineBarrier(
-		vk::PipelineStageFlagBits::eTransfer,
-		vk::PipelineStageFlagBits::eFragmentShader,
-		vk::DependencyFlags{}, nullptr, nullptr, { barrier }
-	);
+	// One barrier for all mips instead of one per blit
+	barriers.access(mState, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader);
+	barriers.flush(cmd);
 
     if (task)
     {
@@ -517,21 +525,58 @@ void VulkanImage2D::generateMipmaps(vk::CommandBuffer * cmd)
 
 }
 
-void VulkanImage2D::resize(uvec2 size)
+void VulkanImage2D::resize(uvec2 size, VulkanFrameContextRef frames)
 {
-	if (mViewCreated) mContext->getDevice().destroyImageView(mImageView);
-	if (mImageCreated) mContext->getDevice().destroyImage(mImage);
-	if (mMemoryAllocated) mContext->getDevice().freeMemory(mMemory);
-    
-    for (int i = 0; i < mMipViews.size(); ++i) 
+    if (frames)
     {
-        mContext->getDevice().destroyImageView(mMipViews[i]);
+        // Frames in flight may still use the old image
+        auto device = mContext->getDevice();
+        auto * allocator = mContext->getAllocator();
+
+        vk::ImageView view = mViewCreated ? mImageView : vk::ImageView();
+        vk::Image image = mImageCreated ? mImage : vk::Image();
+        auto mipViews = mMipViews;
+        auto allocation = mAllocation;
+        bool ownsMemory = mMemoryAllocated;
+        bool mapped = isMemoryMapped();
+
+        frames->defer([=]() mutable {
+            for (auto mipView : mipViews) device.destroyImageView(mipView);
+            if (view) device.destroyImageView(view);
+            if (image) device.destroyImage(image);
+            if (mapped) allocator->unmap(allocation);
+            if (ownsMemory) allocator->free(allocation);
+        });
+
+        mMemoryMapping = nullptr;
+    }
+    else
+    {
+        if (mViewCreated) mContext->getDevice().destroyImageView(mImageView);
+        if (mImageCreated) mContext->getDevice().destroyImage(mImage);
+        if (mMemoryAllocated) freeDeviceMemory();
+
+        for (int i = 0; i < mMipViews.size(); ++i)
+        {
+            mContext->getDevice().destroyImageView(mMipViews[i]);
+        }
     }
 
 	mSize = uvec3(size.x, size.y, 1);
+	mState = VulkanResourceState();
 
 	if (mImageCreated) createImage();
-	if (mMemoryAllocated) allocateDeviceMemory();
+	if (mMemoryAllocated) allocateDeviceMemory(mMemoryFlags);
+
+	// The new image waits for bindMemory, which also creates its view
+	if (mBindMemoryLater)
+	{
+		mMemoryBound = false;
+		mViewCreated = false;
+		mMipViews.clear();
+		return;
+	}
+
 	if (mViewCreated) createImageView();
 }
 
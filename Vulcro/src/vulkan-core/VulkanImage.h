@@ -3,8 +3,17 @@
 #include "vulkan/vulkan.hpp"
 #include "General.h"
 #include "VulkanContext.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanBarrierBatch.h"
 
-class VulkanImage
+//Who provides an image's memory
+enum class VulkanImageMemory
+{
+	ALLOCATE,   // The image allocates and owns its memory
+	BIND_LATER  // Memory is owned elsewhere and bound with bindMemory, e.g. aliased transient targets
+};
+
+class VulkanImage : public std::enable_shared_from_this<VulkanImage>
 {
 public:
 
@@ -37,11 +46,22 @@ public:
 	vk::DescriptorImageInfo getDII(uint16_t mipLevel = 0);
 	vk::DescriptorType getDescriptorType();
 
+	//Transition from the tracked layout, waiting only on the last use of the image
 	void transitionLayout(vk::CommandBuffer * cmd, vk::ImageLayout layout = vk::ImageLayout::eGeneral);
 
     //Warning: Only use for host visible images. Use VulkanImage2D::loadFromMemory instead. 
 	void upload(uint64_t size, void* data);
 
+	//For VulkanImageMemory::BIND_LATER images, memory must stay alive while the image is bound to it
+	vk::MemoryRequirements getMemoryRequirements();
+
+	//Binds memory the image doesn't own and creates its view. Once per vk::Image, resize gives a new one
+	void bindMemory(vk::DeviceMemory memory, vk::DeviceSize offset);
+
+	inline bool isMemoryBound() {
+		return mMemoryAllocated || mMemoryBound;
+	}
+
 	//////////////////////////
 	//// Getters / Setters
 	/////////////////////////
@@ -78,12 +98,34 @@ public:
 		return mSize;
 	}
 
+	inline uint16_t getMipLevels() {
+		return mMipLevels;
+	}
+
 	inline uint64_t getMemorySize() {
 		return mMemorySize;
 	}
 
+	inline const VulkanAllocation & getAllocation() {
+		return mAllocation;
+	}
+
+	//Layout and last access as recorded through VulkanBarrierBatch
+	inline VulkanResourceState & getState() {
+		return mState;
+	}
+
+	//For uses outside a VulkanBarrierBatch, e.g. render passes with their own layout transitions
+	inline void setState(VulkanResourceState const & state) {
+		mState = state;
+	}
+
+	//Render targets at least this large get a dedicated allocation instead of a block slice
+	static const vk::DeviceSize DEDICATED_RENDER_TARGET_SIZE;
+
 protected:
 	void allocateDeviceMemory(vk::MemoryPropertyFlags memFlags = vk::MemoryPropertyFlagBits::eDeviceLocal);
+	void freeDeviceMemory();
 
 	VulkanContextPtr mContext;
 
@@ -98,13 +140,19 @@ protected:
 	vk::Image mImage = nullptr;
 	glm::uvec3 mSize;
 
-	vk::DeviceMemory mMemory = nullptr;
+	VulkanAllocation mAllocation;
+	vk::MemoryPropertyFlags mMemoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
 	uint64_t mMemorySize;
 	uint16_t mMipLevels = 1;
+
+	VulkanResourceState mState;
 	
 	bool mImageCreated = false;
 	bool mMemoryAllocated = false;
     bool mViewCreated = false;
+
+	bool mBindMemoryLater = false;
+	bool mMemoryBound = false;
 };
 
 /**************************************************
@@ -150,6 +198,8 @@ public:
 
 	VulkanImage2D(VulkanContextPtr ctx, vk::Image image, vk::Format format, glm::uvec2 size);
 
+	VulkanImage2D(VulkanContextPtr ctx, vk::ImageUsageFlags usage, vk::Format format, glm::uvec2 size, VulkanImageMemory memory);
+
 	//////////////////////////
 	//// Functions
 	/////////////////////////
@@ -157,13 +207,18 @@ public:
     //Generate mipmaps now or optionally provide command buffer to submit later.
 	void generateMipmaps(vk::CommandBuffer * cmd = nullptr);
 
+    //Without a command buffer the copy is batched on the context's uploader and submitted before the next task executes
     void loadFromBuffer(VulkanBufferRef stagingBuffer, vk::CommandBuffer * cmd = nullptr);
 
     void loadFromMemory(void * pixelData, uint64_t sizeBytes, VulkanBufferRef stagingBuffer = nullptr, vk::CommandBuffer * cmd = nullptr);
+
+    //Record a copy of tightly packed texels at srcOffset into mip 0, leaving the image in eGeneral (or eTransferDstOptimal)
+    void recordCopyFromBuffer(vk::CommandBuffer * cmd, vk::Buffer srcBuffer, vk::DeviceSize srcOffset = 0, bool transitionToGeneral = true);
          
 	void createImageView(vk::ImageAspectFlags aspectFlags = vk::ImageAspectFlagBits::eColor) override;
 
-	void resize(uvec2 size);
+	//frames - destroy the old image once the frame being recorded completes instead of right away
+	void resize(uvec2 size, VulkanFrameContextRef frames = nullptr);
 
 	//////////////////////////
 	//// Getters / Setters
@@ -0,0 +1,136 @@
+#include "VulkanLayoutCache.h"
+
+#include "VulkanSetLayout.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanTracer.h"
+
+#include <cstring>
+
+namespace
+{
+    uint64_t floatBits(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+}
+
+VulkanLayoutCache::VulkanLayoutCache(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+
+}
+
+VulkanLayoutCache::~VulkanLayoutCache()
+{
+    mSetLayouts.clear();
+
+    for (auto & entry : mPipelineLayouts)
+    {
+        mCtx->getDevice().destroyPipelineLayout(entry.second, nullptr, mCtx->getDynamicDispatch());
+    }
+
+    for (auto & entry : mSamplers)
+    {
+        mCtx->getDevice().destroySampler(entry.second, nullptr, mCtx->getDynamicDispatch());
+    }
+}
+
+VulkanSetLayoutRef VulkanLayoutCache::getSetLayout(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t maxSets, bool updateAfterBind)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    updateAfterBind = updateAfterBind && mCtx->supportsUpdateAfterBind();
+
+    // The descriptor allocator already merges equal bindings, its signature is the key
+    auto * signature = mCtx->getDescriptorAllocator()->getSignature(bindings, maxSets, updateAfterBind);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto & layout = mSetLayouts[signature];
+
+    if (!layout)
+    {
+        layout = make_shared<VulkanSetLayout>(mCtx, bindings, maxSets, updateAfterBind);
+    }
+
+    return layout;
+}
+
+vk::Sampler VulkanLayoutCache::getSampler(vk::SamplerCreateInfo const & info)
+{
+    Key key = {
+        static_cast<uint32_t>(info.flags),
+        static_cast<uint64_t>(info.magFilter),
+        static_cast<uint64_t>(info.minFilter),
+        static_cast<uint64_t>(info.mipmapMode),
+        static_cast<uint64_t>(info.addressModeU),
+        static_cast<uint64_t>(info.addressModeV),
+        static_cast<uint64_t>(info.addressModeW),
+        floatBits(info.mipLodBias),
+        info.anisotropyEnable,
+        floatBits(info.maxAnisotropy),
+        info.compareEnable,
+        static_cast<uint64_t>(info.compareOp),
+        floatBits(info.minLod),
+        floatBits(info.maxLod),
+        static_cast<uint64_t>(info.borderColor),
+        info.unnormalizedCoordinates
+    };
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto & sampler = mSamplers[key];
+
+    if (!sampler)
+    {
+        auto createInfo = info;
+        createInfo.pNext = nullptr;
+
+        sampler = mCtx->getDevice().createSampler(createInfo, nullptr, mCtx->getDynamicDispatch());
+    }
+
+    return sampler;
+}
+
+vk::PipelineLayout VulkanLayoutCache::getPipelineLayout(vk::ArrayProxy<const vk::DescriptorSetLayout> setLayouts, vk::ArrayProxy<const vk::PushConstantRange> pushConstantRanges)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    Key key;
+
+    for (auto & setLayout : setLayouts)
+    {
+        key.push_back(reinterpret_cast<uint64_t>(static_cast<VkDescriptorSetLayout>(setLayout)));
+    }
+
+    key.push_back(~0ull);
+
+    for (auto & range : pushConstantRanges)
+    {
+        key.push_back(static_cast<uint32_t>(range.stageFlags));
+        key.push_back(range.offset);
+        key.push_back(range.size);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto & layout = mPipelineLayouts[key];
+
+    if (!layout)
+    {
+        layout = mCtx->getDevice().createPipelineLayout(
+            vk::PipelineLayoutCreateInfo(
+                vk::PipelineLayoutCreateFlags(),
+                setLayouts.size(),
+                setLayouts.data(),
+                pushConstantRanges.size(),
+                pushConstantRanges.data()
+            ), nullptr,
+            mCtx->getDynamicDispatch()
+        );
+    }
+
+    return layout;
+}
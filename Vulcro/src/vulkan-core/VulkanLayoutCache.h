@@ -0,0 +1,56 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <map>
+#include <mutex>
+
+struct VulkanDescriptorSignature;
+
+/*
+* Context owned cache of the immutable objects pipelines are built from. Equal inputs return the same object,
+* so pipelines made from equal set layouts and push constant ranges share a pipeline layout and sets stay bound
+* across switching between them. Everything lives as long as the context.
+*/
+class VulkanLayoutCache
+{
+public:
+
+    VulkanLayoutCache(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanLayoutCache)
+
+    ~VulkanLayoutCache();
+
+    //See VulkanSetLayout, maxSets still grows the shared pools when the layout is found
+    VulkanSetLayoutRef getSetLayout(vk::ArrayProxy<const VulkanSetLayoutBinding> bindings, uint32_t maxSets = 1, bool updateAfterBind = false);
+
+    //info.pNext is ignored
+    vk::Sampler getSampler(vk::SamplerCreateInfo const & info);
+
+    vk::PipelineLayout getPipelineLayout(vk::ArrayProxy<const vk::DescriptorSetLayout> setLayouts, vk::ArrayProxy<const vk::PushConstantRange> pushConstantRanges);
+
+    uint32_t getSamplerCount()
+    {
+        return static_cast<uint32_t>(mSamplers.size());
+    }
+
+    uint32_t getPipelineLayoutCount()
+    {
+        return static_cast<uint32_t>(mPipelineLayouts.size());
+    }
+
+private:
+
+    typedef vector<uint64_t> Key;
+
+    VulkanContextPtr mCtx;
+
+    std::map<VulkanDescriptorSignature *, VulkanSetLayoutRef> mSetLayouts;
+    std::map<Key, vk::Sampler> mSamplers;
+    std::map<Key, vk::PipelineLayout> mPipelineLayouts;
+
+    std::mutex mMutex;
+};
@@ -0,0 +1,429 @@
+#include "VulkanMemoryAllocator.h"
+#include "VulkanContext.h"
+
+const vk::DeviceSize VulkanMemoryAllocator::DEDICATED_THRESHOLD = 64ull * 1024 * 1024;
+const vk::DeviceSize VulkanMemoryAllocator::DEFAULT_BLOCK_SIZE = 256ull * 1024 * 1024;
+
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    if (alignment <= 1) return value;
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+static bool onSamePage(vk::DeviceSize a, vk::DeviceSize b, vk::DeviceSize pageSize)
+{
+    return (a / pageSize) == (b / pageSize);
+}
+
+/**************************************************
+ * Block
+ * ************************************************/
+
+VulkanMemoryBlock::VulkanMemoryBlock(VulkanContextPtr ctx, uint32_t memoryTypeIndex, vk::DeviceSize size, vk::DeviceSize granularity) :
+    mCtx(ctx),
+    mSize(size),
+    mGranularity(glm::max<vk::DeviceSize>(granularity, 1)),
+    mMemoryTypeIndex(memoryTypeIndex)
+{
+    mMemory = mCtx->getDevice().allocateMemory(
+        vk::MemoryAllocateInfo(size, memoryTypeIndex)
+    );
+
+#ifdef VULCRO_PRINT_ALLOCATIONS
+    printf("VulkanMemoryBlock: Allocating block %lli of type %u \n", size, memoryTypeIndex);
+#endif
+
+    mFreeRanges[0] = size;
+}
+
+VulkanMemoryBlock::~VulkanMemoryBlock()
+{
+    if (mMapped)
+    {
+        mCtx->getDevice().unmapMemory(mMemory);
+    }
+
+    mCtx->getDevice().freeMemory(mMemory);
+}
+
+bool VulkanMemoryBlock::allocate(vk::DeviceSize size, vk::DeviceSize alignment, bool linear, VulkanAllocation & outAllocation)
+{
+    for (auto iter = mFreeRanges.begin(); iter != mFreeRanges.end(); ++iter)
+    {
+        vk::DeviceSize rangeStart = iter->first;
+        vk::DeviceSize rangeEnd = iter->first + iter->second;
+
+        vk::DeviceSize start = alignUp(rangeStart, alignment);
+
+        // A buffer and an image may not share a granularity page, bump past the previous neighbour's page
+        if (mGranularity > 1)
+        {
+            auto prev = mAllocations.lower_bound(rangeStart);
+
+            if (prev != mAllocations.begin())
+            {
+                --prev;
+                vk::DeviceSize prevLast = prev->first + prev->second.size - 1;
+
+                if (prev->second.linear != linear && onSamePage(prevLast, start, mGranularity))
+                {
+                    start = alignUp(start, mGranularity);
+                }
+            }
+        }
+
+        vk::DeviceSize end = start + size;
+
+        if (end > rangeEnd)
+        {
+            continue;
+        }
+
+        // Same check against the neighbour that follows this range
+        if (mGranularity > 1)
+        {
+            auto next = mAllocations.find(rangeEnd);
+
+            if (next != mAllocations.end() && next->second.linear != linear && onSamePage(end - 1, next->first, mGranularity))
+            {
+                continue;
+            }
+        }
+
+        mFreeRanges.erase(iter);
+
+        if (start > rangeStart)
+        {
+            mFreeRanges[rangeStart] = start - rangeStart;
+        }
+
+        if (end < rangeEnd)
+        {
+            mFreeRanges[end] = rangeEnd - end;
+        }
+
+        mAllocations[start] = Suballocation{ size, linear };
+        mUsed += size;
+
+        outAllocation.memory = mMemory;
+        outAllocation.offset = start;
+        outAllocation.size = size;
+        outAllocation.memoryTypeIndex = mMemoryTypeIndex;
+        outAllocation.block = this;
+        outAllocation.dedicated = false;
+
+        return true;
+    }
+
+    return false;
+}
+
+void VulkanMemoryBlock::free(vk::DeviceSize offset)
+{
+    auto alloc = mAllocations.find(offset);
+    assert(alloc != mAllocations.end());
+
+    vk::DeviceSize start = offset;
+    vk::DeviceSize size = alloc->second.size;
+
+    mUsed -= size;
+    mAllocations.erase(alloc);
+
+    // Merge with the following free range
+    auto next = mFreeRanges.find(start + size);
+    if (next != mFreeRanges.end())
+    {
+        size += next->second;
+        mFreeRanges.erase(next);
+    }
+
+    // Merge with the preceding free range
+    auto prev = mFreeRanges.lower_bound(start);
+    if (prev != mFreeRanges.begin())
+    {
+        --prev;
+        if (prev->first + prev->second == start)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    mFreeRanges[start] = size;
+}
+
+void * VulkanMemoryBlock::map()
+{
+    if (mMapCount++ == 0)
+    {
+        mMapped = mCtx->getDevice().mapMemory(mMemory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags());
+    }
+
+    return mMapped;
+}
+
+void VulkanMemoryBlock::unmap()
+{
+    assert(mMapCount > 0);
+
+    if (--mMapCount == 0)
+    {
+        mCtx->getDevice().unmapMemory(mMemory);
+        mMapped = nullptr;
+    }
+}
+
+VulkanMemoryBlock::Stats VulkanMemoryBlock::getStats() const
+{
+    Stats stats;
+    stats.memoryTypeIndex = mMemoryTypeIndex;
+    stats.size = mSize;
+    stats.used = mUsed;
+    stats.allocationCount = static_cast<uint32_t>(mAllocations.size());
+    stats.freeRangeCount = static_cast<uint32_t>(mFreeRanges.size());
+    stats.largestFreeRange = 0;
+
+    for (auto & range : mFreeRanges)
+    {
+        stats.largestFreeRange = glm::max(stats.largestFreeRange, range.second);
+    }
+
+    vk::DeviceSize totalFree = mSize - mUsed;
+
+    stats.fragmentation = totalFree > 0 ? 1.0f - (float)stats.largestFreeRange / (float)totalFree : 0.0f;
+
+    return stats;
+}
+
+/**************************************************
+ * Allocator
+ * ************************************************/
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+    mMemoryProperties = ctx->getPhysicalDevice().getMemoryProperties();
+    mGranularity = ctx->getPhysicalDeviceProperties().limits.bufferImageGranularity;
+
+    mBlocks.resize(mMemoryProperties.memoryTypeCount);
+}
+
+VulkanMemoryAllocator::~VulkanMemoryAllocator()
+{
+    mBlocks.clear();
+}
+
+vk::DeviceSize VulkanMemoryAllocator::getBlockSize(uint32_t memoryTypeIndex)
+{
+    auto heapIndex = mMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    auto heapSize = mMemoryProperties.memoryHeaps[heapIndex].size;
+
+    // Small heaps (e.g. the 256MB host visible device local heap) get proportionally smaller blocks
+    if (heapSize <= 1024ull * 1024 * 1024)
+    {
+        return alignUp(heapSize / 8, 32);
+    }
+
+    return DEFAULT_BLOCK_SIZE;
+}
+
+VulkanAllocation VulkanMemoryAllocator::allocate(vk::MemoryRequirements const & memReqs, vk::MemoryPropertyFlags memFlags, bool linear, bool dedicated,
+    vk::MemoryDedicatedAllocateInfo const & resource)
+{
+    auto memTypeRes = mCtx->getBestMemoryIndex(memReqs, memFlags);
+
+    assert(memTypeRes.isValid);
+
+    uint32_t memoryTypeIndex = memTypeRes.value;
+    auto typeFlags = mMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+    vk::DeviceSize alignment = memReqs.alignment;
+    vk::DeviceSize size = memReqs.size;
+
+    // Keep non coherent allocations on their own atoms so flushing one never touches a neighbour
+    if ((typeFlags & vk::MemoryPropertyFlagBits::eHostVisible) && !(typeFlags & vk::MemoryPropertyFlagBits::eHostCoherent))
+    {
+        auto atomSize = mCtx->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
+        alignment = glm::max(alignment, atomSize);
+        size = alignUp(size, atomSize);
+    }
+
+    auto blockSize = getBlockSize(memoryTypeIndex);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VulkanAllocation allocation;
+
+    if (!dedicated && size < DEDICATED_THRESHOLD && size <= blockSize / 2)
+    {
+        for (auto & block : mBlocks[memoryTypeIndex])
+        {
+            if (block->allocate(size, alignment, linear, allocation))
+            {
+                return allocation;
+            }
+        }
+
+        try
+        {
+            mBlocks[memoryTypeIndex].emplace_back(new VulkanMemoryBlock(mCtx, memoryTypeIndex, blockSize, mGranularity));
+
+            if (mBlocks[memoryTypeIndex].back()->allocate(size, alignment, linear, allocation))
+            {
+                return allocation;
+            }
+        }
+        catch (vk::SystemError const & error)
+        {
+            std::cerr << "(VulkanMemoryAllocator - allocate) could not allocate a new block, falling back to dedicated memory" << std::endl;
+        }
+    }
+
+    vk::MemoryAllocateInfo allocateInfo(size, memoryTypeIndex);
+
+    // Memory dedicated to a resource has to be exactly its size, nothing else can be bound to it anyway
+    vk::MemoryDedicatedAllocateInfo dedicatedInfo = resource;
+    dedicatedInfo.pNext = nullptr;
+
+    if (dedicatedInfo.image || dedicatedInfo.buffer)
+    {
+        size = memReqs.size;
+        allocateInfo.allocationSize = size;
+        allocateInfo.pNext = &dedicatedInfo;
+    }
+
+    allocation.memory = mCtx->getDevice().allocateMemory(allocateInfo);
+
+#ifdef VULCRO_PRINT_ALLOCATIONS
+    printf("VulkanMemoryAllocator: Dedicated allocation %lli \n", size);
+#endif
+
+    allocation.offset = 0;
+    allocation.size = size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.block = nullptr;
+    allocation.dedicated = true;
+
+    mDedicatedCount++;
+
+    return allocation;
+}
+
+void VulkanMemoryAllocator::free(VulkanAllocation & allocation)
+{
+    if (!allocation.isValid()) return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (allocation.dedicated)
+    {
+        mDedicatedMappings.erase(allocation.memory);
+        mCtx->getDevice().freeMemory(allocation.memory);
+        mDedicatedCount--;
+    }
+    else
+    {
+        allocation.block->free(allocation.offset);
+
+        // Hold on to one empty block per memory type to avoid thrashing, release the rest
+        if (allocation.block->isEmpty())
+        {
+            auto & blocks = mBlocks[allocation.memoryTypeIndex];
+            uint32_t emptyCount = 0;
+
+            for (auto & block : blocks)
+            {
+                if (block->isEmpty()) emptyCount++;
+            }
+
+            if (emptyCount > 1)
+            {
+                for (auto iter = blocks.begin(); iter != blocks.end(); ++iter)
+                {
+                    if (iter->get() == allocation.block)
+                    {
+                        blocks.erase(iter);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    allocation = VulkanAllocation();
+}
+
+void * VulkanMemoryAllocator::map(VulkanAllocation const & allocation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (allocation.dedicated)
+    {
+        auto & mapping = mDedicatedMappings[allocation.memory];
+
+        if (mapping.second++ == 0)
+        {
+            mapping.first = mCtx->getDevice().mapMemory(allocation.memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags());
+        }
+
+        return mapping.first;
+    }
+
+    return (char*)allocation.block->map() + allocation.offset;
+}
+
+void VulkanMemoryAllocator::unmap(VulkanAllocation const & allocation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (allocation.dedicated)
+    {
+        auto & mapping = mDedicatedMappings[allocation.memory];
+
+        assert(mapping.second > 0);
+
+        if (--mapping.second == 0)
+        {
+            mCtx->getDevice().unmapMemory(allocation.memory);
+            mDedicatedMappings.erase(allocation.memory);
+        }
+
+        return;
+    }
+
+    allocation.block->unmap();
+}
+
+std::vector<VulkanMemoryBlock::Stats> VulkanMemoryAllocator::getBlockStats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::vector<VulkanMemoryBlock::Stats> stats;
+
+    for (auto & blocks : mBlocks)
+    {
+        for (auto & block : blocks)
+        {
+            stats.push_back(block->getStats());
+        }
+    }
+
+    return stats;
+}
+
+void VulkanMemoryAllocator::printStats()
+{
+    auto stats = getBlockStats();
+
+    std::cout << "VulkanMemoryAllocator: " << stats.size() << " blocks, " << mDedicatedCount << " dedicated allocations" << std::endl;
+
+    for (auto & block : stats)
+    {
+        std::cout << "  type " << block.memoryTypeIndex
+            << " | used " << block.used << " / " << block.size
+            << " | allocations " << block.allocationCount
+            << " | free ranges " << block.freeRangeCount
+            << " | largest free " << block.largestFreeRange
+            << " | fragmentation " << block.fragmentation << std::endl;
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "../VulcroTypes.h"
+
+#include <map>
+#include <mutex>
+
+class VulkanMemoryBlock;
+
+/*
+* A range of device memory handed out by VulkanMemoryAllocator.
+* Either a slice of a shared block or a dedicated vk::DeviceMemory.
+*/
+struct VulkanAllocation
+{
+    vk::DeviceMemory memory = nullptr;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+
+    //Owning block, nullptr for dedicated allocations
+    VulkanMemoryBlock * block = nullptr;
+    bool dedicated = false;
+
+    bool isValid() const
+    {
+        return memory;
+    }
+};
+
+/*
+* One large vk::DeviceMemory carved up with a first-fit free list.
+* Linear (buffer) and optimal (image) resources are kept bufferImageGranularity apart.
+*/
+class VulkanMemoryBlock
+{
+public:
+
+    struct Stats
+    {
+        uint32_t memoryTypeIndex;
+        vk::DeviceSize size;
+        vk::DeviceSize used;
+        vk::DeviceSize largestFreeRange;
+        uint32_t allocationCount;
+        uint32_t freeRangeCount;
+
+        //0 when all free space is contiguous, approaching 1 as it splinters
+        float fragmentation;
+    };
+
+    VulkanMemoryBlock(VulkanContextPtr ctx, uint32_t memoryTypeIndex, vk::DeviceSize size, vk::DeviceSize granularity);
+
+    VULCRO_DONT_COPY(VulkanMemoryBlock)
+
+    ~VulkanMemoryBlock();
+
+    bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, bool linear, VulkanAllocation & outAllocation);
+
+    void free(vk::DeviceSize offset);
+
+    //Host visible blocks are mapped once and shared by every allocation inside
+    void * map();
+
+    void unmap();
+
+    Stats getStats() const;
+
+    bool isEmpty() const
+    {
+        return mAllocations.empty();
+    }
+
+    vk::DeviceMemory getMemory() const
+    {
+        return mMemory;
+    }
+
+    vk::DeviceSize getSize() const
+    {
+        return mSize;
+    }
+
+private:
+
+    struct Suballocation
+    {
+        vk::DeviceSize size;
+        bool linear;
+    };
+
+    VulkanContextPtr mCtx;
+    vk::DeviceMemory mMemory;
+    vk::DeviceSize mSize;
+    vk::DeviceSize mGranularity;
+    vk::DeviceSize mUsed = 0;
+    uint32_t mMemoryTypeIndex;
+
+    //offset -> size of each unused range, adjacent ranges are always merged
+    std::map<vk::DeviceSize, vk::DeviceSize> mFreeRanges;
+
+    //offset -> live allocation
+    std::map<vk::DeviceSize, Suballocation> mAllocations;
+
+    void * mMapped = nullptr;
+    uint32_t mMapCount = 0;
+};
+
+/*
+* Context owned device memory allocator.
+* Keeps a list of blocks per memory type and sub-allocates buffers and images out of them,
+* falling back to dedicated allocations for large resources.
+*/
+class VulkanMemoryAllocator
+{
+public:
+
+    //Resources at least this large, or that don't fit a block, get their own vk::DeviceMemory
+    static const vk::DeviceSize DEDICATED_THRESHOLD;
+    static const vk::DeviceSize DEFAULT_BLOCK_SIZE;
+
+    VulkanMemoryAllocator(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanMemoryAllocator)
+
+    ~VulkanMemoryAllocator();
+
+    /*
+    * @param linear - true for buffers, false for optimally tiled images
+    * @param dedicated - force a dedicated allocation (e.g. large render targets)
+    * @param resource - image or buffer the memory is for, chained into dedicated allocations
+    */
+    VulkanAllocation allocate(vk::MemoryRequirements const & memReqs, vk::MemoryPropertyFlags memFlags, bool linear, bool dedicated = false,
+        vk::MemoryDedicatedAllocateInfo const & resource = vk::MemoryDedicatedAllocateInfo());
+
+    void free(VulkanAllocation & allocation);
+
+    void * map(VulkanAllocation const & allocation);
+
+    void unmap(VulkanAllocation const & allocation);
+
+    std::vector<VulkanMemoryBlock::Stats> getBlockStats();
+
+    void printStats();
+
+    uint32_t getDedicatedAllocationCount()
+    {
+        return mDedicatedCount;
+    }
+
+private:
+
+    vk::DeviceSize getBlockSize(uint32_t memoryTypeIndex);
+
+    VulkanContextPtr mCtx;
+    vk::PhysicalDeviceMemoryProperties mMemoryProperties;
+    vk::DeviceSize mGranularity;
+
+    std::vector<std::vector<std::unique_ptr<VulkanMemoryBlock>>> mBlocks;
+
+    //Mapping state for dedicated allocations, keyed by their memory
+    std::unordered_map<VkDeviceMemory, std::pair<void*, uint32_t>> mDedicatedMappings;
+
+    uint32_t mDedicatedCount = 0;
+
+    std::mutex mMutex;
+};
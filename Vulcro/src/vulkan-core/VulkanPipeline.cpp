@@ -1,4 +1,7 @@
 #include "VulkanPipeline.h"
+#include "VulkanLayoutCache.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanProfiler.h"
 
 VulkanRenderPipeline::VulkanRenderPipeline(VulkanContextPtr ctx, VulkanShaderRef shader, VulkanRendererRef renderer,
 	PipelineConfig config,
@@ -11,14 +14,25 @@ VulkanRenderPipeline::VulkanRenderPipeline(VulkanContextPtr ctx, VulkanShaderRef
 {
 	auto vis = _shader->getVIS();
 
-	vk::DynamicState dynamicStateEnables[2];
-	dynamicStateEnables[0] = vk::DynamicState::eViewport;
-	dynamicStateEnables[1] = vk::DynamicState::eScissor;
+	_dynamicState = config.dynamicState && _ctx->supportsExtendedDynamicState();
+
+	vector<vk::DynamicState> dynamicStateEnables = {
+		vk::DynamicState::eViewport,
+		vk::DynamicState::eScissor
+	};
+
+	if (_dynamicState) {
+		dynamicStateEnables.push_back(static_cast<vk::DynamicState>(VK_DYNAMIC_STATE_CULL_MODE_EXT));
+		dynamicStateEnables.push_back(static_cast<vk::DynamicState>(VK_DYNAMIC_STATE_FRONT_FACE_EXT));
+		dynamicStateEnables.push_back(static_cast<vk::DynamicState>(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT));
+		dynamicStateEnables.push_back(static_cast<vk::DynamicState>(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT));
+		dynamicStateEnables.push_back(static_cast<vk::DynamicState>(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT));
+	}
 
 	auto dynamicState = vk::PipelineDynamicStateCreateInfo(
 		vk::PipelineDynamicStateCreateFlags(),
-		2,
-		dynamicStateEnables
+		static_cast<uint32_t>(dynamicStateEnables.size()),
+		dynamicStateEnables.data()
 	);
 
 
@@ -63,7 +77,7 @@ VulkanRenderPipeline::VulkanRenderPipeline(VulkanContextPtr ctx, VulkanShaderRef
 
 
 
-    auto dss = configureDepthTest();
+    auto dss = configureDepthTest(config);
 
     auto cbas = configureBlending(colorBlendConfigs);
 
@@ -81,16 +95,19 @@ VulkanRenderPipeline::VulkanRenderPipeline(VulkanContextPtr ctx, VulkanShaderRef
 	auto uniLayouts = shader->getDescriptorSetLayouts();
 
 
-    auto range = vk::PushConstantRange(vk::ShaderStageFlagBits::eAll, 0, pushConstantSize);
+	// A size given by the caller keeps covering every stage, otherwise just the stages that declare push constants
+	auto range = shader->getReflection().getPushConstantRange();
 
-	_pipelineLayout = _ctx->getDevice().createPipelineLayout(
-		vk::PipelineLayoutCreateInfo(
-			vk::PipelineLayoutCreateFlags(),
-			static_cast<uint32_t>(uniLayouts.size()),
-			uniLayouts.size() > 0 ? &uniLayouts[0] : nullptr,
-            pushConstantSize > 0 ? 1 : 0, //push
-            pushConstantSize > 0 ? &range : nullptr //push constant ranges
-		)
+	if (pushConstantSize > 0) {
+		range = vk::PushConstantRange(vk::ShaderStageFlagBits::eAll, 0, glm::max(pushConstantSize, range.size));
+	}
+
+	_pushConstantStages = range.stageFlags;
+
+	// Shared with every pipeline using the same set layouts and push constants
+	_pipelineLayout = _ctx->getLayoutCache()->getPipelineLayout(
+		uniLayouts,
+		range.size > 0 ? vk::ArrayProxy<const vk::PushConstantRange>(range) : nullptr
 	);
 
 	auto tsci = vk::PipelineTessellationStateCreateInfo(
@@ -101,7 +118,7 @@ VulkanRenderPipeline::VulkanRenderPipeline(VulkanContextPtr ctx, VulkanShaderRef
 	uint32_t numShaders = static_cast<uint32_t>(shader->getStages().size());
 
 	_pipeline = _ctx->getDevice().createGraphicsPipeline(
-		nullptr,
+		_ctx->getPipelineCache()->getCache(),
 		vk::GraphicsPipelineCreateInfo(
 			vk::PipelineCreateFlags(),
 			numShaders,
@@ -133,13 +150,16 @@ void VulkanRenderPipeline::bind(vk::CommandBuffer * cmd)
 
 }
 
-void VulkanRenderPipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> descriptorSets)
+void VulkanRenderPipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> descriptorSets, vk::ArrayProxy<const uint32_t> dynamicOffsets)
 {
 	int i = 0;
 
+	// Local so pipelines shared through the variant cache can record on several threads
+	vk::DescriptorSet vkSets[16];
+
 	for (auto &set : descriptorSets) {
 		if (set != nullptr) {
-			_descriptorSets[i++] = set->getDescriptorSet();
+			vkSets[i++] = set->getDescriptorSet();
 		}
 	}
 
@@ -148,9 +168,9 @@ void VulkanRenderPipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<cons
 		_pipelineLayout,
 		0,
 		i,
-		i > 0 ? _descriptorSets : nullptr,
-		0,
-		nullptr
+		i > 0 ? vkSets : nullptr,
+		dynamicOffsets.size(),
+		dynamicOffsets.data()
 	);
 }
 
@@ -158,8 +178,6 @@ VulkanRenderPipeline::~VulkanRenderPipeline() {
 
 	_ctx->getDevice().destroyPipeline(_pipeline);
 	
-	_ctx->getDevice().destroyPipelineLayout(_pipelineLayout);
-	
 }
 
 vector<vk::PipelineColorBlendAttachmentState> VulkanRenderPipeline::configureBlending(const vector<ColorBlendConfig>  & colorBlendConfigs)
@@ -215,7 +233,7 @@ vector<vk::PipelineColorBlendAttachmentState> VulkanRenderPipeline::configureBle
     return pcbas;
 }
 
-vk::PipelineDepthStencilStateCreateInfo VulkanRenderPipeline::configureDepthTest()
+vk::PipelineDepthStencilStateCreateInfo VulkanRenderPipeline::configureDepthTest(PipelineConfig const & config)
 {
 
 	auto sopstate = vk::StencilOpState();
@@ -224,8 +242,8 @@ vk::PipelineDepthStencilStateCreateInfo VulkanRenderPipeline::configureDepthTest
 
     return vk::PipelineDepthStencilStateCreateInfo(
         vk::PipelineDepthStencilStateCreateFlags(),
-        hasDepth, //DEPTH TEST
-        hasDepth, //DEPTH WRITE
+        hasDepth && config.depthTest, //DEPTH TEST
+        hasDepth && config.depthWrite, //DEPTH WRITE
         vk::CompareOp::eLess,
         VK_FALSE, //Bounds test
         VK_FALSE, //Stencil Test
@@ -240,20 +258,15 @@ VulkanComputePipeline::VulkanComputePipeline(VulkanContextPtr ctx, VulkanShaderR
 _shader(shader),
 _ctx(ctx)
 {
-	auto range = vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, pushConstantSize);
-
-	_pipelineLayout = _ctx->getDevice().createPipelineLayout(
-		vk::PipelineLayoutCreateInfo(
-			vk::PipelineLayoutCreateFlags(),
-			static_cast<uint32_t>(_shader->getDescriptorSetLayouts().size()),
-			&_shader->getDescriptorSetLayouts()[0],
-			pushConstantSize > 0 ? 1 : 0, //push
-            pushConstantSize > 0 ? &range : nullptr //push constant ranges
-		)
+	auto range = vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, glm::max(pushConstantSize, _shader->getReflection().getPushConstantRange().size));
+
+	_pipelineLayout = _ctx->getLayoutCache()->getPipelineLayout(
+		_shader->getDescriptorSetLayouts(),
+		range.size > 0 ? vk::ArrayProxy<const vk::PushConstantRange>(range) : nullptr
 	);
 	
 	_pipeline = _ctx->getDevice().createComputePipeline(
-		nullptr, //cache
+		_ctx->getPipelineCache()->getCache(),
 		vk::ComputePipelineCreateInfo(
 			vk::PipelineCreateFlags(),
 			_shader->getStages()[0],
@@ -274,14 +287,16 @@ void VulkanComputePipeline::bind(vk::CommandBuffer * cmd)
 	);
 }
 
-void VulkanComputePipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> descriptorSets)
+void VulkanComputePipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> descriptorSets, vk::ArrayProxy<const uint32_t> dynamicOffsets)
 {
 
 	int i = 0;
 
+	vk::DescriptorSet vkSets[16];
+
 	for (auto &set : descriptorSets) {
 		if (set != nullptr) {
-			_descriptorSets[i++] = set->getDescriptorSet();
+			vkSets[i++] = set->getDescriptorSet();
 		}
 	}
 
@@ -290,14 +305,22 @@ void VulkanComputePipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<con
 		_pipelineLayout,
 		0,
 		i,
-		i > 0 ? _descriptorSets : nullptr,
-		0,
-		nullptr
+		i > 0 ? vkSets : nullptr,
+		dynamicOffsets.size(),
+		dynamicOffsets.data()
 	);
 }
 
+void VulkanComputePipeline::dispatch(vk::CommandBuffer * cmd, uvec3 blocks, VulkanProfiler * profiler, const char * name)
+{
+	if (profiler) profiler->begin(cmd, name);
+
+	cmd->dispatch(blocks.x, blocks.y, blocks.z);
+
+	if (profiler) profiler->end(cmd);
+}
+
 VulkanComputePipeline::~VulkanComputePipeline()
 {
-	_ctx->getDevice().destroyPipelineLayout(_pipelineLayout);
 	_ctx->getDevice().destroyPipeline(_pipeline);
 }
@@ -29,7 +29,8 @@ public:
 
 	void bind(vk::CommandBuffer * cmd);
 
-	void bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets);
+	//dynamicOffsets supplies one offset per eUniformBufferDynamic / eStorageBufferDynamic binding, in set and binding order
+	void bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets, vk::ArrayProxy<const uint32_t> dynamicOffsets = nullptr);
 
 	//////////////////////////
 	//// Getters /Setters
@@ -45,20 +46,40 @@ public:
 		return _pipelineLayout;
 	}
 
+	//Cull mode, front face, topology and depth test / write come from the command buffer, see VulkanStateRecorder
+	inline bool hasDynamicState()
+	{
+		return _dynamicState;
+	}
+
+	//eAll when a push constant size was given, else the stages the shader reflects push constants in
+	inline vk::ShaderStageFlags getPushConstantStages()
+	{
+		return _pushConstantStages;
+	}
+
+	template <typename T>
+	void pushConstants(vk::CommandBuffer * cmd, T & data)
+	{
+		cmd->pushConstants<T>(_pipelineLayout, _pushConstantStages, 0, { data });
+	}
+
 private:
 
     vector<vk::PipelineColorBlendAttachmentState> configureBlending(const vector<ColorBlendConfig>  & colorBlendConfigs);
-    vk::PipelineDepthStencilStateCreateInfo configureDepthTest();
+    vk::PipelineDepthStencilStateCreateInfo configureDepthTest(PipelineConfig const & config);
 
 
 	vk::Pipeline _pipeline;
 	vk::PipelineLayout _pipelineLayout;
 
-	vk::DescriptorSet _descriptorSets[16];
-
 	VulkanShaderRef  _shader;
 	VulkanContextPtr _ctx;
 	VulkanRendererRef _renderer;
+
+	vk::ShaderStageFlags _pushConstantStages;
+
+	bool _dynamicState = false;
 };
 
 class VulkanComputePipeline {
@@ -69,7 +90,7 @@ public:
 
 	void bind(vk::CommandBuffer * cmd);
 
-	void bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets);
+	void bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets, vk::ArrayProxy<const uint32_t> dynamicOffsets = nullptr);
 
     template <typename T>
     void pushConstants(vk::CommandBuffer * cmd, T & data)
@@ -77,15 +98,12 @@ public:
         cmd->pushConstants<T>(_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, { data });
     }
 
-	void dispatch(vk::CommandBuffer * cmd, uvec3 blocks) {
-		cmd->dispatch(blocks.x, blocks.y, blocks.z);
-	}
+	//With a profiler the dispatch is timed as a region named name
+	void dispatch(vk::CommandBuffer * cmd, uvec3 blocks, VulkanProfiler * profiler = nullptr, const char * name = "dispatch");
 
 	~VulkanComputePipeline();
 
 private:
-	vk::DescriptorSet _descriptorSets[16];
-
 	VulkanShaderRef  _shader;
 	VulkanContextPtr _ctx;
 	vk::Pipeline _pipeline;
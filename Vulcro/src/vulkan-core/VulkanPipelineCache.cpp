@@ -0,0 +1,189 @@
+#include "VulkanPipelineCache.h"
+
+#include "VulkanTracer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+const char * VulkanPipelineCache::DEFAULT_PATH = "vulcro_pipeline_cache.bin";
+
+const uint32_t VulkanPipelineCache::FILE_MAGIC = 0x43504c56; // "VLPC"
+const uint32_t VulkanPipelineCache::FILE_VERSION = 1;
+
+VulkanPipelineCache::VulkanPipelineCache(VulkanContextPtr ctx, std::string path) :
+    mCtx(ctx),
+    mPath(path)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    vector<uint8_t> data;
+
+    if (!mPath.empty())
+    {
+        data = load();
+    }
+
+    mLoaded = data.size() > 0;
+
+    mCache = mCtx->getDevice().createPipelineCache(
+        vk::PipelineCacheCreateInfo(
+            vk::PipelineCacheCreateFlags(),
+            data.size(),
+            data.size() > 0 ? data.data() : nullptr
+        ), nullptr,
+        mCtx->getDynamicDispatch()
+    );
+}
+
+VulkanPipelineCache::~VulkanPipelineCache()
+{
+    if (!mPath.empty())
+    {
+        save();
+    }
+
+    mCtx->getDevice().destroyPipelineCache(mCache, nullptr, mCtx->getDynamicDispatch());
+}
+
+VulkanPipelineCache::FileHeader VulkanPipelineCache::makeHeader()
+{
+    auto & props = mCtx->getPhysicalDeviceProperties();
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.vendorID = props.vendorID;
+    header.deviceID = props.deviceID;
+    header.driverVersion = props.driverVersion;
+    memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+
+    return header;
+}
+
+uint64_t VulkanPipelineCache::hash(const vector<uint8_t> & data)
+{
+    // FNV-1a, only catches truncated or corrupted files
+    uint64_t h = 14695981039346656037ull;
+
+    for (auto byte : data)
+    {
+        h ^= byte;
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+vector<uint8_t> VulkanPipelineCache::load()
+{
+    std::ifstream file(mPath, std::ios::binary);
+
+    if (!file)
+    {
+        return {};
+    }
+
+    FileHeader header;
+
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    {
+        std::cerr << "(VulkanPipelineCache - load) " << mPath << " is truncated" << std::endl;
+        return {};
+    }
+
+    auto expected = makeHeader();
+
+    if (header.magic != expected.magic || header.version != expected.version)
+    {
+        std::cerr << "(VulkanPipelineCache - load) " << mPath << " is not a pipeline cache" << std::endl;
+        return {};
+    }
+
+    // A new driver or another GPU can't use the data, start over rather than hand it to the driver
+    if (header.vendorID != expected.vendorID ||
+        header.deviceID != expected.deviceID ||
+        header.driverVersion != expected.driverVersion ||
+        memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return {};
+    }
+
+    // The size comes from the file too, check it against what follows the header before allocating for it
+    auto dataStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    auto remaining = static_cast<uint64_t>(file.tellg() - dataStart);
+    file.seekg(dataStart);
+
+    if (header.dataSize > remaining)
+    {
+        std::cerr << "(VulkanPipelineCache - load) " << mPath << " is truncated" << std::endl;
+        return {};
+    }
+
+    vector<uint8_t> data(static_cast<size_t>(header.dataSize));
+
+    if (!file.read(reinterpret_cast<char *>(data.data()), data.size()) || hash(data) != header.dataHash)
+    {
+        std::cerr << "(VulkanPipelineCache - load) " << mPath << " is corrupted" << std::endl;
+        return {};
+    }
+
+    return data;
+}
+
+vector<uint8_t> VulkanPipelineCache::getData()
+{
+    return mCtx->getDevice().getPipelineCacheData(mCache, mCtx->getDynamicDispatch());
+}
+
+bool VulkanPipelineCache::save()
+{
+    return save(mPath);
+}
+
+bool VulkanPipelineCache::save(const std::string & path)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    if (path.empty()) return false;
+
+    auto data = getData();
+
+    auto header = makeHeader();
+    header.dataSize = data.size();
+    header.dataHash = hash(data);
+
+    std::string tempPath = path + ".tmp";
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+        if (!file.flush())
+        {
+            std::cerr << "(VulkanPipelineCache - save) could not write " << tempPath << std::endl;
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    // rename replaces the target in one step on POSIX, Windows refuses to rename over an existing file
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(path.c_str());
+
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+        {
+            std::cerr << "(VulkanPipelineCache - save) could not replace " << path << std::endl;
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <string>
+
+/*
+* vk::PipelineCache kept on disk between runs. The file starts with the vendor, device, driver version and
+* pipeline cache UUID it was written with, data from another device or driver is ignored and the cache starts empty.
+* Saving writes a temporary file next to the target and renames it over the target, so a crash mid-save
+* leaves the previous file intact.
+*
+* The context loads one from DEFAULT_PATH on creation and saves it when destroyed, every pipeline it makes uses it.
+*/
+class VulkanPipelineCache
+{
+public:
+
+    static const char * DEFAULT_PATH;
+
+    //Empty path keeps the cache in memory only
+    VulkanPipelineCache(VulkanContextPtr ctx, std::string path = "");
+
+    VULCRO_DONT_COPY(VulkanPipelineCache)
+
+    //Saves to the path the cache was made with
+    ~VulkanPipelineCache();
+
+    vk::PipelineCache getCache()
+    {
+        return mCache;
+    }
+
+    bool save();
+    bool save(const std::string & path);
+
+    //Driver data without the file header
+    vector<uint8_t> getData();
+
+    //Valid data for this device was found on disk
+    bool wasLoaded()
+    {
+        return mLoaded;
+    }
+
+    const std::string & getPath()
+    {
+        return mPath;
+    }
+
+private:
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    static const uint32_t FILE_MAGIC;
+    static const uint32_t FILE_VERSION;
+
+    vector<uint8_t> load();
+
+    FileHeader makeHeader();
+
+    static uint64_t hash(const vector<uint8_t> & data);
+
+    VulkanContextPtr mCtx;
+
+    vk::PipelineCache mCache;
+
+    std::string mPath;
+
+    bool mLoaded = false;
+};
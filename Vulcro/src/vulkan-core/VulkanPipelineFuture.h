@@ -0,0 +1,137 @@
+#pragma once
+
+#include "General.h"
+#include "VulkanContext.h"
+#include "VulkanWorkerPool.h"
+
+#include <atomic>
+#include <future>
+
+/*
+* Pipeline compiling on the context's worker pool, cheap to copy. Until it is done get() returns the fallback,
+* e.g. a generic material, so frames keep rendering while variants compile:
+*
+*   auto future = ctx->makePipelineAsync(shader, renderer, config);
+*   future.setFallback(defaultPipeline);
+*
+*   auto pipeline = future.get();   //every frame
+*   pipeline->bind(cmd);
+*
+* The fallback must be able to use the same sets, i.e. be made from the same set layouts.
+* Command buffers recorded once keep whichever pipeline was current when they were recorded.
+*/
+template<typename T>
+class VulkanPipelineFuture
+{
+public:
+
+    typedef shared_ptr<T> PipelineRef;
+
+    //Handle without a pipeline, get and wait return nullptr
+    VulkanPipelineFuture() {}
+
+    //Run create on ctx's worker pool. Failures are reported and leave the pipeline null
+    static VulkanPipelineFuture compile(VulkanContextPtr ctx, function<PipelineRef()> create)
+    {
+        VulkanPipelineFuture future;
+        future.mState = make_shared<State>();
+
+        auto state = future.mState;
+
+        future.mState->done = ctx->getWorkerPool()->submit([state, create]() {
+
+            try
+            {
+                state->pipeline = create();
+            }
+            catch (std::exception & e)
+            {
+                std::cerr << "(VulkanPipelineFuture - compile) " << e.what() << std::endl;
+            }
+            catch (const char * e)
+            {
+                std::cerr << "(VulkanPipelineFuture - compile) " << e << std::endl;
+            }
+            catch (...)
+            {
+                std::cerr << "(VulkanPipelineFuture - compile) Unknown error" << std::endl;
+            }
+
+            state->ready.store(true, std::memory_order_release);
+
+        }).share();
+
+        return future;
+    }
+
+    //Already compiled pipeline, e.g. one found in a cache
+    static VulkanPipelineFuture ready(PipelineRef pipeline)
+    {
+        VulkanPipelineFuture future;
+        future.mState = make_shared<State>();
+
+        future.mState->pipeline = pipeline;
+        future.mState->ready.store(true, std::memory_order_release);
+
+        std::promise<void> done;
+        done.set_value();
+        future.mState->done = done.get_future().share();
+
+        return future;
+    }
+
+    //False for a default constructed handle
+    bool isValid() const
+    {
+        return mState != nullptr;
+    }
+
+    //Compiled, and neither the pipeline nor this future is held anywhere else
+    bool isUnused() const
+    {
+        return isReady() && mState.use_count() == 1 && mState->pipeline.use_count() <= 1;
+    }
+
+    bool isReady() const
+    {
+        return mState && mState->ready.load(std::memory_order_acquire);
+    }
+
+    //The compiled pipeline once ready, the fallback until then. Never blocks
+    PipelineRef get() const
+    {
+        if (!mState) return nullptr;
+
+        return isReady() ? mState->pipeline : mState->fallback;
+    }
+
+    //Blocks until the pipeline is compiled
+    PipelineRef wait() const
+    {
+        if (!mState) return nullptr;
+
+        mState->done.wait();
+
+        return mState->pipeline;
+    }
+
+    //Set before other threads call get
+    void setFallback(PipelineRef fallback)
+    {
+        if (mState) mState->fallback = fallback;
+    }
+
+private:
+
+    struct State
+    {
+        std::atomic<bool> ready{ false };
+
+        PipelineRef pipeline;
+        PipelineRef fallback;
+
+        std::shared_future<void> done;
+    };
+
+    shared_ptr<State> mState;
+};
@@ -0,0 +1,242 @@
+#include "VulkanPipelineVariantCache.h"
+
+#include "VulkanFrameContext.h"
+#include "VulkanPipeline.h"
+#include "VulkanRenderer.h"
+#include "VulkanTracer.h"
+
+VulkanPipelineVariantCache::VulkanPipelineVariantCache(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+
+}
+
+// Dynamic topology may only change within a class, e.g. triangle list to strip
+static uint64_t getTopologyClass(vk::PrimitiveTopology topology)
+{
+    switch (topology)
+    {
+    case vk::PrimitiveTopology::ePointList:
+        return 0;
+
+    case vk::PrimitiveTopology::eLineList:
+    case vk::PrimitiveTopology::eLineStrip:
+    case vk::PrimitiveTopology::eLineListWithAdjacency:
+    case vk::PrimitiveTopology::eLineStripWithAdjacency:
+        return 1;
+
+    case vk::PrimitiveTopology::ePatchList:
+        return 3;
+
+    default:
+        return 2;
+    }
+}
+
+VulkanPipelineVariantCache::Key VulkanPipelineVariantCache::makeKey(VulkanShaderRef const & shader, VulkanRendererRef const & renderer,
+    PipelineConfig const & config, vector<ColorBlendConfig> const & colorBlendConfigs, uint32_t pushConstantSize)
+{
+    Key key = {
+        reinterpret_cast<uint64_t>(shader.get()),
+        reinterpret_cast<uint64_t>(renderer.get()),
+        reinterpret_cast<uint64_t>(static_cast<VkRenderPass>(renderer->getRenderPass())),
+        config.patchCount,
+        pushConstantSize
+    };
+
+    // State set on the command buffer doesn't tell pipelines apart, so all of it shares one per topology class
+    if (config.dynamicState && mCtx->supportsExtendedDynamicState())
+    {
+        key.push_back(1);
+        key.push_back(getTopologyClass(config.topology));
+    }
+    else
+    {
+        key.push_back(0);
+        key.push_back(static_cast<uint64_t>(config.topology));
+        key.push_back(static_cast<uint32_t>(config.cullFlags));
+        key.push_back(static_cast<uint64_t>(config.frontFace));
+        key.push_back(config.depthTest);
+        key.push_back(config.depthWrite);
+    }
+
+    // Blends past the renderer's targets are ignored and missing ones default, so only the effective blend of each target counts
+    for (uint32_t i = 0; i < renderer->getNumTargets(); i++)
+    {
+        key.push_back(i < colorBlendConfigs.size() ? colorBlendConfigs[i].blend : ColorBlendConfig().blend);
+    }
+
+    return key;
+}
+
+VulkanPipelineVariantCache::Key VulkanPipelineVariantCache::makeKey(VulkanShaderRef const & shader, uint32_t pushConstantSize)
+{
+    return { reinterpret_cast<uint64_t>(shader.get()), pushConstantSize };
+}
+
+// Compile finished without a pipeline, the error was reported when it failed
+template <typename T>
+static bool hasFailed(VulkanPipelineFuture<T> const & entry)
+{
+    return entry.isReady() && !entry.get();
+}
+
+template <typename T>
+VulkanPipelineFuture<T> VulkanPipelineVariantCache::lookup(std::map<Key, VulkanPipelineFuture<T>> & entries, Key const & key)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = entries.find(key);
+
+    if (it == entries.end() || hasFailed(it->second))
+    {
+        mMisses++;
+        return VulkanPipelineFuture<T>();
+    }
+
+    mHits++;
+    return it->second;
+}
+
+template <typename T>
+shared_ptr<T> VulkanPipelineVariantCache::insert(std::map<Key, VulkanPipelineFuture<T>> & entries, Key const & key, shared_ptr<T> pipeline)
+{
+    VulkanPipelineFuture<T> entry;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto & slot = entries[key];
+        if (!slot.isValid() || hasFailed(slot)) slot = VulkanPipelineFuture<T>::ready(pipeline);
+
+        entry = slot;
+    }
+
+    return entry.wait();
+}
+
+template <typename T>
+VulkanPipelineFuture<T> VulkanPipelineVariantCache::findAsync(std::map<Key, VulkanPipelineFuture<T>> & entries, Key const & key, function<shared_ptr<T>()> create)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = entries.find(key);
+
+    if (it != entries.end() && !hasFailed(it->second))
+    {
+        mHits++;
+        return it->second;
+    }
+
+    mMisses++;
+
+    return entries[key] = VulkanPipelineFuture<T>::compile(mCtx, create);
+}
+
+VulkanRenderPipelineRef VulkanPipelineVariantCache::getPipeline(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
+    vector<ColorBlendConfig> const & colorBlendConfigs, uint32_t pushConstantSize)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    auto key = makeKey(shader, renderer, config, colorBlendConfigs, pushConstantSize);
+
+    // Waits if the same state is still compiling asynchronously, a failed compile is retried so its error is thrown here
+    auto entry = lookup(mRenderPipelines, key);
+    if (entry.isValid())
+    {
+        auto pipeline = entry.wait();
+        if (pipeline) return pipeline;
+    }
+
+    return insert(mRenderPipelines, key, make_shared<VulkanRenderPipeline>(mCtx, shader, renderer, config, colorBlendConfigs, pushConstantSize));
+}
+
+VulkanComputePipelineRef VulkanPipelineVariantCache::getComputePipeline(VulkanShaderRef shader, uint32_t pushConstantSize)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    auto key = makeKey(shader, pushConstantSize);
+
+    auto entry = lookup(mComputePipelines, key);
+    if (entry.isValid())
+    {
+        auto pipeline = entry.wait();
+        if (pipeline) return pipeline;
+    }
+
+    return insert(mComputePipelines, key, make_shared<VulkanComputePipeline>(mCtx, shader, pushConstantSize));
+}
+
+VulkanRenderPipelineFuture VulkanPipelineVariantCache::getPipelineAsync(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
+    vector<ColorBlendConfig> const & colorBlendConfigs, uint32_t pushConstantSize)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    auto ctx = mCtx;
+
+    return findAsync<VulkanRenderPipeline>(mRenderPipelines, makeKey(shader, renderer, config, colorBlendConfigs, pushConstantSize), [=]() {
+        return make_shared<VulkanRenderPipeline>(ctx, shader, renderer, config, colorBlendConfigs, pushConstantSize);
+    });
+}
+
+VulkanComputePipelineFuture VulkanPipelineVariantCache::getComputePipelineAsync(VulkanShaderRef shader, uint32_t pushConstantSize)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    auto ctx = mCtx;
+
+    return findAsync<VulkanComputePipeline>(mComputePipelines, makeKey(shader, pushConstantSize), [=]() {
+        return make_shared<VulkanComputePipeline>(ctx, shader, pushConstantSize);
+    });
+}
+
+uint32_t VulkanPipelineVariantCache::trim(VulkanFrameContextRef frames)
+{
+    vector<VulkanRenderPipelineRef> renderPipelines;
+    vector<VulkanComputePipelineRef> computePipelines;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // Pipelines still compiling are held by their worker and stay
+        for (auto it = mRenderPipelines.begin(); it != mRenderPipelines.end();)
+        {
+            if (it->second.isUnused()) { renderPipelines.push_back(it->second.get()); it = mRenderPipelines.erase(it); }
+            else ++it;
+        }
+
+        for (auto it = mComputePipelines.begin(); it != mComputePipelines.end();)
+        {
+            if (it->second.isUnused()) { computePipelines.push_back(it->second.get()); it = mComputePipelines.erase(it); }
+            else ++it;
+        }
+    }
+
+    // Command buffers still in flight may have bound them
+    if (frames)
+    {
+        for (auto & pipeline : renderPipelines) if (pipeline) frames->keepAlive(pipeline);
+        for (auto & pipeline : computePipelines) if (pipeline) frames->keepAlive(pipeline);
+    }
+    else if (!renderPipelines.empty() || !computePipelines.empty())
+    {
+        mCtx->getDevice().waitIdle();
+    }
+
+    return static_cast<uint32_t>(renderPipelines.size() + computePipelines.size());
+}
+
+void VulkanPipelineVariantCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mRenderPipelines.clear();
+    mComputePipelines.clear();
+}
+
+uint32_t VulkanPipelineVariantCache::getPipelineCount()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return static_cast<uint32_t>(mRenderPipelines.size() + mComputePipelines.size());
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+#include "VulkanPipelineFuture.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+/*
+* Context owned pipelines keyed on everything they are built from: the shader object, the renderer and its render pass,
+* PipelineConfig, the blend of each target and the push constant size. Asking again for the same state returns the
+* pipeline made the first time, so per object material lookups only reach the driver once per distinct state.
+* PipelineConfig::dynamicState pipelines are keyed without the state the command buffer sets, so they are shared across it.
+*
+* Shaders and renderers are keyed by identity, a shader made twice from the same files is a different key.
+* Specialized variants from VulkanShader::specialize are shared, so each set of constant values gets one pipeline.
+* Entries hold their shader and renderer alive until trim evicts them. A compile that failed is not cached, the next
+* request compiles again and the synchronous getters throw its error.
+*/
+class VulkanPipelineVariantCache
+{
+public:
+
+    VulkanPipelineVariantCache(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanPipelineVariantCache)
+
+    VulkanRenderPipelineRef getPipeline(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
+        vector<ColorBlendConfig> const & colorBlendConfigs, uint32_t pushConstantSize);
+
+    VulkanComputePipelineRef getComputePipeline(VulkanShaderRef shader, uint32_t pushConstantSize);
+
+    //Misses compile on the worker pool, a pipeline still compiling is shared with every request for it
+    VulkanRenderPipelineFuture getPipelineAsync(VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
+        vector<ColorBlendConfig> const & colorBlendConfigs, uint32_t pushConstantSize);
+
+    VulkanComputePipelineFuture getComputePipelineAsync(VulkanShaderRef shader, uint32_t pushConstantSize);
+
+    //Evict pipelines held by nothing but the cache, e.g. once per frame or after a level unloads.
+    //With frames they are destroyed once the current frame completes, without it trim waits for the device to go idle first
+    uint32_t trim(VulkanFrameContextRef frames = nullptr);
+
+    void clear();
+
+    uint32_t getHitCount()
+    {
+        return mHits;
+    }
+
+    uint32_t getMissCount()
+    {
+        return mMisses;
+    }
+
+    uint32_t getPipelineCount();
+
+private:
+
+    typedef vector<uint64_t> Key;
+
+    Key makeKey(VulkanShaderRef const & shader, VulkanRendererRef const & renderer, PipelineConfig const & config,
+        vector<ColorBlendConfig> const & colorBlendConfigs, uint32_t pushConstantSize);
+
+    static Key makeKey(VulkanShaderRef const & shader, uint32_t pushConstantSize);
+
+    //Counts a hit or miss, an invalid future on a miss
+    template <typename T>
+    VulkanPipelineFuture<T> lookup(std::map<Key, VulkanPipelineFuture<T>> & entries, Key const & key);
+
+    //Pipeline made without the lock held, another thread's entry for the same key wins
+    template <typename T>
+    shared_ptr<T> insert(std::map<Key, VulkanPipelineFuture<T>> & entries, Key const & key, shared_ptr<T> pipeline);
+
+    //Entry for key, or a new one compiling on the worker pool
+    template <typename T>
+    VulkanPipelineFuture<T> findAsync(std::map<Key, VulkanPipelineFuture<T>> & entries, Key const & key, function<shared_ptr<T>()> create);
+
+    VulkanContextPtr mCtx;
+
+    std::map<Key, VulkanRenderPipelineFuture> mRenderPipelines;
+    std::map<Key, VulkanComputePipelineFuture> mComputePipelines;
+
+    std::atomic<uint32_t> mHits{ 0 };
+    std::atomic<uint32_t> mMisses{ 0 };
+
+    std::mutex mMutex;
+};
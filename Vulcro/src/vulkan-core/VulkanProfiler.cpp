@@ -0,0 +1,303 @@
+#include "VulkanProfiler.h"
+
+#include "VulkanQueue.h"
+
+#include <algorithm>
+#include <iomanip>
+
+const uint32_t VulkanProfiler::DEFAULT_FRAMES_IN_FLIGHT = 3;
+const uint32_t VulkanProfiler::DEFAULT_MAX_REGIONS = 256;
+const uint32_t VulkanProfiler::HISTORY_LENGTH = 256;
+
+VulkanProfiler::VulkanProfiler(VulkanContextPtr ctx, uint32_t framesInFlight, uint32_t maxRegionsPerFrame) :
+    mCtx(ctx)
+{
+    framesInFlight = glm::max(framesInFlight, 1u);
+
+    // Two timestamps per region, plus the root
+    mMaxQueries = (maxRegionsPerFrame + 1) * 2;
+
+    mSlots.resize(framesInFlight);
+
+    mQueryPool = mCtx->getDevice().createQueryPool(
+        vk::QueryPoolCreateInfo(
+            vk::QueryPoolCreateFlags(),
+            vk::QueryType::eTimestamp,
+            mMaxQueries * framesInFlight
+        )
+    );
+
+    mNsPerTick = mCtx->getPhysicalDeviceProperties().limits.timestampPeriod;
+
+    auto familyIndex = mCtx->getQueue(VulkanQueueType::GRAPHICS)->getFamilyIndex();
+    auto validBits = mCtx->getPhysicalDevice().getQueueFamilyProperties()[familyIndex].timestampValidBits;
+
+    if (validBits == 0)
+    {
+        std::cerr << "(VulkanProfiler - VulkanProfiler) graphics queue does not support timestamps" << std::endl;
+        mEnabled = false;
+    }
+
+    mTimestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+}
+
+VulkanProfiler::~VulkanProfiler()
+{
+    mCtx->getDevice().destroyQueryPool(mQueryPool);
+}
+
+void VulkanProfiler::beginFrame(vk::CommandBuffer * cmd)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mEnabled) return;
+
+    if (mInFrame)
+    {
+        std::cerr << "(VulkanProfiler - beginFrame) previous frame was not ended" << std::endl;
+    }
+
+    mSlotIndex = (mSlotIndex + 1) % mSlots.size();
+
+    auto & slot = mSlots[mSlotIndex];
+
+    if (slot.recorded)
+    {
+        resolve(slot, mSlotIndex);
+    }
+
+    slot.regions.clear();
+    slot.recorded = true;
+
+    cmd->resetQueryPool(mQueryPool, mSlotIndex * mMaxQueries, mMaxQueries);
+
+    mOpenRegions.clear();
+    mInFrame = true;
+
+    slot.regions.push_back({ "frame", -1, 0, 1 });
+    slot.queryCount = 2;
+    mOpenRegions.push_back(0);
+
+    cmd->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, mQueryPool, mSlotIndex * mMaxQueries + slot.regions[0].beginQuery);
+}
+
+void VulkanProfiler::endFrame(vk::CommandBuffer * cmd)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mEnabled || !mInFrame) return;
+
+    if (mOpenRegions.size() > 1)
+    {
+        std::cerr << "(VulkanProfiler - endFrame) " << mOpenRegions.size() - 1 << " regions left open" << std::endl;
+    }
+
+    while (!mOpenRegions.empty())
+    {
+        endRegion(cmd, vk::PipelineStageFlagBits::eBottomOfPipe);
+    }
+
+    mInFrame = false;
+}
+
+void VulkanProfiler::begin(vk::CommandBuffer * cmd, const char * name, vk::PipelineStageFlagBits stage)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mEnabled || !mInFrame) return;
+
+    auto & slot = mSlots[mSlotIndex];
+
+    if (slot.queryCount + 2 > mMaxQueries)
+    {
+        if (!mWarnedOverflow)
+        {
+            std::cerr << "(VulkanProfiler - begin) too many regions in one frame, dropping " << name << std::endl;
+            mWarnedOverflow = true;
+        }
+
+        // Still tracked so the matching end() pops it, but without queries
+        mOpenRegions.push_back(-1);
+        return;
+    }
+
+    int32_t parent = mOpenRegions.empty() ? -1 : mOpenRegions.back();
+
+    slot.regions.push_back({ name, parent, slot.queryCount, slot.queryCount + 1 });
+    slot.queryCount += 2;
+
+    mOpenRegions.push_back(static_cast<int32_t>(slot.regions.size() - 1));
+
+    cmd->writeTimestamp(stage, mQueryPool, mSlotIndex * mMaxQueries + slot.regions.back().beginQuery);
+}
+
+void VulkanProfiler::end(vk::CommandBuffer * cmd, vk::PipelineStageFlagBits stage)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mEnabled || !mInFrame || mOpenRegions.empty()) return;
+
+    endRegion(cmd, stage);
+}
+
+void VulkanProfiler::endRegion(vk::CommandBuffer * cmd, vk::PipelineStageFlagBits stage)
+{
+    int32_t regionIndex = mOpenRegions.back();
+    mOpenRegions.pop_back();
+
+    if (regionIndex < 0) return;
+
+    auto & region = mSlots[mSlotIndex].regions[regionIndex];
+
+    cmd->writeTimestamp(stage, mQueryPool, mSlotIndex * mMaxQueries + region.endQuery);
+}
+
+void VulkanProfiler::record(vk::CommandBuffer * cmd, const char * name, function<void()> commands)
+{
+    begin(cmd, name);
+    commands();
+    end(cmd);
+}
+
+void VulkanProfiler::resolve(FrameSlot & slot, uint32_t slotIndex)
+{
+    if (slot.queryCount == 0) return;
+
+    vector<uint64_t> ticks(slot.queryCount);
+
+    // No wait flag, a partition that isn't ready yet means framesInFlight is too small and the frame is dropped
+    auto res = mCtx->getDevice().getQueryPoolResults(
+        mQueryPool,
+        slotIndex * mMaxQueries,
+        slot.queryCount,
+        ticks.size() * sizeof(uint64_t),
+        ticks.data(),
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64
+    );
+
+    if (res != vk::Result::eSuccess)
+    {
+        return;
+    }
+
+    vector<VulkanProfileNode> nodes(slot.regions.size());
+    vector<std::string> paths(slot.regions.size());
+
+    for (size_t i = 0; i < slot.regions.size(); i++)
+    {
+        auto & region = slot.regions[i];
+
+        uint64_t begin = ticks[region.beginQuery] & mTimestampMask;
+        uint64_t end = ticks[region.endQuery] & mTimestampMask;
+
+        nodes[i].name = region.name;
+        nodes[i].ms = end >= begin ? (end - begin) * mNsPerTick / 1e6 : 0.0;
+
+        // Parents always come before their children
+        paths[i] = region.parent >= 0 ? paths[region.parent] + "/" + region.name : region.name;
+
+        addSample(paths[i], nodes[i].ms);
+    }
+
+    // Attach children back to front so each node is complete before it is copied into its parent
+    for (size_t i = slot.regions.size() - 1; i > 0; i--)
+    {
+        auto & parent = nodes[slot.regions[i].parent];
+        parent.children.insert(parent.children.begin(), nodes[i]);
+    }
+
+    mLastFrame = nodes[0];
+}
+
+void VulkanProfiler::addSample(const std::string & path, double ms)
+{
+    auto & history = mHistory[path];
+
+    history.push_back(ms);
+
+    if (history.size() > HISTORY_LENGTH)
+    {
+        history.pop_front();
+    }
+}
+
+VulkanProfileNode VulkanProfiler::getLastFrame()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return mLastFrame;
+}
+
+VulkanProfileStats VulkanProfiler::getStats(const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    VulkanProfileStats stats;
+
+    auto it = mHistory.find(path);
+
+    if (it == mHistory.end() || it->second.empty()) return stats;
+
+    auto & history = it->second;
+
+    vector<double> sorted(history.begin(), history.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (auto ms : sorted) sum += ms;
+
+    stats.lastMs = history.back();
+    stats.minMs = sorted.front();
+    stats.avgMs = sum / sorted.size();
+    stats.p99Ms = sorted[glm::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99))];
+    stats.samples = static_cast<uint32_t>(sorted.size());
+
+    return stats;
+}
+
+std::map<std::string, VulkanProfileStats> VulkanProfiler::getAllStats()
+{
+    vector<std::string> paths;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        for (auto & entry : mHistory)
+        {
+            paths.push_back(entry.first);
+        }
+    }
+
+    std::map<std::string, VulkanProfileStats> allStats;
+
+    for (auto & path : paths)
+    {
+        allStats[path] = getStats(path);
+    }
+
+    return allStats;
+}
+
+void VulkanProfiler::print(std::ostream & out)
+{
+    auto frame = getLastFrame();
+
+    if (frame.name.empty()) return;
+
+    printNode(out, frame, frame.name, 0);
+}
+
+void VulkanProfiler::printNode(std::ostream & out, VulkanProfileNode const & node, const std::string & path, uint32_t depth)
+{
+    auto stats = getStats(path);
+
+    out << std::string(depth * 2, ' ') << node.name << std::fixed << std::setprecision(3)
+        << "  " << node.ms << " ms"
+        << "  (min " << stats.minMs << ", avg " << stats.avgMs << ", p99 " << stats.p99Ms << ")" << std::endl;
+
+    for (auto & child : node.children)
+    {
+        printNode(out, child, path + "/" + child.name, depth + 1);
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+
+//One resolved region of a frame, children are the regions begun while it was open
+struct VulkanProfileNode
+{
+    std::string name;
+    double ms = 0.0;
+    vector<VulkanProfileNode> children;
+};
+
+//Rolling statistics of one region path, e.g. "frame/scene/grass"
+struct VulkanProfileStats
+{
+    double lastMs = 0.0;
+    double minMs = 0.0;
+    double avgMs = 0.0;
+    double p99Ms = 0.0;
+    uint32_t samples = 0;
+};
+
+/*
+* GPU timestamp profiler. Regions are scoped inside command buffers with begin / end (or record) and
+* written to a query pool partitioned per frame. A partition is read back when beginFrame comes around
+* to it again, framesInFlight frames later, so nothing ever waits on the GPU.
+*
+*   profiler->beginFrame(cmd);                  //first command buffer of the frame
+*   profiler->record(cmd, "scene", [&]() { sceneRenderer->record(cmd, ...); });
+*   profiler->endFrame(cmd);                    //last command buffer of the frame
+*
+* Command buffers holding a frame's regions must be submitted in recording order,
+* and recorded again every frame since the query indices move.
+*
+* There is a single stack of open regions, so begin / end must not be called from recordParallel workers
+* or from several threads at once. Time a parallel section as one region around it on the recording thread.
+* Compute dispatches, ray traces and acceleration structure builds take an optional profiler to time themselves.
+*/
+class VulkanProfiler
+{
+public:
+
+    static const uint32_t DEFAULT_FRAMES_IN_FLIGHT;
+    static const uint32_t DEFAULT_MAX_REGIONS;
+    static const uint32_t HISTORY_LENGTH;
+
+    //framesInFlight has to be at least the number of frames the GPU can lag behind
+    VulkanProfiler(VulkanContextPtr ctx, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT, uint32_t maxRegionsPerFrame = DEFAULT_MAX_REGIONS);
+
+    VULCRO_DONT_COPY(VulkanProfiler)
+
+    ~VulkanProfiler();
+
+    //Resolves the partition being reused, resets it on cmd and opens the root "frame" region
+    void beginFrame(vk::CommandBuffer * cmd);
+
+    //Closes the root region
+    void endFrame(vk::CommandBuffer * cmd);
+
+    //Regions nest in the order they are begun, end closes the innermost open one
+    void begin(vk::CommandBuffer * cmd, const char * name, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eTopOfPipe);
+    void end(vk::CommandBuffer * cmd, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe);
+
+    void record(vk::CommandBuffer * cmd, const char * name, function<void()> commands);
+
+    //Off skips all query writes, e.g. to compare against unprofiled builds
+    void setEnabled(bool enabled)
+    {
+        mEnabled = enabled;
+    }
+
+    bool isEnabled()
+    {
+        return mEnabled;
+    }
+
+    //Tree of the most recent frame that has been resolved
+    VulkanProfileNode getLastFrame();
+
+    VulkanProfileStats getStats(const std::string & path);
+
+    std::map<std::string, VulkanProfileStats> getAllStats();
+
+    //Indented tree of the last frame with min / avg / p99 per region
+    void print(std::ostream & out);
+
+private:
+
+    struct Region
+    {
+        std::string name;
+        int32_t parent;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct FrameSlot
+    {
+        vector<Region> regions;
+        uint32_t queryCount = 0;
+        bool recorded = false;
+    };
+
+    //Called with mMutex held
+    void endRegion(vk::CommandBuffer * cmd, vk::PipelineStageFlagBits stage);
+
+    void resolve(FrameSlot & slot, uint32_t slotIndex);
+
+    void addSample(const std::string & path, double ms);
+
+    void printNode(std::ostream & out, VulkanProfileNode const & node, const std::string & path, uint32_t depth);
+
+    VulkanContextPtr mCtx;
+
+    vk::QueryPool mQueryPool;
+
+    uint32_t mMaxQueries;
+    double mNsPerTick;
+    uint64_t mTimestampMask;
+
+    vector<FrameSlot> mSlots;
+    uint32_t mSlotIndex = 0;
+    bool mInFrame = false;
+
+    vector<int32_t> mOpenRegions;
+
+    VulkanProfileNode mLastFrame;
+    std::map<std::string, std::deque<double>> mHistory;
+
+    bool mEnabled = true;
+    bool mWarnedOverflow = false;
+
+    std::mutex mMutex;
+};
@@ -0,0 +1,90 @@
+#include "VulkanQueue.h"
+
+VulkanQueue::VulkanQueue(VulkanContextPtr ctx, VulkanQueueType type, uint32_t familyIndex, uint32_t queueIndex) :
+    mCtx(ctx),
+    mType(type),
+    mFamilyIndex(familyIndex)
+{
+    mQueue = ctx->getDevice().getQueue(familyIndex, queueIndex);
+}
+
+void VulkanQueue::submit(vk::ArrayProxy<const vk::SubmitInfo> submits, vk::Fence fence)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mQueue.submit(submits, fence);
+}
+
+vk::Result VulkanQueue::present(vk::PresentInfoKHR const & presentInfo)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return mQueue.presentKHR(presentInfo);
+}
+
+void VulkanQueue::waitIdle()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mQueue.waitIdle();
+}
+
+void VulkanQueue::releaseBuffer(vk::CommandBuffer * cmd, VulkanQueue * dstQueue, vk::Buffer buffer,
+    vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess)
+{
+    if (sharesFamily(dstQueue)) return;
+
+    cmd->pipelineBarrier(
+        srcStage,
+        vk::PipelineStageFlagBits::eBottomOfPipe,
+        vk::DependencyFlags(),
+        {},
+        { vk::BufferMemoryBarrier(srcAccess, vk::AccessFlags(), mFamilyIndex, dstQueue->mFamilyIndex, buffer, 0, VK_WHOLE_SIZE) },
+        {}
+    );
+}
+
+void VulkanQueue::acquireBuffer(vk::CommandBuffer * cmd, VulkanQueue * srcQueue, vk::Buffer buffer,
+    vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+{
+    if (sharesFamily(srcQueue)) return;
+
+    cmd->pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        dstStage,
+        vk::DependencyFlags(),
+        {},
+        { vk::BufferMemoryBarrier(vk::AccessFlags(), dstAccess, srcQueue->mFamilyIndex, mFamilyIndex, buffer, 0, VK_WHOLE_SIZE) },
+        {}
+    );
+}
+
+void VulkanQueue::releaseImage(vk::CommandBuffer * cmd, VulkanQueue * dstQueue, vk::Image image, vk::ImageSubresourceRange range,
+    vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess)
+{
+    if (sharesFamily(dstQueue)) return;
+
+    cmd->pipelineBarrier(
+        srcStage,
+        vk::PipelineStageFlagBits::eBottomOfPipe,
+        vk::DependencyFlags(),
+        {},
+        {},
+        { vk::ImageMemoryBarrier(srcAccess, vk::AccessFlags(), oldLayout, newLayout, mFamilyIndex, dstQueue->mFamilyIndex, image, range) }
+    );
+}
+
+void VulkanQueue::acquireImage(vk::CommandBuffer * cmd, VulkanQueue * srcQueue, vk::Image image, vk::ImageSubresourceRange range,
+    vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+{
+    if (sharesFamily(srcQueue)) return;
+
+    cmd->pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        dstStage,
+        vk::DependencyFlags(),
+        {},
+        {},
+        { vk::ImageMemoryBarrier(vk::AccessFlags(), dstAccess, oldLayout, newLayout, srcQueue->mFamilyIndex, mFamilyIndex, image, range) }
+    );
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <mutex>
+
+/*
+* A device queue with its own lock, vk::Queue access must be externally synchronized.
+*/
+class VulkanQueue
+{
+public:
+
+    VulkanQueue(VulkanContextPtr ctx, VulkanQueueType type, uint32_t familyIndex, uint32_t queueIndex);
+
+    VULCRO_DONT_COPY(VulkanQueue)
+
+    void submit(vk::ArrayProxy<const vk::SubmitInfo> submits, vk::Fence fence = nullptr);
+
+    vk::Result present(vk::PresentInfoKHR const & presentInfo);
+
+    void waitIdle();
+
+    /*
+    * Queue family ownership transfer. The release half is recorded on a command buffer submitted to this queue,
+    * the acquire half on one submitted to dstQueue after a semaphore wait. Both are no-ops within one family.
+    */
+    void releaseBuffer(vk::CommandBuffer * cmd, VulkanQueue * dstQueue, vk::Buffer buffer,
+        vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess);
+
+    void acquireBuffer(vk::CommandBuffer * cmd, VulkanQueue * srcQueue, vk::Buffer buffer,
+        vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+
+    //oldLayout / newLayout must match between the release and acquire halves
+    void releaseImage(vk::CommandBuffer * cmd, VulkanQueue * dstQueue, vk::Image image, vk::ImageSubresourceRange range,
+        vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess);
+
+    void acquireImage(vk::CommandBuffer * cmd, VulkanQueue * srcQueue, vk::Image image, vk::ImageSubresourceRange range,
+        vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+
+    vk::Queue & getQueue()
+    {
+        return mQueue;
+    }
+
+    VulkanQueueType getType()
+    {
+        return mType;
+    }
+
+    uint32_t getFamilyIndex()
+    {
+        return mFamilyIndex;
+    }
+
+    bool sharesFamily(VulkanQueue * other)
+    {
+        return other->mFamilyIndex == mFamilyIndex;
+    }
+
+    std::mutex & getMutex()
+    {
+        return mMutex;
+    }
+
+private:
+
+    VulkanContextPtr mCtx;
+    vk::Queue mQueue;
+    VulkanQueueType mType;
+    uint32_t mFamilyIndex;
+
+    std::mutex mMutex;
+};
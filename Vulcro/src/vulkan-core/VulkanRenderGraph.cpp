@@ -0,0 +1,655 @@
+#include "VulkanRenderGraph.h"
+
+#include "VulkanRenderer.h"
+#include "VulkanBuffer.h"
+#include "VulkanProfiler.h"
+#include "VulkanFrameContext.h"
+#include "VulkanTracer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+
+namespace
+{
+    vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+    {
+        return alignment > 1 ? ((value + alignment - 1) / alignment) * alignment : value;
+    }
+}
+
+/**************************************************
+ * Pass
+ * ************************************************/
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::colorAttachment(ResourceId image)
+{
+    mColorAttachments.push_back(image);
+
+    mWrites.push_back({
+        image,
+        vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::ImageLayout::eColorAttachmentOptimal,
+        false,
+        true
+    });
+
+    return *this;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::useDepth(bool depth)
+{
+    mUseDepth = depth;
+    return *this;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::setClearColors(vector<std::array<float, 4>> colors)
+{
+    mClearColors = colors;
+    return *this;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::target(VulkanRendererRef renderer)
+{
+    mRenderer = renderer;
+    mExternalRenderer = true;
+    return *this;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::sample(ResourceId image, vk::PipelineStageFlags stage)
+{
+    mReads.push_back({ image, vk::AccessFlagBits::eShaderRead, stage, vk::ImageLayout::eUndefined, true, false });
+    return *this;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::read(ResourceId resource, vk::AccessFlags access, vk::PipelineStageFlags stage, vk::ImageLayout layout)
+{
+    mReads.push_back({ resource, access, stage, layout, false, false });
+    return *this;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::Pass::write(ResourceId resource, vk::AccessFlags access, vk::PipelineStageFlags stage, vk::ImageLayout layout)
+{
+    mWrites.push_back({ resource, access, stage, layout, false, false });
+    return *this;
+}
+
+bool VulkanRenderGraph::Pass::reads(ResourceId resource) const
+{
+    for (auto & use : mReads)
+    {
+        if (use.resource == resource) return true;
+    }
+
+    return false;
+}
+
+bool VulkanRenderGraph::Pass::writes(ResourceId resource) const
+{
+    for (auto & use : mWrites)
+    {
+        if (use.resource == resource) return true;
+    }
+
+    return false;
+}
+
+/**************************************************
+ * Graph
+ * ************************************************/
+
+VulkanRenderGraph::VulkanRenderGraph(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+
+}
+
+VulkanRenderGraph::~VulkanRenderGraph()
+{
+    // Images and renderers the graph made go with it, frames in flight may still use them
+    if (mFrames)
+    {
+        for (auto & resource : mResources)
+        {
+            if (resource.transientImage) mFrames->keepAlive(resource.transientImage);
+        }
+
+        for (auto & pass : mPasses)
+        {
+            if (pass.mRenderer && !pass.mExternalRenderer) mFrames->keepAlive(pass.mRenderer);
+        }
+    }
+
+    releaseHeaps();
+}
+
+VulkanRenderGraph::ResourceId VulkanRenderGraph::createImage(const char * name, vk::Format format, glm::uvec2 size, vk::ImageUsageFlags usage)
+{
+    Resource resource;
+    resource.name = name;
+    resource.transientImage = make_shared<VulkanImage2D>(mCtx, usage, format, size, VulkanImageMemory::BIND_LATER);
+    resource.transientImage->setSampler(mCtx->getNearestSampler());
+    resource.image = resource.transientImage;
+    resource.extent = size;
+
+    mResources.push_back(resource);
+    mCompiled = false;
+
+    return static_cast<ResourceId>(mResources.size() - 1);
+}
+
+VulkanRenderGraph::ResourceId VulkanRenderGraph::importImage(const char * name, VulkanImageRef image)
+{
+    Resource resource;
+    resource.name = name;
+    resource.image = image;
+    resource.imported = true;
+
+    mResources.push_back(resource);
+    mCompiled = false;
+
+    return static_cast<ResourceId>(mResources.size() - 1);
+}
+
+VulkanRenderGraph::ResourceId VulkanRenderGraph::importBuffer(const char * name, VulkanBufferRef buffer)
+{
+    Resource resource;
+    resource.name = name;
+    resource.buffer = buffer;
+    resource.imported = true;
+
+    mResources.push_back(resource);
+    mCompiled = false;
+
+    return static_cast<ResourceId>(mResources.size() - 1);
+}
+
+void VulkanRenderGraph::markOutput(ResourceId image)
+{
+    mResources[image].output = true;
+    mCompiled = false;
+}
+
+void VulkanRenderGraph::resizeImage(ResourceId image, glm::uvec2 size)
+{
+    auto & resource = mResources[image];
+
+    if (!resource.transientImage)
+    {
+        std::cerr << "(VulkanRenderGraph - resizeImage) " << resource.name << " is not owned by the graph" << std::endl;
+        return;
+    }
+
+    // The image may still be in use, it is recreated by compile
+    resource.extent = size;
+    mCompiled = false;
+}
+
+VulkanRenderGraph::Pass & VulkanRenderGraph::addPass(const char * name, function<void(vk::CommandBuffer *)> commands)
+{
+    mPasses.emplace_back();
+
+    auto & pass = mPasses.back();
+    pass.mName = name;
+    pass.mCommands = commands;
+
+    mCompiled = false;
+
+    return pass;
+}
+
+VulkanImage2DRef VulkanRenderGraph::getImage(ResourceId image)
+{
+    auto & resource = mResources[image];
+
+    if (resource.transientImage)
+    {
+        return resource.transientImage;
+    }
+
+    return std::dynamic_pointer_cast<VulkanImage2D>(resource.image);
+}
+
+VulkanBufferRef VulkanRenderGraph::getBuffer(ResourceId buffer)
+{
+    return mResources[buffer].buffer;
+}
+
+void VulkanRenderGraph::compile()
+{
+    VULCRO_TRACE_FUNCTION();
+
+    releaseHeaps();
+
+    // A vk::Image can only be bound once, images placed by an earlier compile get a new one
+    for (auto & resource : mResources)
+    {
+        if (!resource.transientImage) continue;
+
+        auto size = resource.transientImage->getSize();
+
+        if (resource.transientImage->isMemoryBound() || size.x != resource.extent.x || size.y != resource.extent.y)
+        {
+            resource.transientImage->resize(resource.extent, mFrames);
+        }
+    }
+
+    cull();
+    computeLifetimes();
+    allocateTransients();
+    createRenderers();
+
+    mCompiled = true;
+}
+
+void VulkanRenderGraph::cull()
+{
+    mOrder.clear();
+
+    // Walk backwards from the outputs, a pass survives if something later (or outside) reads what it writes
+    std::set<ResourceId> needed;
+
+    for (int32_t i = static_cast<int32_t>(mPasses.size()) - 1; i >= 0; i--)
+    {
+        auto & pass = mPasses[i];
+
+        bool alive = pass.mExternalRenderer;
+
+        for (auto & use : pass.mWrites)
+        {
+            auto & resource = mResources[use.resource];
+
+            if (resource.imported || resource.output || needed.count(use.resource))
+            {
+                alive = true;
+            }
+        }
+
+        pass.mCulled = !alive;
+
+        if (!alive) continue;
+
+        // Cleared attachments don't need earlier writers, other writes may only cover part of the resource
+        for (auto & use : pass.mWrites)
+        {
+            if (use.discard && !pass.reads(use.resource))
+            {
+                needed.erase(use.resource);
+            }
+        }
+
+        for (auto & use : pass.mReads)
+        {
+            needed.insert(use.resource);
+        }
+
+        mOrder.push_back(static_cast<uint32_t>(i));
+    }
+
+    std::reverse(mOrder.begin(), mOrder.end());
+}
+
+void VulkanRenderGraph::computeLifetimes()
+{
+    for (auto & resource : mResources)
+    {
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+    }
+
+    for (int32_t k = 0; k < static_cast<int32_t>(mOrder.size()); k++)
+    {
+        auto & pass = mPasses[mOrder[k]];
+
+        for (auto & use : pass.mReads)
+        {
+            auto & resource = mResources[use.resource];
+
+            if (resource.transientImage && resource.firstUse < 0 && !pass.writes(use.resource))
+            {
+                std::cerr << "(VulkanRenderGraph - compile) " << pass.mName << " reads " << resource.name << " before any pass writes it" << std::endl;
+            }
+
+            if (resource.firstUse < 0) resource.firstUse = k;
+            resource.lastUse = k;
+        }
+
+        for (auto & use : pass.mWrites)
+        {
+            auto & resource = mResources[use.resource];
+
+            if (resource.firstUse < 0) resource.firstUse = k;
+            resource.lastUse = k;
+        }
+    }
+}
+
+void VulkanRenderGraph::allocateTransients()
+{
+    struct Candidate
+    {
+        ResourceId id;
+        vk::MemoryRequirements requirements;
+    };
+
+    struct Heap
+    {
+        uint32_t memoryTypeBits;
+        vk::DeviceSize size = 0;
+        vk::DeviceSize alignment = 1;
+        vector<ResourceId> placed;
+    };
+
+    vector<Candidate> candidates;
+
+    for (ResourceId id = 0; id < mResources.size(); id++)
+    {
+        auto & resource = mResources[id];
+
+        // Images no surviving pass uses get no memory at all
+        if (!resource.transientImage || resource.firstUse < 0) continue;
+
+        candidates.push_back({ id, resource.transientImage->getMemoryRequirements() });
+        mUnaliasedMemorySize += candidates.back().requirements.size;
+    }
+
+    // Largest first packs tighter
+    std::stable_sort(candidates.begin(), candidates.end(), [](Candidate const & a, Candidate const & b) {
+        return a.requirements.size > b.requirements.size;
+    });
+
+    auto lifetimesOverlap = [](Resource const & a, Resource const & b) {
+        return a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+    };
+
+    vector<Heap> heaps;
+
+    for (auto & candidate : candidates)
+    {
+        auto & resource = mResources[candidate.id];
+        auto & reqs = candidate.requirements;
+
+        int32_t heapIndex = -1;
+
+        for (int32_t h = 0; h < static_cast<int32_t>(heaps.size()); h++)
+        {
+            if (heaps[h].memoryTypeBits == reqs.memoryTypeBits) heapIndex = h;
+        }
+
+        if (heapIndex < 0)
+        {
+            heaps.emplace_back();
+            heaps.back().memoryTypeBits = reqs.memoryTypeBits;
+            heapIndex = static_cast<int32_t>(heaps.size() - 1);
+        }
+
+        auto & heap = heaps[heapIndex];
+
+        // Ranges of already placed images that are alive at the same time
+        vector<std::pair<vk::DeviceSize, vk::DeviceSize>> busy;
+
+        for (auto other : heap.placed)
+        {
+            auto & placed = mResources[other];
+
+            if (lifetimesOverlap(resource, placed))
+            {
+                busy.push_back({ placed.offset, placed.offset + placed.size });
+            }
+        }
+
+        std::sort(busy.begin(), busy.end());
+
+        // Lowest offset that fits between the busy ranges
+        vk::DeviceSize offset = 0;
+
+        for (auto & range : busy)
+        {
+            if (offset + reqs.size <= range.first) break;
+            offset = glm::max(offset, alignUp(range.second, reqs.alignment));
+        }
+
+        resource.heap = heapIndex;
+        resource.offset = offset;
+        resource.size = reqs.size;
+
+        heap.size = glm::max(heap.size, offset + reqs.size);
+        heap.alignment = glm::max(heap.alignment, reqs.alignment);
+        heap.placed.push_back(candidate.id);
+    }
+
+    for (auto & heap : heaps)
+    {
+        vk::MemoryRequirements heapReqs;
+        heapReqs.size = heap.size;
+        heapReqs.alignment = heap.alignment;
+        heapReqs.memoryTypeBits = heap.memoryTypeBits;
+
+        mHeaps.push_back(mCtx->getAllocator()->allocate(
+            heapReqs,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            false,
+            true /* dedicated */
+        ));
+
+        mTransientMemorySize += heap.size;
+
+        // Images sharing memory have to wait for each other's last use before taking it over
+        for (size_t i = 0; i < heap.placed.size(); i++)
+        {
+            for (size_t j = i + 1; j < heap.placed.size(); j++)
+            {
+                auto & a = mResources[heap.placed[i]];
+                auto & b = mResources[heap.placed[j]];
+
+                if (a.offset < b.offset + b.size && b.offset < a.offset + a.size)
+                {
+                    a.aliases.push_back(heap.placed[j]);
+                    b.aliases.push_back(heap.placed[i]);
+                }
+            }
+        }
+    }
+
+    for (auto & candidate : candidates)
+    {
+        auto & resource = mResources[candidate.id];
+        auto & allocation = mHeaps[resource.heap];
+
+        resource.transientImage->bindMemory(allocation.memory, allocation.offset + resource.offset);
+    }
+}
+
+void VulkanRenderGraph::createRenderers()
+{
+    for (auto passIndex : mOrder)
+    {
+        auto & pass = mPasses[passIndex];
+
+        if (pass.mExternalRenderer || pass.mColorAttachments.empty()) continue;
+
+        // Keep the render pass so pipelines made against it stay compatible, only the framebuffers change
+        if (pass.mRenderer)
+        {
+            pass.mRenderer->resize(mFrames);
+            continue;
+        }
+
+        vector<VulkanImage2DRef> images;
+
+        for (auto id : pass.mColorAttachments)
+        {
+            images.push_back(mResources[id].transientImage);
+        }
+
+        pass.mRenderer = mCtx->makeRenderer();
+        pass.mRenderer->targetImages(images, pass.mUseDepth);
+
+        if (!pass.mClearColors.empty())
+        {
+            pass.mRenderer->setClearColors(pass.mClearColors);
+        }
+    }
+}
+
+void VulkanRenderGraph::releaseHeaps()
+{
+    if (mFrames && !mHeaps.empty())
+    {
+        // Frames in flight may still render with the old memory, free it once the frame being recorded completes
+        auto * allocator = mCtx->getAllocator();
+        auto heaps = mHeaps;
+
+        mFrames->defer([allocator, heaps]() mutable {
+            for (auto & heap : heaps)
+            {
+                allocator->free(heap);
+            }
+        });
+    }
+    else
+    {
+        if (!mHeaps.empty())
+        {
+            mCtx->getDevice().waitIdle();
+        }
+
+        for (auto & heap : mHeaps)
+        {
+            mCtx->getAllocator()->free(heap);
+        }
+    }
+
+    mHeaps.clear();
+
+    for (auto & resource : mResources)
+    {
+        resource.heap = -1;
+        resource.aliases.clear();
+    }
+
+    mTransientMemorySize = 0;
+    mUnaliasedMemorySize = 0;
+}
+
+void VulkanRenderGraph::execute(vk::CommandBuffer * cmd)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    if (!mCompiled)
+    {
+        std::cerr << "(VulkanRenderGraph - execute) graph changed since the last compile" << std::endl;
+        return;
+    }
+
+    for (uint32_t k = 0; k < mOrder.size(); k++)
+    {
+        recordPass(cmd, mPasses[mOrder[k]], k);
+    }
+}
+
+void VulkanRenderGraph::recordPass(vk::CommandBuffer * cmd, Pass & pass, uint32_t passIndex)
+{
+    // Images taking over aliased memory in this pass
+    for (auto * uses : { &pass.mReads, &pass.mWrites })
+    {
+        for (auto & use : *uses)
+        {
+            auto & resource = mResources[use.resource];
+
+            if (resource.firstUse == static_cast<int32_t>(passIndex) && !resource.aliases.empty())
+            {
+                inheritAliasState(resource);
+            }
+        }
+    }
+
+    for (auto * uses : { &pass.mReads, &pass.mWrites })
+    {
+        for (auto & use : *uses)
+        {
+            auto & resource = mResources[use.resource];
+
+            if (resource.buffer)
+            {
+                mBarriers.access(resource.buffer.get(), use.access, use.stage);
+                continue;
+            }
+
+            auto layout = use.sampled ? resource.image->getDII().imageLayout : use.layout;
+
+            mBarriers.transition(resource.image.get(), layout, use.access, use.stage, use.discard);
+        }
+    }
+
+    mBarriers.flush(cmd);
+
+    auto commands = [&]() {
+
+        if (!pass.mRenderer)
+        {
+            pass.mCommands(cmd);
+            return;
+        }
+
+        cmd->setViewport(0, 1, &pass.mRenderer->getFullViewport());
+        cmd->setScissor(0, 1, &pass.mRenderer->getFullRect());
+
+        pass.mRenderer->record(cmd, [&]() {
+            pass.mCommands(cmd);
+        });
+    };
+
+    if (mProfiler)
+    {
+        mProfiler->record(cmd, pass.mName.c_str(), commands);
+    }
+    else
+    {
+        commands();
+    }
+}
+
+void VulkanRenderGraph::inheritAliasState(Resource & resource)
+{
+    auto & state = resource.image->getState();
+
+    // Called once per frame, the aliases' states are their last uses, earlier in this frame or in the previous one
+    for (auto id : resource.aliases)
+    {
+        auto & other = mResources[id].image->getState();
+
+        state.writeStage |= other.writeStage | other.readStage;
+        state.writeAccess |= other.writeAccess;
+    }
+
+    // Contents don't survive another image using the memory
+    state.layout = vk::ImageLayout::eUndefined;
+}
+
+void VulkanRenderGraph::printStats(std::ostream & out)
+{
+    const double MB = 1024.0 * 1024.0;
+
+    out << std::fixed << std::setprecision(2);
+
+    out << "Render graph: " << mOrder.size() << " of " << mPasses.size() << " passes, transient memory "
+        << mTransientMemorySize / MB << " MB aliased from " << mUnaliasedMemorySize / MB << " MB" << std::endl;
+
+    for (auto & resource : mResources)
+    {
+        if (!resource.transientImage) continue;
+
+        out << "  " << resource.name;
+
+        if (resource.heap < 0)
+        {
+            out << " unused" << std::endl;
+            continue;
+        }
+
+        out << " passes " << resource.firstUse << "-" << resource.lastUse
+            << ", heap " << resource.heap << " at " << resource.offset / MB << " MB" << std::endl;
+    }
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+#include "VulkanImage.h"
+#include "VulkanBarrierBatch.h"
+#include "VulkanMemoryAllocator.h"
+
+#include <deque>
+#include <ostream>
+
+/*
+* Frame graph. Passes declare the images and buffers they read and write, compile() then
+*  - culls passes whose results nothing uses,
+*  - finds the lifetime of every transient image and aliases the memory of images whose lifetimes don't overlap,
+*  - creates a VulkanRenderer for passes that draw into transient images,
+* and execute() records the surviving passes with the barriers between them.
+*
+*   auto color = graph->createImage("color", vk::Format::eR8G8B8A8Unorm, size);
+*
+*   graph->addPass("scene", [&](vk::CommandBuffer * cmd) { ... })
+*       .colorAttachment(color)
+*       .useDepth();
+*
+*   graph->addPass("blit", [&](vk::CommandBuffer * cmd) { ... })
+*       .sample(color)
+*       .target(swapchainRenderer);
+*
+*   graph->compile();
+*   graph->execute(cmd);    //every frame
+*
+* Passes run in the order they are added, so a pass has to be added after the passes writing what it reads.
+* Transient images are recreated by compile, rebind their descriptors after it.
+*/
+class VulkanRenderGraph
+{
+public:
+
+    typedef uint32_t ResourceId;
+
+    class Pass
+    {
+    public:
+
+        //Draw into a transient image, cleared at the start of the pass
+        Pass & colorAttachment(ResourceId image);
+
+        //Depth buffer owned by the pass' renderer
+        Pass & useDepth(bool depth = true);
+
+        Pass & setClearColors(vector<std::array<float, 4>> colors);
+
+        //Draw with a renderer owned outside the graph, e.g. one targeting the swapchain. Such passes are never culled
+        Pass & target(VulkanRendererRef renderer);
+
+        //Sample an image in the layout its descriptors use
+        Pass & sample(ResourceId image, vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eFragmentShader);
+
+        //layout is ignored for buffers
+        Pass & read(ResourceId resource, vk::AccessFlags access, vk::PipelineStageFlags stage, vk::ImageLayout layout = vk::ImageLayout::eGeneral);
+        Pass & write(ResourceId resource, vk::AccessFlags access, vk::PipelineStageFlags stage, vk::ImageLayout layout = vk::ImageLayout::eGeneral);
+
+        //Renderer the pass draws with, created by compile for passes with color attachments
+        VulkanRendererRef getRenderer()
+        {
+            return mRenderer;
+        }
+
+        const std::string & getName()
+        {
+            return mName;
+        }
+
+        bool isCulled()
+        {
+            return mCulled;
+        }
+
+    private:
+
+        friend class VulkanRenderGraph;
+
+        struct Use
+        {
+            ResourceId resource;
+            vk::AccessFlags access;
+            vk::PipelineStageFlags stage;
+            vk::ImageLayout layout;
+
+            //Layout taken from the image's descriptor info at compile
+            bool sampled;
+
+            //Previous contents are not needed, e.g. cleared attachments
+            bool discard;
+        };
+
+        bool reads(ResourceId resource) const;
+        bool writes(ResourceId resource) const;
+
+        std::string mName;
+        function<void(vk::CommandBuffer *)> mCommands;
+
+        vector<Use> mReads;
+        vector<Use> mWrites;
+        vector<ResourceId> mColorAttachments;
+
+        vector<std::array<float, 4>> mClearColors;
+        bool mUseDepth = false;
+
+        VulkanRendererRef mRenderer;
+        bool mExternalRenderer = false;
+
+        bool mCulled = false;
+    };
+
+    VulkanRenderGraph(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanRenderGraph)
+
+    ~VulkanRenderGraph();
+
+    //Graph owned image, its memory may be shared with other transient images
+    ResourceId createImage(const char * name, vk::Format format, glm::uvec2 size, vk::ImageUsageFlags usage = VulkanImage::SAMPLED_COLOR_ATTACHMENT);
+
+    //Images and buffers owned outside the graph count as outputs, passes writing them are never culled
+    ResourceId importImage(const char * name, VulkanImageRef image);
+    ResourceId importBuffer(const char * name, VulkanBufferRef buffer);
+
+    //Keep passes writing a transient image that is read outside the graph
+    void markOutput(ResourceId image);
+
+    //Takes effect on the next compile
+    void resizeImage(ResourceId image, glm::uvec2 size);
+
+    //The returned pass stays valid for the lifetime of the graph
+    Pass & addPass(const char * name, function<void(vk::CommandBuffer *)> commands);
+
+    /*
+    * Transient images, framebuffers and memory of an earlier compile are released once the frame context's current frame completes.
+    * Without a frame context compile waits for the device before releasing them.
+    */
+    void compile();
+
+    //Frames the graph is executed in, see compile
+    void setFrameContext(VulkanFrameContextRef frames)
+    {
+        mFrames = frames;
+    }
+
+    void execute(vk::CommandBuffer * cmd);
+
+    //Passes are recorded as named regions of the profiler's frame
+    void setProfiler(VulkanProfilerRef profiler)
+    {
+        mProfiler = profiler;
+    }
+
+    //Valid from createImage on, its memory and view only after compile
+    VulkanImage2DRef getImage(ResourceId image);
+
+    VulkanBufferRef getBuffer(ResourceId buffer);
+
+    //Transient memory after aliasing
+    vk::DeviceSize getTransientMemorySize()
+    {
+        return mTransientMemorySize;
+    }
+
+    //Transient memory each image would take on its own
+    vk::DeviceSize getUnaliasedMemorySize()
+    {
+        return mUnaliasedMemorySize;
+    }
+
+    void printStats(std::ostream & out);
+
+private:
+
+    struct Resource
+    {
+        std::string name;
+
+        VulkanImage2DRef transientImage;
+        VulkanImageRef image;
+        VulkanBufferRef buffer;
+
+        //Size of transient images as of the next compile
+        glm::uvec2 extent;
+
+        bool imported = false;
+        bool output = false;
+
+        //Execution order indices of the first and last surviving pass using it, -1 if unused
+        int32_t firstUse = -1;
+        int32_t lastUse = -1;
+
+        //Placement inside mHeaps
+        int32_t heap = -1;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+
+        //Transient images sharing some of this one's memory
+        vector<ResourceId> aliases;
+    };
+
+    void cull();
+    void computeLifetimes();
+    void allocateTransients();
+    void createRenderers();
+
+    //Freed once the frame being recorded completes, or after waiting idle without a frame context
+    void releaseHeaps();
+
+    void recordPass(vk::CommandBuffer * cmd, Pass & pass, uint32_t passIndex);
+
+    //Carry the last uses of overlapping images over to an image taking over their memory
+    void inheritAliasState(Resource & resource);
+
+    VulkanContextPtr mCtx;
+
+    vector<Resource> mResources;
+    std::deque<Pass> mPasses;
+
+    //Indices into mPasses of surviving passes, in execution order
+    vector<uint32_t> mOrder;
+
+    vector<VulkanAllocation> mHeaps;
+
+    vk::DeviceSize mTransientMemorySize = 0;
+    vk::DeviceSize mUnaliasedMemorySize = 0;
+
+    VulkanBarrierBatch mBarriers;
+
+    VulkanProfilerRef mProfiler;
+
+    VulkanFrameContextRef mFrames;
+
+    bool mCompiled = false;
+};
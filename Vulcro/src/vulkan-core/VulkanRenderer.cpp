@@ -1,4 +1,5 @@
 #include "VulkanRenderer.h"
+#include "VulkanFrameContext.h"
 
 
 VulkanRenderer::VulkanRenderer(VulkanContextPtr ctx) :
@@ -256,18 +257,38 @@ void VulkanRenderer::record(vk::CommandBuffer * cmd, function<void()> commands,
 	end(cmd);
 }
 
-void VulkanRenderer::begin(vk::CommandBuffer * cmd, int32_t whichFramebuffer) {
+uint32_t VulkanRenderer::getFramebufferIndex(int32_t whichFramebuffer)
+{
+	if (whichFramebuffer >= 0) {
+		return whichFramebuffer % _framebuffers.size();
+	}
+
+	if (_swapchain != nullptr) {
+		return _swapchain->getRenderingIndex();
+	}
+
+	return 0;
+}
 
+vk::CommandBufferInheritanceInfo VulkanRenderer::getInheritanceInfo(int32_t whichFramebuffer)
+{
+	return vk::CommandBufferInheritanceInfo(
+		_renderPass,
+		0, //subpass
+		_framebuffers[getFramebufferIndex(whichFramebuffer)]
+	);
+}
 
-	uint32_t framebufferIndex = 0;
+void VulkanRenderer::begin(vk::CommandBuffer * cmd, int32_t whichFramebuffer, vk::SubpassContents contents) {
+
+
+	uint32_t framebufferIndex = getFramebufferIndex(whichFramebuffer);
 	const std::array<float, 4> clearColor = { 0.0f, 0.0f, 0.0f, 0.0f };
 
 	//todo avoid vector
 	std::vector<vk::ClearValue> clears;
 
 	if (_swapchain != nullptr) {
-		framebufferIndex = _swapchain->getRenderingIndex(); //todo
-
 		if (_clearColors.size() == 0)
 			clears.push_back(vk::ClearColorValue(clearColor));
 		else
@@ -284,10 +305,6 @@ void VulkanRenderer::begin(vk::CommandBuffer * cmd, int32_t whichFramebuffer) {
 		}
 	}
 
-	if (whichFramebuffer >= 0) {
-		framebufferIndex = whichFramebuffer % _framebuffers.size();
-	}
-
 	if (_useDepth) {
 		clears.push_back(vk::ClearDepthStencilValue(1.0, 0));
 	}
@@ -301,14 +318,28 @@ void VulkanRenderer::begin(vk::CommandBuffer * cmd, int32_t whichFramebuffer) {
 			&clears[0]
 		),
 
-		vk::SubpassContents::eInline
+		contents
 	);
 }
 
-void VulkanRenderer::resize()
+void VulkanRenderer::resize(VulkanFrameContextRef frames)
 {
-	for (auto &fb : _framebuffers) {
-		_ctx->getDevice().destroyFramebuffer(fb);
+	if (frames) {
+		auto device = _ctx->getDevice();
+		auto framebuffers = _framebuffers;
+
+		frames->defer([device, framebuffers]() {
+			for (auto &fb : framebuffers) {
+				device.destroyFramebuffer(fb);
+			}
+		});
+
+		if (_depthImage) frames->keepAlive(_depthImage);
+	}
+	else {
+		for (auto &fb : _framebuffers) {
+			_ctx->getDevice().destroyFramebuffer(fb);
+		}
 	}
 
 
@@ -342,6 +373,17 @@ void VulkanRenderer::resize()
 
 void VulkanRenderer::end(vk::CommandBuffer * cmd) {
 	cmd->endRenderPass();
+
+	// The render pass does its own layout transitions, record where it leaves the attachments
+	for (auto &image : _images) {
+		image->setState(VulkanResourceState(vk::ImageLayout::eColorAttachmentOptimal,
+			vk::AccessFlagBits::eColorAttachmentWrite, vk::PipelineStageFlagBits::eColorAttachmentOutput));
+	}
+
+	if (_useDepth && _depthImage) {
+		_depthImage->setState(VulkanResourceState(vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::PipelineStageFlagBits::eLateFragmentTests));
+	}
 }
 
 void VulkanRenderer::createImagesFramebuffer() {
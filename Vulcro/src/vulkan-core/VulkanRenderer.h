@@ -25,7 +25,11 @@ public:
 
 	void record(vk::CommandBuffer * cmd, function<void()> commands, int32_t whichFramebuffer = -1);
 
-	void begin(vk::CommandBuffer * cmd, int32_t whichFramebuffer = -1);
+	//Use eSecondaryCommandBuffers when the pass is filled by executeCommands, see VulkanTaskGroup::recordRenderPassParallel
+	void begin(vk::CommandBuffer * cmd, int32_t whichFramebuffer = -1, vk::SubpassContents contents = vk::SubpassContents::eInline);
+
+	//For secondary command buffers recorded inside this renderer's pass
+	vk::CommandBufferInheritanceInfo getInheritanceInfo(int32_t whichFramebuffer = -1);
 
     bool hasDepth() {
         return _useDepth;
@@ -58,7 +62,8 @@ public:
         }
     }
 
-	void resize();
+	//frames - destroy the old framebuffers and depth buffer once the frame being recorded completes instead of right away
+	void resize(VulkanFrameContextRef frames = nullptr);
 
 	void end(vk::CommandBuffer * cmd);
 
@@ -74,6 +79,8 @@ public:
 
 private:
 	
+	uint32_t getFramebufferIndex(int32_t whichFramebuffer);
+
 	void createSwapchainFramebuffers(VulkanSwapchainRef swapchain);
 	void createImagesFramebuffer();
 
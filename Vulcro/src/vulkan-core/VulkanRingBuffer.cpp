@@ -0,0 +1,116 @@
+#include "VulkanRingBuffer.h"
+
+const vk::DeviceSize VulkanRingBuffer::DEFAULT_FRAME_SIZE = 8ull * 1024 * 1024;
+const uint32_t VulkanRingBuffer::DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+const vk::BufferUsageFlags VulkanRingBuffer::USAGE =
+    vk::BufferUsageFlagBits::eUniformBuffer |
+    vk::BufferUsageFlagBits::eStorageBuffer |
+    vk::BufferUsageFlagBits::eVertexBuffer |
+    vk::BufferUsageFlagBits::eIndexBuffer |
+    vk::BufferUsageFlagBits::eTransferSrc;
+
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    if (alignment <= 1) return value;
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+VulkanRingBuffer::VulkanRingBuffer(VulkanContextPtr ctx, vk::DeviceSize frameSize, uint32_t framesInFlight) :
+    mCtx(ctx),
+    mFramesInFlight(framesInFlight),
+    mCursor(0)
+{
+    auto & limits = ctx->getPhysicalDeviceProperties().limits;
+
+    mUniformAlignment = limits.minUniformBufferOffsetAlignment;
+    mStorageAlignment = limits.minStorageBufferOffsetAlignment;
+
+    // Keep every partition starting on an alignment any slice could ask for
+    mFrameSize = alignUp(frameSize, glm::max<vk::DeviceSize>(256, glm::max(mUniformAlignment, mStorageAlignment)));
+
+    mBuffer = ctx->makeBuffer(USAGE, mFrameSize * mFramesInFlight, VulkanBuffer::CPU_ALOT);
+
+    // Coherent memory, mapped for the lifetime of the ring
+    mMapped = static_cast<char*>(mBuffer->getMapped());
+}
+
+void VulkanRingBuffer::beginFrame(uint32_t frameIndex)
+{
+    mFrameIndex = frameIndex % mFramesInFlight;
+    mCursor.store(mFrameIndex * mFrameSize);
+}
+
+void VulkanRingBuffer::nextFrame()
+{
+    beginFrame(mFrameIndex + 1);
+}
+
+VulkanRingSlice VulkanRingBuffer::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    vk::DeviceSize frameEnd = (mFrameIndex + 1) * mFrameSize;
+    vk::DeviceSize current = mCursor.load();
+    vk::DeviceSize offset;
+
+    do
+    {
+        offset = alignUp(current, alignment);
+
+        if (offset + size > frameEnd)
+        {
+            std::cerr << "(VulkanRingBuffer - allocate) frame partition of " << mFrameSize << " bytes exhausted" << std::endl;
+            return VulkanRingSlice();
+        }
+
+    } while (!mCursor.compare_exchange_weak(current, offset + size));
+
+    VulkanRingSlice slice;
+    slice.buffer = mBuffer->getBuffer();
+    slice.offset = offset;
+    slice.size = size;
+    slice.data = mMapped + offset;
+
+    return slice;
+}
+
+VulkanRingSlice VulkanRingBuffer::allocateUniform(vk::DeviceSize size)
+{
+    return allocate(size, mUniformAlignment);
+}
+
+VulkanRingSlice VulkanRingBuffer::allocateStorage(vk::DeviceSize size)
+{
+    return allocate(size, mStorageAlignment);
+}
+
+VulkanRingSlice VulkanRingBuffer::pushIndices(vk::ArrayProxy<const VulkanBuffer::IndexType> indices)
+{
+    auto size = sizeof(VulkanBuffer::IndexType) * indices.size();
+    auto slice = allocate(size, sizeof(VulkanBuffer::IndexType));
+
+    if (slice.isValid())
+    {
+        memcpy(slice.data, indices.data(), size);
+    }
+
+    return slice;
+}
+
+void VulkanRingBuffer::bindVertex(vk::CommandBuffer * cmd, VulkanRingSlice const & slice, uint32_t binding)
+{
+    cmd->bindVertexBuffers(binding, 1, &slice.buffer, &slice.offset);
+}
+
+void VulkanRingBuffer::bindIndex(vk::CommandBuffer * cmd, VulkanRingSlice const & slice, vk::IndexType type)
+{
+    cmd->bindIndexBuffer(slice.buffer, slice.offset, type);
+}
+
+vk::DescriptorBufferInfo VulkanRingBuffer::getDBI(vk::DeviceSize range)
+{
+    return vk::DescriptorBufferInfo(
+        mBuffer->getBuffer(),
+        0,
+        range
+    );
+}
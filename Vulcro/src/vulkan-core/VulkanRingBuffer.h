@@ -0,0 +1,145 @@
+#pragma once
+
+#include "VulkanContext.h"
+#include "VulkanBuffer.h"
+
+#include <atomic>
+
+/*
+* A transient (offset, size) window into a VulkanRingBuffer, valid until the ring wraps back to its frame.
+*/
+struct VulkanRingSlice
+{
+    vk::Buffer buffer = nullptr;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    void * data = nullptr;
+
+    bool isValid() const
+    {
+        return data != nullptr;
+    }
+
+    template<typename T>
+    T * as()
+    {
+        return static_cast<T*>(data);
+    }
+
+    //Offset to pass to bindSets for eUniformBufferDynamic / eStorageBufferDynamic bindings
+    uint32_t getDynamicOffset() const
+    {
+        return static_cast<uint32_t>(offset);
+    }
+};
+
+/*
+* Persistently mapped, host coherent buffer split into one partition per frame in flight.
+* Allocation is a pointer bump, so per-draw constants and streamed geometry cost no map/unmap or driver calls.
+* Bind slices with dynamic descriptor offsets (see getDBI) or vertex / index buffer offsets.
+*/
+class VulkanRingBuffer
+{
+public:
+
+    static const vk::DeviceSize DEFAULT_FRAME_SIZE;
+    static const uint32_t DEFAULT_FRAMES_IN_FLIGHT;
+
+    static const vk::BufferUsageFlags USAGE;
+
+    VulkanRingBuffer(VulkanContextPtr ctx, vk::DeviceSize frameSize = DEFAULT_FRAME_SIZE, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
+
+    VULCRO_DONT_COPY(VulkanRingBuffer)
+
+    //Start handing out slices from the partition of frameIndex, the GPU must be done with that frame
+    void beginFrame(uint32_t frameIndex);
+
+    //Move on to the next partition
+    void nextFrame();
+
+    //Safe to call from several recording threads
+    VulkanRingSlice allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+    VulkanRingSlice allocateUniform(vk::DeviceSize size);
+
+    VulkanRingSlice allocateStorage(vk::DeviceSize size);
+
+    template<typename T>
+    VulkanRingSlice pushUniform(T const & value)
+    {
+        auto slice = allocateUniform(sizeof(T));
+
+        if (slice.isValid())
+        {
+            memcpy(slice.data, &value, sizeof(T));
+        }
+
+        return slice;
+    }
+
+    template<typename T>
+    VulkanRingSlice pushVertices(T const * values, uint32_t count)
+    {
+        auto slice = allocate(sizeof(T) * count, 16);
+
+        if (slice.isValid())
+        {
+            memcpy(slice.data, values, sizeof(T) * count);
+        }
+
+        return slice;
+    }
+
+    VulkanRingSlice pushIndices(vk::ArrayProxy<const VulkanBuffer::IndexType> indices);
+
+    void bindVertex(vk::CommandBuffer * cmd, VulkanRingSlice const & slice, uint32_t binding = 0);
+
+    void bindIndex(vk::CommandBuffer * cmd, VulkanRingSlice const & slice, vk::IndexType type = vk::IndexType::eUint32);
+
+    /*
+    * Descriptor for a dynamic uniform / storage binding of at most 'range' bytes.
+    * The per-draw slice offset is supplied at bind time through bindSets(cmd, sets, { slice.getDynamicOffset() }).
+    */
+    vk::DescriptorBufferInfo getDBI(vk::DeviceSize range);
+
+    VulkanBufferRef getBuffer()
+    {
+        return mBuffer;
+    }
+
+    uint32_t getFrameIndex()
+    {
+        return mFrameIndex;
+    }
+
+    uint32_t getFramesInFlight()
+    {
+        return mFramesInFlight;
+    }
+
+    vk::DeviceSize getFrameSize()
+    {
+        return mFrameSize;
+    }
+
+    //Bytes handed out from the current partition
+    vk::DeviceSize getFrameUsage()
+    {
+        return mCursor.load() - mFrameIndex * mFrameSize;
+    }
+
+private:
+
+    VulkanContextPtr mCtx;
+    VulkanBufferRef mBuffer;
+    char * mMapped = nullptr;
+
+    vk::DeviceSize mFrameSize;
+    uint32_t mFramesInFlight;
+    uint32_t mFrameIndex = 0;
+
+    std::atomic<vk::DeviceSize> mCursor;
+
+    vk::DeviceSize mUniformAlignment;
+    vk::DeviceSize mStorageAlignment;
+};
@@ -1,6 +1,7 @@
 #include "VulkanSet.h"
 
 #include "VulkanSetLayout.h"
+#include "VulkanTracer.h"
 #include "../vulkan-rtx/RTAccelerationStructure.h"
 #include "../vulkan-rtx/RTScene.h"
 
@@ -11,8 +12,19 @@ VulkanSet::VulkanSet(VulkanContextPtr ctx, VulkanSetLayoutRef layout) :
 	_descriptorSet = layout->allocateDescriptorSet();
 }
 
+VulkanSet::VulkanSet(VulkanContextPtr ctx, VulkanSetLayoutRef layout, vk::DescriptorSet descriptorSet) :
+	_ctx(ctx),
+	_layout(layout),
+	_descriptorSet(descriptorSet),
+	_ownsSet(false)
+{
+
+}
+
 void VulkanSet::bindBuffer(uint32_t binding, VulkanBufferRef buffer)
 {
+    VULCRO_TRACE_FUNCTION();
+
     if (!buffer) return;
 
 	vector<VulkanBufferRef> bv = { buffer };
@@ -27,130 +39,67 @@ void VulkanSet::bindBufferArray(uint32_t binding, vk::ArrayProxy<VulkanBufferRef
     }
 
 	auto type = buffers.front()->getDescriptorType();
-	auto count = buffers.size();
-
-	vk::WriteDescriptorSet write;
 
 	if ((type == vk::DescriptorType::eStorageTexelBuffer) || (type == vk::DescriptorType::eUniformTexelBuffer)) {
 
-		std::vector<vk::BufferView> views;
-		views.reserve(count);
+		auto first = static_cast<uint32_t>(_views.size());
 
 		for (auto & buffer : buffers) {
 			if(buffer)
-				views.push_back(buffer->getView());
+				_views.push_back(buffer->getView());
 		}
 
-		write = vk::WriteDescriptorSet(
-			_descriptorSet,
-			binding,
-			0,
-			views.size(),
-			type,
-			nullptr,
-			nullptr,
-			views.data()
-		);
-
-		_ctx->getDevice().updateDescriptorSets(1, &write, 0, nullptr);
+		queueWrite(binding, type, static_cast<uint32_t>(_views.size()) - first, first);
 	}
 	else {
 
-		std::vector<vk::DescriptorBufferInfo> dbis;
-		dbis.reserve(count);
+		auto first = static_cast<uint32_t>(_dbis.size());
 
 		for (auto & buffer : buffers) {
 			if(buffer)
-				dbis.push_back(buffer->getDBI());
+				_dbis.push_back(buffer->getDBI());
 		}
-		write = vk::WriteDescriptorSet(
-			_descriptorSet,
-			binding,
-			0,
-			dbis.size(),
-			type,
-			nullptr,
-			dbis.data(),
-			nullptr
-		);
-
-		_ctx->getDevice().updateDescriptorSets(
-			1,
-			&write,
-			0,
-			nullptr
-		);
 
+		queueWrite(binding, type, static_cast<uint32_t>(_dbis.size()) - first, first);
 	}
-
-
 }
 
 void VulkanSet::bindBuffer(uint32_t binding, vk::DescriptorBufferInfo dbi, vk::DescriptorType type)
 {
+    VULCRO_TRACE_FUNCTION();
 
-	auto write = vk::WriteDescriptorSet(
-		_descriptorSet,
-		binding,
-		0,
-		1,
-		type,
-		nullptr,
-		&dbi,
-		nullptr
-
-	);
+	_dbis.push_back(dbi);
 
-	_ctx->getDevice().updateDescriptorSets(
-		1,
-		&write,
-		0,
-		nullptr
-	);
+	queueWrite(binding, type, 1, static_cast<uint32_t>(_dbis.size()) - 1);
 }
 
 
 void VulkanSet::bindBuffer(uint32_t binding, iuboRef uboref)
 {
+    VULCRO_TRACE_FUNCTION();
+
 	bindBuffer(binding, uboref->getDBI());
 }
 
 void VulkanSet::bindImageArray(uint32_t binding, vk::ArrayProxy<VulkanImageRef> images, vk::DescriptorType type)
 {
-	vector<vk::DescriptorImageInfo> diis;
+    VULCRO_TRACE_FUNCTION();
+
+	auto first = static_cast<uint32_t>(_diis.size());
 
 	for (auto & img : images) {
 		if (img) {
-			diis.push_back(img->getDII());
+			_diis.push_back(img->getDII());
 		}
 	}
 
-    if (diis.size() == 0)
-    {
-        return;
-    }
-
-	auto write = vk::WriteDescriptorSet(
-		_descriptorSet,
-		binding,
-		0,
-		diis.size(),
-		type,
-		diis.data(),
-		nullptr,
-		nullptr
-	);
-
-	_ctx->getDevice().updateDescriptorSets(
-		1,
-		&write,
-		0,
-		nullptr
-	);
+	queueWrite(binding, type, static_cast<uint32_t>(_diis.size()) - first, first);
 }
 
 void VulkanSet::bindImage(uint32_t binding, VulkanImageRef image, vk::DescriptorType type, uint16_t mipLevel)
 {
+    VULCRO_TRACE_FUNCTION();
+
 
 	auto dii = image->getDII(mipLevel);
 
@@ -158,86 +107,133 @@ void VulkanSet::bindImage(uint32_t binding, VulkanImageRef image, vk::Descriptor
 		dii.imageLayout = vk::ImageLayout::eGeneral;
 	}
 
-	auto write = vk::WriteDescriptorSet(
-		_descriptorSet,
-		binding,
-		0,
-		1,
-		type,
-		&dii,
-		nullptr,
-		nullptr
+	_diis.push_back(dii);
 
-	);
+	queueWrite(binding, type, 1, static_cast<uint32_t>(_diis.size()) - 1);
+}
 
-	_ctx->getDevice().updateDescriptorSets(
-		1,
-		&write,
-		0,
-		nullptr
-	);
+void VulkanSet::bindImageAt(uint32_t binding, uint32_t arrayElement, VulkanImageRef image, vk::DescriptorType type, uint16_t mipLevel)
+{
+	auto dii = image->getDII(mipLevel);
+
+	if (type == vk::DescriptorType::eStorageImage) {
+		dii.imageLayout = vk::ImageLayout::eGeneral;
+	}
+
+	_diis.push_back(dii);
+
+	queueWrite(binding, type, 1, static_cast<uint32_t>(_diis.size()) - 1, arrayElement);
+}
+
+void VulkanSet::bindBufferAt(uint32_t binding, uint32_t arrayElement, vk::DescriptorBufferInfo dbi, vk::DescriptorType type)
+{
+	_dbis.push_back(dbi);
 
+	queueWrite(binding, type, 1, static_cast<uint32_t>(_dbis.size()) - 1, arrayElement);
+}
+
+void VulkanSet::bindAccelerationStructure(uint32_t binding, vk::AccelerationStructureNV structure)
+{
+	// The handle is copied, the write doesn't point into the structure's owner
+	_accelStructs.push_back(structure);
+
+	queueWrite(binding, vk::DescriptorType::eAccelerationStructureNV, 1, static_cast<uint32_t>(_accelStructs.size()) - 1);
 }
 
 void VulkanSet::bindTopStructure(uint32_t binding, RTTopStructureRef topStructure)
 {
+    VULCRO_TRACE_FUNCTION();
+
     if (!topStructure) return;
 
-    auto writeas = topStructure->getWriteDescriptor();
-
-    auto write = vk::WriteDescriptorSet(
-        _descriptorSet,
-        binding,
-        0,
-        1,
-        vk::DescriptorType::eAccelerationStructureNV,
-        nullptr,
-        nullptr,
-        nullptr
-    );
-
-    write.setPNext(&writeas);
-
-    _ctx->getDevice().updateDescriptorSets(
-        1,
-        &write,
-        0,
-        nullptr,
-        _ctx->getDynamicDispatch()
-    );
+    bindAccelerationStructure(binding, topStructure->getAccelerationStruct());
 }
 
 void VulkanSet::bindRTScene(uint32_t binding, RTSceneRef rtscene)
 {
+    VULCRO_TRACE_FUNCTION();
 
 	auto writeas = rtscene->getWriteDescriptor();
 
-	auto write = vk::WriteDescriptorSet(
+	bindAccelerationStructure(binding, writeas.pAccelerationStructures[0]);
+}
+
+void VulkanSet::queueWrite(uint32_t binding, vk::DescriptorType type, uint32_t count, uint32_t first, uint32_t arrayElement)
+{
+	if (count == 0) return;
+
+	if (!_queued) {
+		_queued = true;
+		_ctx->queueDescriptorWrites(this);
+	}
+
+	// Pointers are filled in by resolveWrites, the storage vectors may still grow until then
+	_writes.push_back(vk::WriteDescriptorSet(
 		_descriptorSet,
 		binding,
-		0,
-		1,
-		vk::DescriptorType::eAccelerationStructureNV,
-		nullptr,
-		nullptr,
-		nullptr
-	);
+		arrayElement,
+		count,
+		type
+	));
 
-	write.setPNext(&writeas);
+	_writeOffsets.push_back(first);
+}
 
-	_ctx->getDevice().updateDescriptorSets(
-		1,
-		&write,
-		0,
-		nullptr,
-		_ctx->getDynamicDispatch()
-	);
+void VulkanSet::resolveWrites()
+{
+	_accelWrites.clear();
+	_accelWrites.reserve(_accelStructs.size());
+
+	for (size_t i = 0; i < _writes.size(); i++) {
+
+		auto & write = _writes[i];
+		auto first = _writeOffsets[i];
+
+		switch (write.descriptorType) {
+
+		case vk::DescriptorType::eStorageTexelBuffer:
+		case vk::DescriptorType::eUniformTexelBuffer:
+			write.pTexelBufferView = &_views[first];
+			break;
+
+		case vk::DescriptorType::eUniformBuffer:
+		case vk::DescriptorType::eStorageBuffer:
+		case vk::DescriptorType::eUniformBufferDynamic:
+		case vk::DescriptorType::eStorageBufferDynamic:
+			write.pBufferInfo = &_dbis[first];
+			break;
+
+		case vk::DescriptorType::eAccelerationStructureNV:
+			_accelWrites.push_back(vk::WriteDescriptorSetAccelerationStructureNV(1, &_accelStructs[first]));
+			write.pNext = &_accelWrites.back();
+			break;
+
+		default:
+			write.pImageInfo = &_diis[first];
+			break;
+		}
+	}
+}
+
+void VulkanSet::clearWrites()
+{
+	_writes.clear();
+	_writeOffsets.clear();
+	_dbis.clear();
+	_diis.clear();
+	_views.clear();
+	_accelStructs.clear();
+	_accelWrites.clear();
 }
 
 void VulkanSet::update() {
+    VULCRO_TRACE_FUNCTION();
+
 
 	if (_writes.size() == 0) return;
 
+	resolveWrites();
+
 	_ctx->getDevice().updateDescriptorSets(
 		static_cast<uint32_t>(_writes.size()),
 		&_writes[0],
@@ -246,13 +242,71 @@ void VulkanSet::update() {
         _ctx->getDynamicDispatch()
 	);
 
-	_writes.clear();
+	clearWrites();
+
+}
+
+void VulkanSet::updateWithTemplate(const void * data)
+{
+    VULCRO_TRACE_FUNCTION();
+
+	// Queued binds came first, so they must not land on top of the template's writes
+	update();
+
+	_ctx->getDevice().updateDescriptorSetWithTemplate(
+		_descriptorSet,
+		_layout->getUpdateTemplate(),
+		data,
+		_ctx->getDynamicDispatch()
+	);
+}
+
+void VulkanSet::update(vk::ArrayProxy<const VulkanSetRef> sets)
+{
+	vector<VulkanSet *> pointers;
+
+	for (auto & set : sets) {
+		if (set) pointers.push_back(set.get());
+	}
 
+	update(pointers);
+}
+
+void VulkanSet::update(vector<VulkanSet *> const & sets)
+{
+	VulkanContextPtr ctx = nullptr;
+	vector<vk::WriteDescriptorSet> writes;
+
+	for (auto * set : sets) {
+		if (set->hasPendingWrites()) {
+			set->resolveWrites();
+			writes.insert(writes.end(), set->_writes.begin(), set->_writes.end());
+			ctx = set->_ctx;
+		}
+	}
+
+	if (writes.size() == 0) return;
+
+	VULCRO_TRACE_ZONE("VulkanSet::update batch");
+
+	ctx->getDevice().updateDescriptorSets(
+		static_cast<uint32_t>(writes.size()),
+		writes.data(),
+		0,
+		nullptr,
+		ctx->getDynamicDispatch()
+	);
+
+	for (auto * set : sets) {
+		set->clearWrites();
+	}
 }
 
 VulkanSet::~VulkanSet()
 {
 
-	_layout->freeDescriptorSet(_descriptorSet);
+	if (_queued) _ctx->cancelDescriptorWrites(this);
+
+	if (_ownsSet) _layout->freeDescriptorSet(_descriptorSet);
 
 }
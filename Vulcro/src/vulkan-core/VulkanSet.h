@@ -5,6 +5,13 @@
 #include "VulkanImage.h"
 #include "VulkanBuffer.h"
 
+#include <cassert>
+
+/*
+* Binds are queued and written with one vkUpdateDescriptorSets, by update or for every set at once by
+* VulkanContext::flushDescriptorWrites before recording starts. Binding a set to a command buffer only reads it,
+* so sets can be bound from several recording threads. Like before, a set must not be rebound while the GPU may still use it.
+*/
 class VulkanSet
 {
 public:
@@ -15,6 +22,9 @@ public:
 	
 	VulkanSet(VulkanContextPtr ctx, VulkanSetLayoutRef layout);
 
+	//Wraps a set owned elsewhere, e.g. by a VulkanDescriptorArena, it is not freed with this object
+	VulkanSet(VulkanContextPtr ctx, VulkanSetLayoutRef layout, vk::DescriptorSet descriptorSet);
+
 	~VulkanSet();
 
 	//////////////////////////
@@ -44,12 +54,38 @@ public:
 		bindImage(binding, image, vk::DescriptorType::eStorageImage, mipLevel);
 	}
 
+	//Write a single element of an array binding, e.g. a slot of VulkanBindlessHeap
+	void bindImageAt(uint32_t binding, uint32_t arrayElement, VulkanImageRef image, vk::DescriptorType type = vk::DescriptorType::eCombinedImageSampler, uint16_t mipLevel = 0);
+
+	void bindBufferAt(uint32_t binding, uint32_t arrayElement, vk::DescriptorBufferInfo dbi, vk::DescriptorType type = vk::DescriptorType::eStorageBuffer);
+
 	void bindRTScene(uint32_t binding, RTSceneRef rtscene);
 
     void bindTopStructure(uint32_t binding, RTTopStructureRef topStructure);
 
+	//Write the queued binds
 	void update();
 
+	//Write the queued binds of all sets at once, e.g. after rebinding many sets on resize
+	static void update(vk::ArrayProxy<const VulkanSetRef> sets);
+	static void update(vector<VulkanSet *> const & sets);
+
+	/*
+	* Write every binding from data in one call, laid out as described at VulkanSetLayout::getUpdateTemplate.
+	* Skips building writes, for sets rewritten every frame.
+	*/
+	void updateWithTemplate(const void * data);
+
+	template<typename T>
+	void updateWithTemplate(const T & data) {
+		assert(sizeof(T) == _layout->getTemplateSize());
+		updateWithTemplate(static_cast<const void *>(&data));
+	}
+
+	bool hasPendingWrites() const {
+		return _writes.size() > 0;
+	}
+
 
     //////////////////////////
     //// Getters / Setters
@@ -66,15 +102,36 @@ public:
 
 private:
 
-	vector<vk::DescriptorBufferInfo> _dbis;
+	friend class VulkanContext;
+
+	void bindAccelerationStructure(uint32_t binding, vk::AccelerationStructureNV structure);
+
+	//first indexes the storage vector matching type
+	void queueWrite(uint32_t binding, vk::DescriptorType type, uint32_t count, uint32_t first, uint32_t arrayElement = 0);
+
+	//Point the queued writes at their storage
+	void resolveWrites();
 
+	void clearWrites();
+
+	//Storage for the queued writes, kept until they are written
+	vector<vk::DescriptorBufferInfo> _dbis;
 	vector<vk::DescriptorImageInfo> _diis;
+	vector<vk::BufferView> _views;
+	vector<vk::AccelerationStructureNV> _accelStructs;
+	vector<vk::WriteDescriptorSetAccelerationStructureNV> _accelWrites;
 
 	VulkanContextPtr _ctx;
 
 	VulkanSetLayoutRef _layout;
 
 	vector<vk::WriteDescriptorSet> _writes;
+	vector<uint32_t> _writeOffsets;
 
 	vk::DescriptorSet _descriptorSet;
+
+	bool _ownsSet = true;
+
+	//Registered with the context's flushDescriptorWrites
+	bool _queued = false;
 };
\ No newline at end of file
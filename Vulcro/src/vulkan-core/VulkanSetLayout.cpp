@@ -1,96 +1,91 @@
 #include "VulkanSetLayout.h"
 
-VulkanSetLayout::VulkanSetLayout(VulkanContextPtr ctx, vk::ArrayProxy<const Binding> bindings, uint32_t maxSets) :
+#include "VulkanDescriptorAllocator.h"
+
+VulkanSetLayout::VulkanSetLayout(VulkanContextPtr ctx, vk::ArrayProxy<const Binding> bindings, uint32_t maxSets, bool updateAfterBind) :
 	_ctx(ctx),
 	_bindings((SLB*)bindings.begin(), (SLB*)bindings.end())
 {
+	_signature = _ctx->getDescriptorAllocator()->getSignature(bindings, maxSets, updateAfterBind && _ctx->supportsUpdateAfterBind());
 
-	vector<vk::DescriptorSetLayoutBinding> vkbindings;
-	vector<vk::DescriptorPoolSize> poolSizes;
-    vector<vk::DescriptorBindingFlagsEXT> bindingFlags;
+	_descriptorLayout = _signature->layout;
 
+	for (auto & binding : _bindings) {
+		_templateOffsets.push_back(_templateSize);
+		_templateSize += getTemplateStride(binding.type) * binding.arrayCount;
+	}
+}
 
-	for (auto &binding : bindings) {
+size_t VulkanSetLayout::getTemplateStride(vk::DescriptorType type)
+{
+	switch (type) {
 
-        if (binding.arrayCount > 1) bindingFlags.push_back(vk::DescriptorBindingFlagBitsEXT::ePartiallyBound);
-        else bindingFlags.push_back(vk::DescriptorBindingFlagsEXT(0));
+	case vk::DescriptorType::eUniformBuffer:
+	case vk::DescriptorType::eStorageBuffer:
+	case vk::DescriptorType::eUniformBufferDynamic:
+	case vk::DescriptorType::eStorageBufferDynamic:
+		return sizeof(vk::DescriptorBufferInfo);
 
+	case vk::DescriptorType::eUniformTexelBuffer:
+	case vk::DescriptorType::eStorageTexelBuffer:
+		return sizeof(vk::BufferView);
 
-		vkbindings.push_back(vk::DescriptorSetLayoutBinding(
-			static_cast<uint32_t>(vkbindings.size()),
-			binding.type,
-			binding.arrayCount,
-			binding.stageFlags,
-			binding.samplers
-		));
+	case vk::DescriptorType::eAccelerationStructureNV:
+		return 0;
 
-		poolSizes.push_back(
-			vk::DescriptorPoolSize(
-				binding.type,
-				binding.arrayCount
-			)
-		);
+	default:
+		return sizeof(vk::DescriptorImageInfo);
 	}
+}
 
+vk::DescriptorUpdateTemplate VulkanSetLayout::getUpdateTemplate()
+{
+	if (_updateTemplate) return _updateTemplate;
 
-    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingsExt;
-    bindingsExt.bindingCount = bindingFlags.size();
-    bindingsExt.setPBindingFlags(bindingFlags.data());
-    bindingsExt.setPNext(nullptr);
-
-    vk::DescriptorSetLayoutCreateInfo layoutCreateInfo(
-        vk::DescriptorSetLayoutCreateFlags(),
-        static_cast<uint32_t>(vkbindings.size()),
-        &vkbindings[0]
-    );
+	vector<vk::DescriptorUpdateTemplateEntry> entries;
 
-     layoutCreateInfo.pNext = &bindingsExt;
+	for (uint32_t i = 0; i < _bindings.size(); i++) {
 
+		auto stride = getTemplateStride(_bindings[i].type);
 
-	_descriptorLayout = _ctx->getDevice().createDescriptorSetLayout(
-		layoutCreateInfo, nullptr,
-		_ctx->getDynamicDispatch()
-	);
+		if (stride == 0 || _bindings[i].arrayCount == 0) continue;
 
+		entries.push_back(vk::DescriptorUpdateTemplateEntry(
+			i,
+			0,
+			_bindings[i].arrayCount,
+			_bindings[i].type,
+			_templateOffsets[i],
+			stride
+		));
+	}
 
-    _pool = _ctx->getDevice().createDescriptorPool(
-		vk::DescriptorPoolCreateInfo(
-			vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-			maxSets,
-			static_cast<uint32_t>(poolSizes.size()),
-			&poolSizes[0]
+	_updateTemplate = _ctx->getDevice().createDescriptorUpdateTemplate(
+		vk::DescriptorUpdateTemplateCreateInfo(
+			vk::DescriptorUpdateTemplateCreateFlags(),
+			static_cast<uint32_t>(entries.size()),
+			entries.data(),
+			vk::DescriptorUpdateTemplateType::eDescriptorSet,
+			_descriptorLayout
 		), nullptr,
 		_ctx->getDynamicDispatch()
 	);
 
+	return _updateTemplate;
 }
 
 vk::DescriptorSet VulkanSetLayout::allocateDescriptorSet() {
 
-	auto set = _ctx->getDevice().allocateDescriptorSets(
-		vk::DescriptorSetAllocateInfo(
-			_pool,
-			1,
-			&_descriptorLayout
-		),
-		_ctx->getDynamicDispatch()
-	)[0];
-
-	return set;
+	return _ctx->getDescriptorAllocator()->allocate(_signature);
 }
 
 void VulkanSetLayout::freeDescriptorSet(vk::DescriptorSet set)
 {
-	_ctx->getDevice().freeDescriptorSets(
-		_pool,
-		{ set },
-		_ctx->getDynamicDispatch()
-	);
-
+	_ctx->getDescriptorAllocator()->free(_signature, set);
 }
 
 VulkanSetLayout::~VulkanSetLayout()
 {
-	_ctx->getDevice().destroyDescriptorSetLayout(_descriptorLayout, nullptr, _ctx->getDynamicDispatch());
-	_ctx->getDevice().destroyDescriptorPool(_pool, nullptr, _ctx->getDynamicDispatch());
-}
\ No newline at end of file
+	// The layout and pools belong to the allocator, sets made from this layout stay valid
+	if (_updateTemplate) _ctx->getDevice().destroyDescriptorUpdateTemplate(_updateTemplate, nullptr, _ctx->getDynamicDispatch());
+}
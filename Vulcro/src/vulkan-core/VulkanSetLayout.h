@@ -2,6 +2,7 @@
 
 #include "VulkanContext.h"
 
+struct VulkanDescriptorSignature;
 
 class VulkanSetLayout
 {
@@ -9,14 +10,40 @@ class VulkanSetLayout
 
 public:
 
-	VulkanSetLayout(VulkanContextPtr ctx, vk::ArrayProxy<const Binding> bindings, uint32_t maxSets = 1);
+	/*
+	* maxSets only sizes the first pool, more sets can be allocated.
+	* With updateAfterBind the layout's descriptors may be written while its sets are in use, as long as the GPU doesn't read them.
+	*/
+	VulkanSetLayout(VulkanContextPtr ctx, vk::ArrayProxy<const Binding> bindings, uint32_t maxSets = 1, bool updateAfterBind = false);
 
 	~VulkanSetLayout();
 
+	//Shared with every layout made from the same bindings, owned by the context's descriptor allocator
 	vk::DescriptorSetLayout getDescriptorLayout() {
 		return _descriptorLayout;
 	}
 
+	VulkanDescriptorSignature * getSignature() {
+		return _signature;
+	}
+
+	/*
+	* Template writing every binding from one packed struct, created on first use. Bindings are laid out in order
+	* without padding, arrays as consecutive elements: vk::DescriptorBufferInfo for buffers, vk::BufferView for
+	* texel buffers and vk::DescriptorImageInfo for everything else. Acceleration structures are skipped.
+	*/
+	vk::DescriptorUpdateTemplate getUpdateTemplate();
+
+	//Size of the struct getUpdateTemplate reads
+	size_t getTemplateSize() {
+		return _templateSize;
+	}
+
+	//Where binding starts in the struct
+	size_t getTemplateOffset(uint32_t binding) {
+		return _templateOffsets[binding];
+	}
+
 	vk::DescriptorSet allocateDescriptorSet();
 
 	void freeDescriptorSet(vk::DescriptorSet set);
@@ -27,12 +54,16 @@ public:
 
 private:
 
+	static size_t getTemplateStride(vk::DescriptorType type);
+
 	vk::DescriptorSetLayout _descriptorLayout;
-	vk::DescriptorPool _pool;
+	VulkanDescriptorSignature * _signature;
+
+	vk::DescriptorUpdateTemplate _updateTemplate;
+	vector<size_t> _templateOffsets;
+	size_t _templateSize = 0;
 
 	VulkanContextPtr _ctx;
 	vector<Binding> _bindings;
 
 };
-
-
@@ -1,31 +1,7 @@
 #include "VulkanShader.h"
-#include <iostream>
-#include <fstream>
+#include "VulkanShaderCache.h"
 
-using std::ifstream;
-
-
-void readFile(const char * filepath, uint32_t &size, uint32_t ** data) {
-
-	ifstream file(filepath, std::ios::in | std::ios::binary);
-	char * memblock;
-
-	if (file.is_open()) {
-		// get length of file:
-		file.seekg(0, file.end);
-		size = static_cast<uint32_t>(file.tellg());
-		file.seekg(0, file.beg);
-
-		memblock = new char[size];
-		file.read(memblock, size);
-		file.close();
-		*data = (uint32_t*)memblock;
-	}
-	else
-    {
-		throw new std::system_error(std::error_code(), "Shader not found");
-	}
-}
+#include <stdexcept>
 
 
 VulkanShader::VulkanShader(
@@ -33,12 +9,14 @@ VulkanShader::VulkanShader(
 	const char * vertPath, 
 	const char * fragPath, 
 	vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts,
-	vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts)
+	vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts,
+	VulkanSpecialization const & specialization)
 	
 	:
-	_ctx(ctx),
+	_uniformLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end()),
 	_vertexLayouts((VulkanVertexLayoutRef*)vertexLayouts.begin(), (VulkanVertexLayoutRef*)vertexLayouts.end()),
-	_uniformLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end())
+	_ctx(ctx),
+	_specialization(specialization)
 {
 
 	
@@ -50,7 +28,7 @@ VulkanShader::VulkanShader(
 		vk::PipelineShaderStageCreateInfo(
 			vk::PipelineShaderStageCreateFlags(),
 			vk::ShaderStageFlagBits::eVertex,
-			_modules[0],
+			_modules[0]->getModule(),
 			"main",
 			nullptr
 		)
@@ -61,51 +39,26 @@ VulkanShader::VulkanShader(
 		vk::PipelineShaderStageCreateInfo(
 			vk::PipelineShaderStageCreateFlags(),
 			vk::ShaderStageFlagBits::eFragment,
-			_modules[1],
+			_modules[1]->getModule(),
 			"main",
 			nullptr
 		)
 	);
 	
-	//Uniforms
-	for (auto &layout : _uniformLayouts) {
-		_descriptorSetLayouts.push_back(layout->getDescriptorLayout());
-	}
-
-
-	//Attributes
-	int binding = 0;
-
-	for (auto & vertexLayout : _vertexLayouts) {
-
-		auto nviads = vertexLayout->getVIADS(binding);
-		_viads.insert(_viads.end(), nviads.begin(), nviads.end());
-
-
-		_vibds.push_back(vertexLayout->getVIBD(binding));
-
-		binding += 1;
-	}
-
-	_vis = vk::PipelineVertexInputStateCreateInfo(
-		vk::PipelineVertexInputStateCreateFlags(),
-
-		static_cast<uint32_t>(_vibds.size()),
-		_vibds.size() > 0 ? &_vibds[0] : nullptr,
-		static_cast<uint32_t>(_viads.size()),
-		_viads.size() > 0 ? &_viads[0] : nullptr
-	);
-	
+	createLayouts();
+	applySpecialization();
 }
 
 VulkanShader::VulkanShader(VulkanContextPtr ctx, 
 	const char * vertPath, const char * tessControlPath, const char * tessEvalPath,
 	const char * tessGeomPath, const char * fragPath, 
 	vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts,
-	vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts)
-	:_ctx(ctx),
+	vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts,
+	VulkanSpecialization const & specialization)
+	:_uniformLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end()),
 	_vertexLayouts((VulkanVertexLayoutRef*)vertexLayouts.begin(), (VulkanVertexLayoutRef*)vertexLayouts.end()),
-	_uniformLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end())
+	_ctx(ctx),
+	_specialization(specialization)
 {
 
 	_modules.push_back(loadModule(vertPath));
@@ -122,7 +75,7 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 		vk::PipelineShaderStageCreateInfo(
 			vk::PipelineShaderStageCreateFlags(),
 			vk::ShaderStageFlagBits::eVertex,
-			_modules[stageIndex++],
+			_modules[stageIndex++]->getModule(),
 			"main",
 			nullptr
 		)
@@ -133,7 +86,7 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 		vk::PipelineShaderStageCreateInfo(
 			vk::PipelineShaderStageCreateFlags(),
 			vk::ShaderStageFlagBits::eTessellationControl,
-			_modules[stageIndex++],
+			_modules[stageIndex++]->getModule(),
 			"main",
 			nullptr
 		)
@@ -143,7 +96,7 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 		vk::PipelineShaderStageCreateInfo(
 			vk::PipelineShaderStageCreateFlags(),
 			vk::ShaderStageFlagBits::eTessellationEvaluation ,
-			_modules[stageIndex++],
+			_modules[stageIndex++]->getModule(),
 			"main",
 			nullptr
 		)
@@ -156,7 +109,7 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 			vk::PipelineShaderStageCreateInfo(
 				vk::PipelineShaderStageCreateFlags(),
 				vk::ShaderStageFlagBits::eGeometry,
-				_modules[stageIndex++],
+				_modules[stageIndex++]->getModule(),
 				"main",
 				nullptr
 			)
@@ -167,7 +120,7 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 		vk::PipelineShaderStageCreateInfo(
 			vk::PipelineShaderStageCreateFlags(),
 			vk::ShaderStageFlagBits::eFragment,
-			_modules[stageIndex++],
+			_modules[stageIndex++]->getModule(),
 			"main",
 			nullptr
 		)
@@ -175,21 +128,118 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 
 
 
-	//Uniforms
+	createLayouts();
+	applySpecialization();
+}
+
+VulkanShader::VulkanShader(VulkanContextPtr ctx, const char * computePath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, VulkanSpecialization const & specialization)
+	: _uniformLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end())
+	, _ctx(ctx)
+	, _specialization(specialization)
+{
+	
+	_modules.push_back(loadModule(computePath));
+
+	_stages.push_back(
+		vk::PipelineShaderStageCreateInfo(
+			vk::PipelineShaderStageCreateFlags(),
+			vk::ShaderStageFlagBits::eCompute,
+			_modules[0]->getModule(),
+			"main",
+			nullptr
+		)
+	);
+
+	createLayouts();
+	applySpecialization();
+}
+
+VulkanShader::VulkanShader(VulkanShader & base, VulkanSpecialization const & specialization)
+	: _uniformLayouts(base._layoutsReflected && base._reflection.hasSpecSizedBindings() ? vector<VulkanSetLayoutRef>() : base._uniformLayouts)
+	, _vertexLayouts(base._vertexLayouts)
+	, _ctx(base._ctx)
+	, _stages(base._stages)
+	, _modules(base._modules)
+	, _specialization(specialization)
+	, _layoutsReflected(base._layoutsReflected)
+{
+	createLayouts();
+	applySpecialization();
+}
+
+VulkanShaderRef VulkanShader::specialize(VulkanSpecialization const & specialization)
+{
+	std::lock_guard<std::mutex> lock(_variantsMutex);
+
+	auto & variant = _variants[specialization];
+
+	if (!variant) {
+		variant = make_shared<VulkanShader>(*this, specialization);
+	}
+
+	return variant;
+}
+
+void VulkanShader::applySpecialization()
+{
+	// Constant ids a stage doesn't declare are ignored by it
+	_specializationInfo = _specialization.getInfo();
+
+	for (auto & stage : _stages) {
+		stage.pSpecializationInfo = _specialization.empty() ? nullptr : &_specializationInfo;
+	}
+}
+
+void VulkanShader::createLayouts()
+{
+	for (auto & module : _modules) {
+		_reflection.merge(module->getReflection());
+	}
+
+	_reflection.specialize(_specialization);
+
+	//Uniforms, derived from the shader unless given
+	if (_uniformLayouts.empty()) {
+		_layoutsReflected = true;
+
+		for (uint32_t set = 0; set < _reflection.getSetCount(); set++) {
+			_uniformLayouts.push_back(_ctx->makeSetLayout(_reflection.getSetLayoutBindings(set)));
+		}
+	}
+
 	for (auto &layout : _uniformLayouts) {
 		_descriptorSetLayouts.push_back(layout->getDescriptorLayout());
 	}
 
+	//Attributes, one interleaved buffer in location order unless given
+	auto & inputs = _reflection.getInputs();
+
+	if (_vertexLayouts.empty() && !inputs.empty()) {
 
-	//Attributes
-	int binding = 0;
+		vector<vk::Format> fields;
+
+		for (auto & input : inputs) {
+			if (input.location != fields.size()) {
+				std::cerr << "(VulkanShader - createLayouts) vertex inputs skip locations, pass vertex layouts explicitly" << std::endl;
+				fields.clear();
+				break;
+			}
+
+			fields.push_back(input.format);
+		}
+
+		if (!fields.empty()) {
+			_vertexLayouts.push_back(_ctx->makeVertexLayout(fields));
+		}
+	}
+
+	uint32_t binding = 0;
 
 	for (auto & vertexLayout : _vertexLayouts) {
 
 		auto nviads = vertexLayout->getVIADS(binding);
 		_viads.insert(_viads.end(), nviads.begin(), nviads.end());
 
-
 		_vibds.push_back(vertexLayout->getVIBD(binding));
 
 		binding += 1;
@@ -202,80 +252,33 @@ VulkanShader::VulkanShader(VulkanContextPtr ctx,
 		static_cast<uint32_t>(_viads.size()),
 		_viads.size() > 0 ? &_viads[0] : nullptr
 	);
-
-
-
 }
 
-VulkanShader::VulkanShader(VulkanContextPtr ctx, const char * computePath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts)
-	: _ctx(ctx)
-	, _uniformLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end())
+vk::ShaderModule VulkanShader::createModule(VulkanContextPtr ctx, const char * path)
 {
-	
-	_modules.push_back(loadModule(computePath));
+	VulkanMappedFile file(path);
 
-	_stages.push_back(
-		vk::PipelineShaderStageCreateInfo(
-			vk::PipelineShaderStageCreateFlags(),
-			vk::ShaderStageFlagBits::eCompute,
-			_modules[0],
-			"main",
-			nullptr
-		)
-	);
-
-	//Uniforms
-	for (auto &layout : _uniformLayouts) {
-		_descriptorSetLayouts.push_back(layout->getDescriptorLayout());
+	if (!file.isOpen()) {
+		std::cerr << "(VulkanShader - createModule) could not load " << path << std::endl;
+		throw std::runtime_error(std::string("Shader not found: ") + path);
 	}
-}
 
-vk::ShaderModule VulkanShader::createModule(VulkanContextPtr ctx, const char * path)
-{
-	uint32_t csize;
-	uint32_t *cdata;
-	readFile(path, csize, &cdata);
-
-	auto module = ctx->getDevice().createShaderModule(
+	return ctx->getDevice().createShaderModule(
 		vk::ShaderModuleCreateInfo(
 			vk::ShaderModuleCreateFlags(),
-			csize,
-			cdata
+			file.getSize(),
+			reinterpret_cast<const uint32_t *>(file.getData())
 		), nullptr,
 		ctx->getDynamicDispatch()
 	);
-
-    delete[] cdata;
-	return module;
 }
 
-
-
-vk::ShaderModule VulkanShader::loadModule(const char * path)
+VulkanShaderModuleRef VulkanShader::loadModule(const char * path)
 {
-	/*
-	uint32_t csize;
-	uint32_t *cdata;
-	readFile(path, csize, &cdata);
-
-	auto module = _ctx->getDevice().createShaderModule(
-		vk::ShaderModuleCreateInfo(
-			vk::ShaderModuleCreateFlags(),
-			csize,
-			cdata
-		)
-	);
-
-	delete cdata;
-	*/
-
-	return VulkanShader::createModule(_ctx, path);
+	return _ctx->getShaderCache()->getModule(path);
 }
 
 VulkanShader::~VulkanShader()
 {
-
-	for (auto &mod : _modules) {
-		_ctx->getDevice().destroyShaderModule(mod);
-	}
-}
\ No newline at end of file
+	// Modules are shared through the context's shader cache
+}
@@ -2,7 +2,16 @@
 #include "VulkanContext.h"
 #include "VulkanSetLayout.h"
 #include "VulkanVertexLayout.h"
+#include "VulkanShaderReflection.h"
+#include "VulkanSpecialization.h"
 
+#include <map>
+#include <mutex>
+
+/*
+* Stages of one pipeline. Set layouts and vertex layouts left empty are derived from the SPIR-V,
+* with each binding visible to just the stages that use it. Specialization constants apply to every stage.
+*/
 class VulkanShader
 {
 
@@ -13,7 +22,8 @@ public:
 		const char * vertPath,
 		const char * fragPath,
 		vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts = {},
-		vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts = {}
+		vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts = {},
+		VulkanSpecialization const & specialization = VulkanSpecialization()
 	);
 
 	VulkanShader(
@@ -24,15 +34,25 @@ public:
 		const char * tessGeomPath,
 		const char * fragPath,
 		vk::ArrayProxy<const VulkanVertexLayoutRef> vertexLayouts = {},
-		vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts = {}
+		vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts = {},
+		VulkanSpecialization const & specialization = VulkanSpecialization()
 	);
 
 	VulkanShader(
 		VulkanContextPtr ctx,
 		const char * computePath,
-		vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts = {}
+		vk::ArrayProxy<const VulkanSetLayoutRef> uniformLayouts = {},
+		VulkanSpecialization const & specialization = VulkanSpecialization()
 	);
 
+	//Same stages and layouts as base with other constants, see specialize.
+	//Reflected layouts are derived again when a specialization constant sizes one of their arrays
+	VulkanShader(VulkanShader & base, VulkanSpecialization const & specialization);
+
+	//Variant with these constants, made once per distinct set of values and shared after
+	VulkanShaderRef specialize(VulkanSpecialization const & specialization);
+
+	//Uncached module the caller destroys, shaders get theirs from VulkanContext::getShaderCache
 	static vk::ShaderModule createModule(VulkanContextPtr ctx, const char * path);
 		
 	~VulkanShader();
@@ -53,9 +73,26 @@ public:
 		return _descriptorSetLayouts;
 	}
 
+	const vector<VulkanVertexLayoutRef> &getVertexLayouts() {
+		return _vertexLayouts;
+	}
+
+	//Merged over all stages
+	const VulkanShaderReflection &getReflection() {
+		return _reflection;
+	}
+
+	const VulkanSpecialization &getSpecialization() {
+		return _specialization;
+	}
+
 private:
 
-	vk::ShaderModule loadModule(const char* path);
+	VulkanShaderModuleRef loadModule(const char* path);
+
+	void createLayouts();
+
+	void applySpecialization();
 
 	vector<VulkanSetLayoutRef> _uniformLayouts;
 	vector<VulkanVertexLayoutRef> _vertexLayouts;
@@ -68,8 +105,19 @@ private:
 
 	VulkanContextPtr _ctx;
 	vector<vk::PipelineShaderStageCreateInfo> _stages;
-	vector<vk::ShaderModule> _modules;
+	vector<VulkanShaderModuleRef> _modules;
+
+	VulkanShaderReflection _reflection;
+
+	VulkanSpecialization _specialization;
+	vk::SpecializationInfo _specializationInfo;
+
+	std::map<VulkanSpecialization, VulkanShaderRef> _variants;
+	std::mutex _variantsMutex;
 
 	bool layoutCreated = false;
+
+	//Uniform layouts came from reflection rather than the caller
+	bool _layoutsReflected = false;
 };
 
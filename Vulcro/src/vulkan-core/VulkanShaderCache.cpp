@@ -0,0 +1,217 @@
+#include "VulkanShaderCache.h"
+
+#include "VulkanTracer.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**************************************************
+ * Mapped file
+ * ************************************************/
+
+#ifdef _WIN32
+
+VulkanMappedFile::VulkanMappedFile(const char * path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    mFile = file;
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+
+    mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!mMapping) return;
+
+    mData = static_cast<const uint8_t *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    mSize = mData ? static_cast<size_t>(size.QuadPart) : 0;
+}
+
+VulkanMappedFile::~VulkanMappedFile()
+{
+    if (mData) UnmapViewOfFile(mData);
+    if (mMapping) CloseHandle(mMapping);
+    if (mFile) CloseHandle(mFile);
+}
+
+#else
+
+VulkanMappedFile::VulkanMappedFile(const char * path)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return;
+
+    struct stat info;
+
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void * data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED)
+        {
+            mData = static_cast<const uint8_t *>(data);
+            mSize = static_cast<size_t>(info.st_size);
+        }
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+VulkanMappedFile::~VulkanMappedFile()
+{
+    if (mData) munmap(const_cast<uint8_t *>(mData), mSize);
+}
+
+#endif
+
+/**************************************************
+ * Module
+ * ************************************************/
+
+VulkanShaderModule::VulkanShaderModule(VulkanContextPtr ctx, vk::ShaderModule module, std::string path, uint64_t hash, VulkanShaderReflection reflection) :
+    mCtx(ctx),
+    mModule(module),
+    mPath(path),
+    mHash(hash),
+    mReflection(reflection)
+{
+
+}
+
+VulkanShaderModule::~VulkanShaderModule()
+{
+    mCtx->getDevice().destroyShaderModule(mModule, nullptr, mCtx->getDynamicDispatch());
+}
+
+/**************************************************
+ * Cache
+ * ************************************************/
+
+VulkanShaderCache::VulkanShaderCache(VulkanContextPtr ctx) :
+    mCtx(ctx)
+{
+
+}
+
+uint64_t VulkanShaderCache::hash(const uint8_t * data, size_t size)
+{
+    uint64_t h = 14695981039346656037ull;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= data[i];
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+VulkanShaderModuleRef VulkanShaderCache::getModule(const char * path)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto & entry = mByPath[path];
+
+    if (entry) return entry;
+
+    VulkanMappedFile file(path);
+
+    if (!file.isOpen() || file.getSize() % sizeof(uint32_t) != 0)
+    {
+        mByPath.erase(path);
+
+        std::cerr << "(VulkanShaderCache - getModule) could not load " << path << std::endl;
+        throw std::runtime_error(std::string("Shader not found: ") + path);
+    }
+
+    auto contentHash = hash(file.getData(), file.getSize());
+
+    // Another path with the same SPIR-V
+    entry = mByHash[contentHash].lock();
+
+    if (entry) return entry;
+
+    auto module = mCtx->getDevice().createShaderModule(
+        vk::ShaderModuleCreateInfo(
+            vk::ShaderModuleCreateFlags(),
+            file.getSize(),
+            reinterpret_cast<const uint32_t *>(file.getData())
+        ), nullptr,
+        mCtx->getDynamicDispatch()
+    );
+
+    mLoadCount++;
+
+    // Reflected while the file is still mapped, so the SPIR-V is only ever read once
+    VulkanShaderReflection reflection;
+    reflection.parse(reinterpret_cast<const uint32_t *>(file.getData()), file.getSize() / sizeof(uint32_t));
+
+    entry = make_shared<VulkanShaderModule>(mCtx, module, path, contentHash, reflection);
+    mByHash[contentHash] = entry;
+
+    return entry;
+}
+
+void VulkanShaderCache::invalidate(const char * path)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mByPath.erase(path);
+}
+
+void VulkanShaderCache::trim()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Paths with the same contents each hold the shared module
+    std::map<VulkanShaderModule *, long> cacheRefs;
+
+    for (auto & entry : mByPath)
+    {
+        cacheRefs[entry.second.get()]++;
+    }
+
+    for (auto it = mByPath.begin(); it != mByPath.end();)
+    {
+        if (it->second.use_count() == cacheRefs[it->second.get()]) it = mByPath.erase(it);
+        else ++it;
+    }
+
+    for (auto it = mByHash.begin(); it != mByHash.end();)
+    {
+        if (it->second.expired()) it = mByHash.erase(it);
+        else ++it;
+    }
+}
+
+uint32_t VulkanShaderCache::getModuleCount()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t count = 0;
+
+    for (auto & entry : mByHash)
+    {
+        if (!entry.second.expired()) count++;
+    }
+
+    return count;
+}
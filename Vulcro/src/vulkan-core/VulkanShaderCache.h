@@ -0,0 +1,137 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+#include "VulkanShaderReflection.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/*
+* Read only view of a whole file through mmap / MapViewOfFile, no copy into the heap.
+* The mapping is page aligned, so SPIR-V can be handed to the driver as is.
+*/
+class VulkanMappedFile
+{
+public:
+
+    VulkanMappedFile(const char * path);
+
+    VULCRO_DONT_COPY(VulkanMappedFile)
+
+    ~VulkanMappedFile();
+
+    bool isOpen()
+    {
+        return mData != nullptr;
+    }
+
+    const uint8_t * getData()
+    {
+        return mData;
+    }
+
+    size_t getSize()
+    {
+        return mSize;
+    }
+
+private:
+
+    const uint8_t * mData = nullptr;
+    size_t mSize = 0;
+
+#ifdef _WIN32
+    void * mFile = nullptr;
+    void * mMapping = nullptr;
+#endif
+};
+
+class VulkanShaderModule
+{
+public:
+
+    VulkanShaderModule(VulkanContextPtr ctx, vk::ShaderModule module, std::string path, uint64_t hash, VulkanShaderReflection reflection);
+
+    VULCRO_DONT_COPY(VulkanShaderModule)
+
+    ~VulkanShaderModule();
+
+    vk::ShaderModule getModule()
+    {
+        return mModule;
+    }
+
+    const std::string & getPath()
+    {
+        return mPath;
+    }
+
+    uint64_t getHash()
+    {
+        return mHash;
+    }
+
+    //Parsed once when the file is loaded
+    const VulkanShaderReflection & getReflection()
+    {
+        return mReflection;
+    }
+
+private:
+
+    VulkanContextPtr mCtx;
+
+    vk::ShaderModule mModule;
+
+    std::string mPath;
+    uint64_t mHash;
+
+    VulkanShaderReflection mReflection;
+};
+
+/*
+* Context owned shader modules, one per SPIR-V file. A path is only read the first time it is asked for,
+* files with the same contents share a module. Modules stay cached until trim drops the ones no shader holds.
+*/
+class VulkanShaderCache
+{
+public:
+
+    VulkanShaderCache(VulkanContextPtr ctx);
+
+    VULCRO_DONT_COPY(VulkanShaderCache)
+
+    //Throws if the file is missing or not SPIR-V
+    VulkanShaderModuleRef getModule(const char * path);
+
+    //Forget path so the next getModule reads it again, e.g. after recompiling the shader
+    void invalidate(const char * path);
+
+    //Drop modules only the cache still holds
+    void trim();
+
+    //Files read and modules created so far
+    uint32_t getLoadCount()
+    {
+        return mLoadCount;
+    }
+
+    uint32_t getModuleCount();
+
+    //64 bit FNV-1a
+    static uint64_t hash(const uint8_t * data, size_t size);
+
+private:
+
+    VulkanContextPtr mCtx;
+
+    std::map<std::string, VulkanShaderModuleRef> mByPath;
+    std::map<uint64_t, std::weak_ptr<VulkanShaderModule>> mByHash;
+
+    uint32_t mLoadCount = 0;
+
+    std::mutex mMutex;
+};
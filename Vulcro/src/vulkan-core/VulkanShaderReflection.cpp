@@ -0,0 +1,504 @@
+#include "VulkanShaderReflection.h"
+
+#include "vulkan/spirv.hpp"
+
+#include <algorithm>
+#include <set>
+
+/**************************************************
+ * SPIR-V module
+ * ************************************************/
+
+// Just the instructions reflection needs, indexed by result id
+struct SpirvModule
+{
+    struct Decorations
+    {
+        uint32_t set = 0;
+        uint32_t binding = 0;
+        uint32_t location = 0;
+        uint32_t arrayStride = 0;
+        uint32_t specId = 0;
+
+        bool hasBinding = false;
+        bool hasSpecId = false;
+        bool hasLocation = false;
+        bool builtIn = false;
+        bool block = false;
+        bool bufferBlock = false;
+
+        //Per struct member
+        vector<uint32_t> offsets;
+        vector<uint32_t> matrixStrides;
+    };
+
+    struct Variable
+    {
+        uint32_t id;
+        uint32_t pointerType;
+        spv::StorageClass storage;
+    };
+
+    //Opcode and operands after the result id
+    std::map<uint32_t, std::pair<spv::Op, vector<uint32_t>>> types;
+    std::map<uint32_t, uint32_t> constants;
+
+    //Constants that are specialization constants, constants holds their defaults
+    std::set<uint32_t> specConstants;
+    std::map<uint32_t, Decorations> decorations;
+
+    vector<Variable> variables;
+
+    spv::ExecutionModel model = spv::ExecutionModelMax;
+
+    Decorations & member(uint32_t id, uint32_t index)
+    {
+        auto & d = decorations[id];
+
+        if (d.offsets.size() <= index)
+        {
+            d.offsets.resize(index + 1, 0);
+            d.matrixStrides.resize(index + 1, 0);
+        }
+
+        return d;
+    }
+
+    uint32_t typeSize(uint32_t id, uint32_t matrixStride = 0);
+};
+
+uint32_t SpirvModule::typeSize(uint32_t id, uint32_t matrixStride)
+{
+    auto it = types.find(id);
+    if (it == types.end()) return 0;
+
+    auto & ops = it->second.second;
+
+    switch (it->second.first)
+    {
+    case spv::OpTypeInt:
+    case spv::OpTypeFloat:
+        return ops[0] / 8;
+
+    case spv::OpTypeVector:
+        return typeSize(ops[0]) * ops[1];
+
+    case spv::OpTypeMatrix:
+        return (matrixStride ? matrixStride : typeSize(ops[0])) * ops[1];
+
+    case spv::OpTypeArray:
+    {
+        auto stride = decorations[id].arrayStride;
+        return (stride ? stride : typeSize(ops[0])) * constants[ops[1]];
+    }
+
+    case spv::OpTypeStruct:
+    {
+        // Members are laid out by their offsets, the struct ends after the furthest one
+        uint32_t size = 0;
+        auto & d = decorations[id];
+
+        for (uint32_t i = 0; i < ops.size(); i++)
+        {
+            uint32_t offset = i < d.offsets.size() ? d.offsets[i] : size;
+            uint32_t stride = i < d.matrixStrides.size() ? d.matrixStrides[i] : 0;
+
+            size = glm::max(size, offset + typeSize(ops[i], stride));
+        }
+
+        return size;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+static vk::ShaderStageFlags getStage(spv::ExecutionModel model)
+{
+    switch (model)
+    {
+    case spv::ExecutionModelVertex: return vk::ShaderStageFlagBits::eVertex;
+    case spv::ExecutionModelTessellationControl: return vk::ShaderStageFlagBits::eTessellationControl;
+    case spv::ExecutionModelTessellationEvaluation: return vk::ShaderStageFlagBits::eTessellationEvaluation;
+    case spv::ExecutionModelGeometry: return vk::ShaderStageFlagBits::eGeometry;
+    case spv::ExecutionModelFragment: return vk::ShaderStageFlagBits::eFragment;
+    case spv::ExecutionModelGLCompute: return vk::ShaderStageFlagBits::eCompute;
+    case spv::ExecutionModelRayGenerationNV: return vk::ShaderStageFlagBits::eRaygenNV;
+    case spv::ExecutionModelIntersectionNV: return vk::ShaderStageFlagBits::eIntersectionNV;
+    case spv::ExecutionModelAnyHitNV: return vk::ShaderStageFlagBits::eAnyHitNV;
+    case spv::ExecutionModelClosestHitNV: return vk::ShaderStageFlagBits::eClosestHitNV;
+    case spv::ExecutionModelMissNV: return vk::ShaderStageFlagBits::eMissNV;
+    case spv::ExecutionModelCallableNV: return vk::ShaderStageFlagBits::eCallableNV;
+    default: return vk::ShaderStageFlags();
+    }
+}
+
+// Vertex attribute format of a scalar or vector input, eUndefined for anything else
+static vk::Format getInputFormat(SpirvModule & module, uint32_t type)
+{
+    static const vk::Format FLOATS[] = { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat };
+    static const vk::Format INTS[] = { vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint };
+    static const vk::Format UINTS[] = { vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint };
+
+    uint32_t components = 1;
+    auto * t = &module.types[type];
+
+    if (t->first == spv::OpTypeVector)
+    {
+        components = t->second[1];
+        t = &module.types[t->second[0]];
+    }
+
+    if (components < 1 || components > 4 || t->second.empty() || t->second[0] != 32) return vk::Format::eUndefined;
+
+    if (t->first == spv::OpTypeFloat) return FLOATS[components - 1];
+    if (t->first == spv::OpTypeInt) return t->second[1] ? INTS[components - 1] : UINTS[components - 1];
+
+    return vk::Format::eUndefined;
+}
+
+/**************************************************
+ * Reflection
+ * ************************************************/
+
+bool VulkanShaderReflection::parse(const uint32_t * words, size_t wordCount)
+{
+    if (wordCount < 5 || words[0] != spv::MagicNumber) return false;
+
+    SpirvModule module;
+
+    for (size_t i = 5; i < wordCount;)
+    {
+        uint32_t count = words[i] >> spv::WordCountShift;
+        auto op = static_cast<spv::Op>(words[i] & spv::OpCodeMask);
+
+        if (count == 0 || i + count > wordCount) return false;
+
+        const uint32_t * w = words + i + 1;
+
+        switch (op)
+        {
+        case spv::OpEntryPoint:
+            // A module with several entry points reflects as the first one
+            if (module.model == spv::ExecutionModelMax) module.model = static_cast<spv::ExecutionModel>(w[0]);
+            break;
+
+        case spv::OpDecorate:
+        {
+            auto & d = module.decorations[w[0]];
+
+            switch (static_cast<spv::Decoration>(w[1]))
+            {
+            case spv::DecorationDescriptorSet: d.set = w[2]; break;
+            case spv::DecorationBinding: d.binding = w[2]; d.hasBinding = true; break;
+            case spv::DecorationLocation: d.location = w[2]; d.hasLocation = true; break;
+            case spv::DecorationArrayStride: d.arrayStride = w[2]; break;
+            case spv::DecorationSpecId: d.specId = w[2]; d.hasSpecId = true; break;
+            case spv::DecorationBuiltIn: d.builtIn = true; break;
+            case spv::DecorationBlock: d.block = true; break;
+            case spv::DecorationBufferBlock: d.bufferBlock = true; break;
+            default: break;
+            }
+            break;
+        }
+
+        case spv::OpMemberDecorate:
+        {
+            auto & d = module.member(w[0], w[1]);
+
+            switch (static_cast<spv::Decoration>(w[2]))
+            {
+            case spv::DecorationOffset: d.offsets[w[1]] = w[3]; break;
+            case spv::DecorationMatrixStride: d.matrixStrides[w[1]] = w[3]; break;
+            case spv::DecorationBuiltIn: d.builtIn = true; break;
+            default: break;
+            }
+            break;
+        }
+
+        case spv::OpTypeInt:
+        case spv::OpTypeFloat:
+        case spv::OpTypeVector:
+        case spv::OpTypeMatrix:
+        case spv::OpTypeImage:
+        case spv::OpTypeSampler:
+        case spv::OpTypeSampledImage:
+        case spv::OpTypeArray:
+        case spv::OpTypeRuntimeArray:
+        case spv::OpTypeStruct:
+        case spv::OpTypePointer:
+        case spv::OpTypeAccelerationStructureNV:
+            module.types[w[0]] = std::make_pair(op, vector<uint32_t>(w + 1, w + count - 1));
+            break;
+
+        case spv::OpConstant:
+            module.constants[w[1]] = w[2];
+            break;
+
+        case spv::OpSpecConstant:
+            module.constants[w[1]] = w[2];
+            module.specConstants.insert(w[1]);
+            break;
+
+        case spv::OpVariable:
+            module.variables.push_back({ w[1], w[0], static_cast<spv::StorageClass>(w[2]) });
+            break;
+
+        default:
+            break;
+        }
+
+        i += count;
+    }
+
+    auto stage = getStage(module.model);
+
+    mStages |= stage;
+
+    for (auto & variable : module.variables)
+    {
+        auto & decorations = module.decorations[variable.id];
+
+        auto pointer = module.types.find(variable.pointerType);
+        if (pointer == module.types.end() || pointer->second.first != spv::OpTypePointer) continue;
+
+        uint32_t type = pointer->second.second[1];
+
+        if (variable.storage == spv::StorageClassPushConstant)
+        {
+            mPushConstants.stageFlags |= stage;
+            mPushConstants.size = glm::max(mPushConstants.size, module.typeSize(type));
+            continue;
+        }
+
+        if (variable.storage == spv::StorageClassInput)
+        {
+            if (module.model != spv::ExecutionModelVertex || decorations.builtIn || !decorations.hasLocation) continue;
+
+            // Matrices take one location per column
+            auto & t = module.types[type];
+            uint32_t columns = t.first == spv::OpTypeMatrix ? t.second[1] : 1;
+            auto format = getInputFormat(module, t.first == spv::OpTypeMatrix ? t.second[0] : type);
+
+            if (format == vk::Format::eUndefined)
+            {
+                std::cerr << "(VulkanShaderReflection - parse) unsupported vertex input at location " << decorations.location << std::endl;
+                continue;
+            }
+
+            for (uint32_t c = 0; c < columns; c++)
+            {
+                mInputs.push_back({ decorations.location + c, format });
+            }
+
+            continue;
+        }
+
+        if (variable.storage != spv::StorageClassUniformConstant &&
+            variable.storage != spv::StorageClassUniform &&
+            variable.storage != spv::StorageClassStorageBuffer)
+        {
+            continue;
+        }
+
+        if (!decorations.hasBinding) continue;
+
+        uint32_t arrayCount = 1;
+        uint32_t fixedCount = 1;
+        uint32_t specDimensions = 0;
+        uint32_t specId = 0;
+
+        while (module.types[type].first == spv::OpTypeArray || module.types[type].first == spv::OpTypeRuntimeArray)
+        {
+            auto & t = module.types[type];
+
+            if (t.first == spv::OpTypeArray)
+            {
+                auto length = t.second[1];
+                auto constant = module.constants.find(length);
+
+                // Lengths computed from specialization constants (OpSpecConstantOp) aren't evaluated
+                if (constant == module.constants.end())
+                {
+                    std::cerr << "(VulkanShaderReflection - parse) set " << decorations.set << " binding " << decorations.binding
+                        << " has an array length that isn't a constant, pass its layout explicitly" << std::endl;
+                }
+                else
+                {
+                    auto & lengthDecorations = module.decorations[length];
+
+                    if (module.specConstants.count(length) && lengthDecorations.hasSpecId)
+                    {
+                        specDimensions++;
+                        specId = lengthDecorations.specId;
+                    }
+                    else
+                    {
+                        fixedCount *= constant->second;
+                    }
+
+                    arrayCount *= constant->second;
+                }
+            }
+
+            type = t.second[0];
+        }
+
+        auto & t = module.types[type];
+        vk::DescriptorType descriptorType;
+
+        switch (t.first)
+        {
+        case spv::OpTypeSampler:
+            descriptorType = vk::DescriptorType::eSampler;
+            break;
+
+        case spv::OpTypeSampledImage:
+            descriptorType = vk::DescriptorType::eCombinedImageSampler;
+            break;
+
+        case spv::OpTypeImage:
+        {
+            // Operands are sampled type, dim, depth, arrayed, multisampled, sampled, format
+            auto dim = static_cast<spv::Dim>(t.second[1]);
+            bool storage = t.second[5] == 2;
+
+            if (dim == spv::DimBuffer) descriptorType = storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+            else if (dim == spv::DimSubpassData) descriptorType = vk::DescriptorType::eInputAttachment;
+            else descriptorType = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+            break;
+        }
+
+        case spv::OpTypeAccelerationStructureNV:
+            descriptorType = vk::DescriptorType::eAccelerationStructureNV;
+            break;
+
+        case spv::OpTypeStruct:
+            if (variable.storage == spv::StorageClassStorageBuffer || module.decorations[type].bufferBlock) descriptorType = vk::DescriptorType::eStorageBuffer;
+            else descriptorType = vk::DescriptorType::eUniformBuffer;
+            break;
+
+        default:
+            continue;
+        }
+
+        VulkanReflectedBinding reflected = { decorations.set, decorations.binding, descriptorType, arrayCount, stage };
+
+        // One specialized dimension is followed, arrays of arrays sized by several constants keep their defaults
+        if (specDimensions == 1)
+        {
+            reflected.specSized = true;
+            reflected.specId = specId;
+            reflected.fixedCount = fixedCount;
+        }
+        else if (specDimensions > 1)
+        {
+            std::cerr << "(VulkanShaderReflection - parse) set " << decorations.set << " binding " << decorations.binding
+                << " is sized by several specialization constants, reflected with their defaults" << std::endl;
+        }
+
+        mBindings[std::make_pair(decorations.set, decorations.binding)] = reflected;
+    }
+
+    std::sort(mInputs.begin(), mInputs.end(), [](VulkanReflectedInput const & a, VulkanReflectedInput const & b) {
+        return a.location < b.location;
+    });
+
+    return true;
+}
+
+void VulkanShaderReflection::merge(VulkanShaderReflection const & other)
+{
+    mStages |= other.mStages;
+
+    for (auto & entry : other.mBindings)
+    {
+        auto it = mBindings.find(entry.first);
+
+        if (it == mBindings.end())
+        {
+            mBindings[entry.first] = entry.second;
+            continue;
+        }
+
+        if (it->second.type != entry.second.type)
+        {
+            std::cerr << "(VulkanShaderReflection - merge) stages disagree on the type of set " << entry.first.first << " binding " << entry.first.second << std::endl;
+        }
+
+        it->second.stageFlags |= entry.second.stageFlags;
+        it->second.arrayCount = glm::max(it->second.arrayCount, entry.second.arrayCount);
+
+        if (entry.second.specSized && !it->second.specSized)
+        {
+            it->second.specSized = true;
+            it->second.specId = entry.second.specId;
+            it->second.fixedCount = entry.second.fixedCount;
+        }
+    }
+
+    mPushConstants.stageFlags |= other.mPushConstants.stageFlags;
+    mPushConstants.size = glm::max(mPushConstants.size, other.mPushConstants.size);
+
+    // Only the vertex stage has vertex inputs
+    if (mInputs.empty()) mInputs = other.mInputs;
+}
+
+void VulkanShaderReflection::specialize(VulkanSpecialization const & specialization)
+{
+    for (auto & entry : mBindings)
+    {
+        auto & binding = entry.second;
+        uint32_t length;
+
+        if (binding.specSized && specialization.get(binding.specId, length))
+        {
+            binding.arrayCount = binding.fixedCount * length;
+        }
+    }
+}
+
+bool VulkanShaderReflection::hasSpecSizedBindings() const
+{
+    for (auto & entry : mBindings)
+    {
+        if (entry.second.specSized) return true;
+    }
+
+    return false;
+}
+
+vector<VulkanReflectedBinding> VulkanShaderReflection::getBindings() const
+{
+    vector<VulkanReflectedBinding> bindings;
+
+    for (auto & entry : mBindings)
+    {
+        bindings.push_back(entry.second);
+    }
+
+    return bindings;
+}
+
+uint32_t VulkanShaderReflection::getSetCount() const
+{
+    return mBindings.empty() ? 0 : mBindings.rbegin()->first.first + 1;
+}
+
+vector<VulkanSetLayoutBinding> VulkanShaderReflection::getSetLayoutBindings(uint32_t set) const
+{
+    vector<VulkanSetLayoutBinding> bindings;
+
+    for (auto & entry : mBindings)
+    {
+        if (entry.first.first != set) continue;
+
+        // Layout bindings are numbered by position, so holes are kept as empty bindings
+        bindings.resize(entry.first.second, VulkanSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, nullptr, vk::ShaderStageFlags()));
+
+        bindings.push_back(VulkanSetLayoutBinding(entry.second.arrayCount, entry.second.type, nullptr, entry.second.stageFlags));
+    }
+
+    return bindings;
+}
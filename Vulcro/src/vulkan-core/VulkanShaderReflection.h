@@ -0,0 +1,88 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <map>
+
+struct VulkanReflectedBinding
+{
+    uint32_t set;
+    uint32_t binding;
+    vk::DescriptorType type;
+    uint32_t arrayCount;
+    vk::ShaderStageFlags stageFlags;
+
+    //Array length given by specialization constant specId, arrayCount is fixedCount times its value
+    bool specSized = false;
+    uint32_t specId = 0;
+    uint32_t fixedCount = 1;
+};
+
+struct VulkanReflectedInput
+{
+    uint32_t location;
+    vk::Format format;
+};
+
+/*
+* Descriptors, push constants and vertex inputs read straight from SPIR-V. Reflections of the stages of one
+* pipeline are merged, so every binding ends up with exactly the stages that use it.
+*
+* Uniform and storage buffers reflect as the plain descriptor types, runtime sized arrays as a single
+* descriptor. Arrays sized by a specialization constant take its default until specialize is called.
+* Pass layouts explicitly for dynamic buffers and bindless sets.
+*/
+class VulkanShaderReflection
+{
+public:
+
+    //False if words isn't SPIR-V, the reflection is left empty
+    bool parse(const uint32_t * words, size_t wordCount);
+
+    //Union of stages, bindings used by both get both stages
+    void merge(VulkanShaderReflection const & other);
+
+    //Size arrays by the values specialization gives their constants, constants it doesn't set keep their defaults
+    void specialize(VulkanSpecialization const & specialization);
+
+    //True if any binding is sized by a specialization constant
+    bool hasSpecSizedBindings() const;
+
+    vk::ShaderStageFlags getStages() const
+    {
+        return mStages;
+    }
+
+    //Sorted by set, then binding
+    vector<VulkanReflectedBinding> getBindings() const;
+
+    //Highest set index used plus one
+    uint32_t getSetCount() const;
+
+    //Bindings of one set in the form makeSetLayout takes, unused binding numbers get arrayCount 0
+    vector<VulkanSetLayoutBinding> getSetLayoutBindings(uint32_t set) const;
+
+    //Size 0 if no stage has push constants
+    vk::PushConstantRange getPushConstantRange() const
+    {
+        return mPushConstants;
+    }
+
+    //Vertex stage inputs by location, builtins excluded
+    const vector<VulkanReflectedInput> & getInputs() const
+    {
+        return mInputs;
+    }
+
+private:
+
+    vk::ShaderStageFlags mStages;
+
+    std::map<std::pair<uint32_t, uint32_t>, VulkanReflectedBinding> mBindings;
+
+    vk::PushConstantRange mPushConstants = vk::PushConstantRange(vk::ShaderStageFlags(), 0, 0);
+
+    vector<VulkanReflectedInput> mInputs;
+};
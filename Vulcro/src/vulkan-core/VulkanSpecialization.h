@@ -0,0 +1,134 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+/*
+* Values for a shader's specialization constants, folded in by the driver when the pipeline is compiled.
+*
+*   auto spec = VulkanSpecialization::fromValues(64, 0.5f);        //constant_id 0 and 1
+*   auto spec = VulkanSpecialization().set(0, 64).set(1, 0.5f);    //the same
+*
+* GLSL bools are 32 bit, pass them as VkBool32. Specializations compare by value, so they can key caches.
+* The map entries are built when the specialization is made, vk::SpecializationMapEntry is not constexpr in these headers.
+*/
+class VulkanSpecialization
+{
+public:
+
+    template <typename T>
+    VulkanSpecialization & set(uint32_t constantId, T const & value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Specialization constants must be plain scalars");
+
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it)
+        {
+            if (it->constantID != constantId) continue;
+
+            if (it->size == sizeof(T))
+            {
+                std::memcpy(mData.data() + it->offset, &value, sizeof(T));
+                return *this;
+            }
+
+            //Resized constant, drop its old bytes so the id only appears once
+            auto offset = it->offset;
+            auto size = static_cast<uint32_t>(it->size);
+
+            mData.erase(mData.begin() + offset, mData.begin() + offset + size);
+            mEntries.erase(it);
+
+            for (auto & entry : mEntries)
+            {
+                if (entry.offset > offset) entry.offset -= size;
+            }
+
+            break;
+        }
+
+        mEntries.push_back(vk::SpecializationMapEntry(constantId, static_cast<uint32_t>(mData.size()), sizeof(T)));
+
+        auto bytes = reinterpret_cast<const uint8_t *>(&value);
+        mData.insert(mData.end(), bytes, bytes + sizeof(T));
+
+        return *this;
+    }
+
+    //Value N is constant_id N. Each has to be a 32 bit scalar, checked at compile time
+    template <typename... Ts>
+    static VulkanSpecialization fromValues(Ts const &... values)
+    {
+        VulkanSpecialization specialization;
+        specialization.append(0, values...);
+
+        return specialization;
+    }
+
+    //Value of constantId, false unless it was set as a 32 bit scalar
+    bool get(uint32_t constantId, uint32_t & value) const
+    {
+        for (auto & entry : mEntries)
+        {
+            if (entry.constantID == constantId && entry.size == sizeof(uint32_t))
+            {
+                std::memcpy(&value, mData.data() + entry.offset, sizeof(uint32_t));
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool empty() const
+    {
+        return mEntries.empty();
+    }
+
+    //Points into this object, which has to outlive the pipeline creation using it
+    vk::SpecializationInfo getInfo() const
+    {
+        return vk::SpecializationInfo(
+            static_cast<uint32_t>(mEntries.size()),
+            mEntries.data(),
+            mData.size(),
+            mData.data()
+        );
+    }
+
+    bool operator<(VulkanSpecialization const & other) const
+    {
+        if (mData != other.mData) return mData < other.mData;
+
+        return std::lexicographical_compare(mEntries.begin(), mEntries.end(), other.mEntries.begin(), other.mEntries.end(),
+            [](vk::SpecializationMapEntry const & a, vk::SpecializationMapEntry const & b) {
+                if (a.constantID != b.constantID) return a.constantID < b.constantID;
+                if (a.offset != b.offset) return a.offset < b.offset;
+                return a.size < b.size;
+            });
+    }
+
+    bool operator==(VulkanSpecialization const & other) const
+    {
+        return mData == other.mData && mEntries == other.mEntries;
+    }
+
+private:
+
+    void append(uint32_t) {}
+
+    template <typename T, typename... Ts>
+    void append(uint32_t constantId, T const & value, Ts const &... rest)
+    {
+        static_assert(std::is_arithmetic<T>::value && sizeof(T) == sizeof(uint32_t), "Specialization values must be 32 bit scalars, e.g. int32_t, float or VkBool32");
+
+        set(constantId, value);
+        append(constantId + 1, rest...);
+    }
+
+    vector<vk::SpecializationMapEntry> mEntries;
+    vector<uint8_t> mData;
+};
@@ -0,0 +1,84 @@
+#include "VulkanStateRecorder.h"
+
+#include "VulkanPipeline.h"
+#include "VulkanRenderer.h"
+#include "VulkanTracer.h"
+
+VulkanStateRecorder::VulkanStateRecorder(VulkanContextPtr ctx, VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config,
+    vector<ColorBlendConfig> colorBlendConfigs, uint32_t pushConstantSize) :
+    mCtx(ctx),
+    mShader(shader),
+    mRenderer(renderer),
+    mColorBlendConfigs(colorBlendConfigs),
+    mPushConstantSize(pushConstantSize),
+    mConfig(config)
+{
+    mConfig.dynamicState = true;
+}
+
+bool VulkanStateRecorder::samePipelineState(PipelineConfig const & a, PipelineConfig const & b)
+{
+    return a.topology == b.topology &&
+        a.patchCount == b.patchCount &&
+        a.cullFlags == b.cullFlags &&
+        a.frontFace == b.frontFace &&
+        a.depthTest == b.depthTest &&
+        a.depthWrite == b.depthWrite;
+}
+
+VulkanRenderPipelineRef VulkanStateRecorder::bind(vk::CommandBuffer * cmd)
+{
+    VULCRO_TRACE_FUNCTION();
+
+    // The variant cache is only asked when the state changed, it returns the same pipeline for state set dynamically
+    if (!mPipeline || !samePipelineState(mConfig, mPipelineConfig))
+    {
+        auto pipeline = mCtx->makePipeline(mShader, mRenderer, mConfig, mColorBlendConfigs, mPushConstantSize);
+
+        if (pipeline != mPipeline) mBound = false;
+
+        mPipeline = pipeline;
+        mPipelineConfig = mConfig;
+    }
+
+    if (!mBound)
+    {
+        mPipeline->bind(cmd);
+        mBound = true;
+        mPipelineBinds++;
+    }
+
+    if (!mPipeline->hasDynamicState()) return mPipeline;
+
+    auto & dispatch = mCtx->getExtendedDynamicStateDispatch();
+    VkCommandBuffer vkcmd = *cmd;
+
+    bool hasDepth = mRenderer->hasDepth();
+
+    if (!mRecordedValid || mRecorded.cullFlags != mConfig.cullFlags)
+        dispatch.vkCmdSetCullModeEXT(vkcmd, static_cast<VkCullModeFlags>(mConfig.cullFlags));
+
+    if (!mRecordedValid || mRecorded.frontFace != mConfig.frontFace)
+        dispatch.vkCmdSetFrontFaceEXT(vkcmd, static_cast<VkFrontFace>(mConfig.frontFace));
+
+    if (!mRecordedValid || mRecorded.topology != mConfig.topology)
+        dispatch.vkCmdSetPrimitiveTopologyEXT(vkcmd, static_cast<VkPrimitiveTopology>(mConfig.topology));
+
+    if (!mRecordedValid || mRecorded.depthTest != mConfig.depthTest)
+        dispatch.vkCmdSetDepthTestEnableEXT(vkcmd, hasDepth && mConfig.depthTest);
+
+    if (!mRecordedValid || mRecorded.depthWrite != mConfig.depthWrite)
+        dispatch.vkCmdSetDepthWriteEnableEXT(vkcmd, hasDepth && mConfig.depthWrite);
+
+    mRecorded = mConfig;
+    mRecordedValid = true;
+
+    return mPipeline;
+}
+
+void VulkanStateRecorder::reset()
+{
+    mBound = false;
+    mRecordedValid = false;
+    mPipelineBinds = 0;
+}
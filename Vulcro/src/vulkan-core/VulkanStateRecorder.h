@@ -0,0 +1,93 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+/*
+* Fixed function state of one shader drawing into one renderer, changed between draws like command buffer state:
+*
+*   VulkanStateRecorder state(ctx, shader, renderer);
+*
+*   state.setCullMode(vk::CullModeFlagBits::eNone);
+*   state.bind(cmd)->bindSets(cmd, sets);
+*   ...draw double sided...
+*
+*   state.setCullMode(vk::CullModeFlagBits::eBack);
+*   state.setDepthWrite(false);
+*   state.bind(cmd);
+*   ...draw...
+*
+* With VK_EXT_extended_dynamic_state one pipeline per topology class covers every state and bind only records what
+* changed. Without it bind switches to the pipeline made for the current state, taken from the variant cache.
+* One recorder per command buffer being recorded, call reset before reusing it for another.
+*/
+class VulkanStateRecorder
+{
+public:
+
+    VulkanStateRecorder(VulkanContextPtr ctx, VulkanShaderRef shader, VulkanRendererRef renderer, PipelineConfig config = PipelineConfig(),
+        vector<ColorBlendConfig> colorBlendConfigs = {}, uint32_t pushConstantSize = 0);
+
+    VULCRO_DONT_COPY(VulkanStateRecorder)
+
+    void setCullMode(vk::CullModeFlags cullFlags)
+    {
+        mConfig.cullFlags = cullFlags;
+    }
+
+    void setFrontFace(vk::FrontFace frontFace)
+    {
+        mConfig.frontFace = frontFace;
+    }
+
+    void setTopology(vk::PrimitiveTopology topology)
+    {
+        mConfig.topology = topology;
+    }
+
+    void setDepthTest(bool depthTest)
+    {
+        mConfig.depthTest = depthTest;
+    }
+
+    void setDepthWrite(bool depthWrite)
+    {
+        mConfig.depthWrite = depthWrite;
+    }
+
+    //Binds the pipeline for the current state if it isn't bound yet and records dynamic state that changed. Call before drawing
+    VulkanRenderPipelineRef bind(vk::CommandBuffer * cmd);
+
+    //Forget what was recorded, e.g. for a new command buffer or after binding other pipelines
+    void reset();
+
+    //Pipelines bound since the last reset, fewer with dynamic state
+    uint32_t getPipelineBindCount()
+    {
+        return mPipelineBinds;
+    }
+
+private:
+
+    static bool samePipelineState(PipelineConfig const & a, PipelineConfig const & b);
+
+    VulkanContextPtr mCtx;
+
+    VulkanShaderRef mShader;
+    VulkanRendererRef mRenderer;
+    vector<ColorBlendConfig> mColorBlendConfigs;
+    uint32_t mPushConstantSize;
+
+    PipelineConfig mConfig;
+
+    //State of the last pipeline lookup, and of what was last recorded into the command buffer
+    PipelineConfig mPipelineConfig;
+    PipelineConfig mRecorded;
+
+    VulkanRenderPipelineRef mPipeline;
+    bool mBound = false;
+    bool mRecordedValid = false;
+
+    uint32_t mPipelineBinds = 0;
+};
@@ -1,4 +1,5 @@
 #include "VulkanSwapchain.h"
+#include "VulkanQueue.h"
 
 VulkanSwapchain::VulkanSwapchain(VulkanContextPtr ctx, vk::SurfaceKHR surface) :
 	mContext(ctx),
@@ -94,7 +95,7 @@ void VulkanSwapchain::createSemaphore()
 
 bool VulkanSwapchain::present(vector<vk::Semaphore> inSems) {
 	try {
-		mContext->getQueue().presentKHR(
+		mContext->getQueue(VulkanQueueType::GRAPHICS)->present(
 			vk::PresentInfoKHR(
 				static_cast<uint32_t>(inSems.size()),
 				inSems.size() > 0 ? &inSems[0] : nullptr,
@@ -113,6 +114,11 @@ bool VulkanSwapchain::present(vector<vk::Semaphore> inSems) {
 }
 
 bool VulkanSwapchain::nextFrame()
+{
+	return nextFrame(mSemaphore);
+}
+
+bool VulkanSwapchain::nextFrame(vk::Semaphore acquireSemaphore)
 {
 
 	if(mExtent.width == 0) return false;
@@ -121,7 +127,7 @@ bool VulkanSwapchain::nextFrame()
 		auto ret = mContext->getDevice().acquireNextImageKHR(
 			mSwapchain,
 			UINT64_MAX,
-			mSemaphore,
+			acquireSemaphore,
 			vk::Fence()
 		);
 
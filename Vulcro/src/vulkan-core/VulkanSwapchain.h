@@ -21,8 +21,12 @@ public:
 
 	bool init(vk::SurfaceKHR surface);
 
+	//Acquire the next image, signaling getSemaphore()
 	bool nextFrame();
 
+	//Acquire the next image, signaling acquireSemaphore. Lets frames in flight use a semaphore each
+	bool nextFrame(vk::Semaphore acquireSemaphore);
+
 	bool present(vector<vk::Semaphore> inSems = {});
 
 	bool resize();
@@ -1,11 +1,14 @@
 #include "VulkanTask.h"
 
 #include "VulkanTaskPool.h"
+#include "VulkanQueue.h"
+#include "VulkanTracer.h"
 
 VulkanTask::VulkanTask(VulkanContextPtr ctx, VulkanTaskPoolRef pool) :
     VulkanTask(ctx, pool->getPool())
 {
     mTaskPool = pool;
+    mQueue = pool->getQueue();
 }
 
 
@@ -13,7 +16,7 @@ VulkanTask::VulkanTask(VulkanContextPtr ctx, vk::CommandPool pool) :
 	mCtx(ctx),
 	mPool(pool)
 {
-	mFence = mCtx->getDevice().createFence(vk::FenceCreateInfo());
+    mQueue = mCtx->getQueue(VulkanQueueType::GRAPHICS);
 
 	mCommandBuffer = mCtx->getDevice().allocateCommandBuffers(
 		vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, 1)
@@ -22,11 +25,15 @@ VulkanTask::VulkanTask(VulkanContextPtr ctx, vk::CommandPool pool) :
 	mCreatedCommandBuffer = true;
 }
 
-VulkanTask::VulkanTask(VulkanContextPtr ctx, vk::CommandBuffer & cb) :
+VulkanTask::VulkanTask(VulkanContextPtr ctx, vk::CommandBuffer & cb, VulkanQueue * queue) :
 	mCtx(ctx),
-	mCommandBuffer(cb)
+	mCommandBuffer(cb),
+    mQueue(queue)
 {
-	mFence = mCtx->getDevice().createFence(vk::FenceCreateInfo());
+    if (mQueue == nullptr)
+    {
+        mQueue = mCtx->getQueue(VulkanQueueType::GRAPHICS);
+    }
 
 	mCreatedCommandBuffer = false;
 }
@@ -36,26 +43,31 @@ VulkanTask::~VulkanTask()
     // Free the command buffer if this task was responsible for allocating it
     if (mCreatedCommandBuffer)
     {
+        waitUntilDone();
         mCtx->getDevice().freeCommandBuffers(mPool, 1, &mCommandBuffer);
     }
-
-    // Destroy the fence
-    mCtx->getDevice().destroyFence(mFence);
 }
 
 void VulkanTask::record(function<void(vk::CommandBuffer*)> commands)
 {
+	// Binding sets only reads them, their queued binds have to be written before recording
+	mCtx->flushDescriptorWrites();
+
 	begin();
 	commands(&mCommandBuffer);
 	end();
 }
 
-void VulkanTask::begin()
+void VulkanTask::begin(vk::CommandBufferInheritanceInfo const * inheritance)
 {
+    // The command buffer can't be reset while the GPU is still running the previous recording
+    waitUntilDone();
+
 	vk::CommandBufferBeginInfo bgi;
 	//bgi.flags = mAutoReset ? vk::CommandBufferUsageFlagBits::eOneTimeSubmit : vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 	//bgi.flags = mAutoReset ? vk::CommandBufferUsageFlagBits::eOneTimeSubmit : vk::CommandBufferUsageFlags(0);
-    bgi.flags = vk::CommandBufferUsageFlags(0);
+    bgi.flags = inheritance ? vk::CommandBufferUsageFlagBits::eRenderPassContinue : vk::CommandBufferUsageFlags(0);
+    bgi.pInheritanceInfo = inheritance;
 
 	mCommandBuffer.begin(bgi);
 }
@@ -65,42 +77,126 @@ void VulkanTask::end()
 	mCommandBuffer.end();
 }
 
-void VulkanTask::execute(bool blockUntilFinished, temps<vk::Semaphore> inSems, temps<vk::Semaphore> outSems)
+VulkanCompletion VulkanTask::execute(bool blockUntilFinished, temps<vk::Semaphore> inSems, temps<vk::Semaphore> outSems)
 {
-	vk::PipelineStageFlags wait_flags = vk::PipelineStageFlagBits::eTopOfPipe;
+    VULCRO_TRACE_FUNCTION();
+
+    // Batched uploads go first so this task sees their data
+    mCtx->flushUploads();
+
+    auto * fencePool = mCtx->getFencePool();
+
+    // Cheap opportunity to recycle fences and fire callbacks of earlier submissions
+    fencePool->collect();
+
+    // A top of pipe wait stage blocks nothing, so plain semaphores hold back every stage
+    for (auto & semaphore : inSems)
+    {
+        waitFor(semaphore);
+    }
+
+    for (auto & semaphore : outSems)
+    {
+        signal(semaphore);
+    }
+
+    VulkanSubmission submission;
+    prepareSubmission(submission);
 
-	vk::PipelineStageFlags flags[5] = { wait_flags, wait_flags, wait_flags, wait_flags, wait_flags };
+    auto fence = fencePool->acquire();
 
-	auto submit = vk::SubmitInfo(
-		static_cast<uint32_t>(inSems.size()),
-		inSems.size() > 0 ? inSems.begin() : nullptr,
-		flags,
-		1,
-		&mCommandBuffer,
-		static_cast<uint32_t>(outSems.size()),
-		outSems.size() > 0 ? outSems.begin() : nullptr
-	);
+    {
+        VULCRO_TRACE_ZONE("VulkanTask::execute - submit");
+        mQueue->submit(submission.build(&mCommandBuffer), fence);
+    }
 
-    vk::Result res = mCtx->getQueue().submit(1, &submit, blockUntilFinished ? mFence : nullptr);
+    onSubmitted(fencePool->track(fence));
 
 	if (blockUntilFinished) waitUntilDone();
+
+    return mCompletion;
+}
+
+
+void VulkanTask::waitFor(VulkanTimelineRef timeline, uint64_t value, vk::PipelineStageFlags stage)
+{
+    mWaits.push_back({ timeline, timeline->getSemaphore(), value, stage });
+}
+
+void VulkanTask::waitFor(vk::Semaphore semaphore, vk::PipelineStageFlags stage)
+{
+    mWaits.push_back({ nullptr, semaphore, 0, stage });
+}
+
+void VulkanTask::signal(VulkanTimelineRef timeline, uint64_t value)
+{
+    mSignals.push_back({ timeline, timeline->getSemaphore(), value, vk::PipelineStageFlags() });
+}
+
+void VulkanTask::signal(vk::Semaphore semaphore)
+{
+    mSignals.push_back({ nullptr, semaphore, 0, vk::PipelineStageFlags() });
+}
+
+uint64_t VulkanTask::signal(VulkanTimelineRef timeline)
+{
+    uint64_t value = timeline->next();
+    signal(timeline, value);
+    return value;
+}
+
+void VulkanTask::prepareSubmission(VulkanSubmission & submission)
+{
+    for (auto & wait : mWaits)
+    {
+        if (wait.timeline && wait.timeline->isEmulated())
+        {
+            // No GPU side wait available, the signaling submission has to finish first
+            if (!wait.timeline->wait(wait.value, 1000ull * 1000 * 1000 * 10))
+            {
+                std::cerr << "(VulkanTask - prepareSubmission) timed out waiting on an emulated timeline" << std::endl;
+            }
+            continue;
+        }
+
+        submission.usesTimeline |= wait.timeline != nullptr;
+        submission.addWait(wait.semaphore, wait.stage, wait.value);
+    }
+
+    for (auto & signal : mSignals)
+    {
+        if (signal.timeline && signal.timeline->isEmulated()) continue;
+
+        submission.usesTimeline |= signal.timeline != nullptr;
+        submission.addSignal(signal.semaphore, signal.value);
+    }
+
+    mWaits.clear();
 }
 
+void VulkanTask::onSubmitted(VulkanCompletion completion)
+{
+    mCompletion = completion;
+
+    for (auto & signal : mSignals)
+    {
+        if (signal.timeline)
+        {
+            signal.timeline->onSubmitted(signal.value, completion);
+        }
+    }
+
+    mSignals.clear();
+}
 
 void VulkanTask::waitUntilDone()
 {	
-    vk::Result res = mCtx->getDevice().waitForFences(1, &mFence, VK_TRUE, 1000 * 1000 * 1000 * 10);
+    VULCRO_TRACE_FUNCTION();
 
-    if (res == vk::Result::eTimeout)
+    if (!mCompletion.wait(1000ull * 1000 * 1000 * 10))
     {
         std::cerr << "(VulkanTask - waitUntilDone) task timed out" << std::endl;
     }
-	else if (res != vk::Result::eSuccess)
-    {
-        std::cerr << "(VulkanTask - waitUntilDone) task errored out" << std::endl;
-	}
-
-	mCtx->getDevice().resetFences(1, &mFence);
 }
 
 
@@ -3,6 +3,8 @@
 #include "General.h"
 #include "vulkan/vulkan.hpp"
 #include "VulkanContext.h"
+#include "VulkanFencePool.h"
+#include "VulkanTimeline.h"
 
 enum class VulkanTaskResult
 {
@@ -22,7 +24,7 @@ public:
 
     VulkanTask(VulkanContextPtr ctx, VulkanTaskPoolRef taskPool);
 	VulkanTask(VulkanContextPtr ctx, vk::CommandPool pool);
-	VulkanTask(VulkanContextPtr ctx, vk::CommandBuffer &cb);
+	VulkanTask(VulkanContextPtr ctx, vk::CommandBuffer &cb, VulkanQueue * queue = nullptr);
 
 	~VulkanTask();
 
@@ -32,11 +34,29 @@ public:
 
 	void record(function<void(vk::CommandBuffer*)> commands);
 
-	void begin();
+	//Pass inheritance to begin a secondary command buffer that continues a render pass
+	void begin(vk::CommandBufferInheritanceInfo const * inheritance = nullptr);
 
 	void end();
 	
-	void execute(bool blockUntilFinished = false, temps<vk::Semaphore> inSems = {}, temps<vk::Semaphore> outSems = {});
+	/*
+	* The returned handle can be polled, waited on or given callbacks, see VulkanCompletion.
+	* inSems are waited on at every stage, use waitFor() to hold back only the stages that need them.
+	*/
+	VulkanCompletion execute(bool blockUntilFinished = false, temps<vk::Semaphore> inSems = {}, temps<vk::Semaphore> outSems = {});
+
+    /*
+    * Dependencies for the next execute() or VulkanContext::submit(), cleared once submitted.
+    * stage is the first stage that needs the result, earlier stages are free to start.
+    */
+    void waitFor(VulkanTimelineRef timeline, uint64_t value, vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands);
+    void waitFor(vk::Semaphore semaphore, vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands);
+
+    void signal(VulkanTimelineRef timeline, uint64_t value);
+    void signal(vk::Semaphore semaphore);
+
+    //Signal timeline->next(), returns the value to wait for
+    uint64_t signal(VulkanTimelineRef timeline);
 
     /************************************
         Getters / Setters
@@ -46,14 +66,38 @@ public:
 		return mCommandBuffer;
 	}
 
+	//Completion of the most recent execute
+	VulkanCompletion getCompletion() {
+		return mCompletion;
+	}
+
+    VulkanQueue * getQueue() {
+        return mQueue;
+    }
+
 protected:
 
+    friend class VulkanContext;
+
+    struct Dependency
+    {
+        VulkanTimelineRef timeline;
+        vk::Semaphore semaphore;
+        uint64_t value;
+        vk::PipelineStageFlags stage;
+    };
+
     /************************************
         Functions
     ************************************/
 
     void waitUntilDone();
 
+    //Moves the declared dependencies into submission, emulated timeline waits block here
+    void prepareSubmission(VulkanSubmission & submission);
+
+    void onSubmitted(VulkanCompletion completion);
+
     /************************************
         Members
     ************************************/
@@ -62,9 +106,16 @@ protected:
 
 	VulkanContextPtr mCtx;
 	vk::CommandBuffer mCommandBuffer;
-	vk::Fence mFence;
 	vk::CommandPool mPool;
 
+	VulkanCompletion mCompletion;
+
+    vector<Dependency> mWaits;
+    vector<Dependency> mSignals;
+
     VulkanTaskPoolRef mTaskPool = nullptr;
+
+    //Submission queue, matches the family of the pool the command buffer came from
+    VulkanQueue * mQueue = nullptr;
 };
 
@@ -1,73 +1,94 @@
 #include "VulkanTaskGroup.h"
 #include "VulkanTaskPool.h"
+#include "VulkanQueue.h"
+#include "VulkanRenderer.h"
+#include "VulkanWorkerPool.h"
+#include "VulkanFrameContext.h"
 
 #include <future>
 
 VulkanTaskGroup::VulkanTaskGroup(VulkanContextPtr ctx, uint32_t numTasks, VulkanTaskPoolRef pool) :
-    VulkanTaskGroup(ctx, numTasks, pool->getPool())
+    VulkanTaskGroup(ctx, numTasks, pool->getPool(), pool->getQueue()->getType())
 {
     mTaskPool = pool;
 }
 
-VulkanTaskGroup::VulkanTaskGroup(VulkanContextPtr ctx, uint32_t numTasks, vk::CommandPool pool) :
+VulkanTaskGroup::VulkanTaskGroup(VulkanContextPtr ctx, uint32_t numTasks, vk::CommandPool pool, VulkanQueueType queueType) :
 	_ctx(ctx),
-	_pool(pool)
+	_pool(pool),
+    mQueueType(queueType)
 {
-	_commandBuffers = _ctx->getDevice().allocateCommandBuffers(
-		vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, numTasks)
-	);
-
-	for (auto & buffer : _commandBuffers) {
-		_tasks.push_back(make_shared<VulkanTask>(_ctx, buffer));
-	}
-	
-    for (int f = 0; f < _ctx->getQueueCount(); f++)
-    {
-        _fences.push_back(_ctx->getDevice().createFence(
-            vk::FenceCreateInfo()
-        ));
-    }
+    allocateTasks(0, numTasks);
 }
 
 
 void VulkanTaskGroup::resize(uint32_t numTasks)
 {
+    // Slots are rebuilt with the new count on the next recordParallel
+    clearSlots();
+
     if (numTasks < _tasks.size())
     {
-        _ctx->getDevice().freeCommandBuffers(
-            _pool,
-            static_cast<uint32_t>(_commandBuffers.size() - numTasks),
-            &_commandBuffers[numTasks]
-        );
+        freeTasks(numTasks);
+    }
+    else if(numTasks > _tasks.size())
+    {
+        allocateTasks(static_cast<uint32_t>(_tasks.size()), static_cast<uint32_t>(numTasks - _tasks.size()));
+    }
 
-        _tasks.resize(numTasks);
+}
+
+void VulkanTaskGroup::allocateTasks(uint32_t first, uint32_t count)
+{
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        auto buffer = _ctx->getDevice().allocateCommandBuffers(
+            vk::CommandBufferAllocateInfo(_pool, vk::CommandBufferLevel::ePrimary, 1)
+        )[0];
 
+        _commandBuffers.push_back(buffer);
+        _tasks.push_back(make_shared<VulkanTask>(_ctx, buffer, _ctx->getQueue(mQueueType)));
     }
-    else if(numTasks > _tasks.size())
+}
+
+void VulkanTaskGroup::waitForCompletions()
+{
+    for (auto & completion : mCompletions)
     {
-        auto moreTasks = numTasks - _tasks.size();
+        completion.wait();
+    }
 
-        auto newBuffers = _ctx->getDevice().allocateCommandBuffers(
-            vk::CommandBufferAllocateInfo(_pool, vk::CommandBufferLevel::ePrimary, moreTasks)
-        );
+    mCompletions.clear();
+}
 
-        for (int i = 0; i < moreTasks; i++)
-        {
-            _tasks.push_back(make_shared<VulkanTask>(_ctx, newBuffers[i]));
-            _commandBuffers.push_back(newBuffers[i]);
-        }
+void VulkanTaskGroup::freeTasks(uint32_t first)
+{
+    waitForCompletions();
 
+    for (uint32_t i = first; i < _commandBuffers.size(); i++)
+    {
+        _ctx->getDevice().freeCommandBuffers(_pool, 1, &_commandBuffers[i]);
     }
 
+    _commandBuffers.resize(first);
+    _tasks.resize(first);
 }
 
 VulkanTaskResult VulkanTaskGroup::executeAcrossQueues()
 {
+    _ctx->flushUploads();
+
+    waitForCompletions();
+
+    auto * fencePool = _ctx->getFencePool();
+
     // The number of queues we have available to submit tasks
-    auto queueCount = _ctx->getQueueCount();
+    auto queueCount = _ctx->getQueueCount(mQueueType);
+
+    auto & tasks = getRecordedTasks();
 
     // The number of tasks we're looking to submit
-    auto taskCount = _tasks.size();
+    auto taskCount = tasks.size();
     int queuesUsed = 0;
 
     // Todo: in the future it would be best to sort tasks by how long they're likely to take
@@ -94,7 +115,7 @@ VulkanTaskResult VulkanTaskGroup::executeAcrossQueues()
         std::vector<vk::CommandBuffer> cmds;
         for (int commandIndex = 0; commandIndex < tasksToSubmit; ++commandIndex)
         {
-            cmds.push_back(_tasks[commandsSubmitted + commandIndex]->getCommandBuffer());
+            cmds.push_back(tasks[commandsSubmitted + commandIndex]->getCommandBuffer());
         }
 
         // Increment the total number of commands submitted
@@ -115,42 +136,41 @@ VulkanTaskResult VulkanTaskGroup::executeAcrossQueues()
             nullptr
         );
 
+        auto fence = fencePool->acquire();
+
         // Submit our command list to the queue at 'queueIndex'
-        _ctx->getQueue(queueIndex).submit(
-            1,
-            &submit,
-            _fences[queueIndex]
+        _ctx->getQueue(mQueueType, queueIndex)->submit(
+            submit,
+            fence
         );
+
+        mCompletions.push_back(fencePool->track(fence));
     }
 
     VulkanTaskResult result = VulkanTaskResult::SUCCESS;
 
     // We'll now wait for a result from each queue
-    for (int i = 0; i < queuesUsed; ++i)
+    for (auto & completion : mCompletions)
     {
-        // Count how many times we have timed out
-        int limiter = 0;
-
-        // Wait for the fence to be passed or timed out
-        vk::Result res = _ctx->getDevice().waitForFences(1, &_fences[i], VK_TRUE, 1000000);
-
-        if (res != vk::Result::eSuccess)
+        // Wait for the fence to be passed or timed out, a late queue is waited on before the group is reused
+        if (!completion.wait(1000000))
         {
             result = VulkanTaskResult::ERROR_LOOSE;
         }
     }
 
-    _ctx->getDevice().resetFences(
-        queuesUsed,
-        _fences.data()
-    );
-
 
     return result;
 }
 
 void VulkanTaskGroup::record(function<void(vk::CommandBuffer*, uint32_t taskNumber)> commands)
 {
+    waitForCompletions();
+
+    mRecordedSlot = -1;
+
+    _ctx->flushDescriptorWrites();
+
 	for (uint32_t i = 0; i < _tasks.size(); i++) {
 		_tasks[i]->begin();
 		commands(&_tasks[i]->getCommandBuffer(), i);
@@ -158,22 +178,146 @@ void VulkanTaskGroup::record(function<void(vk::CommandBuffer*, uint32_t taskNumb
 	}
 }
 
-VulkanTaskGroup::~VulkanTaskGroup()
+void VulkanTaskGroup::recordParallel(function<void(vk::CommandBuffer*, uint32_t taskNumber)> commands, vk::CommandBufferInheritanceInfo const * inheritance)
 {
-	_tasks.clear();
+    auto taskCount = static_cast<uint32_t>(_tasks.size());
 
-	_ctx->getDevice().freeCommandBuffers(
-		_pool,
-		static_cast<uint32_t>(_commandBuffers.size()),
-		&_commandBuffers[0]
-	);
+    if (taskCount == 0) return;
 
-    for (auto & fence : _fences)
+    waitForCompletions();
+
+    auto * workers = _ctx->getWorkerPool();
+
+    // The calling thread records too
+    uint32_t threadCount = glm::min(workers->getThreadCount() + 1, taskCount);
+    auto level = inheritance ? vk::CommandBufferLevel::eSecondary : vk::CommandBufferLevel::ePrimary;
+
+    uint32_t slotCount = mFrames ? mFrames->getFramesInFlight() : 1;
+
+    if (mSlots.size() != slotCount)
     {
-        _ctx->getDevice().destroyFence(
-            fence
-        );
+        clearSlots();
+        mSlots.resize(slotCount);
+    }
+
+    int32_t slotIndex = mFrames ? static_cast<int32_t>(mFrames->getFrameIndex()) : 0;
+    auto & slot = mSlots[slotIndex];
+
+    prepareSlot(slot, threadCount, level);
+
+    mRecordedSlot = slotIndex;
+
+    // Once, before any worker binds the sets
+    _ctx->flushDescriptorWrites();
+
+    workers->parallelFor(threadCount, [&](uint32_t thread)
+    {
+        for (uint32_t i = thread; i < taskCount; i += threadCount)
+        {
+            slot.tasks[i]->begin(inheritance);
+            commands(&slot.tasks[i]->getCommandBuffer(), i);
+            slot.tasks[i]->end();
+        }
+    });
+}
+
+void VulkanTaskGroup::setFrameContext(VulkanFrameContextRef frames)
+{
+    clearSlots();
+
+    mFrames = frames;
+}
+
+void VulkanTaskGroup::prepareSlot(RecordingSlot & slot, uint32_t threadCount, vk::CommandBufferLevel level)
+{
+    // Primaries submitted from the slot last time round, a no-op once a frame context retired the slot
+    for (auto & task : slot.tasks)
+    {
+        task->getCompletion().wait();
+    }
+
+    auto taskCount = static_cast<uint32_t>(_tasks.size());
+
+    if (slot.threadPools.size() == threadCount && slot.level == level && slot.tasks.size() == taskCount)
+    {
+        // Resetting the whole pool is cheaper than resetting its command buffers one by one
+        for (auto & pool : slot.threadPools)
+        {
+            pool->reset();
+        }
+
+        return;
+    }
+
+    // Command pools are externally synchronized, give every recording thread its own
+    slot.tasks.clear();
+    slot.commandBuffers.clear();
+    slot.threadPools.clear();
+
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        slot.threadPools.push_back(_ctx->makeTaskPool(vk::CommandPoolCreateFlagBits::eTransient, mQueueType));
+    }
+
+    for (uint32_t i = 0; i < taskCount; i++)
+    {
+        auto buffer = _ctx->getDevice().allocateCommandBuffers(
+            vk::CommandBufferAllocateInfo(slot.threadPools[i % threadCount]->getPool(), level, 1)
+        )[0];
+
+        slot.commandBuffers.push_back(buffer);
+        slot.tasks.push_back(make_shared<VulkanTask>(_ctx, buffer, _ctx->getQueue(mQueueType)));
     }
 
+    slot.level = level;
+}
+
+void VulkanTaskGroup::clearSlots()
+{
+    waitForCompletions();
+
+    for (auto & slot : mSlots)
+    {
+        for (auto & task : slot.tasks)
+        {
+            task->getCompletion().wait();
+        }
+
+        // Secondaries only finish with the primary that executed them, let the frame they were last used in retire first
+        if (mFrames)
+        {
+            for (auto & pool : slot.threadPools)
+            {
+                mFrames->keepAlive(pool);
+            }
+        }
+    }
+
+    mSlots.clear();
+    mRecordedSlot = -1;
+}
+
+void VulkanTaskGroup::recordRenderPassParallel(vk::CommandBuffer * primary, VulkanRendererRef renderer, function<void(vk::CommandBuffer*, uint32_t taskNumber)> commands, int32_t whichFramebuffer)
+{
+    auto inheritance = renderer->getInheritanceInfo(whichFramebuffer);
+
+    recordParallel(commands, &inheritance);
+
+    renderer->begin(primary, whichFramebuffer, vk::SubpassContents::eSecondaryCommandBuffers);
+    executeSecondary(primary);
+    renderer->end(primary);
+}
+
+void VulkanTaskGroup::executeSecondary(vk::CommandBuffer * primary)
+{
+    assert(mRecordedSlot >= 0 && mSlots[mRecordedSlot].level == vk::CommandBufferLevel::eSecondary);
+
+    primary->executeCommands(mSlots[mRecordedSlot].commandBuffers);
+}
+
+VulkanTaskGroup::~VulkanTaskGroup()
+{
+    clearSlots();
+	freeTasks(0);
 }
 
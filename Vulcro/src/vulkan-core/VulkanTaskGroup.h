@@ -9,31 +9,81 @@ public:
 	VulkanTaskGroup(VulkanContextPtr ctx, uint32_t numTasks, VulkanTaskPoolRef pool);
 
     //Deprecated
-    VulkanTaskGroup(VulkanContextPtr ctx, uint32_t numTasks, vk::CommandPool pool);
+    VulkanTaskGroup(VulkanContextPtr ctx, uint32_t numTasks, vk::CommandPool pool, VulkanQueueType queueType = VulkanQueueType::GRAPHICS);
 
 
 	void record(function<void(vk::CommandBuffer *, uint32_t taskNumber)> commands);
 	
-    //void recordParallel(function<void(vk::CommandBuffer *, uint32_t taskNumber)> commands);
+    /*
+    * Record tasks on the context's worker pool. commands must be safe to call from several threads at once.
+    * Every recording thread has its own command pool per frame slot, reset as a whole before the slot is recorded again.
+    * Without a frame context there is a single slot, so secondaries must not be re-recorded while a primary executing them is in flight.
+    * @param inheritance - record secondary command buffers continuing this render pass instead of primaries
+    */
+    void recordParallel(function<void(vk::CommandBuffer *, uint32_t taskNumber)> commands, vk::CommandBufferInheritanceInfo const * inheritance = nullptr);
+
+    //Key recordParallel's pools by the current slot of frames. Record after frames->beginFrame, which already waited for the slot's last frame
+    void setFrameContext(VulkanFrameContextRef frames);
+
+    //Split one render pass on primary across the group's tasks as secondary command buffers
+    void recordRenderPassParallel(vk::CommandBuffer * primary, VulkanRendererRef renderer, function<void(vk::CommandBuffer *, uint32_t taskNumber)> commands, int32_t whichFramebuffer = -1);
+
+    //Execute the group's secondary command buffers inside the render pass active on primary
+    void executeSecondary(vk::CommandBuffer * primary);
     
     void resize(uint32_t numTasks);
 
-    //Distribues tasks across available queues, waits on a fence on this thread
+    //Distribues tasks across the queues of the pool's type, waits on a fence on this thread
     VulkanTaskResult executeAcrossQueues();
 
+	//Tasks of the last recordParallel, or of record
 	VulkanTaskRef at(uint32_t taskNumber) {
-		return _tasks[taskNumber];
+		return getRecordedTasks()[taskNumber];
 	}
 
 	~VulkanTaskGroup();
 	
 private:
 
+    void allocateTasks(uint32_t first, uint32_t count);
+
+    void freeTasks(uint32_t first);
+
+    //Command buffers can't be re-recorded or freed while a previous executeAcrossQueues is in flight
+    void waitForCompletions();
+
+    //Per thread command pools of one frame slot, task i records from pool i % size
+    struct RecordingSlot
+    {
+        vector<VulkanTaskPoolRef> threadPools;
+        vector<VulkanTaskRef> tasks;
+        vector<vk::CommandBuffer> commandBuffers;
+        vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary;
+    };
+
+    void prepareSlot(RecordingSlot & slot, uint32_t threadCount, vk::CommandBufferLevel level);
+
+    void clearSlots();
+
+    vector<VulkanTaskRef> & getRecordedTasks()
+    {
+        return mRecordedSlot < 0 ? _tasks : mSlots[mRecordedSlot].tasks;
+    }
+
 	VulkanContextPtr _ctx;
 	vector<VulkanTaskRef> _tasks;
 	vk::CommandPool _pool;
 	vector<vk::CommandBuffer> _commandBuffers;
-    vector<vk::Fence> _fences;
+    vector<VulkanCompletion> mCompletions;
 
     VulkanTaskPoolRef mTaskPool;
+
+    VulkanQueueType mQueueType;
+
+    VulkanFrameContextRef mFrames;
+
+    vector<RecordingSlot> mSlots;
+
+    //Slot the last recordParallel used, -1 once record uses the group's own tasks again
+    int32_t mRecordedSlot = -1;
 };
\ No newline at end of file
@@ -1,14 +1,17 @@
 #include "VulkanTaskPool.h"
 #include "VulkanTask.h"
 #include "VulkanTaskGroup.h"
+#include "VulkanQueue.h"
 
-VulkanTaskPool::VulkanTaskPool(VulkanContextPtr ctx, vk::CommandPoolCreateFlags createFlags)
+VulkanTaskPool::VulkanTaskPool(VulkanContextPtr ctx, vk::CommandPoolCreateFlags createFlags, VulkanQueueType queueType)
     :mCtx(ctx)
 {
     auto device = ctx->getDevice();
 
+    mQueue = ctx->getQueue(queueType);
+
     mCommandPool = device.createCommandPool(
-        vk::CommandPoolCreateInfo(createFlags, ctx->getFamilyIndex())
+        vk::CommandPoolCreateInfo(createFlags, mQueue->getFamilyIndex())
     );
 }
 
@@ -7,7 +7,7 @@
 class VulkanTaskPool
 {
 public:
-    VulkanTaskPool(VulkanContextPtr ctx, vk::CommandPoolCreateFlags poolFlags = vk::CommandPoolCreateFlags());
+    VulkanTaskPool(VulkanContextPtr ctx, vk::CommandPoolCreateFlags poolFlags = vk::CommandPoolCreateFlags(), VulkanQueueType queueType = VulkanQueueType::GRAPHICS);
     ~VulkanTaskPool();
 
     vk::CommandPool getPool()
@@ -15,9 +15,16 @@ public:
         return mCommandPool;
     }
 
+    //Queue that tasks recorded from this pool are submitted to
+    VulkanQueue * getQueue()
+    {
+        return mQueue;
+    }
+
     void reset();
 private:
 
     VulkanContextPtr mCtx;
     vk::CommandPool mCommandPool;
+    VulkanQueue * mQueue;
 };
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "VulkanTimeline.h"
+
+VulkanTimeline::VulkanTimeline(VulkanContextPtr ctx, uint64_t initialValue) :
+    mCtx(ctx),
+    mTarget(initialValue),
+    mSubmittedValue(initialValue),
+    mValue(initialValue)
+{
+    if (!mCtx->supportsTimelineSemaphores()) return;
+
+    VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    typeInfo.initialValue = initialValue;
+
+    vk::SemaphoreCreateInfo createInfo;
+    createInfo.pNext = &typeInfo;
+
+    mSemaphore = mCtx->getDevice().createSemaphore(createInfo);
+}
+
+VulkanTimeline::~VulkanTimeline()
+{
+    if (mSemaphore)
+    {
+        // Pending submissions may still signal it, reserved values that were never submitted would hang
+        uint64_t submitted;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            submitted = mSubmittedValue;
+        }
+
+        wait(submitted);
+        mCtx->getDevice().destroySemaphore(mSemaphore);
+    }
+}
+
+uint64_t VulkanTimeline::getValue()
+{
+    if (mSemaphore)
+    {
+        uint64_t value = 0;
+        mCtx->getTimelineDispatch().vkGetSemaphoreCounterValueKHR(mCtx->getDevice(), mSemaphore, &value);
+        return value;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Retire submissions in signal order, stop at the first one still running
+    while (!mSubmitted.empty() && mSubmitted.begin()->second.poll())
+    {
+        mValue = glm::max(mValue, mSubmitted.begin()->first);
+        mSubmitted.erase(mSubmitted.begin());
+    }
+
+    return mValue;
+}
+
+bool VulkanTimeline::wait(uint64_t value, uint64_t timeoutNs)
+{
+    if (mSemaphore)
+    {
+        VkSemaphore semaphore = mSemaphore;
+
+        VkSemaphoreWaitInfoKHR waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &value;
+
+        auto res = mCtx->getTimelineDispatch().vkWaitSemaphoresKHR(mCtx->getDevice(), &waitInfo, timeoutNs);
+
+        if (res != VK_SUCCESS && res != VK_TIMEOUT)
+        {
+            std::cerr << "(VulkanTimeline - wait) waiting on timeline failed" << std::endl;
+        }
+
+        return res == VK_SUCCESS;
+    }
+
+    VulkanCompletion completion;
+    uint64_t reached = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        if (mValue >= value) return true;
+
+        auto it = mSubmitted.lower_bound(value);
+
+        if (it == mSubmitted.end())
+        {
+            // Nothing submitted signals it yet, waiting would never return
+            std::cerr << "(VulkanTimeline - wait) value " << value << " has not been submitted" << std::endl;
+            return false;
+        }
+
+        completion = it->second;
+        reached = it->first;
+    }
+
+    if (!completion.wait(timeoutNs)) return false;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mValue = glm::max(mValue, reached);
+    mSubmitted.erase(mSubmitted.begin(), mSubmitted.upper_bound(reached));
+
+    return true;
+}
+
+void VulkanTimeline::signal(uint64_t value)
+{
+    uint64_t target = mTarget;
+    while (target < value && !mTarget.compare_exchange_weak(target, value));
+
+    if (mSemaphore)
+    {
+        VkSemaphoreSignalInfoKHR signalInfo = {};
+        signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR;
+        signalInfo.semaphore = mSemaphore;
+        signalInfo.value = value;
+
+        mCtx->getTimelineDispatch().vkSignalSemaphoreKHR(mCtx->getDevice(), &signalInfo);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mSubmittedValue = glm::max(mSubmittedValue, value);
+    mValue = glm::max(mValue, value);
+}
+
+void VulkanTimeline::onSubmitted(uint64_t value, VulkanCompletion completion)
+{
+    uint64_t target = mTarget;
+    while (target < value && !mTarget.compare_exchange_weak(target, value));
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mSubmittedValue = glm::max(mSubmittedValue, value);
+
+    if (!mSemaphore)
+    {
+        mSubmitted[value] = completion;
+    }
+}
+
+vk::SubmitInfo const & VulkanSubmission::build(vk::CommandBuffer const * cmd)
+{
+    info = vk::SubmitInfo(
+        static_cast<uint32_t>(waitSemaphores.size()),
+        waitSemaphores.data(),
+        waitStages.data(),
+        cmd ? 1 : 0,
+        cmd,
+        static_cast<uint32_t>(signalSemaphores.size()),
+        signalSemaphores.data()
+    );
+
+    if (usesTimeline)
+    {
+        timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+        info.pNext = &timelineInfo;
+    }
+
+    return info;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+#include "VulkanCompat.h"
+#include "VulkanFencePool.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+/*
+* Monotonic 64 bit GPU counter backed by a VK_KHR_timeline_semaphore. Tasks wait for and signal values on it
+* (see VulkanTask::waitFor / signal) instead of passing binary semaphores around by hand.
+*
+* Without the extension the counter is emulated with the completions of the submissions that signal it.
+* GPU side waits then turn into host waits before the waiting task is submitted, correct but not overlapped.
+*/
+class VulkanTimeline
+{
+public:
+
+    VulkanTimeline(VulkanContextPtr ctx, uint64_t initialValue = 0);
+
+    VULCRO_DONT_COPY(VulkanTimeline)
+
+    ~VulkanTimeline();
+
+    //Reserve the next value to signal
+    uint64_t next()
+    {
+        return ++mTarget;
+    }
+
+    //Highest value reserved or signaled so far, the counter ends up here once all submitted work finishes
+    uint64_t getTarget()
+    {
+        return mTarget;
+    }
+
+    //Value the GPU has reached
+    uint64_t getValue();
+
+    //Returns false if timeoutNs elapsed first
+    bool wait(uint64_t value, uint64_t timeoutNs = UINT64_MAX);
+
+    //Set the counter from the host
+    void signal(uint64_t value);
+
+    bool isEmulated()
+    {
+        return !mSemaphore;
+    }
+
+    //Null when emulated
+    vk::Semaphore getSemaphore()
+    {
+        return mSemaphore;
+    }
+
+private:
+
+    friend class VulkanTask;
+
+    //Emulation only, value is reached once completion is
+    void onSubmitted(uint64_t value, VulkanCompletion completion);
+
+    VulkanContextPtr mCtx;
+
+    vk::Semaphore mSemaphore = nullptr;
+
+    std::atomic<uint64_t> mTarget;
+
+    //Highest value a submitted task or the host signals, never past mTarget
+    uint64_t mSubmittedValue = 0;
+
+    //Emulation state
+    uint64_t mValue = 0;
+    std::map<uint64_t, VulkanCompletion> mSubmitted;
+    std::mutex mMutex;
+};
+
+/*
+* Storage for one vk::SubmitInfo and the arrays it points into, filled by VulkanTask.
+* Keep it at a stable address between build() and the queue submit.
+*/
+struct VulkanSubmission
+{
+    vector<vk::Semaphore> waitSemaphores;
+    vector<vk::PipelineStageFlags> waitStages;
+    vector<uint64_t> waitValues;
+
+    vector<vk::Semaphore> signalSemaphores;
+    vector<uint64_t> signalValues;
+
+    //Only chained when a timeline semaphore is involved, values of binary semaphores are ignored
+    bool usesTimeline = false;
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+
+    vk::SubmitInfo info;
+
+    void addWait(vk::Semaphore semaphore, vk::PipelineStageFlags stage, uint64_t value = 0)
+    {
+        waitSemaphores.push_back(semaphore);
+        waitStages.push_back(stage);
+        waitValues.push_back(value);
+    }
+
+    void addSignal(vk::Semaphore semaphore, uint64_t value = 0)
+    {
+        signalSemaphores.push_back(semaphore);
+        signalValues.push_back(value);
+    }
+
+    vk::SubmitInfo const & build(vk::CommandBuffer const * cmd);
+};
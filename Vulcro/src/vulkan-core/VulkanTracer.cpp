@@ -0,0 +1,237 @@
+#include "VulkanTracer.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+const uint32_t VulkanTracer::EVENTS_PER_THREAD = 1 << 16;
+
+std::atomic<bool> VulkanTracer::sEnabled(false);
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char * name;
+        uint64_t beginNs;
+        uint64_t endNs;
+    };
+
+    /*
+    * Written only by its thread. count is published with release after the event is filled in,
+    * writing is raised around the append so stop() can wait out appends that saw tracing enabled.
+    */
+    struct ThreadBuffer
+    {
+        vector<TraceEvent> events;
+        std::atomic<uint32_t> count{ 0 };
+        std::atomic<uint32_t> dropped{ 0 };
+        std::atomic<bool> writing{ false };
+        const char * name = nullptr;
+        uint32_t threadIndex = 0;
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        vector<shared_ptr<ThreadBuffer>> buffers;
+    };
+
+    Registry & getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    ThreadBuffer & getThreadBuffer()
+    {
+        // The registry keeps buffers of exited threads alive so their events still export
+        thread_local shared_ptr<ThreadBuffer> buffer;
+
+        if (!buffer)
+        {
+            buffer = make_shared<ThreadBuffer>();
+            buffer->events.resize(VulkanTracer::EVENTS_PER_THREAD);
+
+            auto & registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            buffer->threadIndex = static_cast<uint32_t>(registry.buffers.size());
+            registry.buffers.push_back(buffer);
+        }
+
+        return *buffer;
+    }
+
+    const std::chrono::steady_clock::time_point sEpoch = std::chrono::steady_clock::now();
+
+    void writeEscaped(std::ostream & out, const char * text)
+    {
+        for (const char * c = text; *c; c++)
+        {
+            if (*c == '"' || *c == '\\') out << '\\';
+            out << *c;
+        }
+    }
+}
+
+uint64_t VulkanTracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sEpoch).count();
+}
+
+void VulkanTracer::record(const char * name, uint64_t beginNs, uint64_t endNs)
+{
+    auto & buffer = getThreadBuffer();
+
+    buffer.writing.store(true, std::memory_order_seq_cst);
+
+    // Re-check now that stop() can see us
+    if (isEnabled())
+    {
+        uint32_t index = buffer.count.load(std::memory_order_relaxed);
+
+        if (index < buffer.events.size())
+        {
+            buffer.events[index] = { name, beginNs, endNs };
+            buffer.count.store(index + 1, std::memory_order_release);
+        }
+        else
+        {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    buffer.writing.store(false, std::memory_order_release);
+}
+
+void VulkanTracer::setThreadName(const char * name)
+{
+    getThreadBuffer().name = name;
+}
+
+void VulkanTracer::start()
+{
+    stop();
+
+    auto & registry = getRegistry();
+
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        for (auto & buffer : registry.buffers)
+        {
+            buffer->count.store(0, std::memory_order_relaxed);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    sEnabled.store(true, std::memory_order_seq_cst);
+}
+
+void VulkanTracer::stop()
+{
+    sEnabled.store(false, std::memory_order_seq_cst);
+
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    // Appends that started before tracing was turned off still land
+    for (auto & buffer : registry.buffers)
+    {
+        while (buffer->writing.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool VulkanTracer::stop(const char * path)
+{
+    stop();
+
+    std::ofstream file(path);
+
+    if (!file)
+    {
+        std::cerr << "(VulkanTracer - stop) could not open " << path << std::endl;
+        return false;
+    }
+
+    writeChromeTrace(file);
+
+    auto dropped = getDroppedCount();
+
+    if (dropped > 0)
+    {
+        std::cerr << "(VulkanTracer - stop) " << dropped << " events did not fit in the per thread buffers" << std::endl;
+    }
+
+    return true;
+}
+
+void VulkanTracer::writeChromeTrace(std::ostream & out)
+{
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    out << std::fixed << std::setprecision(3);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+
+    auto separator = [&]()
+    {
+        if (!first) out << ",";
+        out << "\n";
+        first = false;
+    };
+
+    for (auto & buffer : registry.buffers)
+    {
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+
+        if (count == 0) continue;
+
+        if (buffer->name)
+        {
+            separator();
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadIndex << ",\"args\":{\"name\":\"";
+            writeEscaped(out, buffer->name);
+            out << "\"}}";
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            auto & event = buffer->events[i];
+
+            // Complete events, timestamps in microseconds
+            separator();
+            out << "{\"name\":\"";
+            writeEscaped(out, event.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadIndex
+                << ",\"ts\":" << event.beginNs / 1000.0
+                << ",\"dur\":" << (event.endNs - event.beginNs) / 1000.0 << "}";
+        }
+    }
+
+    out << "\n]}" << std::endl;
+}
+
+uint64_t VulkanTracer::getDroppedCount()
+{
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    uint64_t dropped = 0;
+
+    for (auto & buffer : registry.buffers)
+    {
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+
+    return dropped;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "General.h"
+
+#include <atomic>
+#include <ostream>
+
+/*
+* CPU tracing of library hot paths, exported as Chrome trace / Perfetto JSON.
+*
+* Zones are compiled in with the VULCRO_ENABLE_TRACING CMake option and cost one relaxed load while
+* tracing is off. While on, each thread appends to its own fixed size buffer without taking locks,
+* a thread only locks once to register its buffer. Events past a buffer's capacity are dropped and counted.
+*
+*   VulkanTracer::start();
+*   ... frames ...
+*   VulkanTracer::stop("trace.json");   //open in chrome://tracing or ui.perfetto.dev
+*/
+class VulkanTracer
+{
+public:
+
+    //Events each thread can hold per capture
+    static const uint32_t EVENTS_PER_THREAD;
+
+    //Clear all buffers and start recording
+    static void start();
+
+    //Stop recording and write everything captured to path, returns false if the file can't be written
+    static bool stop(const char * path);
+
+    static void stop();
+
+    static bool isEnabled()
+    {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    //Call with tracing stopped
+    static void writeChromeTrace(std::ostream & out);
+
+    //Shown instead of the thread number in the trace viewer, name must outlive the capture
+    static void setThreadName(const char * name);
+
+    //name must outlive the capture, e.g. a string literal
+    static void record(const char * name, uint64_t beginNs, uint64_t endNs);
+
+    static uint64_t now();
+
+    static uint64_t getDroppedCount();
+
+private:
+
+    static std::atomic<bool> sEnabled;
+};
+
+class VulkanTraceZone
+{
+public:
+
+    VulkanTraceZone(const char * name) :
+        mName(VulkanTracer::isEnabled() ? name : nullptr)
+    {
+        if (mName) mBegin = VulkanTracer::now();
+    }
+
+    VULCRO_DONT_COPY(VulkanTraceZone)
+
+    ~VulkanTraceZone()
+    {
+        if (mName) VulkanTracer::record(mName, mBegin, VulkanTracer::now());
+    }
+
+private:
+
+    const char * mName;
+    uint64_t mBegin = 0;
+};
+
+#ifdef VULCRO_ENABLE_TRACING
+#define VULCRO_TRACE_CONCAT_INNER(a, b) a##b
+#define VULCRO_TRACE_CONCAT(a, b) VULCRO_TRACE_CONCAT_INNER(a, b)
+#define VULCRO_TRACE_ZONE(name) VulkanTraceZone VULCRO_TRACE_CONCAT(_vulcroTraceZone, __LINE__)(name)
+#define VULCRO_TRACE_FUNCTION() VULCRO_TRACE_ZONE(__FUNCTION__)
+#else
+#define VULCRO_TRACE_ZONE(name)
+#define VULCRO_TRACE_FUNCTION()
+#endif
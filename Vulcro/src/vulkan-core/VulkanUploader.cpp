@@ -0,0 +1,428 @@
+#include "VulkanUploader.h"
+#include "VulkanBuffer.h"
+#include "VulkanImage.h"
+#include "VulkanTaskPool.h"
+#include "VulkanQueue.h"
+
+const vk::DeviceSize VulkanUploader::DEFAULT_STAGING_SIZE = 32ull * 1024 * 1024;
+
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+VulkanUploader::VulkanUploader(VulkanContextPtr ctx, vk::DeviceSize stagingSize) :
+    mCtx(ctx)
+{
+    mStagingAlignment = glm::max<vk::DeviceSize>(16, ctx->getPhysicalDeviceProperties().limits.optimalBufferCopyOffsetAlignment);
+    mStagingSize = alignUp(stagingSize, mStagingAlignment);
+
+    mStaging = ctx->makeBuffer(vk::BufferUsageFlagBits::eTransferSrc, mStagingSize, VulkanBuffer::CPU_ALOT);
+    mStagingData = static_cast<char*>(mStaging->getMapped());
+
+    auto poolFlags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+
+    mPool = ctx->makeTaskPool(poolFlags, VulkanQueueType::GRAPHICS);
+    mQueue = mPool->getQueue();
+
+    mTransferQueue = ctx->getQueue(VulkanQueueType::TRANSFER);
+
+    if (!mTransferQueue->sharesFamily(mQueue))
+    {
+        mTransferPool = ctx->makeTaskPool(poolFlags, VulkanQueueType::TRANSFER);
+    }
+}
+
+VulkanUploader::~VulkanUploader()
+{
+    waitIdle();
+
+    auto device = mCtx->getDevice();
+
+    for (auto & batch : mFreeBatches)
+    {
+        device.freeCommandBuffers(mPool->getPool(), 1, &batch->cmd);
+        device.destroyFence(batch->fence);
+
+        if (mTransferPool)
+        {
+            device.freeCommandBuffers(mTransferPool->getPool(), 1, &batch->transferCmd);
+            device.destroySemaphore(batch->semaphore);
+        }
+    }
+}
+
+VulkanUploadToken VulkanUploader::uploadBuffer(VulkanBuffer * dst, void const * data, vk::DeviceSize size, vk::DeviceSize dstOffset, std::shared_ptr<void> keepAlive)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto staging = allocateStaging(size);
+    memcpy(staging.data, data, size);
+
+    auto * batch = beginBatch();
+    auto * transferCmd = getTransferCommands(batch);
+
+    if (transferCmd)
+    {
+        transferCmd->copyBuffer(staging.buffer, dst->getBuffer(), { vk::BufferCopy(staging.offset, dstOffset, size) });
+
+        batch->bufferTransfers.push_back(vk::BufferMemoryBarrier(
+            vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+            mTransferQueue->getFamilyIndex(), mQueue->getFamilyIndex(),
+            dst->getBuffer(), 0, VK_WHOLE_SIZE
+        ));
+    }
+    else
+    {
+        batch->cmd.copyBuffer(staging.buffer, dst->getBuffer(), { vk::BufferCopy(staging.offset, dstOffset, size) });
+    }
+
+    if (keepAlive) batch->keepAlive.push_back(keepAlive);
+
+    return batch->token;
+}
+
+VulkanUploadToken VulkanUploader::copyBuffer(VulkanBufferRef src, VulkanBuffer * dst, vk::DeviceSize size, vk::DeviceSize srcOffset, vk::DeviceSize dstOffset, std::shared_ptr<void> keepAlive)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto * batch = beginGraphicsCopy();
+
+    batch->cmd.copyBuffer(src->getBuffer(), dst->getBuffer(), { vk::BufferCopy(srcOffset, dstOffset, size) });
+
+    batch->keepAlive.push_back(src);
+    if (keepAlive) batch->keepAlive.push_back(keepAlive);
+
+    return batch->token;
+}
+
+VulkanUploadToken VulkanUploader::uploadImage(VulkanImage2D * dst, void const * data, vk::DeviceSize size, std::shared_ptr<void> keepAlive)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto staging = allocateStaging(size);
+    memcpy(staging.data, data, size);
+
+    auto * batch = beginBatch();
+    auto * transferCmd = getTransferCommands(batch);
+
+    if (transferCmd)
+    {
+        // Stages of earlier graphics queue uses don't exist on the transfer queue, which only ever sees the image fresh
+        dst->setState(VulkanResourceState());
+
+        // The eTransferDstOptimal -> eGeneral transition happens as part of the ownership transfer
+        dst->recordCopyFromBuffer(transferCmd, staging.buffer, staging.offset, false);
+
+        batch->imageTransfers.push_back(vk::ImageMemoryBarrier(
+            vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+            vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral,
+            mTransferQueue->getFamilyIndex(), mQueue->getFamilyIndex(),
+            dst->getImage(),
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, dst->getMipLevels(), 0, 1)
+        ));
+    }
+    else
+    {
+        dst->recordCopyFromBuffer(&batch->cmd, staging.buffer, staging.offset);
+    }
+
+    // submitBatch makes the copy visible to everything submitted after it
+    dst->setState(VulkanResourceState(vk::ImageLayout::eGeneral, vk::AccessFlags(), vk::PipelineStageFlags()));
+
+    if (keepAlive) batch->keepAlive.push_back(keepAlive);
+
+    return batch->token;
+}
+
+VulkanUploadToken VulkanUploader::copyBufferToImage(VulkanBufferRef src, VulkanImage2D * dst, std::shared_ptr<void> keepAlive)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto * batch = beginGraphicsCopy();
+
+    dst->recordCopyFromBuffer(&batch->cmd, src->getBuffer(), 0);
+    dst->setState(VulkanResourceState(vk::ImageLayout::eGeneral, vk::AccessFlags(), vk::PipelineStageFlags()));
+
+    batch->keepAlive.push_back(src);
+    if (keepAlive) batch->keepAlive.push_back(keepAlive);
+
+    return batch->token;
+}
+
+VulkanUploadToken VulkanUploader::flush()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return submitBatch();
+}
+
+bool VulkanUploader::isComplete(VulkanUploadToken token)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    retire(false);
+
+    return token <= mCompletedToken;
+}
+
+void VulkanUploader::wait(VulkanUploadToken token)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mRecording && token >= mRecording->token)
+    {
+        submitBatch();
+    }
+
+    while (mCompletedToken < token && !mInFlight.empty())
+    {
+        retire(true);
+    }
+}
+
+void VulkanUploader::waitIdle()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    submitBatch();
+
+    while (!mInFlight.empty())
+    {
+        retire(true);
+    }
+}
+
+VulkanUploader::Batch * VulkanUploader::beginBatch()
+{
+    if (mRecording)
+    {
+        return mRecording.get();
+    }
+
+    if (!mFreeBatches.empty())
+    {
+        mRecording = std::move(mFreeBatches.back());
+        mFreeBatches.pop_back();
+    }
+    else
+    {
+        mRecording.reset(new Batch());
+
+        mRecording->cmd = mCtx->getDevice().allocateCommandBuffers(
+            vk::CommandBufferAllocateInfo(mPool->getPool(), vk::CommandBufferLevel::ePrimary, 1)
+        )[0];
+
+        mRecording->fence = mCtx->getDevice().createFence(vk::FenceCreateInfo());
+
+        if (mTransferPool)
+        {
+            mRecording->transferCmd = mCtx->getDevice().allocateCommandBuffers(
+                vk::CommandBufferAllocateInfo(mTransferPool->getPool(), vk::CommandBufferLevel::ePrimary, 1)
+            )[0];
+
+            mRecording->semaphore = mCtx->getDevice().createSemaphore(vk::SemaphoreCreateInfo());
+        }
+    }
+
+    mRecording->token = mNextToken++;
+    mRecording->cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+    return mRecording.get();
+}
+
+VulkanUploader::Batch * VulkanUploader::beginGraphicsCopy()
+{
+    // Acquire barriers are recorded at submit time, after everything else in cmd.
+    // A GPU copy could read a resource this batch is still transferring, so start a new batch behind it.
+    if (mRecording && mRecording->transferRecording)
+    {
+        submitBatch();
+    }
+
+    return beginBatch();
+}
+
+vk::CommandBuffer * VulkanUploader::getTransferCommands(Batch * batch)
+{
+    if (!mTransferPool)
+    {
+        return nullptr;
+    }
+
+    if (!batch->transferRecording)
+    {
+        batch->transferCmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        batch->transferRecording = true;
+    }
+
+    return &batch->transferCmd;
+}
+
+VulkanUploader::StagingRange VulkanUploader::allocateStaging(vk::DeviceSize size)
+{
+    // Larger than the whole ring, give it a buffer of its own for the lifetime of the batch
+    if (size > mStagingSize)
+    {
+        auto temp = mCtx->makeBuffer(vk::BufferUsageFlagBits::eTransferSrc, size, VulkanBuffer::CPU_ALOT);
+        beginBatch()->keepAlive.push_back(temp);
+
+        return StagingRange{ temp->getBuffer(), 0, static_cast<char*>(temp->getMapped()) };
+    }
+
+    while (true)
+    {
+        if (mStagingUsed == 0)
+        {
+            mStagingHead = 0;
+        }
+
+        vk::DeviceSize offset = alignUp(mStagingHead, mStagingAlignment);
+
+        // Not enough room before the end of the ring, skip to the start
+        if (offset + size > mStagingSize)
+        {
+            offset = 0;
+        }
+
+        vk::DeviceSize consumed = offset >= mStagingHead ? (offset + size - mStagingHead) : (mStagingSize - mStagingHead + size);
+
+        if (mStagingUsed + consumed <= mStagingSize)
+        {
+            mStagingHead = offset + size;
+            mStagingUsed += consumed;
+            beginBatch()->stagingBytes += consumed;
+
+            return StagingRange{ mStaging->getBuffer(), offset, mStagingData + offset };
+        }
+
+        // Ring is full, hand what we have to the GPU and wait for the oldest batch to free its range
+        if (mRecording && mRecording->stagingBytes > 0)
+        {
+            submitBatch();
+        }
+
+        retire(true);
+    }
+}
+
+VulkanUploadToken VulkanUploader::submitBatch()
+{
+    if (!mRecording)
+    {
+        return mNextToken - 1;
+    }
+
+    auto * batch = mRecording.get();
+
+    if (batch->transferRecording)
+    {
+        // Release on the transfer queue, acquire on graphics, with matching barriers
+        batch->transferCmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eBottomOfPipe,
+            vk::DependencyFlags(),
+            {},
+            batch->bufferTransfers,
+            batch->imageTransfers
+        );
+
+        batch->transferCmd.end();
+
+        auto transferSubmit = vk::SubmitInfo(0, nullptr, nullptr, 1, &batch->transferCmd, 1, &batch->semaphore);
+
+        mTransferQueue->submit(transferSubmit);
+
+        batch->cmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eAllCommands,
+            vk::DependencyFlags(),
+            {},
+            batch->bufferTransfers,
+            batch->imageTransfers
+        );
+    }
+
+    // Make every copy in the batch visible to whatever is submitted after it
+    batch->cmd.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eAllCommands,
+        vk::DependencyFlags(),
+        { vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite) },
+        {},
+        {}
+    );
+
+    batch->cmd.end();
+
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+
+    auto submit = vk::SubmitInfo(
+        batch->transferRecording ? 1 : 0,
+        batch->transferRecording ? &batch->semaphore : nullptr,
+        &waitStage,
+        1,
+        &batch->cmd,
+        0,
+        nullptr
+    );
+
+    mQueue->submit(submit, batch->fence);
+
+#ifdef VULCRO_PRINT_ALLOCATIONS
+    printf("Upload batch %llu submitted, %llu staging bytes\n", (unsigned long long)mRecording->token, (unsigned long long)mRecording->stagingBytes);
+#endif
+
+    auto token = mRecording->token;
+
+    mInFlight.push_back(std::move(mRecording));
+
+    retire(false);
+
+    return token;
+}
+
+void VulkanUploader::retire(bool wait)
+{
+    if (wait && !mInFlight.empty())
+    {
+        auto res = mCtx->getDevice().waitForFences(1, &mInFlight.front()->fence, VK_TRUE, UINT64_MAX);
+
+        if (res != vk::Result::eSuccess)
+        {
+            std::cerr << "(VulkanUploader - retire) failed waiting on upload batch" << std::endl;
+        }
+    }
+
+    // Batches share one queue, so they complete in submission order
+    while (!mInFlight.empty() && mCtx->getDevice().getFenceStatus(mInFlight.front()->fence) == vk::Result::eSuccess)
+    {
+        auto batch = std::move(mInFlight.front());
+        mInFlight.pop_front();
+
+        mStagingUsed -= batch->stagingBytes;
+        mCompletedToken = batch->token;
+
+        recycle(std::move(batch));
+    }
+}
+
+void VulkanUploader::recycle(std::unique_ptr<Batch> batch)
+{
+    mCtx->getDevice().resetFences(1, &batch->fence);
+    batch->cmd.reset(vk::CommandBufferResetFlags());
+
+    if (batch->transferRecording)
+    {
+        batch->transferCmd.reset(vk::CommandBufferResetFlags());
+        batch->transferRecording = false;
+    }
+
+    batch->bufferTransfers.clear();
+    batch->imageTransfers.clear();
+
+    batch->stagingBytes = 0;
+    batch->keepAlive.clear();
+
+    mFreeBatches.push_back(std::move(batch));
+}
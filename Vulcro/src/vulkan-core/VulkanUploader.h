@@ -0,0 +1,137 @@
+#pragma once
+
+#include "General.h"
+#include "vulkan/vulkan.hpp"
+#include "VulkanContext.h"
+
+#include <deque>
+#include <mutex>
+
+/*
+* Context owned upload manager.
+* Copies are staged through one persistently mapped ring and recorded into a shared command buffer,
+* which is submitted once per batch instead of once per resource.
+*
+* A batch is submitted when flush() is called, when the staging ring runs out of room,
+* and automatically before any VulkanTask or VulkanTaskGroup is executed, so work submitted
+* afterwards on the graphics queue always sees the uploaded data.
+*
+* Staged copies run on the transfer queue when the device has a dedicated transfer family. Ownership of the
+* destinations is released there and acquired on the graphics queue behind a semaphore. GPU to GPU copies
+* always run on the graphics queue, since their sources may still be owned by it.
+*/
+class VulkanUploader
+{
+public:
+
+    static const vk::DeviceSize DEFAULT_STAGING_SIZE;
+
+    VulkanUploader(VulkanContextPtr ctx, vk::DeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+
+    VULCRO_DONT_COPY(VulkanUploader)
+
+    ~VulkanUploader();
+
+    /*
+    * Copy host data into dst. The data is consumed before returning.
+    * dst should be newly created, it may be written from the transfer family without first being released by graphics.
+    * @param keepAlive - held until the batch completes, usually the owner of dst
+    */
+    VulkanUploadToken uploadBuffer(VulkanBuffer * dst, void const * data, vk::DeviceSize size, vk::DeviceSize dstOffset = 0, std::shared_ptr<void> keepAlive = nullptr);
+
+    //GPU side copy, src is kept alive until the batch completes
+    VulkanUploadToken copyBuffer(VulkanBufferRef src, VulkanBuffer * dst, vk::DeviceSize size, vk::DeviceSize srcOffset = 0, vk::DeviceSize dstOffset = 0, std::shared_ptr<void> keepAlive = nullptr);
+
+    //Upload mip 0 of dst from tightly packed host data, previous contents are discarded
+    VulkanUploadToken uploadImage(VulkanImage2D * dst, void const * data, vk::DeviceSize size, std::shared_ptr<void> keepAlive = nullptr);
+
+    VulkanUploadToken copyBufferToImage(VulkanBufferRef src, VulkanImage2D * dst, std::shared_ptr<void> keepAlive = nullptr);
+
+    //Submit the batch being recorded, if any, and return its token
+    VulkanUploadToken flush();
+
+    bool isComplete(VulkanUploadToken token);
+
+    //Flushes first if token belongs to the batch still being recorded
+    void wait(VulkanUploadToken token);
+
+    void waitIdle();
+
+    bool hasPendingCopies()
+    {
+        return mRecording != nullptr;
+    }
+
+private:
+
+    struct Batch
+    {
+        //Graphics queue commands, including the acquire half of ownership transfers
+        vk::CommandBuffer cmd;
+
+        //Dedicated transfer queue commands, signals semaphore for cmd to wait on
+        vk::CommandBuffer transferCmd = nullptr;
+        vk::Semaphore semaphore = nullptr;
+        bool transferRecording = false;
+
+        std::vector<vk::BufferMemoryBarrier> bufferTransfers;
+        std::vector<vk::ImageMemoryBarrier> imageTransfers;
+
+        vk::Fence fence;
+        VulkanUploadToken token = 0;
+
+        //Staging ring bytes (including alignment and wrap padding) released when the batch retires
+        vk::DeviceSize stagingBytes = 0;
+
+        std::vector<std::shared_ptr<void>> keepAlive;
+    };
+
+    struct StagingRange
+    {
+        vk::Buffer buffer;
+        vk::DeviceSize offset;
+        char * data;
+    };
+
+    Batch * beginBatch();
+
+    //Batch for copies recorded on the graphics queue
+    Batch * beginGraphicsCopy();
+
+    //Command buffer for staged copies, nullptr when they go on the graphics queue
+    vk::CommandBuffer * getTransferCommands(Batch * batch);
+
+    //May submit the current batch and wait on older ones to make room
+    StagingRange allocateStaging(vk::DeviceSize size);
+
+    VulkanUploadToken submitBatch();
+
+    //Retire finished batches, blocking on the oldest if wait is set
+    void retire(bool wait);
+
+    void recycle(std::unique_ptr<Batch> batch);
+
+    VulkanContextPtr mCtx;
+
+    VulkanQueue * mQueue;
+    VulkanQueue * mTransferQueue;
+
+    VulkanTaskPoolRef mPool;
+    VulkanTaskPoolRef mTransferPool = nullptr;
+
+    VulkanBufferRef mStaging;
+    char * mStagingData = nullptr;
+    vk::DeviceSize mStagingSize;
+    vk::DeviceSize mStagingHead = 0;
+    vk::DeviceSize mStagingUsed = 0;
+    vk::DeviceSize mStagingAlignment;
+
+    std::unique_ptr<Batch> mRecording = nullptr;
+    std::deque<std::unique_ptr<Batch>> mInFlight;
+    std::vector<std::unique_ptr<Batch>> mFreeBatches;
+
+    VulkanUploadToken mNextToken = 1;
+    VulkanUploadToken mCompletedToken = 0;
+
+    std::mutex mMutex;
+};
@@ -7,6 +7,19 @@ uint32_t getSizeOf(vk::Format format) {
         case (vk::Format::eR8G8B8A8Sint):
         case (vk::Format::eR8G8B8A8Snorm):
         return 4;
+        case (vk::Format::eR32Sfloat):
+        case (vk::Format::eR32Sint):
+        case (vk::Format::eR32Uint):
+        return 4;
+        case (vk::Format::eR32G32Sint):
+        case (vk::Format::eR32G32Uint):
+        return 8;
+        case (vk::Format::eR32G32B32Sint):
+        case (vk::Format::eR32G32B32Uint):
+        return 12;
+        case (vk::Format::eR32G32B32A32Sint):
+        case (vk::Format::eR32G32B32A32Uint):
+        return 16;
 	case (vk::Format::eR32G32B32A32Sfloat) :
 			return 16;
 	case (vk::Format::eR32G32B32Sfloat) :
@@ -0,0 +1,128 @@
+#include "VulkanWorkerPool.h"
+
+#include <atomic>
+
+// Pool whose worker loop runs on this thread, if any
+static thread_local VulkanWorkerPool * tWorkerOf = nullptr;
+
+VulkanWorkerPool::VulkanWorkerPool(uint32_t numThreads)
+{
+    if (numThreads == 0)
+    {
+        uint32_t cores = std::thread::hardware_concurrency();
+        numThreads = cores > 1 ? cores - 1 : 1;
+    }
+
+    for (uint32_t i = 0; i < numThreads; i++)
+    {
+        mThreads.emplace_back(&VulkanWorkerPool::workerLoop, this);
+    }
+}
+
+VulkanWorkerPool::~VulkanWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+
+    mCondition.notify_all();
+
+    for (auto & thread : mThreads)
+    {
+        thread.join();
+    }
+}
+
+std::future<void> VulkanWorkerPool::submit(function<void()> job)
+{
+    auto task = std::make_shared<std::packaged_task<void()>>(job);
+    auto future = task->get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back([task]() { (*task)(); });
+    }
+
+    mCondition.notify_one();
+
+    return future;
+}
+
+void VulkanWorkerPool::parallelFor(uint32_t count, function<void(uint32_t index)> job)
+{
+    if (count == 0) return;
+
+    if (tWorkerOf == this)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            job(i);
+        }
+
+        return;
+    }
+
+    auto next = std::make_shared<std::atomic<uint32_t>>(0);
+
+    auto drain = [next, count, &job]()
+    {
+        for (uint32_t i = (*next)++; i < count; i = (*next)++)
+        {
+            job(i);
+        }
+    };
+
+    uint32_t helpers = glm::min(count - 1, getThreadCount());
+
+    vector<std::future<void>> futures;
+    futures.reserve(helpers);
+
+    for (uint32_t i = 0; i < helpers; i++)
+    {
+        futures.push_back(submit(drain));
+    }
+
+    try
+    {
+        drain();
+    }
+    catch (...)
+    {
+        // job is captured by reference, let the helpers finish before unwinding
+        for (auto & future : futures) future.wait();
+        throw;
+    }
+
+    // get() rethrows anything a job threw
+    for (auto & future : futures)
+    {
+        future.get();
+    }
+}
+
+void VulkanWorkerPool::workerLoop()
+{
+    tWorkerOf = this;
+
+    while (true)
+    {
+        function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            mCondition.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+
+            if (mStopping && mJobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+
+        job();
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "General.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+/*
+* Fixed set of worker threads shared by everything that records or builds in parallel.
+*/
+class VulkanWorkerPool
+{
+public:
+
+    //0 picks one thread per hardware core, minus the calling thread
+    VulkanWorkerPool(uint32_t numThreads = 0);
+
+    VULCRO_DONT_COPY(VulkanWorkerPool)
+
+    ~VulkanWorkerPool();
+
+    std::future<void> submit(function<void()> job);
+
+    /*
+    * Run job(i) for every i in [0, count) and return once all are done. The calling thread takes part.
+    * Each index runs exactly once, so per-index resources (e.g. command pools) are never touched by two threads at a time.
+    * Called from one of the pool's own workers it runs every index inline, waiting on jobs queued behind it could deadlock.
+    */
+    void parallelFor(uint32_t count, function<void(uint32_t index)> job);
+
+    uint32_t getThreadCount()
+    {
+        return static_cast<uint32_t>(mThreads.size());
+    }
+
+private:
+
+    void workerLoop();
+
+    vector<std::thread> mThreads;
+    std::deque<function<void()>> mJobs;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping = false;
+};
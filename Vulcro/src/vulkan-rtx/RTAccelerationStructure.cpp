@@ -1,4 +1,5 @@
 #include "RTAccelerationStructure.h"
+#include "../vulkan-core/VulkanProfiler.h"
 
 RTAccelerationStructure::RTAccelerationStructure(VulkanContextPtr ctx, uint32_t numInstances, bool allowUpdate)
 	:_ctx(ctx),
@@ -115,46 +116,41 @@ uint64_t RTAccelerationStructure::computeScratchMemorySize()
 
 }
 
-static const vk::MemoryBarrier MemoryBarrier { vk::AccessFlags(vk::AccessFlagBits::eAccelerationStructureWriteNV | vk::AccessFlagBits::eAccelerationStructureReadNV),
-    vk::AccessFlags(vk::AccessFlagBits::eAccelerationStructureWriteNV | vk::AccessFlagBits::eAccelerationStructureReadNV)
-};
-   
-
-void RTAccelerationStructure::build(vk::CommandBuffer * cmd, VulkanBufferRef scratchBuffer, VulkanBufferRef instanceBuffer)
+void RTAccelerationStructure::build(vk::CommandBuffer * cmd, VulkanBufferRef scratchBuffer, VulkanBufferRef instanceBuffer, VulkanBarrierBatch * barriers,
+    VulkanProfiler * profiler)
 {
-   
-	if (_isTop) {
-
-		cmd->buildAccelerationStructureNV(
-			getInfo(),
-			instanceBuffer ? instanceBuffer->getBuffer() : nullptr,
-			vk::DeviceSize(0),
-			_built,
-			getAccelerationStruct(),
-			_built ? getAccelerationStruct() : nullptr,
-			scratchBuffer->getBuffer(),
-			vk::DeviceSize(0),
-			_ctx->getDynamicDispatch()
-		);
-
-        cmd->pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::DependencyFlags(0), { MemoryBarrier }, nullptr, nullptr);
-	}
-	else {
-
-		cmd->buildAccelerationStructureNV(
-			getInfo(),
-			nullptr,
-			vk::DeviceSize(0),
-			_built,
-			getAccelerationStruct(),
-			_built ? getAccelerationStruct() : nullptr,
-			scratchBuffer->getBuffer(),
-			vk::DeviceSize(0),
-			_ctx->getDynamicDispatch()
-		);
-        
-        cmd->pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::DependencyFlags(0), { MemoryBarrier }, nullptr, nullptr);
-	}
+    VulkanBarrierBatch localBarriers;
+    auto & batch = barriers ? *barriers : localBarriers;
+
+    const vk::PipelineStageFlags buildStage = vk::PipelineStageFlagBits::eAccelerationStructureBuildNV;
+    const vk::AccessFlags readWrite = vk::AccessFlagBits::eAccelerationStructureReadNV | vk::AccessFlagBits::eAccelerationStructureWriteNV;
+
+    // Scratch is often shared between builds, and updates read the previous structure
+    batch.access(scratchBuffer.get(), readWrite, buildStage);
+    batch.access(mState, _built ? readWrite : vk::AccessFlags(vk::AccessFlagBits::eAccelerationStructureWriteNV), buildStage);
+    batch.flush(cmd);
+
+    if (profiler) profiler->begin(cmd, _isTop ? "build TLAS" : "build BLAS");
+
+	cmd->buildAccelerationStructureNV(
+		getInfo(),
+		(_isTop && instanceBuffer) ? instanceBuffer->getBuffer() : nullptr,
+		vk::DeviceSize(0),
+		_built,
+		getAccelerationStruct(),
+		_built ? getAccelerationStruct() : nullptr,
+		scratchBuffer->getBuffer(),
+		vk::DeviceSize(0),
+		_ctx->getDynamicDispatch()
+	);
+
+    if (profiler) profiler->end(cmd);
+
+    if (_isTop)
+    {
+        batch.access(mState, vk::AccessFlagBits::eAccelerationStructureReadNV, vk::PipelineStageFlagBits::eRayTracingShaderNV | vk::PipelineStageFlagBits::eAccelerationStructureBuildNV);
+        batch.flush(cmd);
+    }
 
     _built = true;
 }
@@ -351,12 +347,21 @@ void RTBlasRepo::rebuildDirtyGeometries(VulkanTaskRef task)
 
     task->begin();
 
+    VulkanBarrierBatch barriers;
 
     for (auto id : mDirtyBlas)
     {
-        mBlas[id]->build(&task->getCommandBuffer(), mScratch);
+        mBlas[id]->build(&task->getCommandBuffer(), mScratch, nullptr, &barriers);
     }
 
+    // One barrier for every structure built above before top structures read them
+    for (auto id : mDirtyBlas)
+    {
+        barriers.access(mBlas[id]->getState(), vk::AccessFlagBits::eAccelerationStructureReadNV, vk::PipelineStageFlagBits::eAccelerationStructureBuildNV);
+    }
+
+    barriers.flush(&task->getCommandBuffer());
+
     task->end();
     task->execute(true);
 
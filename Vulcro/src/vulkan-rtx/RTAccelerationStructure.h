@@ -3,6 +3,7 @@
 #include "../vulkan-core/VulkanContext.h"
 #include "../vulkan-core/VulkanBuffer.h"
 #include "../vulkan-core/VulkanTask.h"
+#include "../vulkan-core/VulkanBarrierBatch.h"
 
 class RTGeometry {
 
@@ -61,7 +62,14 @@ public:
         return _allowUpdate;
     }
 
-	void build(vk::CommandBuffer *cmd, VulkanBufferRef scratchBuffer, VulkanBufferRef instanceBuffer = nullptr);
+	/*
+	* Barriers against earlier uses of this structure and the scratch buffer come from their tracked state.
+	* Pass barriers to have them recorded together with other pending barriers of the caller.
+	* A built top structure is made readable by ray tracing shaders, bottom structures are left to the caller.
+	* With a profiler the build is timed as a "build TLAS" or "build BLAS" region.
+	*/
+	void build(vk::CommandBuffer *cmd, VulkanBufferRef scratchBuffer, VulkanBufferRef instanceBuffer = nullptr, VulkanBarrierBatch * barriers = nullptr,
+		VulkanProfiler * profiler = nullptr);
 
     void dropGeometryRefs()
     {
@@ -74,6 +82,10 @@ public:
 		return _handle;
 	}
 
+	VulkanResourceState & getState() {
+		return mState;
+	}
+
 	~RTAccelerationStructure();
 
 protected:
@@ -89,6 +101,8 @@ protected:
 	bool _built = false;
 	bool _isTop;
 
+	VulkanResourceState mState;
+
 };
 
 class RTBottomStructure : public RTAccelerationStructure
@@ -1,5 +1,9 @@
 #include "RTPipeline.h"
+#include "../vulkan-core/VulkanLayoutCache.h"
+#include "../vulkan-core/VulkanPipelineCache.h"
+#include "../vulkan-core/VulkanProfiler.h"
 #include "../vulkan-core/VulkanShader.h"
+#include "../vulkan-core/VulkanShaderCache.h"
 #include "../vulkan-core/VulkanSet.h"
 
 RTPipeline::RTPipeline(VulkanContextPtr ctx, RTShaderBuilderRef shader):
@@ -10,16 +14,13 @@ RTPipeline::RTPipeline(VulkanContextPtr ctx, RTShaderBuilderRef shader):
 	
 	auto &uniLayouts = shader->getDescriptorSetLayouts();
 
-	_pipelineLayout = _ctx->getDevice().createPipelineLayout(
-		vk::PipelineLayoutCreateInfo(
-			vk::PipelineLayoutCreateFlags(),
-			static_cast<uint32_t>(uniLayouts.size()),
-			uniLayouts.data(),
-			0,
-			nullptr //Push constant Ranges
-		),
-		nullptr,
-		_ctx->getDynamicDispatch()
+	auto range = shader->getReflection().getPushConstantRange();
+
+	_pushConstantStages = range.stageFlags;
+
+	_pipelineLayout = _ctx->getLayoutCache()->getPipelineLayout(
+		uniLayouts,
+		range.size > 0 ? vk::ArrayProxy<const vk::PushConstantRange>(range) : nullptr
 	);
 
 	auto createInfo = vk::RayTracingPipelineCreateInfoNV(
@@ -35,7 +36,7 @@ RTPipeline::RTPipeline(VulkanContextPtr ctx, RTShaderBuilderRef shader):
 	);
 
 	_pipeline = ctx->getDevice().createRayTracingPipelineNV(
-		nullptr,
+		_ctx->getPipelineCache()->getCache(),
 		createInfo,
 		nullptr,
 		_ctx->getDynamicDispatch()
@@ -62,7 +63,6 @@ RTPipeline::RTPipeline(VulkanContextPtr ctx, RTShaderBuilderRef shader):
 
 RTPipeline::~RTPipeline()
 {
-	_ctx->getDevice().destroyPipelineLayout(_pipelineLayout, nullptr, _ctx->getDynamicDispatch());
 	_ctx->getDevice().destroyPipeline(_pipeline, nullptr, _ctx->getDynamicDispatch());
 }
 
@@ -76,13 +76,16 @@ void RTPipeline::bind(vk::CommandBuffer * cmd)
 
 }
 
-void RTPipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets)
+void RTPipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets, vk::ArrayProxy<const uint32_t> dynamicOffsets)
 {
 	int i = 0;
 
+	// Not a member, so one pipeline can record on several threads at once
+	vk::DescriptorSet vkSets[16];
+
 	for (auto &set : sets) {
 		if (set != nullptr) {
-			_descriptorSets[i++] = set->getDescriptorSet();
+			vkSets[i++] = set->getDescriptorSet();
 		}
 	}
 
@@ -91,23 +94,25 @@ void RTPipeline::bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSe
 		_pipelineLayout,
 		0,
 		i,
-		i > 0 ? _descriptorSets : nullptr,
-		0,
-		nullptr,
+		i > 0 ? vkSets : nullptr,
+		dynamicOffsets.size(),
+		dynamicOffsets.data(),
 		_ctx->getDynamicDispatch()
 	);
 }
 
-void RTPipeline::traceRays(vk::CommandBuffer * cmd, glm::uvec2 resolution)
+void RTPipeline::traceRays(vk::CommandBuffer * cmd, glm::uvec2 resolution, VulkanProfiler * profiler)
 {
-	traceRays(cmd, glm::uvec3(resolution, 1.0));
+	traceRays(cmd, glm::uvec3(resolution, 1.0), profiler);
 }
 
-void RTPipeline::traceRays(vk::CommandBuffer * cmd, glm::uvec3 resolution)
+void RTPipeline::traceRays(vk::CommandBuffer * cmd, glm::uvec3 resolution, VulkanProfiler * profiler)
 {
 
 	uint64_t stride = _RTProps.shaderGroupHandleSize;
 
+	if (profiler) profiler->begin(cmd, "traceRays");
+
 	cmd->traceRaysNV(
 		_sbtBuffer->getBuffer(),
 		0,
@@ -125,17 +130,23 @@ void RTPipeline::traceRays(vk::CommandBuffer * cmd, glm::uvec3 resolution)
 		resolution.z,
 		_ctx->getDynamicDispatch()
 	);
+
+	if (profiler) profiler->end(cmd);
 }
 
 
 
 
-RTShaderBuilder::RTShaderBuilder(VulkanContextPtr ctx, const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts)
+RTShaderBuilder::RTShaderBuilder(VulkanContextPtr ctx, const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, VulkanSpecialization const & specialization)
 	:_ctx(ctx),
 	_setLayouts((VulkanSetLayoutRef*)setLayouts.begin(), (VulkanSetLayoutRef*)setLayouts.end()),
 	_numHitGroups(0),
-    _numMissGroups(0)
+    _numMissGroups(0),
+	_deriveLayouts(setLayouts.size() == 0),
+	_specialization(specialization)
 {
+	_specializationInfo = _specialization.getInfo();
+
 	vk::RayTracingShaderGroupCreateInfoNV groupInfo;
 
 
@@ -149,23 +160,54 @@ RTShaderBuilder::RTShaderBuilder(VulkanContextPtr ctx, const char * raygenPath,
 	groupInfo.setClosestHitShader(VK_SHADER_UNUSED_NV);
 	groupInfo.setIntersectionShader(VK_SHADER_UNUSED_NV);
 
-	vk::ShaderModule module = VulkanShader::createModule(ctx, raygenPath);
+	auto module = loadModule(raygenPath);
 
 	vk::PipelineShaderStageCreateInfo stage;
 	stage.setStage(vk::ShaderStageFlagBits::eRaygenNV);
 	stage.setPName("main");
-	stage.setModule(module);
+	stage.setPSpecializationInfo(getSpecializationInfo());
+	stage.setModule(module->getModule());
 
-	_modules.push_back(module);
 	_stages.push_back(stage);
 	_groups.push_back(groupInfo);
 }
 
 RTShaderBuilder::~RTShaderBuilder()
 {
-	for (auto & module : _modules) {
-		_ctx->getDevice().destroyShaderModule(module);
+
+}
+
+VulkanShaderModuleRef RTShaderBuilder::loadModule(const char * path)
+{
+	auto module = _ctx->getShaderCache()->getModule(path);
+
+	_modules.push_back(module);
+	_reflection.merge(module->getReflection());
+
+	return module;
+}
+
+const vector<VulkanSetLayoutRef> & RTShaderBuilder::getSetLayouts()
+{
+	// Groups can be added until the pipeline is made, so derived layouts follow the latest stages
+	if (_deriveLayouts) {
+		_setLayouts.clear();
+		_descriptorSetLayouts.clear();
+
+		for (uint32_t set = 0; set < _reflection.getSetCount(); set++) {
+			_setLayouts.push_back(_ctx->makeSetLayout(_reflection.getSetLayoutBindings(set)));
+			_descriptorSetLayouts.push_back(_setLayouts.back()->getDescriptorLayout());
+		}
 	}
+
+	return _setLayouts;
+}
+
+const vector<vk::DescriptorSetLayout> & RTShaderBuilder::getDescriptorSetLayouts()
+{
+	getSetLayouts();
+
+	return _descriptorSetLayouts;
 }
 
 void RTShaderBuilder::addMissGroup(const char * missPath)
@@ -179,13 +221,13 @@ void RTShaderBuilder::addMissGroup(const char * missPath)
 	groupInfo.setIntersectionShader(VK_SHADER_UNUSED_NV);
 
 
-	vk::ShaderModule module = VulkanShader::createModule(_ctx, missPath);
-	_modules.push_back(module);
+	auto module = loadModule(missPath);
 
 	vk::PipelineShaderStageCreateInfo stage;
 	stage.setStage(vk::ShaderStageFlagBits::eMissNV);
 	stage.setPName("main");
-	stage.setModule(module);
+	stage.setPSpecializationInfo(getSpecializationInfo());
+	stage.setModule(module->getModule());
 
 	_stages.push_back(stage);
 	groupInfo.setGeneralShader(static_cast<uint32_t>(_stages.size()) - 1);
@@ -205,13 +247,13 @@ void RTShaderBuilder::addCallableGroup(const char * callablePath)
     groupInfo.setClosestHitShader(VK_SHADER_UNUSED_NV);
     groupInfo.setIntersectionShader(VK_SHADER_UNUSED_NV);
 
-    vk::ShaderModule module = VulkanShader::createModule(_ctx, callablePath);
-    _modules.push_back(module);
+    auto module = loadModule(callablePath);
 
     vk::PipelineShaderStageCreateInfo stage;
     stage.setStage(vk::ShaderStageFlagBits::eCallableNV);
     stage.setPName("main");
-    stage.setModule(module);
+    stage.setPSpecializationInfo(getSpecializationInfo());
+    stage.setModule(module->getModule());
 
     _stages.push_back(stage);
     groupInfo.setGeneralShader(static_cast<uint32_t>(_stages.size()) - 1);
@@ -238,13 +280,13 @@ void RTShaderBuilder::addHitGroup(const char * closestHitPath, const char * anyH
 
 
 	if (closestHitPath != nullptr) {
-		vk::ShaderModule module = VulkanShader::createModule(_ctx, closestHitPath);
-		_modules.push_back(module);
+		auto module = loadModule(closestHitPath);
 
 		vk::PipelineShaderStageCreateInfo stage;
 		stage.setStage(vk::ShaderStageFlagBits::eClosestHitNV);
 		stage.setPName("main");
-		stage.setModule(module);
+		stage.setPSpecializationInfo(getSpecializationInfo());
+		stage.setModule(module->getModule());
 
 		_stages.push_back(stage);
 		groupInfo.setClosestHitShader(static_cast<uint32_t>(_stages.size()) - 1);
@@ -252,26 +294,26 @@ void RTShaderBuilder::addHitGroup(const char * closestHitPath, const char * anyH
 	}
 
 	if (anyHitPath != nullptr) {
-		vk::ShaderModule module = VulkanShader::createModule(_ctx, anyHitPath);
-		_modules.push_back(module);
+		auto module = loadModule(anyHitPath);
 
 		vk::PipelineShaderStageCreateInfo stage;
 		stage.setStage(vk::ShaderStageFlagBits::eAnyHitNV);
 		stage.setPName("main");
-		stage.setModule(module);
+		stage.setPSpecializationInfo(getSpecializationInfo());
+		stage.setModule(module->getModule());
 
 		_stages.push_back(stage);
 		groupInfo.setAnyHitShader(static_cast<uint32_t>(_stages.size()) - 1);
 	}
 
     if (intersectionPath != nullptr) {
-        vk::ShaderModule module = VulkanShader::createModule(_ctx, intersectionPath);
-        _modules.push_back(module);
+        auto module = loadModule(intersectionPath);
 
         vk::PipelineShaderStageCreateInfo stage;
         stage.setStage(vk::ShaderStageFlagBits::eIntersectionNV);
         stage.setPName("main");
-        stage.setModule(module);
+        stage.setPSpecializationInfo(getSpecializationInfo());
+        stage.setModule(module->getModule());
 
         _stages.push_back(stage);
         groupInfo.setIntersectionShader(static_cast<uint32_t>(_stages.size()) - 1);
@@ -1,13 +1,20 @@
 #pragma once
 
 #include "../vulkan-core/VulkanContext.h"
+#include "../vulkan-core/VulkanShaderReflection.h"
+#include "../vulkan-core/VulkanSpecialization.h"
 
 
+/*
+* Stages and hit groups of a ray tracing pipeline. Without set layouts they are reflected from the stages added,
+* each binding visible to the stages using it.
+*/
 class RTShaderBuilder {
 
 public:
 
-	RTShaderBuilder(VulkanContextPtr ctx, const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts);
+	//The specialization applies to every stage, including ones added later
+	RTShaderBuilder(VulkanContextPtr ctx, const char * raygenPath, vk::ArrayProxy<const VulkanSetLayoutRef> setLayouts, VulkanSpecialization const & specialization = VulkanSpecialization());
 	~RTShaderBuilder();
 
 	//void addGroup(vk::ArrayProxy<StageBuilder> stages);
@@ -17,8 +24,13 @@ public:
 
     void addCallableGroup(const char * callablePath);
 
-	const vector<vk::DescriptorSetLayout> &getDescriptorSetLayouts() {
-		return _descriptorSetLayouts;
+	const vector<VulkanSetLayoutRef> &getSetLayouts();
+
+	const vector<vk::DescriptorSetLayout> &getDescriptorSetLayouts();
+
+	//Merged over all stages added so far
+	const VulkanShaderReflection &getReflection() {
+		return _reflection;
 	}
 
 	const vector<vk::PipelineShaderStageCreateInfo> &getStages() {
@@ -38,14 +50,26 @@ public:
 
 protected:
 
+	VulkanShaderModuleRef loadModule(const char * path);
+
+	const vk::SpecializationInfo * getSpecializationInfo() {
+		return _specialization.empty() ? nullptr : &_specializationInfo;
+	}
+
+	VulkanContextPtr _ctx;
 	vector<vk::RayTracingShaderGroupCreateInfoNV > _groups;
 	vector<vk::PipelineShaderStageCreateInfo> _stages;
 	vector<VulkanSetLayoutRef> _setLayouts;
-	vector<vk::ShaderModule> _modules;
-	VulkanContextPtr _ctx;
+	vector<VulkanShaderModuleRef> _modules;
 	vector<vk::DescriptorSetLayout> _descriptorSetLayouts;
 	uint64_t _numHitGroups;
     uint64_t _numMissGroups;
+
+	VulkanShaderReflection _reflection;
+	bool _deriveLayouts;
+
+	VulkanSpecialization _specialization;
+	vk::SpecializationInfo _specializationInfo;
 };
 
 class RTPipeline {
@@ -58,18 +82,27 @@ public:
 	vk::Pipeline getPipeline() {
 		return _pipeline;
 	}
-	void bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets);
-	void traceRays(vk::CommandBuffer * cmd, glm::uvec2 resolution);
-	void traceRays(vk::CommandBuffer * cmd, glm::uvec3 resolution);
+	void bindSets(vk::CommandBuffer * cmd, vk::ArrayProxy<const VulkanSetRef> sets, vk::ArrayProxy<const uint32_t> dynamicOffsets = nullptr);
+
+	//Push constants are reflected from the stages
+	template <typename T>
+	void pushConstants(vk::CommandBuffer * cmd, T & data)
+	{
+		cmd->pushConstants<T>(_pipelineLayout, _pushConstantStages, 0, { data });
+	}
+
+	//With a profiler the trace is timed as a "traceRays" region
+	void traceRays(vk::CommandBuffer * cmd, glm::uvec2 resolution, VulkanProfiler * profiler = nullptr);
+	void traceRays(vk::CommandBuffer * cmd, glm::uvec3 resolution, VulkanProfiler * profiler = nullptr);
 
 protected:
 	VulkanContextPtr _ctx;
 	vk::Pipeline _pipeline;
 	vk::PipelineLayout _pipelineLayout;
-	vk::DescriptorSet _descriptorSets[16];
 	RTShaderBuilderRef  _shader;
 	VulkanBufferRef _sbtBuffer;
 	vk::PhysicalDeviceRayTracingPropertiesNV _RTProps;
+	vk::ShaderStageFlags _pushConstantStages;
 
 
 };
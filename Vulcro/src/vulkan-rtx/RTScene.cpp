@@ -1,4 +1,5 @@
 #include "RTScene.h"
+#include "../vulkan-core/VulkanTracer.h"
 
 RTScene::RTScene(VulkanContextPtr ctx, RTBlasRepoRef geoRepo)
     :_ctx(ctx)
@@ -94,6 +95,8 @@ uint32_t RTScene::getInstanceGlobalIndex(const GeometryId& geometryName, uint32_
 #include "../vulkan-core/VulkanTask.h"
 void RTScene::build(VulkanTaskRef task)
 {
+    VULCRO_TRACE_FUNCTION();
+
     mGeoRepo->rebuildDirtyGeometries();
 
     task->begin();
@@ -103,8 +106,10 @@ void RTScene::build(VulkanTaskRef task)
     task->execute(true);
 }
 
-void RTScene::build(vk::CommandBuffer * cmd)
+void RTScene::build(vk::CommandBuffer * cmd, VulkanProfiler * profiler)
 {
+    VULCRO_TRACE_FUNCTION();
+
     //TODO only make buffer when instances change size?
 
     int instanceGlobalIndex = 0;
@@ -112,26 +117,30 @@ void RTScene::build(vk::CommandBuffer * cmd)
 
     _instanceData.clear();
 
-    for (auto &iter : _geometryMap) {
+    {
+        VULCRO_TRACE_ZONE("RTScene::build - pack instances");
+
+        for (auto &iter : _geometryMap) {
 
-        iter.second.bindingIndex = bindingIndex;
-        iter.second.instanceOffset = instanceGlobalIndex;
+            iter.second.bindingIndex = bindingIndex;
+            iter.second.instanceOffset = instanceGlobalIndex;
 
-        for (auto &instance : iter.second.instances) {
-            VkGeometryInstance instanceData;
-            instanceData.instanceCustomIndex = instance.instanceCustomIndex;
-            instanceData.instanceShaderBindingTableRecordOffset = instance.instanceShaderBindingTableRecordOffset;
-            instanceData.mask = instance.mask;
-            instanceData.transform = instance.transform;
-            instanceData.flags = instance.flags;
+            for (auto &instance : iter.second.instances) {
+                VkGeometryInstance instanceData;
+                instanceData.instanceCustomIndex = instance.instanceCustomIndex;
+                instanceData.instanceShaderBindingTableRecordOffset = instance.instanceShaderBindingTableRecordOffset;
+                instanceData.mask = instance.mask;
+                instanceData.transform = instance.transform;
+                instanceData.flags = instance.flags;
 
-            instanceData.accelerationStructureHandle = iter.second.accelStruct->getHandle();
-            _instanceData.push_back(instanceData);
+                instanceData.accelerationStructureHandle = iter.second.accelStruct->getHandle();
+                _instanceData.push_back(instanceData);
 
-            ++instanceGlobalIndex;
-        }
+                ++instanceGlobalIndex;
+            }
 
-        ++bindingIndex;
+            ++bindingIndex;
+        }
     }
 
     auto newSize = sizeof(VkGeometryInstance) * _instanceData.size();
@@ -163,7 +172,7 @@ void RTScene::build(vk::CommandBuffer * cmd)
     memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
     */
 
-    _topStruct->build(cmd, _scratchBuffer, _instanceBuffer);
+    _topStruct->build(cmd, _scratchBuffer, _instanceBuffer, nullptr, profiler);
 }
 
 vk::WriteDescriptorSetAccelerationStructureNV RTScene::getWriteDescriptor()
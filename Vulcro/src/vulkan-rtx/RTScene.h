@@ -26,6 +26,8 @@ public:
 
     struct InstanceData
     {
+        InstanceData() {}
+
         uint32_t sbtOffset = 0; //hit group index
         uint8_t mask = 0xFF; //Visibility Mask
         vk::GeometryInstanceFlagsNV flags = vk::GeometryInstanceFlagsNV();
@@ -48,7 +50,8 @@ public:
 
     std::array<float, 12> getInstanceTransform(const GeometryId & geometryName, uint32_t instanceIndex);
 
-    void build(vk::CommandBuffer * cmd);
+    //With a profiler the top structure build is timed, see RTAccelerationStructure::build
+    void build(vk::CommandBuffer * cmd, VulkanProfiler * profiler = nullptr);
 
     void build(VulkanTaskRef task);
 